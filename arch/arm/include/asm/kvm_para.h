@@ -1 +1,57 @@
+#ifndef __ARM_KVM_PARA_H
+#define __ARM_KVM_PARA_H
+
 #include <asm-generic/kvm_para.h>
+
+#ifdef __KERNEL__
+
+#ifdef CONFIG_KVM_GUEST
+
+#include <linux/of.h>
+#include <asm/opcodes-virt.h>
+
+static inline int kvm_para_available(void)
+{
+	struct device_node *hyper_node;
+	int ret;
+
+	hyper_node = of_find_node_by_path("/hypervisor");
+	if (!hyper_node)
+		return 0;
+
+	ret = of_device_is_compatible(hyper_node, "linux,kvm");
+	of_node_put(hyper_node);
+
+	return ret;
+}
+
+/*
+ * A KVM hypercall is HVC #0 with the hypercall number in r0 and up to
+ * three arguments in r1-r3.  The result is returned in r0.
+ */
+static inline long kvm_hypercall2(unsigned int nr, unsigned long p1,
+				  unsigned long p2)
+{
+	register unsigned long r0 asm("r0") = nr;
+	register unsigned long r1 asm("r1") = p1;
+	register unsigned long r2 asm("r2") = p2;
+
+	asm volatile(__HVC(0)
+		     : "+r" (r0)
+		     : "r" (r1), "r" (r2)
+		     : "memory");
+	return r0;
+}
+
+#else
+
+static inline int kvm_para_available(void)
+{
+	return 0;
+}
+
+#endif /* CONFIG_KVM_GUEST */
+
+#endif /* __KERNEL__ */
+
+#endif /* __ARM_KVM_PARA_H */
@@ -0,0 +1,114 @@
+/*
+ * arch/arm/kernel/kvm.c
+ *
+ * KVM paravirtual guest support.
+ *
+ * Every cpu registers a struct kvm_vcpu_state with the host, which sets
+ * its preempted field while the host has the virtual cpu scheduled out.
+ * vcpu_is_preempted() reads it, so that a mutex waiter stops spinning on
+ * an owner that cannot make progress.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+#define pr_fmt(fmt) "kvm: " fmt
+
+#include <linux/kernel.h>
+#include <linux/init.h>
+#include <linux/cpu.h>
+#include <linux/notifier.h>
+#include <linux/percpu.h>
+#include <linux/reboot.h>
+#include <linux/sched.h>
+#include <linux/smp.h>
+#include <linux/kvm_para.h>
+
+static DEFINE_PER_CPU(struct kvm_vcpu_state, vcpu_state) __aligned(64);
+static bool vcpu_state_enabled __read_mostly;
+
+bool vcpu_is_preempted(int cpu)
+{
+	if (!vcpu_state_enabled)
+		return false;
+
+	return ACCESS_ONCE(per_cpu(vcpu_state, cpu).preempted);
+}
+
+static int kvm_register_vcpu_state(void)
+{
+	struct kvm_vcpu_state *state = &__get_cpu_var(vcpu_state);
+	phys_addr_t pa = per_cpu_ptr_to_phys(state);
+	long ret;
+
+	memset(state, 0, sizeof(*state));
+	ret = kvm_hypercall2(KVM_HC_VCPU_STATE,
+			     lower_32_bits(pa) | KVM_VCPU_STATE_ENABLED,
+			     upper_32_bits(pa));
+	if (ret)
+		pr_warn("cpu %d: registering the vcpu state failed (%ld)\n",
+			smp_processor_id(), ret);
+	return ret;
+}
+
+static void kvm_unregister_vcpu_state(void *unused)
+{
+	kvm_hypercall2(KVM_HC_VCPU_STATE, 0, 0);
+	__get_cpu_var(vcpu_state).preempted = 0;
+}
+
+/*
+ * Keep the host from writing to the area of a cpu that is offline, or
+ * into the memory of whatever we reboot or kexec into.
+ */
+static int __cpuinit kvm_cpu_notify(struct notifier_block *self,
+				    unsigned long action, void *hcpu)
+{
+	switch (action & ~CPU_TASKS_FROZEN) {
+	case CPU_STARTING:
+		kvm_register_vcpu_state();
+		break;
+	case CPU_DYING:
+		kvm_unregister_vcpu_state(NULL);
+		break;
+	}
+	return NOTIFY_OK;
+}
+
+static struct notifier_block __cpuinitdata kvm_cpu_notifier = {
+	.notifier_call	= kvm_cpu_notify,
+};
+
+static int kvm_reboot_notify(struct notifier_block *self,
+			     unsigned long code, void *unused)
+{
+	vcpu_state_enabled = false;
+	on_each_cpu(kvm_unregister_vcpu_state, NULL, 1);
+	return NOTIFY_DONE;
+}
+
+static struct notifier_block kvm_reboot_notifier = {
+	.notifier_call	= kvm_reboot_notify,
+};
+
+/* Runs before the secondary cpus are brought up */
+static int __init kvm_guest_init(void)
+{
+	int ret;
+
+	if (!kvm_para_available())
+		return 0;
+
+	preempt_disable();
+	ret = kvm_register_vcpu_state();
+	preempt_enable();
+	if (ret)
+		return 0;
+
+	register_cpu_notifier(&kvm_cpu_notifier);
+	register_reboot_notifier(&kvm_reboot_notifier);
+	vcpu_state_enabled = true;
+	pr_info("using the paravirtual vcpu state\n");
+	return 0;
+}
+early_initcall(kvm_guest_init);
@@ -462,14 +462,36 @@ static int handle_svc_hyp(struct kvm_vcpu *vcpu, struct kvm_run *run)
 
 static int handle_hvc(struct kvm_vcpu *vcpu, struct kvm_run *run)
 {
+	unsigned long nr = *vcpu_reg(vcpu, 0);
+	gpa_t gpa;
+	long ret;
+
 	/*
 	 * Guest called HVC instruction:
-	 * Let it know we don't want that by injecting an undefined exception.
+	 * HVC #0 is a KVM hypercall, with the hypercall number in r0, the
+	 * arguments in r1-r3 and the result returned in r0.  Let the guest
+	 * know we don't want anything else by injecting an undefined
+	 * exception.
 	 */
-	kvm_debug("hvc: %x (at %08x)", vcpu->arch.hsr & ((1 << 16) - 1),
-				     vcpu->arch.regs.pc);
-	kvm_debug("         HSR: %8x", vcpu->arch.hsr);
-	kvm_inject_undefined(vcpu);
+	if (vcpu->arch.hsr & ((1 << 16) - 1)) {
+		kvm_debug("hvc: %x (at %08x)", vcpu->arch.hsr & ((1 << 16) - 1),
+					     vcpu->arch.regs.pc);
+		kvm_debug("         HSR: %8x", vcpu->arch.hsr);
+		kvm_inject_undefined(vcpu);
+		return 1;
+	}
+
+	switch (nr) {
+	case KVM_HC_VCPU_STATE:
+		/* r1: low word of the address and enable bit, r2: high word */
+		gpa = ((gpa_t)*vcpu_reg(vcpu, 2) << 32) | *vcpu_reg(vcpu, 1);
+		ret = kvm_vcpu_set_state_area(vcpu, gpa);
+		break;
+	default:
+		ret = -KVM_ENOSYS;
+		break;
+	}
+	*vcpu_reg(vcpu, 0) = ret;
 	return 1;
 }
 
@@ -38,17 +38,19 @@ static DEFINE_MUTEX(kvm_hyp_pgd_mutex);
 static int mmu_topup_memory_cache(struct kvm_mmu_memory_cache *cache,
 				  int min, int max)
 {
-	void *page;
+	struct page *page, *next;
+	LIST_HEAD(pages);
 
 	BUG_ON(max > KVM_NR_MEM_OBJS);
 	if (cache->nobjs >= min)
 		return 0;
-	while (cache->nobjs < max) {
-		page = (void *)__get_free_page(PGALLOC_GFP);
-		if (!page)
-			return -ENOMEM;
-		cache->objects[cache->nobjs++] = page;
+	alloc_pages_bulk(PGALLOC_GFP, max - cache->nobjs, &pages);
+	list_for_each_entry_safe(page, next, &pages, lru) {
+		list_del(&page->lru);
+		cache->objects[cache->nobjs++] = page_address(page);
 	}
+	if (cache->nobjs < max)
+		return -ENOMEM;
 	return 0;
 }
 
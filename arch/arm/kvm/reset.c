@@ -79,5 +79,8 @@ int kvm_reset_vcpu(struct kvm_vcpu *vcpu)
 	/* Reset CP15 registers */
 	kvm_reset_coprocs(vcpu);
 
+	/* The guest has to register its state area again */
+	kvm_vcpu_set_state_area(vcpu, 0);
+
 	return 0;
 }
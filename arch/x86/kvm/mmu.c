@@ -644,16 +644,19 @@ static void mmu_free_memory_cache(struct kvm_mmu_memory_cache *mc,
 static int mmu_topup_memory_cache_page(struct kvm_mmu_memory_cache *cache,
 				       int min)
 {
-	void *page;
+	struct page *page, *next;
+	LIST_HEAD(pages);
 
 	if (cache->nobjs >= min)
 		return 0;
-	while (cache->nobjs < ARRAY_SIZE(cache->objects)) {
-		page = (void *)__get_free_page(GFP_KERNEL);
-		if (!page)
-			return -ENOMEM;
-		cache->objects[cache->nobjs++] = page;
+	alloc_pages_bulk(GFP_KERNEL, ARRAY_SIZE(cache->objects) - cache->nobjs,
+			 &pages);
+	list_for_each_entry_safe(page, next, &pages, lru) {
+		list_del(&page->lru);
+		cache->objects[cache->nobjs++] = page_address(page);
 	}
+	if (cache->nobjs < ARRAY_SIZE(cache->objects))
+		return -ENOMEM;
 	return 0;
 }
 
@@ -14,15 +14,33 @@
 
 #define PART_BITS 4
 
+/* Requests taken off the block queue per pass of the request function. */
+#define VIRTBLK_SUBMIT_BATCH 32
+
 static int major;
 static DEFINE_IDA(vd_index_ida);
 
 struct workqueue_struct *virtblk_wq;
 
+struct virtio_blk_vq {
+	struct virtqueue *vq;
+
+	/* Serializes adding and reaping buffers; nests outside queue_lock. */
+	spinlock_t lock;
+
+	/* Scatterlist: can be too big for stack. */
+	struct scatterlist *sg;
+
+	char name[16];
+} ____cacheline_aligned_in_smp;
+
 struct virtio_blk
 {
 	struct virtio_device *vdev;
-	struct virtqueue *vq;
+
+	/* Request virtqueues, one per vcpu as far as the host allows. */
+	struct virtio_blk_vq *vqs;
+	int num_vqs;
 
 	/* The disk structure for the kernel. */
 	struct gendisk *disk;
@@ -43,75 +61,94 @@ struct virtio_blk
 
 	/* Ida index - used to track minor number allocations. */
 	int index;
-
-	/* Scatterlist: can be too big for stack. */
-	struct scatterlist sg[/*sg_elems*/];
 };
 
 struct virtblk_req
 {
+	struct list_head list;
 	struct request *req;
 	struct virtio_blk_outhdr out_hdr;
 	struct virtio_scsi_inhdr in_hdr;
 	u8 status;
 };
 
+static void virtblk_end_request(struct virtblk_req *vbr)
+{
+	int error;
+
+	switch (vbr->status) {
+	case VIRTIO_BLK_S_OK:
+		error = 0;
+		break;
+	case VIRTIO_BLK_S_UNSUPP:
+		error = -ENOTTY;
+		break;
+	default:
+		error = -EIO;
+		break;
+	}
+
+	switch (vbr->req->cmd_type) {
+	case REQ_TYPE_BLOCK_PC:
+		vbr->req->resid_len = vbr->in_hdr.residual;
+		vbr->req->sense_len = vbr->in_hdr.sense_len;
+		vbr->req->errors = vbr->in_hdr.errors;
+		break;
+	case REQ_TYPE_SPECIAL:
+		vbr->req->errors = (error != 0);
+		break;
+	default:
+		break;
+	}
+
+	__blk_end_request_all(vbr->req, error);
+}
+
+/*
+ * Reap everything the host has finished under the virtqueue lock only,
+ * then complete the whole batch with a single hold of the queue lock.
+ */
 static void blk_done(struct virtqueue *vq)
 {
 	struct virtio_blk *vblk = vq->vdev->priv;
-	struct virtblk_req *vbr;
+	/* Request virtqueues are the only ones, in order. */
+	struct virtio_blk_vq *bvq = &vblk->vqs[vq->index];
+	struct request_queue *q = vblk->disk->queue;
+	struct virtblk_req *vbr, *tmp;
 	unsigned int len;
 	unsigned long flags;
+	LIST_HEAD(done);
 
-	spin_lock_irqsave(vblk->disk->queue->queue_lock, flags);
-	while ((vbr = virtqueue_get_buf(vblk->vq, &len)) != NULL) {
-		int error;
-
-		switch (vbr->status) {
-		case VIRTIO_BLK_S_OK:
-			error = 0;
-			break;
-		case VIRTIO_BLK_S_UNSUPP:
-			error = -ENOTTY;
-			break;
-		default:
-			error = -EIO;
-			break;
-		}
-
-		switch (vbr->req->cmd_type) {
-		case REQ_TYPE_BLOCK_PC:
-			vbr->req->resid_len = vbr->in_hdr.residual;
-			vbr->req->sense_len = vbr->in_hdr.sense_len;
-			vbr->req->errors = vbr->in_hdr.errors;
-			break;
-		case REQ_TYPE_SPECIAL:
-			vbr->req->errors = (error != 0);
-			break;
-		default:
-			break;
-		}
-
-		__blk_end_request_all(vbr->req, error);
+	spin_lock_irqsave(&bvq->lock, flags);
+	do {
+		virtqueue_disable_cb(vq);
+		while ((vbr = virtqueue_get_buf(vq, &len)) != NULL)
+			list_add_tail(&vbr->list, &done);
+	} while (!virtqueue_enable_cb(vq));
+	spin_unlock_irqrestore(&bvq->lock, flags);
+
+	if (list_empty(&done))
+		return;
+
+	spin_lock_irqsave(q->queue_lock, flags);
+	list_for_each_entry_safe(vbr, tmp, &done, list) {
+		virtblk_end_request(vbr);
 		mempool_free(vbr, vblk->pool);
 	}
 	/* In case queue is stopped waiting for more buffers. */
-	blk_start_queue(vblk->disk->queue);
-	spin_unlock_irqrestore(vblk->disk->queue->queue_lock, flags);
+	if (blk_queue_stopped(q))
+		blk_start_queue(q);
+	spin_unlock_irqrestore(q->queue_lock, flags);
 }
 
-static bool do_req(struct request_queue *q, struct virtio_blk *vblk,
-		   struct request *req)
+/* Caller must hold bvq->lock. */
+static bool virtblk_add_req(struct virtio_blk *vblk, struct virtio_blk_vq *bvq,
+			    struct virtblk_req *vbr)
 {
+	struct request_queue *q = vblk->disk->queue;
+	struct request *req = vbr->req;
+	struct scatterlist *sg = bvq->sg;
 	unsigned long num, out = 0, in = 0;
-	struct virtblk_req *vbr;
-
-	vbr = mempool_alloc(vblk->pool, GFP_ATOMIC);
-	if (!vbr)
-		/* When another request finishes we'll try again. */
-		return false;
-
-	vbr->req = req;
 
 	if (req->cmd_flags & REQ_FLUSH) {
 		vbr->out_hdr.type = VIRTIO_BLK_T_FLUSH;
@@ -140,7 +177,7 @@ static bool do_req(struct request_queue *q, struct virtio_blk *vblk,
 		}
 	}
 
-	sg_set_buf(&vblk->sg[out++], &vbr->out_hdr, sizeof(vbr->out_hdr));
+	sg_set_buf(&sg[out++], &vbr->out_hdr, sizeof(vbr->out_hdr));
 
 	/*
 	 * If this is a packet command we need a couple of additional headers.
@@ -149,17 +186,17 @@ static bool do_req(struct request_queue *q, struct virtio_blk *vblk,
 	 * inhdr with additional status information before the normal inhdr.
 	 */
 	if (vbr->req->cmd_type == REQ_TYPE_BLOCK_PC)
-		sg_set_buf(&vblk->sg[out++], vbr->req->cmd, vbr->req->cmd_len);
+		sg_set_buf(&sg[out++], vbr->req->cmd, vbr->req->cmd_len);
 
-	num = blk_rq_map_sg(q, vbr->req, vblk->sg + out);
+	num = blk_rq_map_sg(q, vbr->req, sg + out);
 
 	if (vbr->req->cmd_type == REQ_TYPE_BLOCK_PC) {
-		sg_set_buf(&vblk->sg[num + out + in++], vbr->req->sense, SCSI_SENSE_BUFFERSIZE);
-		sg_set_buf(&vblk->sg[num + out + in++], &vbr->in_hdr,
+		sg_set_buf(&sg[num + out + in++], vbr->req->sense, SCSI_SENSE_BUFFERSIZE);
+		sg_set_buf(&sg[num + out + in++], &vbr->in_hdr,
 			   sizeof(vbr->in_hdr));
 	}
 
-	sg_set_buf(&vblk->sg[num + out + in++], &vbr->status,
+	sg_set_buf(&sg[num + out + in++], &vbr->status,
 		   sizeof(vbr->status));
 
 	if (num) {
@@ -172,35 +209,82 @@ static bool do_req(struct request_queue *q, struct virtio_blk *vblk,
 		}
 	}
 
-	if (virtqueue_add_buf(vblk->vq, vblk->sg, out, in, vbr, GFP_ATOMIC)<0) {
-		mempool_free(vbr, vblk->pool);
-		return false;
-	}
-
-	return true;
+	return virtqueue_add_buf(bvq->vq, sg, out, in, vbr, GFP_ATOMIC) >= 0;
 }
 
+/*
+ * Called with the queue lock held and interrupts off, so we stay on this
+ * cpu and use its virtqueue throughout.  Requests are taken off the queue
+ * in batches under the queue lock, then added to the virtqueue with only
+ * the virtqueue lock held.  The host is notified once, on the way out,
+ * without holding either lock.  bvq->lock nests outside queue_lock, so it
+ * is never taken while queue_lock is held.
+ */
 static void do_virtblk_request(struct request_queue *q)
 {
 	struct virtio_blk *vblk = q->queuedata;
+	struct virtio_blk_vq *bvq;
+	struct virtblk_req *vbr, *tmp;
 	struct request *req;
-	unsigned int issued = 0;
-
-	while ((req = blk_peek_request(q)) != NULL) {
-		BUG_ON(req->nr_phys_segments + 2 > vblk->sg_elems);
+	bool stopped = false, notify = false;
+	LIST_HEAD(batch);
+
+	bvq = &vblk->vqs[smp_processor_id() % vblk->num_vqs];
+
+	while (!stopped) {
+		unsigned int n = 0;
+
+		while (n < VIRTBLK_SUBMIT_BATCH &&
+		       (req = blk_peek_request(q)) != NULL) {
+			BUG_ON(req->nr_phys_segments + 2 > vblk->sg_elems);
+
+			/* When another request finishes we'll try again. */
+			vbr = mempool_alloc(vblk->pool, GFP_ATOMIC);
+			if (!vbr) {
+				blk_stop_queue(q);
+				stopped = true;
+				break;
+			}
+			vbr->req = req;
+			blk_start_request(req);
+			list_add_tail(&vbr->list, &batch);
+			n++;
+		}
+		if (!n)
+			break;
 
-		/* If this request fails, stop queue and wait for something to
-		   finish to restart it. */
-		if (!do_req(q, vblk, req)) {
+		spin_unlock(q->queue_lock);
+		spin_lock(&bvq->lock);
+		n = 0;
+		list_for_each_entry_safe(vbr, tmp, &batch, list) {
+			if (!virtblk_add_req(vblk, bvq, vbr))
+				break;
+			list_del(&vbr->list);
+			n++;
+		}
+		if (n)
+			notify |= virtqueue_kick_prepare(bvq->vq);
+		/* The ring is full: hand the rest back and wait for something
+		 * to finish.  We still hold bvq->lock, so the completion that
+		 * restarts the queue can't slip in before we stop it. */
+		spin_lock(q->queue_lock);
+		if (!list_empty(&batch)) {
+			list_for_each_entry_safe_reverse(vbr, tmp, &batch, list) {
+				list_del(&vbr->list);
+				blk_requeue_request(q, vbr->req);
+				mempool_free(vbr, vblk->pool);
+			}
 			blk_stop_queue(q);
-			break;
+			stopped = true;
 		}
-		blk_start_request(req);
-		issued++;
+		spin_unlock(&bvq->lock);
 	}
 
-	if (issued)
-		virtqueue_kick(vblk->vq);
+	if (notify) {
+		spin_unlock(q->queue_lock);
+		virtqueue_notify(bvq->vq);
+		spin_lock(q->queue_lock);
+	}
 }
 
 /* return id (s/n) string for *disk to *id_str
@@ -355,15 +439,87 @@ static void virtblk_config_changed(struct virtio_device *vdev)
 	queue_work(virtblk_wq, &vblk->config_work);
 }
 
+static void virtblk_free_vqs(struct virtio_blk *vblk)
+{
+	int i;
+
+	vblk->vdev->config->del_vqs(vblk->vdev);
+	for (i = 0; i < vblk->num_vqs; i++)
+		kfree(vblk->vqs[i].sg);
+	kfree(vblk->vqs);
+	vblk->vqs = NULL;
+}
+
 static int init_vq(struct virtio_blk *vblk)
 {
-	int err = 0;
+	struct virtio_device *vdev = vblk->vdev;
+	vq_callback_t **callbacks;
+	const char **names;
+	struct virtqueue **vqs;
+	u16 num_vqs;
+	int i, cpu, err;
+
+	err = virtio_config_val(vdev, VIRTIO_BLK_F_MQ,
+				offsetof(struct virtio_blk_config, num_queues),
+				&num_vqs);
+	if (err || !num_vqs)
+		num_vqs = 1;
+	num_vqs = min_t(u16, num_vqs, num_possible_cpus());
+
+	err = -ENOMEM;
+	vblk->vqs = kzalloc(sizeof(*vblk->vqs) * num_vqs, GFP_KERNEL);
+	names = kmalloc(sizeof(*names) * num_vqs, GFP_KERNEL);
+	callbacks = kmalloc(sizeof(*callbacks) * num_vqs, GFP_KERNEL);
+	vqs = kmalloc(sizeof(*vqs) * num_vqs, GFP_KERNEL);
+	if (!vblk->vqs || !names || !callbacks || !vqs)
+		goto out;
 
-	/* We expect one virtqueue, for output. */
-	vblk->vq = virtio_find_single_vq(vblk->vdev, blk_done, "requests");
-	if (IS_ERR(vblk->vq))
-		err = PTR_ERR(vblk->vq);
+	vblk->num_vqs = num_vqs;
+	for (i = 0; i < num_vqs; i++) {
+		struct virtio_blk_vq *bvq = &vblk->vqs[i];
+
+		spin_lock_init(&bvq->lock);
+		bvq->sg = kmalloc(sizeof(*bvq->sg) * vblk->sg_elems,
+				  GFP_KERNEL);
+		if (!bvq->sg)
+			goto out;
+		sg_init_table(bvq->sg, vblk->sg_elems);
+		callbacks[i] = blk_done;
+		/* Keep the old name when there is just the one. */
+		if (num_vqs == 1)
+			strcpy(bvq->name, "requests");
+		else
+			snprintf(bvq->name, sizeof(bvq->name), "req.%d", i);
+		names[i] = bvq->name;
+	}
 
+	err = vdev->config->find_vqs(vdev, num_vqs, vqs, callbacks, names);
+	if (err)
+		goto out;
+
+	for (i = 0; i < num_vqs; i++)
+		vblk->vqs[i].vq = vqs[i];
+
+	/* Steer each queue's completions to the first cpu submitting on it. */
+	if (num_vqs > 1) {
+		i = 0;
+		for_each_online_cpu(cpu) {
+			if (i == num_vqs)
+				break;
+			virtqueue_set_affinity(vblk->vqs[i++].vq, cpu);
+		}
+	}
+
+out:
+	kfree(vqs);
+	kfree(callbacks);
+	kfree(names);
+	if (err && vblk->vqs) {
+		for (i = 0; i < num_vqs; i++)
+			kfree(vblk->vqs[i].sg);
+		kfree(vblk->vqs);
+		vblk->vqs = NULL;
+	}
 	return err;
 }
 
@@ -499,8 +655,7 @@ static int __devinit virtblk_probe(struct virtio_device *vdev)
 
 	/* We need an extra sg elements at head and tail. */
 	sg_elems += 2;
-	vdev->priv = vblk = kmalloc(sizeof(*vblk) +
-				    sizeof(vblk->sg[0]) * sg_elems, GFP_KERNEL);
+	vdev->priv = vblk = kzalloc(sizeof(*vblk), GFP_KERNEL);
 	if (!vblk) {
 		err = -ENOMEM;
 		goto out_free_index;
@@ -508,7 +663,6 @@ static int __devinit virtblk_probe(struct virtio_device *vdev)
 
 	vblk->vdev = vdev;
 	vblk->sg_elems = sg_elems;
-	sg_init_table(vblk->sg, vblk->sg_elems);
 	mutex_init(&vblk->config_lock);
 	INIT_WORK(&vblk->config_work, virtblk_config_changed_work);
 	vblk->config_enable = true;
@@ -644,7 +798,7 @@ out_put_disk:
 out_mempool:
 	mempool_destroy(vblk->pool);
 out_free_vq:
-	vdev->config->del_vqs(vdev);
+	virtblk_free_vqs(vblk);
 out_free_vblk:
 	kfree(vblk);
 out_free_index:
@@ -673,7 +827,7 @@ static void __devexit virtblk_remove(struct virtio_device *vdev)
 
 	put_disk(vblk->disk);
 	mempool_destroy(vblk->pool);
-	vdev->config->del_vqs(vdev);
+	virtblk_free_vqs(vblk);
 	kfree(vblk);
 	ida_simple_remove(&vd_index_ida, index);
 }
@@ -698,7 +852,7 @@ static int virtblk_freeze(struct virtio_device *vdev)
 	spin_unlock_irq(vblk->disk->queue->queue_lock);
 	blk_sync_queue(vblk->disk->queue);
 
-	vdev->config->del_vqs(vdev);
+	virtblk_free_vqs(vblk);
 	return 0;
 }
 
@@ -726,7 +880,8 @@ static const struct virtio_device_id id_table[] = {
 static unsigned int features[] = {
 	VIRTIO_BLK_F_SEG_MAX, VIRTIO_BLK_F_SIZE_MAX, VIRTIO_BLK_F_GEOMETRY,
 	VIRTIO_BLK_F_RO, VIRTIO_BLK_F_BLK_SIZE, VIRTIO_BLK_F_SCSI,
-	VIRTIO_BLK_F_WCE, VIRTIO_BLK_F_TOPOLOGY, VIRTIO_BLK_F_CONFIG_WCE
+	VIRTIO_BLK_F_WCE, VIRTIO_BLK_F_TOPOLOGY, VIRTIO_BLK_F_CONFIG_WCE,
+	VIRTIO_BLK_F_MQ,
 };
 
 /*
@@ -0,0 +1,650 @@
+/*
+ * zswap.c - compressed cache for swap pages
+ *
+ * Zswap is a frontswap backend: pages on their way out to a swap device
+ * are instead LZO-compressed into a zsmalloc pool in RAM, and read back
+ * from there on swapin, which takes the swap device off the fault path.
+ *
+ * The pool is capped at a percentage of RAM.  When a store finds the pool
+ * full, the least recently stored pages of that swap device are
+ * decompressed into the swap cache and written back to the device itself,
+ * to make room; if that does not free enough, the store is rejected and
+ * the page goes to the device directly, as it would without zswap.
+ *
+ * Zswap is off unless "zswap" is given on the kernel command line.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2.
+ */
+
+#define pr_fmt(fmt) "zswap: " fmt
+
+#include <linux/module.h>
+#include <linux/cpu.h>
+#include <linux/highmem.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+#include <linux/types.h>
+#include <linux/atomic.h>
+#include <linux/math64.h>
+#include <linux/rbtree.h>
+#include <linux/swap.h>
+#include <linux/swapops.h>
+#include <linux/writeback.h>
+#include <linux/pagemap.h>
+#include <linux/lzo.h>
+#include <linux/frontswap.h>
+#include <linux/debugfs.h>
+
+#include "../zsmalloc/zsmalloc.h"
+
+/*
+ * Stores come from reclaim, with the page locked: never wait for memory,
+ * nor dip into the emergency reserves, to make room for a compressed copy.
+ */
+#define ZSWAP_GFP_MASK \
+	(__GFP_NORETRY | __GFP_NOWARN | __GFP_NOMEMALLOC | __GFP_HIGHMEM)
+
+/* How many pages to try writing back when a store finds the pool full */
+#define ZSWAP_WRITEBACK_BATCH	16
+
+/* Boot-time switch */
+static bool zswap_enabled __read_mostly;
+
+/* Largest share of RAM the compressed pool may take, in percent */
+static unsigned int zswap_max_pool_percent = 20;
+module_param_named(max_pool_percent, zswap_max_pool_percent, uint, 0644);
+
+/* Compressed size, as percent of a page, above which a store is refused */
+static unsigned int zswap_max_compression_ratio = 80;
+module_param_named(max_compression_ratio,
+		   zswap_max_compression_ratio, uint, 0644);
+
+/* Statistics, exported in debugfs */
+static atomic_t zswap_stored_pages = ATOMIC_INIT(0);
+static u64 zswap_pool_limit_hit;
+static u64 zswap_written_back_pages;
+static u64 zswap_reject_writeback_fail;
+static u64 zswap_reject_compress_poor;
+static u64 zswap_reject_alloc_fail;
+static u64 zswap_duplicate_entry;
+
+/**
+ * struct zswap_entry - a compressed page held for a swap slot
+ * @rbnode: link into the tree of the swap device, keyed by @offset
+ * @lru: link into the tree's list, oldest stores first
+ * @refcount: one for the tree, plus one for each user outside its lock
+ * @offset: the swap offset of the page
+ * @handle: zsmalloc handle of the compressed data
+ * @length: length of the compressed data
+ */
+struct zswap_entry {
+	struct rb_node rbnode;
+	struct list_head lru;
+	int refcount;
+	pgoff_t offset;
+	unsigned long handle;
+	unsigned int length;
+};
+
+/**
+ * struct zswap_tree - the compressed pages of one swap device
+ * @rbroot: entries by swap offset
+ * @lru: entries in order of store, for writeback
+ * @lock: protects the tree, the list and the entries' refcounts
+ */
+struct zswap_tree {
+	struct rb_root rbroot;
+	struct list_head lru;
+	spinlock_t lock;
+};
+
+static struct zswap_tree *zswap_trees[MAX_SWAPFILES];
+static struct zs_pool *zswap_pool;
+static struct kmem_cache *zswap_entry_cache;
+
+/* Per-cpu LZO working memory, and buffer for the compressed output */
+static DEFINE_PER_CPU(u8 *, zswap_workmem);
+static DEFINE_PER_CPU(u8 *, zswap_dstmem);
+
+/*********************************
+* helpers
+**********************************/
+static inline unsigned long zswap_pool_pages(void)
+{
+	return zs_get_total_size_bytes(zswap_pool) >> PAGE_SHIFT;
+}
+
+static bool zswap_is_full(void)
+{
+	return zswap_pool_pages() >=
+		totalram_pages * zswap_max_pool_percent / 100;
+}
+
+static struct zswap_entry *zswap_rb_search(struct rb_root *root,
+					   pgoff_t offset)
+{
+	struct rb_node *node = root->rb_node;
+	struct zswap_entry *entry;
+
+	while (node) {
+		entry = rb_entry(node, struct zswap_entry, rbnode);
+		if (entry->offset > offset)
+			node = node->rb_left;
+		else if (entry->offset < offset)
+			node = node->rb_right;
+		else
+			return entry;
+	}
+	return NULL;
+}
+
+/*
+ * Insert entry into the tree; if there is already one for that offset,
+ * return it in *dupentry and leave the tree unchanged.
+ */
+static int zswap_rb_insert(struct rb_root *root, struct zswap_entry *entry,
+			   struct zswap_entry **dupentry)
+{
+	struct rb_node **link = &root->rb_node, *parent = NULL;
+	struct zswap_entry *myentry;
+
+	while (*link) {
+		parent = *link;
+		myentry = rb_entry(parent, struct zswap_entry, rbnode);
+		if (myentry->offset > entry->offset)
+			link = &parent->rb_left;
+		else if (myentry->offset < entry->offset)
+			link = &parent->rb_right;
+		else {
+			*dupentry = myentry;
+			return -EEXIST;
+		}
+	}
+	rb_link_node(&entry->rbnode, parent, link);
+	rb_insert_color(&entry->rbnode, root);
+	return 0;
+}
+
+/* Caller holds tree->lock */
+static void zswap_rb_erase(struct zswap_tree *tree, struct zswap_entry *entry)
+{
+	rb_erase(&entry->rbnode, &tree->rbroot);
+	RB_CLEAR_NODE(&entry->rbnode);
+	list_del_init(&entry->lru);
+}
+
+static void zswap_free_entry(struct zswap_entry *entry)
+{
+	zs_free(zswap_pool, entry->handle);
+	kmem_cache_free(zswap_entry_cache, entry);
+	atomic_dec(&zswap_stored_pages);
+}
+
+/* Caller holds tree->lock: returns true if that was the last reference */
+static inline bool zswap_entry_put(struct zswap_entry *entry)
+{
+	BUG_ON(entry->refcount <= 0);
+	return --entry->refcount == 0;
+}
+
+/* Drop whatever entry the tree holds for offset */
+static void zswap_invalidate_offset(struct zswap_tree *tree, pgoff_t offset)
+{
+	struct zswap_entry *entry;
+	bool free;
+
+	spin_lock(&tree->lock);
+	entry = zswap_rb_search(&tree->rbroot, offset);
+	if (!entry) {
+		spin_unlock(&tree->lock);
+		return;
+	}
+	zswap_rb_erase(tree, entry);
+	free = zswap_entry_put(entry);
+	spin_unlock(&tree->lock);
+	if (free)
+		zswap_free_entry(entry);
+}
+
+static int zswap_decompress(struct zswap_entry *entry, struct page *page)
+{
+	size_t dlen = PAGE_SIZE;
+	u8 *src, *dst;
+	int ret;
+
+	src = zs_map_object(zswap_pool, entry->handle, ZS_MM_RO);
+	dst = kmap_atomic(page);
+	ret = lzo1x_decompress_safe(src, entry->length, dst, &dlen);
+	kunmap_atomic(dst);
+	zs_unmap_object(zswap_pool, entry->handle);
+
+	return (ret == LZO_E_OK && dlen == PAGE_SIZE) ? 0 : -EIO;
+}
+
+/*********************************
+* writeback
+**********************************/
+/*
+ * Decompress the oldest entry of the tree into a new swap cache page and
+ * write that to the swap device, then drop the entry.  If the slot has a
+ * swap cache page already, it is being swapped in or out, so leave it be.
+ */
+static int zswap_writeback_entry(unsigned type, struct zswap_tree *tree)
+{
+	struct writeback_control wbc = {
+		.sync_mode = WB_SYNC_NONE,
+	};
+	struct zswap_entry *entry;
+	struct page *page;
+	bool new_page;
+	bool free = false;
+	int ret;
+
+	spin_lock(&tree->lock);
+	if (list_empty(&tree->lru)) {
+		spin_unlock(&tree->lock);
+		return -ENOENT;
+	}
+	entry = list_first_entry(&tree->lru, struct zswap_entry, lru);
+	list_del_init(&entry->lru);
+	entry->refcount++;
+	spin_unlock(&tree->lock);
+
+	page = __read_swap_cache_async(swp_entry(type, entry->offset),
+				       GFP_KERNEL, NULL, 0, &new_page);
+	if (!page) {
+		/* Out of memory, or the slot is being freed */
+		ret = -ENOMEM;
+		goto out;
+	}
+	if (!new_page) {
+		page_cache_release(page);
+		ret = -EEXIST;
+		goto out;
+	}
+
+	/*
+	 * The entry may have been invalidated or replaced while the tree
+	 * was unlocked.  Now that the slot has a swap cache page, locked,
+	 * that can no longer happen under us.
+	 */
+	spin_lock(&tree->lock);
+	if (RB_EMPTY_NODE(&entry->rbnode)) {
+		spin_unlock(&tree->lock);
+		delete_from_swap_cache(page);
+		unlock_page(page);
+		page_cache_release(page);
+		ret = -EEXIST;
+		goto out;
+	}
+	spin_unlock(&tree->lock);
+
+	ret = zswap_decompress(entry, page);
+	if (ret) {
+		/* Nothing valid to write: drop the page, keep the entry */
+		delete_from_swap_cache(page);
+		unlock_page(page);
+		page_cache_release(page);
+		goto out;
+	}
+	SetPageUptodate(page);
+
+	/* Move it to the tail of the inactive list after writeback */
+	SetPageReclaim(page);
+	__swap_writepage(page, &wbc);
+	page_cache_release(page);
+	zswap_written_back_pages++;
+
+out:
+	spin_lock(&tree->lock);
+	if (!RB_EMPTY_NODE(&entry->rbnode)) {
+		if (ret) {
+			/* Still ours: give it another turn later */
+			list_add_tail(&entry->lru, &tree->lru);
+		} else {
+			zswap_rb_erase(tree, entry);
+			zswap_entry_put(entry);
+		}
+	}
+	free = zswap_entry_put(entry);
+	spin_unlock(&tree->lock);
+	if (free)
+		zswap_free_entry(entry);
+
+	return ret;
+}
+
+/*********************************
+* frontswap hooks
+**********************************/
+static int zswap_frontswap_store(unsigned type, pgoff_t offset,
+				 struct page *page)
+{
+	struct zswap_tree *tree = zswap_trees[type];
+	struct zswap_entry *entry, *dupentry;
+	size_t dlen;
+	u8 *src, *dst, *buf;
+	unsigned long handle;
+	bool free = false;
+	int i, ret;
+
+	if (!tree)
+		return -ENODEV;
+
+	if (zswap_is_full()) {
+		zswap_pool_limit_hit++;
+		for (i = 0; i < ZSWAP_WRITEBACK_BATCH; i++)
+			if (zswap_writeback_entry(type, tree) == -ENOENT)
+				break;
+		if (zswap_is_full()) {
+			zswap_reject_writeback_fail++;
+			ret = -ENOMEM;
+			goto reject;
+		}
+	}
+
+	entry = kmem_cache_alloc(zswap_entry_cache, GFP_KERNEL);
+	if (!entry) {
+		zswap_reject_alloc_fail++;
+		ret = -ENOMEM;
+		goto reject;
+	}
+
+	/* Compress into this cpu's buffer, and copy out before moving on */
+	dst = get_cpu_var(zswap_dstmem);
+	src = kmap_atomic(page);
+	ret = lzo1x_1_compress(src, PAGE_SIZE, dst, &dlen,
+			       __get_cpu_var(zswap_workmem));
+	kunmap_atomic(src);
+	if (ret != LZO_E_OK) {
+		ret = -EINVAL;
+		goto putcpu;
+	}
+	if (dlen > PAGE_SIZE * zswap_max_compression_ratio / 100) {
+		zswap_reject_compress_poor++;
+		ret = -E2BIG;
+		goto putcpu;
+	}
+
+	handle = zs_malloc(zswap_pool, dlen);
+	if (!handle) {
+		zswap_reject_alloc_fail++;
+		ret = -ENOMEM;
+		goto putcpu;
+	}
+	buf = zs_map_object(zswap_pool, handle, ZS_MM_WO);
+	memcpy(buf, dst, dlen);
+	zs_unmap_object(zswap_pool, handle);
+	put_cpu_var(zswap_dstmem);
+
+	entry->offset = offset;
+	entry->handle = handle;
+	entry->length = dlen;
+	entry->refcount = 1;
+	INIT_LIST_HEAD(&entry->lru);
+	atomic_inc(&zswap_stored_pages);
+
+	spin_lock(&tree->lock);
+	if (zswap_rb_insert(&tree->rbroot, entry, &dupentry) == -EEXIST) {
+		/* A rewrite of the slot: the old copy is stale */
+		zswap_duplicate_entry++;
+		zswap_rb_erase(tree, dupentry);
+		free = zswap_entry_put(dupentry);
+		zswap_rb_insert(&tree->rbroot, entry, &dupentry);
+	}
+	list_add_tail(&entry->lru, &tree->lru);
+	spin_unlock(&tree->lock);
+	if (free)
+		zswap_free_entry(dupentry);
+
+	return 0;
+
+putcpu:
+	put_cpu_var(zswap_dstmem);
+	kmem_cache_free(zswap_entry_cache, entry);
+reject:
+	/*
+	 * The page goes to the swap device instead, so an older copy of the
+	 * slot left here would be stale, and could be written back over it.
+	 */
+	zswap_invalidate_offset(tree, offset);
+	return ret;
+}
+
+static int zswap_frontswap_load(unsigned type, pgoff_t offset,
+				struct page *page)
+{
+	struct zswap_tree *tree = zswap_trees[type];
+	struct zswap_entry *entry;
+	bool free;
+	int ret;
+
+	if (!tree)
+		return -1;
+
+	spin_lock(&tree->lock);
+	entry = zswap_rb_search(&tree->rbroot, offset);
+	if (!entry) {
+		/* Written back to the swap device */
+		spin_unlock(&tree->lock);
+		return -1;
+	}
+	entry->refcount++;
+	spin_unlock(&tree->lock);
+
+	ret = zswap_decompress(entry, page);
+
+	spin_lock(&tree->lock);
+	free = zswap_entry_put(entry);
+	spin_unlock(&tree->lock);
+	if (free)
+		zswap_free_entry(entry);
+
+	return ret ? -1 : 0;
+}
+
+static void zswap_frontswap_invalidate_page(unsigned type, pgoff_t offset)
+{
+	struct zswap_tree *tree = zswap_trees[type];
+
+	if (tree)
+		zswap_invalidate_offset(tree, offset);
+}
+
+static void zswap_frontswap_invalidate_area(unsigned type)
+{
+	struct zswap_tree *tree = zswap_trees[type];
+	struct zswap_entry *entry;
+	struct rb_node *node;
+
+	if (!tree)
+		return;
+
+	/* swapoff has already brought everything back in */
+	spin_lock(&tree->lock);
+	while ((node = rb_first(&tree->rbroot)) != NULL) {
+		entry = rb_entry(node, struct zswap_entry, rbnode);
+		zswap_rb_erase(tree, entry);
+		if (zswap_entry_put(entry))
+			zswap_free_entry(entry);
+	}
+	spin_unlock(&tree->lock);
+}
+
+static void zswap_frontswap_init(unsigned type)
+{
+	struct zswap_tree *tree;
+
+	if (zswap_trees[type])
+		return;
+	tree = kzalloc(sizeof(*tree), GFP_KERNEL);
+	if (!tree) {
+		pr_err("alloc failed, swap device %u not cached\n", type);
+		return;
+	}
+	tree->rbroot = RB_ROOT;
+	INIT_LIST_HEAD(&tree->lru);
+	spin_lock_init(&tree->lock);
+	zswap_trees[type] = tree;
+}
+
+static struct frontswap_ops zswap_frontswap_ops = {
+	.store = zswap_frontswap_store,
+	.load = zswap_frontswap_load,
+	.invalidate_page = zswap_frontswap_invalidate_page,
+	.invalidate_area = zswap_frontswap_invalidate_area,
+	.init = zswap_frontswap_init,
+};
+
+/*********************************
+* debugfs functions
+**********************************/
+#ifdef CONFIG_DEBUG_FS
+static struct dentry *zswap_debugfs_root;
+
+static int zswap_stored_pages_get(void *data, u64 *val)
+{
+	*val = atomic_read(&zswap_stored_pages);
+	return 0;
+}
+DEFINE_SIMPLE_ATTRIBUTE(zswap_stored_pages_fops, zswap_stored_pages_get,
+			NULL, "%llu\n");
+
+static int zswap_pool_pages_get(void *data, u64 *val)
+{
+	*val = zswap_pool_pages();
+	return 0;
+}
+DEFINE_SIMPLE_ATTRIBUTE(zswap_pool_pages_fops, zswap_pool_pages_get,
+			NULL, "%llu\n");
+
+/* Uncompressed size of what is stored, as percent of the pool's size */
+static int zswap_compression_ratio_get(void *data, u64 *val)
+{
+	u64 pool_bytes = zs_get_total_size_bytes(zswap_pool);
+	u64 stored_bytes = (u64)atomic_read(&zswap_stored_pages) << PAGE_SHIFT;
+
+	*val = pool_bytes ? div64_u64(stored_bytes * 100, pool_bytes) : 0;
+	return 0;
+}
+DEFINE_SIMPLE_ATTRIBUTE(zswap_compression_ratio_fops,
+			zswap_compression_ratio_get, NULL, "%llu\n");
+
+static int __init zswap_debugfs_init(void)
+{
+	zswap_debugfs_root = debugfs_create_dir("zswap", NULL);
+	if (!zswap_debugfs_root)
+		return -ENOMEM;
+
+	debugfs_create_file("stored_pages", S_IRUGO,
+			zswap_debugfs_root, NULL, &zswap_stored_pages_fops);
+	debugfs_create_file("pool_pages", S_IRUGO,
+			zswap_debugfs_root, NULL, &zswap_pool_pages_fops);
+	debugfs_create_file("compression_ratio", S_IRUGO,
+			zswap_debugfs_root, NULL,
+			&zswap_compression_ratio_fops);
+	debugfs_create_u64("pool_limit_hit", S_IRUGO,
+			zswap_debugfs_root, &zswap_pool_limit_hit);
+	debugfs_create_u64("written_back_pages", S_IRUGO,
+			zswap_debugfs_root, &zswap_written_back_pages);
+	debugfs_create_u64("reject_writeback_fail", S_IRUGO,
+			zswap_debugfs_root, &zswap_reject_writeback_fail);
+	debugfs_create_u64("reject_compress_poor", S_IRUGO,
+			zswap_debugfs_root, &zswap_reject_compress_poor);
+	debugfs_create_u64("reject_alloc_fail", S_IRUGO,
+			zswap_debugfs_root, &zswap_reject_alloc_fail);
+	debugfs_create_u64("duplicate_entry", S_IRUGO,
+			zswap_debugfs_root, &zswap_duplicate_entry);
+	return 0;
+}
+#else
+static int __init zswap_debugfs_init(void)
+{
+	return 0;
+}
+#endif
+
+/*********************************
+* module init
+**********************************/
+static int __init enable_zswap(char *s)
+{
+	zswap_enabled = true;
+	return 1;
+}
+__setup("zswap", enable_zswap);
+
+static void __init zswap_free_cpu_buffers(void)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		kfree(per_cpu(zswap_workmem, cpu));
+		kfree(per_cpu(zswap_dstmem, cpu));
+		per_cpu(zswap_workmem, cpu) = NULL;
+		per_cpu(zswap_dstmem, cpu) = NULL;
+	}
+}
+
+static int __init zswap_alloc_cpu_buffers(void)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		per_cpu(zswap_workmem, cpu) = kmalloc_node(LZO1X_MEM_COMPRESS,
+				GFP_KERNEL, cpu_to_node(cpu));
+		per_cpu(zswap_dstmem, cpu) =
+			kmalloc_node(lzo1x_worst_compress(PAGE_SIZE),
+				     GFP_KERNEL, cpu_to_node(cpu));
+		if (!per_cpu(zswap_workmem, cpu) ||
+		    !per_cpu(zswap_dstmem, cpu)) {
+			zswap_free_cpu_buffers();
+			return -ENOMEM;
+		}
+	}
+	return 0;
+}
+
+static int __init zswap_init(void)
+{
+	struct frontswap_ops old_ops;
+
+	if (!zswap_enabled)
+		return 0;
+
+	zswap_entry_cache = KMEM_CACHE(zswap_entry, 0);
+	if (!zswap_entry_cache)
+		goto error;
+
+	zswap_pool = zs_create_pool("zswap", ZSWAP_GFP_MASK);
+	if (!zswap_pool)
+		goto free_cache;
+
+	if (zswap_alloc_cpu_buffers())
+		goto free_pool;
+
+	old_ops = frontswap_register_ops(&zswap_frontswap_ops);
+	if (old_ops.init != NULL)
+		pr_warn("frontswap_ops overridden\n");
+
+	if (zswap_debugfs_init())
+		pr_warn("debugfs initialization failed\n");
+
+	pr_info("using lzo, pool capped at %u%% of RAM\n",
+		zswap_max_pool_percent);
+	return 0;
+
+free_pool:
+	zs_destroy_pool(zswap_pool);
+free_cache:
+	kmem_cache_destroy(zswap_entry_cache);
+error:
+	pr_err("initialization failed\n");
+	zswap_enabled = false;
+	return -ENOMEM;
+}
+/* must come after zsmalloc has set up its per-cpu mapping areas */
+late_initcall(zswap_init);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("Compressed cache for swap pages");
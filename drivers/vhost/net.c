@@ -18,6 +18,7 @@
 #include <linux/rcupdate.h>
 #include <linux/file.h>
 #include <linux/slab.h>
+#include <linux/sched.h>
 
 #include <linux/net.h>
 #include <linux/if_packet.h>
@@ -126,6 +127,44 @@ static void tx_poll_start(struct vhost_net *net, struct socket *sock)
 	net->tx_poll_state = VHOST_NET_POLL_STARTED;
 }
 
+/* Roughly microseconds, cheap enough to read in a busy-poll loop. */
+static unsigned long busy_clock(void)
+{
+	return local_clock() >> 10;
+}
+
+static bool vhost_can_busy_poll(struct vhost_dev *dev, unsigned long endtime)
+{
+	return likely(!need_resched()) &&
+	       likely(!time_after(busy_clock(), endtime)) &&
+	       likely(!signal_pending(current)) &&
+	       !vhost_has_work(dev);
+}
+
+/* Spin on the avail ring for up to the vq busy-poll budget before the
+ * caller re-enables guest notifications.  Returns true if the guest added
+ * buffers meanwhile.  Caller must have VQ lock. */
+static bool vhost_net_busy_poll_avail(struct vhost_net *net,
+				      struct vhost_virtqueue *vq)
+{
+	unsigned long endtime;
+	bool found;
+
+	if (!vq->busyloop_timeout)
+		return false;
+
+	endtime = busy_clock() + vq->busyloop_timeout;
+	while (vhost_can_busy_poll(&net->dev, endtime) &&
+	       vhost_vq_avail_empty(&net->dev, vq))
+		cpu_relax();
+
+	found = !vhost_vq_avail_empty(&net->dev, vq);
+	vq->busyloop_polls++;
+	if (found)
+		vq->busyloop_hits++;
+	return found;
+}
+
 /* Expects to be always run from workqueue - which acts as
  * read-size critical section for our kind of RCU. */
 static void handle_tx(struct vhost_net *net)
@@ -202,6 +241,8 @@ static void handle_tx(struct vhost_net *net)
 				set_bit(SOCK_ASYNC_NOSPACE, &sock->flags);
 				break;
 			}
+			if (vhost_net_busy_poll_avail(net, vq))
+				continue;
 			if (unlikely(vhost_enable_notify(&net->dev, vq))) {
 				vhost_disable_notify(&net->dev, vq);
 				continue;
@@ -297,6 +338,30 @@ static int peek_head_len(struct sock *sk)
 	return len;
 }
 
+/* Like peek_head_len(), but if the socket is empty keep polling it for up
+ * to the RX vq busy-poll budget.  Caller must have RX VQ lock. */
+static int vhost_net_rx_peek_head_len(struct vhost_net *net,
+				      struct vhost_virtqueue *vq,
+				      struct sock *sk)
+{
+	unsigned long endtime;
+	int len = peek_head_len(sk);
+
+	if (len || !vq->busyloop_timeout)
+		return len;
+
+	endtime = busy_clock() + vq->busyloop_timeout;
+	while (vhost_can_busy_poll(&net->dev, endtime) &&
+	       skb_queue_empty(&sk->sk_receive_queue))
+		cpu_relax();
+
+	len = peek_head_len(sk);
+	vq->busyloop_polls++;
+	if (len)
+		vq->busyloop_hits++;
+	return len;
+}
+
 /* This is a multi-buffer version of vhost_get_desc, that works if
  *	vq has read descriptors only.
  * @vq		- the relevant virtqueue
@@ -397,7 +462,7 @@ static void handle_rx(struct vhost_net *net)
 		vq->log : NULL;
 	mergeable = vhost_has_feature(&net->dev, VIRTIO_NET_F_MRG_RXBUF);
 
-	while ((sock_len = peek_head_len(sock->sk))) {
+	while ((sock_len = vhost_net_rx_peek_head_len(net, vq, sock->sk))) {
 		sock_len += sock_hlen;
 		vhost_len = sock_len + vhost_hlen;
 		headcount = get_rx_bufs(vq, vq->heads, vhost_len,
@@ -408,6 +473,8 @@ static void handle_rx(struct vhost_net *net)
 			break;
 		/* OK, now we need to know about added descriptors. */
 		if (!headcount) {
+			if (vhost_net_busy_poll_avail(net, vq))
+				continue;
 			if (unlikely(vhost_enable_notify(&net->dev, vq))) {
 				/* They have slipped one in as we were
 				 * doing that: check again. */
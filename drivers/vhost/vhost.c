@@ -23,6 +23,7 @@
 #include <linux/file.h>
 #include <linux/highmem.h>
 #include <linux/slab.h>
+#include <linux/sort.h>
 #include <linux/kthread.h>
 #include <linux/cgroup.h>
 
@@ -150,6 +151,12 @@ void vhost_work_queue(struct vhost_dev *dev, struct vhost_work *work)
 	spin_unlock_irqrestore(&dev->work_lock, flags);
 }
 
+/* A racy check for pending work, good enough to end a busy-poll loop. */
+bool vhost_has_work(struct vhost_dev *dev)
+{
+	return !list_empty(&dev->work_list);
+}
+
 void vhost_poll_queue(struct vhost_poll *poll)
 {
 	vhost_work_queue(poll->dev, &poll->work);
@@ -183,6 +190,11 @@ static void vhost_vq_reset(struct vhost_dev *dev,
 	vq->upend_idx = 0;
 	vq->done_idx = 0;
 	vq->ubufs = NULL;
+	vq->busyloop_timeout = 0;
+	vq->busyloop_polls = 0;
+	vq->busyloop_hits = 0;
+	vq->avail_cache_num = 0;
+	vq->mem_cache.memory_size = 0;
 }
 
 static int vhost_worker(void *data)
@@ -599,10 +611,22 @@ int vhost_vq_access_ok(struct vhost_virtqueue *vq)
 		vq_log_access_ok(vq->dev, vq, vq->log_base);
 }
 
+static int vhost_region_cmp(const void *a, const void *b)
+{
+	const struct vhost_memory_region *ra = a, *rb = b;
+
+	if (ra->guest_phys_addr < rb->guest_phys_addr)
+		return -1;
+	if (ra->guest_phys_addr > rb->guest_phys_addr)
+		return 1;
+	return 0;
+}
+
 static long vhost_set_memory(struct vhost_dev *d, struct vhost_memory __user *m)
 {
 	struct vhost_memory mem, *newmem, *oldmem;
 	unsigned long size = offsetof(struct vhost_memory, regions);
+	int i;
 
 	if (copy_from_user(&mem, m, size))
 		return -EFAULT;
@@ -626,10 +650,29 @@ static long vhost_set_memory(struct vhost_dev *d, struct vhost_memory __user *m)
 		kfree(newmem);
 		return -EFAULT;
 	}
+	/* Keep regions sorted by guest address so find_region() can bisect. */
+	sort(newmem->regions, newmem->nregions, sizeof *newmem->regions,
+	     vhost_region_cmp, NULL);
+	/* Bisecting is only exact if no two regions overlap. */
+	for (i = 1; i < newmem->nregions; ++i) {
+		struct vhost_memory_region *prev = newmem->regions + i - 1;
+
+		if (newmem->regions[i].guest_phys_addr - prev->guest_phys_addr <
+		    prev->memory_size) {
+			kfree(newmem);
+			return -EINVAL;
+		}
+	}
 	oldmem = rcu_dereference_protected(d->memory,
 					   lockdep_is_held(&d->mutex));
 	rcu_assign_pointer(d->memory, newmem);
 	synchronize_rcu();
+	/* Drop translations cached from the old table. */
+	for (i = 0; i < d->nvqs; ++i) {
+		mutex_lock(&d->vqs[i].mutex);
+		d->vqs[i].mem_cache.memory_size = 0;
+		mutex_unlock(&d->vqs[i].mutex);
+	}
 	kfree(oldmem);
 	return 0;
 }
@@ -644,6 +687,7 @@ static long vhost_set_vring(struct vhost_dev *d, int ioctl, void __user *argp)
 	struct vhost_vring_state s;
 	struct vhost_vring_file f;
 	struct vhost_vring_addr a;
+	struct vhost_vring_busyloop_stats b;
 	u32 idx;
 	long r;
 
@@ -674,6 +718,7 @@ static long vhost_set_vring(struct vhost_dev *d, int ioctl, void __user *argp)
 			break;
 		}
 		vq->num = s.num;
+		vq->avail_cache_num = 0;
 		break;
 	case VHOST_SET_VRING_BASE:
 		/* Moving base with an active backend?
@@ -693,6 +738,7 @@ static long vhost_set_vring(struct vhost_dev *d, int ioctl, void __user *argp)
 		vq->last_avail_idx = s.num;
 		/* Forget the cached index value. */
 		vq->avail_idx = vq->last_avail_idx;
+		vq->avail_cache_num = 0;
 		break;
 	case VHOST_GET_VRING_BASE:
 		s.index = idx;
@@ -751,6 +797,7 @@ static long vhost_set_vring(struct vhost_dev *d, int ioctl, void __user *argp)
 		vq->avail = (void __user *)(unsigned long)a.avail_user_addr;
 		vq->log_addr = a.log_guest_addr;
 		vq->used = (void __user *)(unsigned long)a.used_user_addr;
+		vq->avail_cache_num = 0;
 		break;
 	case VHOST_SET_VRING_KICK:
 		if (copy_from_user(&f, argp, sizeof f)) {
@@ -806,6 +853,27 @@ static long vhost_set_vring(struct vhost_dev *d, int ioctl, void __user *argp)
 		} else
 			filep = eventfp;
 		break;
+	case VHOST_SET_VRING_BUSYLOOP_TIMEOUT:
+		if (copy_from_user(&s, argp, sizeof s)) {
+			r = -EFAULT;
+			break;
+		}
+		vq->busyloop_timeout = s.num;
+		break;
+	case VHOST_GET_VRING_BUSYLOOP_TIMEOUT:
+		s.index = idx;
+		s.num = vq->busyloop_timeout;
+		if (copy_to_user(argp, &s, sizeof s))
+			r = -EFAULT;
+		break;
+	case VHOST_GET_VRING_BUSYLOOP_STATS:
+		memset(&b, 0, sizeof b);
+		b.index = idx;
+		b.polls = vq->busyloop_polls;
+		b.hits = vq->busyloop_hits;
+		if (copy_to_user(argp, &b, sizeof b))
+			r = -EFAULT;
+		break;
 	default:
 		r = -ENOIOCTLCMD;
 	}
@@ -909,23 +977,36 @@ done:
 	return r;
 }
 
+/* Regions are sorted by guest_phys_addr and never overlap, see
+ * vhost_set_memory(). */
 static const struct vhost_memory_region *find_region(struct vhost_memory *mem,
 						     __u64 addr, __u32 len)
 {
 	struct vhost_memory_region *reg;
-	int i;
+	int lo = 0, hi = mem->nregions;
 
-	/* linear search is not brilliant, but we really have on the order of 6
-	 * regions in practice */
-	for (i = 0; i < mem->nregions; ++i) {
-		reg = mem->regions + i;
-		if (reg->guest_phys_addr <= addr &&
-		    reg->guest_phys_addr + reg->memory_size - 1 >= addr)
+	while (lo < hi) {
+		int mid = lo + (hi - lo) / 2;
+
+		reg = mem->regions + mid;
+		if (addr < reg->guest_phys_addr)
+			hi = mid;
+		else if (reg->guest_phys_addr + reg->memory_size - 1 < addr)
+			lo = mid + 1;
+		else
 			return reg;
 	}
 	return NULL;
 }
 
+static inline bool vhost_region_contains(const struct vhost_memory_region *reg,
+					 u64 addr)
+{
+	return reg->memory_size &&
+	       reg->guest_phys_addr <= addr &&
+	       reg->guest_phys_addr + reg->memory_size - 1 >= addr;
+}
+
 /* TODO: This is really inefficient.  We need something like get_user()
  * (instruction directly accesses the data, with an exception table entry
  * returning -EFAULT). See Documentation/x86/exception-tables.txt.
@@ -1051,8 +1132,10 @@ int vhost_init_used(struct vhost_virtqueue *vq)
 	return get_user(vq->last_used_idx, &vq->used->idx);
 }
 
-static int translate_desc(struct vhost_dev *dev, u64 addr, u32 len,
-			  struct iovec iov[], int iov_size)
+/* Caller must have VQ lock: the last region hit is cached in vq->mem_cache,
+ * which is a copy, so it stays safe to use after the table is replaced. */
+static int translate_desc(struct vhost_dev *dev, struct vhost_virtqueue *vq,
+			  u64 addr, u32 len, struct iovec iov[], int iov_size)
 {
 	const struct vhost_memory_region *reg;
 	struct vhost_memory *mem;
@@ -1069,10 +1152,15 @@ static int translate_desc(struct vhost_dev *dev, u64 addr, u32 len,
 			ret = -ENOBUFS;
 			break;
 		}
-		reg = find_region(mem, addr, len);
-		if (unlikely(!reg)) {
-			ret = -EFAULT;
-			break;
+		if (likely(vhost_region_contains(&vq->mem_cache, addr))) {
+			reg = &vq->mem_cache;
+		} else {
+			reg = find_region(mem, addr, len);
+			if (unlikely(!reg)) {
+				ret = -EFAULT;
+				break;
+			}
+			vq->mem_cache = *reg;
 		}
 		_iov = iov + ret;
 		size = reg->memory_size - addr + reg->guest_phys_addr;
@@ -1128,8 +1216,8 @@ static int get_indirect(struct vhost_dev *dev, struct vhost_virtqueue *vq,
 		return -EINVAL;
 	}
 
-	ret = translate_desc(dev, indirect->addr, indirect->len, vq->indirect,
-			     UIO_MAXIOV);
+	ret = translate_desc(dev, vq, indirect->addr, indirect->len,
+			     vq->indirect, UIO_MAXIOV);
 	if (unlikely(ret < 0)) {
 		vq_err(vq, "Translation failure %d in indirect.\n", ret);
 		return ret;
@@ -1168,8 +1256,8 @@ static int get_indirect(struct vhost_dev *dev, struct vhost_virtqueue *vq,
 			return -EINVAL;
 		}
 
-		ret = translate_desc(dev, desc.addr, desc.len, iov + iov_count,
-				     iov_size - iov_count);
+		ret = translate_desc(dev, vq, desc.addr, desc.len,
+				     iov + iov_count, iov_size - iov_count);
 		if (unlikely(ret < 0)) {
 			vq_err(vq, "Translation failure %d indirect idx %d\n",
 			       ret, i);
@@ -1197,6 +1285,34 @@ static int get_indirect(struct vhost_dev *dev, struct vhost_virtqueue *vq,
 	return 0;
 }
 
+/* Read the head published at avail index idx.  Heads are copied from the
+ * avail ring up to VHOST_AVAIL_CACHE at a time: entries the guest has
+ * already exposed are not changed by it until we have used them, so the
+ * copy stays valid across vhost_discard_vq_desc(). */
+static int vhost_get_avail_head(struct vhost_virtqueue *vq, u16 idx,
+				unsigned int *head)
+{
+	u16 off = idx - vq->avail_cache_idx;
+	unsigned int n;
+
+	if (off < vq->avail_cache_num) {
+		*head = vq->avail_cache[off];
+		return 0;
+	}
+
+	n = min_t(unsigned int, (u16)(vq->avail_idx - idx), VHOST_AVAIL_CACHE);
+	n = min(n, vq->num - idx % vq->num);
+	vq->avail_cache_num = 0;
+	if (__copy_from_user(vq->avail_cache,
+			     &vq->avail->ring[idx % vq->num],
+			     n * sizeof *vq->avail_cache))
+		return -EFAULT;
+	vq->avail_cache_idx = idx;
+	vq->avail_cache_num = n;
+	*head = vq->avail_cache[0];
+	return 0;
+}
+
 /* This looks in the virtqueue and for the first available buffer, and converts
  * it to an iovec for convenient access.  Since descriptors consist of some
  * number of output then some number of input descriptors, it's actually two
@@ -1215,31 +1331,38 @@ int vhost_get_vq_desc(struct vhost_dev *dev, struct vhost_virtqueue *vq,
 	u16 last_avail_idx;
 	int ret;
 
-	/* Check it isn't doing very strange things with descriptor numbers. */
 	last_avail_idx = vq->last_avail_idx;
-	if (unlikely(__get_user(vq->avail_idx, &vq->avail->idx))) {
-		vq_err(vq, "Failed to access avail idx at %p\n",
-		       &vq->avail->idx);
-		return -EFAULT;
-	}
 
-	if (unlikely((u16)(vq->avail_idx - last_avail_idx) > vq->num)) {
-		vq_err(vq, "Guest moved used index from %u to %u",
-		       last_avail_idx, vq->avail_idx);
-		return -EFAULT;
-	}
+	/* Only go back to the guest for the avail index once we have used up
+	 * everything it published last time we looked. */
+	if (vq->avail_idx == last_avail_idx) {
+		if (unlikely(__get_user(vq->avail_idx, &vq->avail->idx))) {
+			vq_err(vq, "Failed to access avail idx at %p\n",
+			       &vq->avail->idx);
+			return -EFAULT;
+		}
+
+		/* Check it isn't doing very strange things with descriptor
+		 * numbers. */
+		if (unlikely((u16)(vq->avail_idx - last_avail_idx) > vq->num)) {
+			vq_err(vq, "Guest moved used index from %u to %u",
+			       last_avail_idx, vq->avail_idx);
+			return -EFAULT;
+		}
 
-	/* If there's nothing new since last we looked, return invalid. */
-	if (vq->avail_idx == last_avail_idx)
-		return vq->num;
+		/* If there's nothing new since last we looked, return
+		 * invalid. */
+		if (vq->avail_idx == last_avail_idx)
+			return vq->num;
 
-	/* Only get avail ring entries after they have been exposed by guest. */
-	smp_rmb();
+		/* Only get avail ring entries after they have been exposed
+		 * by guest. */
+		smp_rmb();
+	}
 
 	/* Grab the next descriptor number they're advertising, and increment
 	 * the index we've seen. */
-	if (unlikely(__get_user(head,
-				&vq->avail->ring[last_avail_idx % vq->num]))) {
+	if (unlikely(vhost_get_avail_head(vq, last_avail_idx, &head))) {
 		vq_err(vq, "Failed to read head: idx %d address %p\n",
 		       last_avail_idx,
 		       &vq->avail->ring[last_avail_idx % vq->num]);
@@ -1290,8 +1413,8 @@ int vhost_get_vq_desc(struct vhost_dev *dev, struct vhost_virtqueue *vq,
 			continue;
 		}
 
-		ret = translate_desc(dev, desc.addr, desc.len, iov + iov_count,
-				     iov_size - iov_count);
+		ret = translate_desc(dev, vq, desc.addr, desc.len,
+				     iov + iov_count, iov_size - iov_count);
 		if (unlikely(ret < 0)) {
 			vq_err(vq, "Translation failure %d descriptor idx %d\n",
 			       ret, i);
@@ -1549,6 +1672,18 @@ bool vhost_enable_notify(struct vhost_dev *dev, struct vhost_virtqueue *vq)
 	return avail_idx != vq->avail_idx;
 }
 
+/* Check, without touching notification state, whether the guest has made
+ * more buffers available since we last looked. */
+bool vhost_vq_avail_empty(struct vhost_dev *dev, struct vhost_virtqueue *vq)
+{
+	u16 avail_idx;
+
+	if (__get_user(avail_idx, &vq->avail->idx))
+		return false;
+
+	return avail_idx == vq->avail_idx;
+}
+
 /* We don't need to be notified again. */
 void vhost_disable_notify(struct vhost_dev *dev, struct vhost_virtqueue *vq)
 {
@@ -18,6 +18,9 @@
 #define VHOST_DMA_DONE_LEN	1
 #define VHOST_DMA_CLEAR_LEN	0
 
+/* Number of avail ring heads read from the guest in one go. */
+#define VHOST_AVAIL_CACHE	32
+
 struct vhost_device;
 
 struct vhost_work;
@@ -110,6 +113,16 @@ struct vhost_virtqueue {
 	/* Last used index value we have signalled on */
 	bool signalled_used_valid;
 
+	/* Avail ring heads prefetched from the guest, starting at avail
+	 * index avail_cache_idx. */
+	u16 avail_cache[VHOST_AVAIL_CACHE];
+	u16 avail_cache_idx;
+	u16 avail_cache_num;
+
+	/* Last guest memory region translate_desc() hit on this vq.
+	 * memory_size is 0 if nothing is cached. */
+	struct vhost_memory_region mem_cache;
+
 	/* Log writes to used structure. */
 	bool log_used;
 	u64 log_addr;
@@ -144,6 +157,12 @@ struct vhost_virtqueue {
 	/* Reference counting for outstanding ubufs.
 	 * Protected by vq mutex. Writers must also take device mutex. */
 	struct vhost_ubuf_ref *ubufs;
+	/* Busy-poll budget in microseconds, 0 if disabled. */
+	unsigned busyloop_timeout;
+	/* Busy-poll attempts and how many of them found work.
+	 * Protected by vq mutex. */
+	u64 busyloop_polls;
+	u64 busyloop_hits;
 };
 
 struct vhost_dev {
@@ -186,6 +205,8 @@ void vhost_add_used_and_signal(struct vhost_dev *, struct vhost_virtqueue *,
 void vhost_add_used_and_signal_n(struct vhost_dev *, struct vhost_virtqueue *,
 			       struct vring_used_elem *heads, unsigned count);
 void vhost_signal(struct vhost_dev *, struct vhost_virtqueue *);
+bool vhost_vq_avail_empty(struct vhost_dev *, struct vhost_virtqueue *);
+bool vhost_has_work(struct vhost_dev *);
 void vhost_disable_notify(struct vhost_dev *, struct vhost_virtqueue *);
 bool vhost_enable_notify(struct vhost_dev *, struct vhost_virtqueue *);
 
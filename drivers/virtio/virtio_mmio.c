@@ -35,6 +35,13 @@
  *			interrupts = <42>;
  *		}
  *
+ *    A device that offers the VIRTIO_MMIO_F_QUEUE_IRQ feature may list
+ *    further interrupts after the first one. The driver then tries to give
+ *    every virtqueue with a callback its own line, so that each queue's
+ *    interrupt can be steered to a separate cpu. The first line stays in
+ *    use for configuration changes. If there are not enough lines, all
+ *    queues share the first one as before.
+ *
  * 3. Kernel module (or command line) parameter. Can be used more than once -
  *    one device will be created for each one. Syntax:
  *
@@ -72,6 +79,8 @@
  * 0x038  W  QueueNum         Queue size for the currently selected queue
  * 0x03c  W  QueueAlign       Used Ring alignment for the current queue
  * 0x040  RW QueuePFN         PFN for the currently selected queue
+ * 0x044  W  QueueIRQ         Interrupt line for the currently selected queue
+ *                            (only with VIRTIO_MMIO_F_QUEUE_IRQ)
  *
  * 0x050  W  QueueNotify      Queue notifier
  * 0x060  R  InterruptStatus  Interrupt status register
@@ -119,7 +128,7 @@ struct virtio_mmio_device {
 	void __iomem *base;
 	unsigned long version;
 
-	/* a list of queues so we can dispatch IRQs */
+	/* a list of queues sharing the first line so we can dispatch IRQs */
 	spinlock_t lock;
 	struct list_head virtqueues;
 };
@@ -139,6 +148,10 @@ struct virtio_mmio_vq_info {
 
 	/* the list node for the virtqueues list */
 	struct list_head node;
+
+	/* the queue's own interrupt, or 0 if it uses the shared one */
+	unsigned int irq;
+	char irq_name[32];
 };
 
 
@@ -158,10 +171,14 @@ static u32 vm_get_features(struct virtio_device *vdev)
 static void vm_finalize_features(struct virtio_device *vdev)
 {
 	struct virtio_mmio_device *vm_dev = to_virtio_mmio_device(vdev);
+	bool queue_irq;
 	int i;
 
-	/* Give virtio_ring a chance to accept features. */
+	/* Give virtio_ring a chance to accept features, keep our own. */
+	queue_irq = test_bit(VIRTIO_MMIO_F_QUEUE_IRQ, vdev->features);
 	vring_transport_features(vdev);
+	if (queue_irq)
+		set_bit(VIRTIO_MMIO_F_QUEUE_IRQ, vdev->features);
 
 	for (i = 0; i < ARRAY_SIZE(vdev->features); i++) {
 		writel(i, vm_dev->base + VIRTIO_MMIO_GUEST_FEATURES_SEL);
@@ -232,7 +249,7 @@ static void vm_notify(struct virtqueue *vq)
 	writel(info->queue_index, vm_dev->base + VIRTIO_MMIO_QUEUE_NOTIFY);
 }
 
-/* Notify all virtqueues on an interrupt. */
+/* Notify all virtqueues sharing the first line on an interrupt. */
 static irqreturn_t vm_interrupt(int irq, void *opaque)
 {
 	struct virtio_mmio_device *vm_dev = opaque;
@@ -280,6 +297,8 @@ static void vm_del_vq(struct virtqueue *vq)
 	/* Select and deactivate the queue */
 	writel(info->queue_index, vm_dev->base + VIRTIO_MMIO_QUEUE_SEL);
 	writel(0, vm_dev->base + VIRTIO_MMIO_QUEUE_PFN);
+	if (virtio_has_feature(vq->vdev, VIRTIO_MMIO_F_QUEUE_IRQ))
+		writel(0, vm_dev->base + VIRTIO_MMIO_QUEUE_IRQ);
 
 	size = PAGE_ALIGN(vring_size(info->num, VIRTIO_MMIO_VRING_ALIGN));
 	free_pages_exact(info->queue, size);
@@ -291,8 +310,15 @@ static void vm_del_vqs(struct virtio_device *vdev)
 	struct virtio_mmio_device *vm_dev = to_virtio_mmio_device(vdev);
 	struct virtqueue *vq, *n;
 
-	list_for_each_entry_safe(vq, n, &vdev->vqs, list)
+	list_for_each_entry_safe(vq, n, &vdev->vqs, list) {
+		struct virtio_mmio_vq_info *info = vq->priv;
+
+		if (info->irq) {
+			irq_set_affinity_hint(info->irq, NULL);
+			free_irq(info->irq, vq);
+		}
 		vm_del_vq(vq);
+	}
 
 	free_irq(platform_get_irq(vm_dev->pdev, 0), vm_dev);
 }
@@ -301,7 +327,7 @@ static void vm_del_vqs(struct virtio_device *vdev)
 
 static struct virtqueue *vm_setup_vq(struct virtio_device *vdev, unsigned index,
 				  void (*callback)(struct virtqueue *vq),
-				  const char *name)
+				  const char *name, unsigned line)
 {
 	struct virtio_mmio_device *vm_dev = to_virtio_mmio_device(vdev);
 	struct virtio_mmio_vq_info *info;
@@ -325,6 +351,8 @@ static struct virtqueue *vm_setup_vq(struct virtio_device *vdev, unsigned index,
 		goto error_kmalloc;
 	}
 	info->queue_index = index;
+	info->irq = 0;
+	INIT_LIST_HEAD(&info->node);
 
 	/* Allocate pages for the queue - start with a queue as big as
 	 * possible (limited by maximum size allowed by device), drop down
@@ -348,7 +376,9 @@ static struct virtqueue *vm_setup_vq(struct virtio_device *vdev, unsigned index,
 		info->num /= 2;
 	}
 
-	/* Activate the queue */
+	/* Activate the queue, telling the device which line it signals */
+	if (virtio_has_feature(vdev, VIRTIO_MMIO_F_QUEUE_IRQ))
+		writel(line, vm_dev->base + VIRTIO_MMIO_QUEUE_IRQ);
 	writel(info->num, vm_dev->base + VIRTIO_MMIO_QUEUE_NUM);
 	writel(VIRTIO_MMIO_VRING_ALIGN,
 			vm_dev->base + VIRTIO_MMIO_QUEUE_ALIGN);
@@ -356,8 +386,9 @@ static struct virtqueue *vm_setup_vq(struct virtio_device *vdev, unsigned index,
 			vm_dev->base + VIRTIO_MMIO_QUEUE_PFN);
 
 	/* Create the vring */
-	vq = vring_new_virtqueue(info->num, VIRTIO_MMIO_VRING_ALIGN, vdev,
-				 true, info->queue, vm_notify, callback, name);
+	vq = vring_new_virtqueue(index, info->num, VIRTIO_MMIO_VRING_ALIGN,
+				 vdev, true, info->queue, vm_notify, callback,
+				 name);
 	if (!vq) {
 		err = -ENOMEM;
 		goto error_new_virtqueue;
@@ -366,14 +397,18 @@ static struct virtqueue *vm_setup_vq(struct virtio_device *vdev, unsigned index,
 	vq->priv = info;
 	info->vq = vq;
 
-	spin_lock_irqsave(&vm_dev->lock, flags);
-	list_add(&info->node, &vm_dev->virtqueues);
-	spin_unlock_irqrestore(&vm_dev->lock, flags);
+	if (!line) {
+		spin_lock_irqsave(&vm_dev->lock, flags);
+		list_add(&info->node, &vm_dev->virtqueues);
+		spin_unlock_irqrestore(&vm_dev->lock, flags);
+	}
 
 	return vq;
 
 error_new_virtqueue:
 	writel(0, vm_dev->base + VIRTIO_MMIO_QUEUE_PFN);
+	if (virtio_has_feature(vdev, VIRTIO_MMIO_F_QUEUE_IRQ))
+		writel(0, vm_dev->base + VIRTIO_MMIO_QUEUE_IRQ);
 	free_pages_exact(info->queue, size);
 error_alloc_pages:
 	kfree(info);
@@ -382,28 +417,92 @@ error_available:
 	return ERR_PTR(err);
 }
 
-static int vm_find_vqs(struct virtio_device *vdev, unsigned nvqs,
-		       struct virtqueue *vqs[],
-		       vq_callback_t *callbacks[],
-		       const char *names[])
+static int vm_try_find_vqs(struct virtio_device *vdev, unsigned nvqs,
+			   struct virtqueue *vqs[],
+			   vq_callback_t *callbacks[],
+			   const char *names[],
+			   bool per_vq_irqs)
 {
 	struct virtio_mmio_device *vm_dev = to_virtio_mmio_device(vdev);
-	unsigned int irq = platform_get_irq(vm_dev->pdev, 0);
+	struct platform_device *pdev = vm_dev->pdev;
+	unsigned int irq = platform_get_irq(pdev, 0);
+	struct virtio_mmio_vq_info *info;
+	unsigned line = 0;
 	int i, err;
 
+	if (per_vq_irqs) {
+		/* Every queue with a callback needs a line of its own. */
+		for (i = 0; i < nvqs; ++i)
+			if (callbacks[i])
+				++line;
+		if (!line || platform_get_irq(pdev, line) < 0)
+			return -ENOENT;
+		line = 0;
+	}
+
 	err = request_irq(irq, vm_interrupt, IRQF_SHARED,
 			dev_name(&vdev->dev), vm_dev);
 	if (err)
 		return err;
 
 	for (i = 0; i < nvqs; ++i) {
-		vqs[i] = vm_setup_vq(vdev, i, callbacks[i], names[i]);
+		bool own = per_vq_irqs && callbacks[i];
+
+		vqs[i] = vm_setup_vq(vdev, i, callbacks[i], names[i],
+				     own ? ++line : 0);
 		if (IS_ERR(vqs[i])) {
-			vm_del_vqs(vdev);
-			return PTR_ERR(vqs[i]);
+			err = PTR_ERR(vqs[i]);
+			goto error_find;
 		}
+		if (!own)
+			continue;
+
+		info = vqs[i]->priv;
+		snprintf(info->irq_name, sizeof(info->irq_name), "%s-%s",
+			 dev_name(&vdev->dev), names[i]);
+		/* A queue's own line: no status to read, nothing to scan */
+		err = request_irq(platform_get_irq(pdev, line),
+				  vring_interrupt, 0, info->irq_name, vqs[i]);
+		if (err)
+			goto error_find;
+		info->irq = platform_get_irq(pdev, line);
+	}
+
+	return 0;
+
+error_find:
+	vm_del_vqs(vdev);
+	return err;
+}
+
+static int vm_find_vqs(struct virtio_device *vdev, unsigned nvqs,
+		       struct virtqueue *vqs[],
+		       vq_callback_t *callbacks[],
+		       const char *names[])
+{
+	int err;
+
+	/* Try a line per virtqueue, then fall back to the shared one. */
+	if (virtio_has_feature(vdev, VIRTIO_MMIO_F_QUEUE_IRQ)) {
+		err = vm_try_find_vqs(vdev, nvqs, vqs, callbacks, names, true);
+		if (!err)
+			return 0;
 	}
+	return vm_try_find_vqs(vdev, nvqs, vqs, callbacks, names, false);
+}
+
+static int vm_set_vq_affinity(struct virtqueue *vq, int cpu)
+{
+	struct virtio_mmio_vq_info *info = vq->priv;
+
+	if (!vq->callback)
+		return -EINVAL;
+
+	/* Moving the shared line would drag every other queue along. */
+	if (!info->irq)
+		return 0;
 
+	irq_set_affinity_hint(info->irq, cpu == -1 ? NULL : cpumask_of(cpu));
 	return 0;
 }
 
@@ -425,6 +524,7 @@ static struct virtio_config_ops virtio_mmio_config_ops = {
 	.get_features	= vm_get_features,
 	.finalize_features = vm_finalize_features,
 	.bus_name	= vm_bus_name,
+	.set_vq_affinity = vm_set_vq_affinity,
 };
 
 
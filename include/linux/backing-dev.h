@@ -43,6 +43,9 @@ enum bdi_stat_item {
 	BDI_WRITEBACK,
 	BDI_DIRTIED,
 	BDI_WRITTEN,
+	BDI_READAHEAD,
+	BDI_READAHEAD_HIT,
+	BDI_READAHEAD_MISS,
 	NR_BDI_STAT_ITEMS
 };
 
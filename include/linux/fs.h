@@ -1005,6 +1005,18 @@ struct file_ra_state {
 	unsigned int ra_pages;		/* Maximum readahead window */
 	unsigned int mmap_miss;		/* Cache miss stat for mmap accesses */
 	loff_t prev_pos;		/* Cache last read() position */
+
+	/*
+	 * Readahead accounting, used to adapt ra_pages to how much of
+	 * what is read ahead actually gets used
+	 */
+	unsigned int pending;		/* # of readahead pages not yet
+					   known to be used or lost */
+	pgoff_t mark;			/* offset up to which used readahead
+					   pages have been accounted */
+	unsigned int hits;		/* # of readahead pages used */
+	unsigned int misses;		/* # of readahead pages evicted or
+					   left unused, both decaying */
 };
 
 /*
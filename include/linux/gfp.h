@@ -308,6 +308,23 @@ __alloc_pages(gfp_t gfp_mask, unsigned int order,
 	return __alloc_pages_nodemask(gfp_mask, order, zonelist, NULL);
 }
 
+unsigned long __alloc_pages_bulk(gfp_t gfp_mask, struct zonelist *zonelist,
+				 nodemask_t *nodemask, unsigned long nr_pages,
+				 struct list_head *list);
+
+/*
+ * Allocate up to @nr_pages order-0 pages from the local node onto @list.
+ * Returns the number of pages allocated.  Free them with free_pages_bulk().
+ */
+static inline unsigned long
+alloc_pages_bulk(gfp_t gfp_mask, unsigned long nr_pages,
+		 struct list_head *list)
+{
+	return __alloc_pages_bulk(gfp_mask,
+				  node_zonelist(numa_node_id(), gfp_mask),
+				  NULL, nr_pages, list);
+}
+
 static inline struct page *alloc_pages_node(int nid, gfp_t gfp_mask,
 						unsigned int order)
 {
@@ -367,6 +384,7 @@ extern void __free_pages(struct page *page, unsigned int order);
 extern void free_pages(unsigned long addr, unsigned int order);
 extern void free_hot_cold_page(struct page *page, int cold);
 extern void free_hot_cold_page_list(struct list_head *list, int cold);
+extern void free_pages_bulk(struct list_head *list);
 
 #define __free_page(page) __free_pages((page), 0)
 #define free_page(addr) free_pages((addr), 0)
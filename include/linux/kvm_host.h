@@ -213,6 +213,11 @@ struct kvm_vcpu {
 	int sigset_active;
 	sigset_t sigset;
 	struct kvm_vcpu_stat stat;
+	/* scheduled out while still runnable */
+	bool preempted;
+	/* guest area mirroring @preempted, see kvm_vcpu_set_state_area() */
+	bool state_enabled;
+	struct gfn_to_hva_cache state_cache;
 
 #ifdef CONFIG_HAS_IOMEM
 	int mmio_needed;
@@ -407,6 +412,7 @@ static inline struct kvm_vcpu *kvm_get_vcpu(struct kvm *kvm, int i)
 
 int kvm_vcpu_init(struct kvm_vcpu *vcpu, struct kvm *kvm, unsigned id);
 void kvm_vcpu_uninit(struct kvm_vcpu *vcpu);
+int kvm_vcpu_set_state_area(struct kvm_vcpu *vcpu, gpa_t gpa);
 
 void vcpu_load(struct kvm_vcpu *vcpu);
 void vcpu_put(struct kvm_vcpu *vcpu);
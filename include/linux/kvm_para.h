@@ -1,6 +1,8 @@
 #ifndef __LINUX_KVM_PARA_H
 #define __LINUX_KVM_PARA_H
 
+#include <linux/types.h>
+
 /*
  * This header file provides a method for making a hypercall to the host
  * Architectures should define:
@@ -19,6 +21,18 @@
 #define KVM_HC_MMU_OP			2
 #define KVM_HC_FEATURES			3
 #define KVM_HC_PPC_MAP_MAGIC_PAGE	4
+#define KVM_HC_VCPU_STATE		5
+
+/*
+ * Per-vcpu area the host keeps up to date for the guest, registered with
+ * KVM_HC_VCPU_STATE.  See Documentation/virtual/kvm/hypercalls.txt.
+ */
+struct kvm_vcpu_state {
+	__u32 preempted;
+	__u32 pad[15];
+};
+
+#define KVM_VCPU_STATE_ENABLED		1
 
 /*
  * hypercalls use architecture specific
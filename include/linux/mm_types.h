@@ -296,6 +296,7 @@ enum {
 	MM_FILEPAGES,
 	MM_ANONPAGES,
 	MM_SWAPENTS,
+	MM_ANONHUGEPAGES,	/* subset of MM_ANONPAGES mapped by huge pmds */
 	NR_MM_COUNTERS
 };
 
@@ -403,6 +404,17 @@ struct mm_struct {
 #endif
 #ifdef CONFIG_CPUMASK_OFFSTACK
 	struct cpumask cpumask_allocation;
+#endif
+#ifdef CONFIG_NUMA_BALANCING
+	/*
+	 * numa_next_scan is the next time in jiffies when the address
+	 * space is scanned for NUMA hinting faults, numa_scan_offset the
+	 * address where that scan starts, and numa_scan_seq counts the
+	 * passes over the whole address space.
+	 */
+	unsigned long numa_next_scan;
+	unsigned long numa_scan_offset;
+	int numa_scan_seq;
 #endif
 	struct uprobes_state uprobes_state;
 };
@@ -130,6 +130,16 @@ int kmem_cache_shrink(struct kmem_cache *);
 void kmem_cache_free(struct kmem_cache *, void *);
 unsigned int kmem_cache_size(struct kmem_cache *);
 
+/*
+ * Bulk allocation and freeing of objects.
+ *
+ * kmem_cache_alloc_bulk() fills @p with @size objects and returns @size,
+ * or allocates nothing and returns 0.  kmem_cache_free_bulk() frees the
+ * @size objects in @p, which may be clobbered in the process.
+ */
+int kmem_cache_alloc_bulk(struct kmem_cache *, gfp_t, size_t, void **);
+void kmem_cache_free_bulk(struct kmem_cache *, size_t, void **);
+
 /*
  * Please use this macro to create slab caches. Simply specify the
  * name of the structure and maybe some flags that are listed above.
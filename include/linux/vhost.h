@@ -27,6 +27,16 @@ struct vhost_vring_file {
 
 };
 
+/* Busy-poll statistics for a virtqueue, see VHOST_GET_VRING_BUSYLOOP_STATS. */
+struct vhost_vring_busyloop_stats {
+	unsigned int index;
+	unsigned int padding;
+	/* Number of times the worker busy-polled an empty ring. */
+	__u64 polls;
+	/* Number of those polls that found new work before timing out. */
+	__u64 hits;
+};
+
 struct vhost_vring_addr {
 	unsigned int index;
 	/* Option flags. */
@@ -113,6 +123,17 @@ struct vhost_memory {
 /* Set eventfd to signal an error */
 #define VHOST_SET_VRING_ERR _IOW(VHOST_VIRTIO, 0x22, struct vhost_vring_file)
 
+/* Busy-poll the ring (and, for net, the backend socket) for up to num
+ * microseconds before re-enabling guest notifications.  0 disables. */
+#define VHOST_SET_VRING_BUSYLOOP_TIMEOUT _IOW(VHOST_VIRTIO, 0x23,	\
+					 struct vhost_vring_state)
+/* Get accessor: reads index, writes value in num */
+#define VHOST_GET_VRING_BUSYLOOP_TIMEOUT _IOWR(VHOST_VIRTIO, 0x24,	\
+					 struct vhost_vring_state)
+/* Read busy-poll counters for the ring given in index. */
+#define VHOST_GET_VRING_BUSYLOOP_STATS _IOWR(VHOST_VIRTIO, 0x25,	\
+					 struct vhost_vring_busyloop_stats)
+
 /* VHOST_NET specific defines */
 
 /* Attach virtio net ring to a raw socket, or tap device.
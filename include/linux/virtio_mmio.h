@@ -83,6 +83,11 @@
 /* Guest's PFN for the currently selected queue - Read Write */
 #define VIRTIO_MMIO_QUEUE_PFN		0x040
 
+/* Interrupt line for the currently selected queue - Write Only
+ * (0 means the shared line, n the device's n-th additional line),
+ * only present if VIRTIO_MMIO_F_QUEUE_IRQ was negotiated */
+#define VIRTIO_MMIO_QUEUE_IRQ		0x044
+
 /* Queue notifier - Write Only */
 #define VIRTIO_MMIO_QUEUE_NOTIFY	0x050
 
@@ -108,4 +113,11 @@
 #define VIRTIO_MMIO_INT_VRING		(1 << 0)
 #define VIRTIO_MMIO_INT_CONFIG		(1 << 1)
 
+/*
+ * Transport feature bits
+ */
+
+/* The device implements the QueueIRQ register */
+#define VIRTIO_MMIO_F_QUEUE_IRQ		31
+
 #endif
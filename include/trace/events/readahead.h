@@ -0,0 +1,52 @@
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM readahead
+
+#if !defined(_TRACE_READAHEAD_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _TRACE_READAHEAD_H
+
+#include <linux/tracepoint.h>
+#include <linux/fs.h>
+
+TRACE_EVENT(readahead,
+
+	TP_PROTO(struct address_space *mapping, struct file_ra_state *ra,
+		 unsigned long actual),
+
+	TP_ARGS(mapping, ra, actual),
+
+	TP_STRUCT__entry(
+		__field(	dev_t,		dev		)
+		__field(	unsigned long,	ino		)
+		__field(	pgoff_t,	start		)
+		__field(	unsigned int,	size		)
+		__field(	unsigned int,	async_size	)
+		__field(	unsigned long,	actual		)
+		__field(	unsigned int,	ra_pages	)
+		__field(	unsigned int,	hits		)
+		__field(	unsigned int,	misses		)
+	),
+
+	TP_fast_assign(
+		__entry->dev		= mapping->host->i_sb->s_dev;
+		__entry->ino		= mapping->host->i_ino;
+		__entry->start		= ra->start;
+		__entry->size		= ra->size;
+		__entry->async_size	= ra->async_size;
+		__entry->actual		= actual;
+		__entry->ra_pages	= ra->ra_pages;
+		__entry->hits		= ra->hits;
+		__entry->misses		= ra->misses;
+	),
+
+	TP_printk("dev=%d:%d ino=%lu start=%lu size=%u async_size=%u "
+		  "actual=%lu ra_pages=%u hits=%u misses=%u",
+		MAJOR(__entry->dev), MINOR(__entry->dev), __entry->ino,
+		__entry->start, __entry->size, __entry->async_size,
+		__entry->actual, __entry->ra_pages,
+		__entry->hits, __entry->misses)
+);
+
+#endif /* _TRACE_READAHEAD_H */
+
+/* This part must be outside protection */
+#include <trace/define_trace.h>
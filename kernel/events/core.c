@@ -36,6 +36,7 @@
 #include <linux/perf_event.h>
 #include <linux/ftrace_event.h>
 #include <linux/hw_breakpoint.h>
+#include <linux/tick.h>
 
 #include "internal.h"
 
@@ -652,8 +653,14 @@ static void perf_pmu_rotate_start(struct pmu *pmu)
 
 	WARN_ON(!irqs_disabled());
 
-	if (list_empty(&cpuctx->rotation_list))
+	if (list_empty(&cpuctx->rotation_list)) {
+		bool was_empty = list_empty(head);
+
 		list_add(&cpuctx->rotation_list, head);
+		/* The tick of a full dynticks cpu must now rotate the events */
+		if (was_empty)
+			tick_nohz_full_kick();
+	}
 }
 
 static void get_ctx(struct perf_event_context *ctx)
@@ -2569,6 +2576,15 @@ void perf_event_task_tick(void)
 	}
 }
 
+/*
+ * The tick rotates and adjusts the events of the contexts on the rotation
+ * list; a full dynticks cpu can only stop it while the list is empty.
+ */
+bool perf_event_can_stop_tick(void)
+{
+	return list_empty(&__get_cpu_var(rotation_list));
+}
+
 static int event_enable_on_exec(struct perf_event *event,
 				struct perf_event_context *ctx)
 {
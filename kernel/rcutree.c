@@ -52,6 +52,7 @@
 #include <linux/prefetch.h>
 #include <linux/delay.h>
 #include <linux/stop_machine.h>
+#include <linux/tick.h>
 
 #include "rcutree.h"
 #include <trace/events/rcu.h>
@@ -62,7 +63,7 @@
 
 static struct lock_class_key rcu_node_class[RCU_NUM_LVLS];
 
-#define RCU_STATE_INITIALIZER(sname, cr) { \
+#define RCU_STATE_INITIALIZER(sname, sabbr, cr) { \
 	.level = { &sname##_state.node[0] }, \
 	.call = cr, \
 	.fqs_state = RCU_GP_IDLE, \
@@ -74,13 +75,14 @@ static struct lock_class_key rcu_node_class[RCU_NUM_LVLS];
 	.barrier_mutex = __MUTEX_INITIALIZER(sname##_state.barrier_mutex), \
 	.fqslock = __RAW_SPIN_LOCK_UNLOCKED(&sname##_state.fqslock), \
 	.name = #sname, \
+	.abbr = sabbr, \
 }
 
 struct rcu_state rcu_sched_state =
-	RCU_STATE_INITIALIZER(rcu_sched, call_rcu_sched);
+	RCU_STATE_INITIALIZER(rcu_sched, 's', call_rcu_sched);
 DEFINE_PER_CPU(struct rcu_data, rcu_sched_data);
 
-struct rcu_state rcu_bh_state = RCU_STATE_INITIALIZER(rcu_bh, call_rcu_bh);
+struct rcu_state rcu_bh_state = RCU_STATE_INITIALIZER(rcu_bh, 'b', call_rcu_bh);
 DEFINE_PER_CPU(struct rcu_data, rcu_bh_data);
 
 static struct rcu_state *rcu_state;
@@ -697,6 +699,12 @@ static int rcu_implicit_dynticks_qs(struct rcu_data *rdp)
 		return 1;
 	}
 
+	/*
+	 * A full dynticks CPU may be running with its tick stopped, kick
+	 * it so that it notices the grace period.
+	 */
+	tick_nohz_full_kick_cpu(rdp->cpu);
+
 	/* Go check for the CPU being offline. */
 	return rcu_implicit_offline_qs(rdp);
 }
@@ -1917,6 +1925,36 @@ static void __call_rcu_core(struct rcu_state *rsp, struct rcu_data *rdp,
 		force_quiescent_state(rsp, 1);
 }
 
+/*
+ * Add an initialized callback to the current CPU's ->nxtlist and do any
+ * core-RCU processing this requires.  Must be called with irqs disabled,
+ * @flags being the irq state saved by the caller.
+ */
+static void __call_rcu_local(struct rcu_state *rsp, struct rcu_data *rdp,
+			     struct rcu_head *head, bool lazy,
+			     unsigned long flags)
+{
+	/* Add the callback to our list. */
+	ACCESS_ONCE(rdp->qlen)++;
+	if (lazy)
+		rdp->qlen_lazy++;
+	else
+		rcu_idle_count_callbacks_posted();
+	smp_mb();  /* Count before adding callback for rcu_barrier(). */
+	*rdp->nxttail[RCU_NEXT_TAIL] = head;
+	rdp->nxttail[RCU_NEXT_TAIL] = &head->next;
+
+	if (__is_kfree_rcu_offset((unsigned long)head->func))
+		trace_rcu_kfree_callback(rsp->name, head,
+					 (unsigned long)head->func,
+					 rdp->qlen_lazy, rdp->qlen);
+	else
+		trace_rcu_callback(rsp->name, head, rdp->qlen_lazy, rdp->qlen);
+
+	/* Go handle any RCU core processing required. */
+	__call_rcu_core(rsp, rdp, head, flags);
+}
+
 static void
 __call_rcu(struct rcu_head *head, void (*func)(struct rcu_head *rcu),
 	   struct rcu_state *rsp, bool lazy)
@@ -1940,24 +1978,31 @@ __call_rcu(struct rcu_head *head, void (*func)(struct rcu_head *rcu),
 	local_irq_save(flags);
 	rdp = this_cpu_ptr(rsp->rda);
 
-	/* Add the callback to our list. */
-	ACCESS_ONCE(rdp->qlen)++;
-	if (lazy)
-		rdp->qlen_lazy++;
-	else
-		rcu_idle_count_callbacks_posted();
-	smp_mb();  /* Count before adding callback for rcu_barrier(). */
-	*rdp->nxttail[RCU_NEXT_TAIL] = head;
-	rdp->nxttail[RCU_NEXT_TAIL] = &head->next;
+	/* Callbacks of offloaded CPUs go to their rcuo kthread instead. */
+	if (!__call_rcu_nocb(rdp, head, lazy))
+		__call_rcu_local(rsp, rdp, head, lazy, flags);
+	local_irq_restore(flags);
+}
 
-	if (__is_kfree_rcu_offset((unsigned long)func))
-		trace_rcu_kfree_callback(rsp->name, head, (unsigned long)func,
-					 rdp->qlen_lazy, rdp->qlen);
-	else
-		trace_rcu_callback(rsp->name, head, rdp->qlen_lazy, rdp->qlen);
+/*
+ * Like __call_rcu(), but queue the callback on the current CPU's ->nxtlist
+ * even on a no-CBs CPU.  This is for the callbacks of rcu_barrier() and
+ * of the rcuo kthreads, which must not wait behind an rcuo kthread.
+ */
+static void call_rcu_local(struct rcu_head *head,
+			   void (*func)(struct rcu_head *rcu),
+			   struct rcu_state *rsp)
+{
+	unsigned long flags;
 
-	/* Go handle any RCU core processing required. */
-	__call_rcu_core(rsp, rdp, head, flags);
+	debug_rcu_head_queue(head);
+	head->func = func;
+	head->next = NULL;
+
+	smp_mb(); /* Ensure RCU update seen before callback registry. */
+
+	local_irq_save(flags);
+	__call_rcu_local(rsp, this_cpu_ptr(rsp->rda), head, false, flags);
 	local_irq_restore(flags);
 }
 
@@ -2278,6 +2323,29 @@ static int rcu_cpu_has_callbacks(int cpu)
 	return 0;
 }
 
+/*
+ * Check whether this CPU needs its scheduling-clock tick for RCU: it
+ * has callbacks, or the current grace period waits on it for a quiescent
+ * state it has not reported yet.  Full dynticks CPUs keep their tick
+ * while this is the case.
+ */
+int rcu_cpu_needs_tick(int cpu)
+{
+	struct rcu_state *rsp;
+	struct rcu_data *rdp;
+
+	for_each_rcu_flavor(rsp) {
+		rdp = per_cpu_ptr(rsp->rda, cpu);
+		if (rdp->nxtlist)
+			return 1;
+		if (rdp->qs_pending && !rdp->passed_quiesce)
+			return 1;
+		if (ACCESS_ONCE(rdp->mynode->gpnum) != rdp->gpnum)
+			return 1;
+	}
+	return 0;
+}
+
 /*
  * Helper function for _rcu_barrier() tracing.  If tracing is disabled,
  * the compiler is expected to optimize this away.
@@ -2316,7 +2384,7 @@ static void rcu_barrier_func(void *type)
 
 	_rcu_barrier_trace(rsp, "IRQ", -1, rsp->n_barrier_done);
 	atomic_inc(&rsp->barrier_cpu_count);
-	rsp->call(&rdp->barrier_head, rcu_barrier_callback);
+	call_rcu_local(&rdp->barrier_head, rcu_barrier_callback, rsp);
 }
 
 /*
@@ -2397,11 +2465,18 @@ static void _rcu_barrier(struct rcu_state *rsp)
 	 * that will tell us when all the preceding callbacks have
 	 * been invoked.  If an offline CPU has callbacks, wait for
 	 * it to either come back online or to finish orphaning those
-	 * callbacks.
+	 * callbacks.  No-CBs CPUs in addition get a callback queued
+	 * directly behind the ones their rcuo kthread has yet to invoke,
+	 * whether they are online or not.
 	 */
 	for_each_possible_cpu(cpu) {
 		preempt_disable();
 		rdp = per_cpu_ptr(rsp->rda, cpu);
+		if (rcu_is_nocb_cpu(cpu)) {
+			_rcu_barrier_trace(rsp, "NoCB", cpu,
+					   rsp->n_barrier_done);
+			rcu_nocb_barrier(rsp, rdp);
+		}
 		if (cpu_is_offline(cpu)) {
 			_rcu_barrier_trace(rsp, "Offline", cpu,
 					   rsp->n_barrier_done);
@@ -2435,7 +2510,7 @@ static void _rcu_barrier(struct rcu_state *rsp)
 	atomic_inc(&rsp->barrier_cpu_count);
 	smp_mb__after_atomic_inc(); /* Ensure atomic_inc() before callback. */
 	rd.rsp = rsp;
-	rsp->call(&rd.barrier_head, rcu_barrier_callback);
+	call_rcu_local(&rd.barrier_head, rcu_barrier_callback, rsp);
 
 	/*
 	 * Now that we have an rcu_barrier_callback() callback on each
@@ -2499,6 +2574,7 @@ rcu_boot_init_percpu_data(int cpu, struct rcu_state *rsp)
 	WARN_ON_ONCE(atomic_read(&rdp->dynticks->dynticks) != 1);
 	rdp->cpu = cpu;
 	rdp->rsp = rsp;
+	rcu_boot_init_nocb_percpu_data(rdp);
 	raw_spin_unlock_irqrestore(&rnp->lock, flags);
 }
 
@@ -79,7 +79,7 @@ static void __init rcu_bootup_announce_oddness(void)
 #ifdef CONFIG_TREE_PREEMPT_RCU
 
 struct rcu_state rcu_preempt_state =
-	RCU_STATE_INITIALIZER(rcu_preempt, call_rcu);
+	RCU_STATE_INITIALIZER(rcu_preempt, 'p', call_rcu);
 DEFINE_PER_CPU(struct rcu_data, rcu_preempt_data);
 static struct rcu_state *rcu_state = &rcu_preempt_state;
 
@@ -2227,3 +2227,274 @@ static void increment_cpu_stall_ticks(void)
 }
 
 #endif /* #else #ifdef CONFIG_RCU_CPU_STALL_INFO */
+
+#ifdef CONFIG_RCU_NOCB_CPU
+
+/*
+ * Offload callback processing from the CPUs listed in rcu_nocbs=.  Such a
+ * CPU no longer queues its callbacks on its ->nxtlist, but on a lockless
+ * list drained by an "rcuo" kthread of its own for each flavor of RCU.
+ * The kthread waits for a grace period and then invokes the callbacks, so
+ * the CPU itself neither runs callback batches from RCU_SOFTIRQ nor has to
+ * keep its tick to push callbacks through grace periods.  It still reports
+ * quiescent states like any other CPU.  The rcuo kthreads are ordinary
+ * tasks, so they can be bound to housekeeping CPUs with taskset or cpusets.
+ */
+static cpumask_var_t rcu_nocb_mask; /* CPUs to have callbacks offloaded. */
+static bool have_rcu_nocb_mask;	    /* Was rcu_nocb_mask allocated? */
+static bool rcu_nocb_poll;	    /* Offload kthreads are to poll. */
+module_param(rcu_nocb_poll, bool, 0444);
+
+/* Parse the boot-time rcu_nocbs= CPU list. */
+static int __init rcu_nocb_setup(char *str)
+{
+	alloc_bootmem_cpumask_var(&rcu_nocb_mask);
+	have_rcu_nocb_mask = true;
+	if (cpulist_parse(str, rcu_nocb_mask) < 0) {
+		printk(KERN_WARNING "RCU: Incorrect rcu_nocbs cpumask\n");
+		cpumask_clear(rcu_nocb_mask);
+	}
+	return 1;
+}
+__setup("rcu_nocbs=", rcu_nocb_setup);
+
+/* Is the specified CPU a no-CBs CPU? */
+static bool rcu_is_nocb_cpu(int cpu)
+{
+	if (have_rcu_nocb_mask)
+		return cpumask_test_cpu(cpu, rcu_nocb_mask);
+	return false;
+}
+
+/*
+ * Enqueue the callbacks from @rhp to @rhtp on the specified CPU's no-CBs
+ * list, which may be done from any CPU.  The counts are bumped before the
+ * callbacks become visible so that rcu_barrier() never misses one.  A
+ * producer finding the list empty is responsible for waking the kthread.
+ */
+static void __call_rcu_nocb_enqueue(struct rcu_data *rdp,
+				    struct rcu_head *rhp,
+				    struct rcu_head **rhtp,
+				    int rhcount, int rhcount_lazy)
+{
+	struct rcu_head **old_rhpp;
+
+	atomic_long_add(rhcount, &rdp->nocb_q_count);
+	atomic_long_add(rhcount_lazy, &rdp->nocb_q_count_lazy);
+	old_rhpp = xchg(&rdp->nocb_tail, rhtp);
+	ACCESS_ONCE(*old_rhpp) = rhp;
+	if (old_rhpp == &rdp->nocb_head && !rcu_nocb_poll)
+		wake_up(&rdp->nocb_wq);
+}
+
+/*
+ * Hand a call_rcu() callback to the rcuo kthread if the current CPU is a
+ * no-CBs CPU.  Returns true if it did, false if the caller still has to
+ * queue the callback normally.
+ */
+static bool __call_rcu_nocb(struct rcu_data *rdp, struct rcu_head *rhp,
+			    bool lazy)
+{
+	if (!rcu_is_nocb_cpu(rdp->cpu))
+		return false;
+	__call_rcu_nocb_enqueue(rdp, rhp, &rhp->next, 1, lazy);
+	if (__is_kfree_rcu_offset((unsigned long)rhp->func))
+		trace_rcu_kfree_callback(rdp->rsp->name, rhp,
+					 (unsigned long)rhp->func,
+					 atomic_long_read(&rdp->nocb_q_count_lazy),
+					 atomic_long_read(&rdp->nocb_q_count));
+	else
+		trace_rcu_callback(rdp->rsp->name, rhp,
+				   atomic_long_read(&rdp->nocb_q_count_lazy),
+				   atomic_long_read(&rdp->nocb_q_count));
+	return true;
+}
+
+/* The no-CBs twin of rcu_barrier_callback(). */
+static void rcu_nocb_barrier_callback(struct rcu_head *rhp)
+{
+	struct rcu_data *rdp;
+
+	rdp = container_of(rhp, struct rcu_data, nocb_barrier_head);
+	rcu_barrier_callback(&rdp->barrier_head);
+}
+
+/*
+ * Queue an rcu_barrier() callback behind whatever the specified no-CBs
+ * CPU has queued or its kthread is invoking, if anything.  The kthread
+ * processes its callbacks in order, so this callback runs last.  Any
+ * callbacks on the CPU's ->nxtlist, such as orphans it adopted, are
+ * covered by the usual rcu_barrier() callback.
+ */
+static void rcu_nocb_barrier(struct rcu_state *rsp, struct rcu_data *rdp)
+{
+	struct rcu_head *rhp = &rdp->nocb_barrier_head;
+
+	if (!atomic_long_read(&rdp->nocb_q_count)) {
+		smp_mb(); /* Read ->nocb_q_count before ->nocb_p_count. */
+		if (!ACCESS_ONCE(rdp->nocb_p_count))
+			return;
+	}
+	atomic_inc(&rsp->barrier_cpu_count);
+	smp_mb__after_atomic_inc(); /* Ensure atomic_inc() before callback. */
+	debug_rcu_head_queue(rhp);
+	rhp->func = rcu_nocb_barrier_callback;
+	rhp->next = NULL;
+	__call_rcu_nocb_enqueue(rdp, rhp, &rhp->next, 1, 0);
+}
+
+/*
+ * Wait for a grace period on behalf of an rcuo kthread.  The callback
+ * goes on the ->nxtlist of whichever CPU the kthread runs on, even a
+ * no-CBs one, as queueing it to some rcuo kthread could end up waiting
+ * on ourselves.  This also holds for orphaned callbacks, which is why
+ * no-CBs CPUs adopt them onto their ->nxtlist.
+ */
+struct rcu_nocb_gp_wait {
+	struct rcu_head head;
+	struct completion done;
+};
+
+static void rcu_nocb_gp_done(struct rcu_head *rhp)
+{
+	struct rcu_nocb_gp_wait *w;
+
+	w = container_of(rhp, struct rcu_nocb_gp_wait, head);
+	complete(&w->done);
+}
+
+static void rcu_nocb_wait_gp(struct rcu_state *rsp)
+{
+	struct rcu_nocb_gp_wait w;
+
+	init_rcu_head_on_stack(&w.head);
+	init_completion(&w.done);
+	call_rcu_local(&w.head, rcu_nocb_gp_done, rsp);
+	wait_for_completion(&w.done);
+	destroy_rcu_head_on_stack(&w.head);
+}
+
+/*
+ * Per-CPU, per-flavor kthread that invokes the callbacks of a no-CBs CPU:
+ * take the whole list, wait for a grace period, invoke, repeat.
+ */
+static int rcu_nocb_kthread(void *arg)
+{
+	struct rcu_data *rdp = arg;
+	struct rcu_head *list, *next, **tail;
+	long c, cl;
+
+	for (;;) {
+		/* Wait for callbacks to be queued. */
+		if (!rcu_nocb_poll)
+			wait_event_interruptible(rdp->nocb_wq,
+						 ACCESS_ONCE(rdp->nocb_head));
+		list = ACCESS_ONCE(rdp->nocb_head);
+		if (!list) {
+			if (rcu_nocb_poll)
+				schedule_timeout_interruptible(1);
+			continue;
+		}
+
+		/*
+		 * Take the list, leaving an empty one behind.  Producers
+		 * that got hold of the old tail still link into our list.
+		 */
+		ACCESS_ONCE(rdp->nocb_head) = NULL;
+		tail = xchg(&rdp->nocb_tail, &rdp->nocb_head);
+
+		/*
+		 * Move the counts over, pending count first, so that
+		 * rcu_barrier() always sees them in at least one place.
+		 */
+		c = atomic_long_read(&rdp->nocb_q_count);
+		cl = atomic_long_read(&rdp->nocb_q_count_lazy);
+		ACCESS_ONCE(rdp->nocb_p_count) += c;
+		ACCESS_ONCE(rdp->nocb_p_count_lazy) += cl;
+		smp_mb(); /* Bump ->nocb_p_count before dropping ->nocb_q_count. */
+		atomic_long_sub(c, &rdp->nocb_q_count);
+		atomic_long_sub(cl, &rdp->nocb_q_count_lazy);
+
+		rcu_nocb_wait_gp(rdp->rsp);
+
+		/* Each pass through the following loop invokes a callback. */
+		trace_rcu_batch_start(rdp->rsp->name, cl, c, -1);
+		c = cl = 0;
+		while (list) {
+			next = list->next;
+			/* Wait for a racing enqueue to link in its callback. */
+			while (next == NULL && &list->next != tail) {
+				schedule_timeout_interruptible(1);
+				next = ACCESS_ONCE(list->next);
+			}
+			debug_rcu_head_unqueue(list);
+			local_bh_disable();
+			if (__rcu_reclaim(rdp->rsp->name, list))
+				cl++;
+			c++;
+			local_bh_enable();
+			list = next;
+		}
+		trace_rcu_batch_end(rdp->rsp->name, c, !!list, 0, 0, 1);
+		ACCESS_ONCE(rdp->nocb_p_count) -= c;
+		ACCESS_ONCE(rdp->nocb_p_count_lazy) -= cl;
+		rdp->n_nocbs_invoked += c;
+	}
+	return 0;
+}
+
+/* Initialize the no-CBs list and wait queue of a CPU at boot. */
+static void __init rcu_boot_init_nocb_percpu_data(struct rcu_data *rdp)
+{
+	rdp->nocb_tail = &rdp->nocb_head;
+	init_waitqueue_head(&rdp->nocb_wq);
+}
+
+/* Create an rcuo kthread for each no-CBs CPU and each flavor of RCU. */
+static int __init rcu_spawn_nocb_kthreads(void)
+{
+	int cpu;
+	struct rcu_data *rdp;
+	struct rcu_state *rsp;
+	struct task_struct *t;
+	char buf[64];
+
+	if (!have_rcu_nocb_mask || cpumask_empty(rcu_nocb_mask))
+		return 0;
+	cpulist_scnprintf(buf, sizeof(buf), rcu_nocb_mask);
+	printk(KERN_INFO "\tOffload RCU callbacks from CPUs: %s.\n", buf);
+	for_each_rcu_flavor(rsp) {
+		for_each_cpu(cpu, rcu_nocb_mask) {
+			rdp = per_cpu_ptr(rsp->rda, cpu);
+			t = kthread_run(rcu_nocb_kthread, rdp,
+					"rcuo%c/%d", rsp->abbr, cpu);
+			BUG_ON(IS_ERR(t));
+			ACCESS_ONCE(rdp->nocb_kthread) = t;
+		}
+	}
+	return 0;
+}
+early_initcall(rcu_spawn_nocb_kthreads);
+
+#else /* #ifdef CONFIG_RCU_NOCB_CPU */
+
+static bool rcu_is_nocb_cpu(int cpu)
+{
+	return false;
+}
+
+static bool __call_rcu_nocb(struct rcu_data *rdp, struct rcu_head *rhp,
+			    bool lazy)
+{
+	return false;
+}
+
+static void rcu_nocb_barrier(struct rcu_state *rsp, struct rcu_data *rdp)
+{
+}
+
+static void __init rcu_boot_init_nocb_percpu_data(struct rcu_data *rdp)
+{
+}
+
+#endif /* #else #ifdef CONFIG_RCU_NOCB_CPU */
@@ -26,6 +26,8 @@
 #include <linux/slab.h>
 #include <linux/profile.h>
 #include <linux/interrupt.h>
+#include <linux/mempolicy.h>
+#include <linux/task_work.h>
 
 #include <trace/events/sched.h>
 
@@ -653,7 +655,6 @@ static u64 sched_vslice(struct cfs_rq *cfs_rq, struct sched_entity *se)
 	return calc_delta_fair(sched_slice(cfs_rq, se), se);
 }
 
-static void update_cfs_load(struct cfs_rq *cfs_rq, int global_update);
 static void update_cfs_shares(struct cfs_rq *cfs_rq);
 
 /*
@@ -675,10 +676,6 @@ __update_curr(struct cfs_rq *cfs_rq, struct sched_entity *curr,
 
 	curr->vruntime += delta_exec_weighted;
 	update_min_vruntime(cfs_rq);
-
-#if defined CONFIG_SMP && defined CONFIG_FAIR_GROUP_SCHED
-	cfs_rq->load_unacc_exec_time += delta_exec;
-#endif
 }
 
 static void update_curr(struct cfs_rq *cfs_rq)
@@ -713,6 +710,34 @@ static void update_curr(struct cfs_rq *cfs_rq)
 	account_cfs_rq_runtime(cfs_rq, delta_exec);
 }
 
+#if defined(CONFIG_FAIR_GROUP_SCHED) && defined(CONFIG_SCHEDSTATS)
+/*
+ * Count a wait or run period of a task in the histograms of its group and
+ * of every group above it.  The counters of a cpu are only updated under
+ * its rq->lock.
+ */
+static void
+account_lat_hist(struct cfs_rq *cfs_rq, struct sched_entity *se, int type,
+		 u64 delta)
+{
+	int cpu = cpu_of(rq_of(cfs_rq));
+	int bucket = min_t(int, ilog2(delta | 1), SCHED_LAT_BUCKETS - 1);
+	struct task_group *tg;
+
+	if (!entity_is_task(se))
+		return;
+
+	for (tg = cfs_rq->tg; tg; tg = tg->parent)
+		per_cpu_ptr(tg->lat_hist, cpu)->count[type][bucket]++;
+}
+#else
+static inline void
+account_lat_hist(struct cfs_rq *cfs_rq, struct sched_entity *se, int type,
+		 u64 delta)
+{
+}
+#endif
+
 static inline void
 update_stats_wait_start(struct cfs_rq *cfs_rq, struct sched_entity *se)
 {
@@ -741,6 +766,8 @@ update_stats_wait_end(struct cfs_rq *cfs_rq, struct sched_entity *se)
 	schedstat_set(se->statistics.wait_sum, se->statistics.wait_sum +
 			rq_of(cfs_rq)->clock - se->statistics.wait_start);
 #ifdef CONFIG_SCHEDSTATS
+	account_lat_hist(cfs_rq, se, SCHED_LAT_WAIT,
+			 rq_of(cfs_rq)->clock - se->statistics.wait_start);
 	if (entity_is_task(se)) {
 		trace_sched_stat_wait(task_of(se),
 			rq_of(cfs_rq)->clock - se->statistics.wait_start);
@@ -772,10 +799,278 @@ update_stats_curr_start(struct cfs_rq *cfs_rq, struct sched_entity *se)
 	se->exec_start = rq_of(cfs_rq)->clock_task;
 }
 
+/*
+ * The current entity stops running - update its stats:
+ */
+static inline void
+update_stats_curr_end(struct cfs_rq *cfs_rq, struct sched_entity *se)
+{
+#ifdef CONFIG_SCHEDSTATS
+	account_lat_hist(cfs_rq, se, SCHED_LAT_SLICE,
+			 se->sum_exec_runtime - se->prev_sum_exec_runtime);
+#endif
+}
+
+#ifdef CONFIG_NUMA_BALANCING
+/*
+ * Automatic NUMA balancing: every so often a slice of the address space
+ * of the running task is made inaccessible by change_prot_numa(), and
+ * the hinting faults taken when the task touches those pages again
+ * tell us which nodes its memory lives on.  The fault path moves
+ * private pages next to the cpu touching them, and the statistics
+ * gathered here give the load balancer a preferred node to keep the
+ * task on.
+ */
+unsigned int sysctl_numa_balancing = 1;
+
+/* Delay before the first scan of a new address space, in ms */
+unsigned int sysctl_numa_balancing_scan_delay = 1000;
+
+/* Bounds on the time between scans of a task's address space, in ms */
+unsigned int sysctl_numa_balancing_scan_period_min = 1000;
+unsigned int sysctl_numa_balancing_scan_period_max = 60000;
+
+/* Amount of address space scanned at a time, in MB */
+unsigned int sysctl_numa_balancing_scan_size = 256;
+
+static void task_numa_placement(struct task_struct *p)
+{
+	int seq = ACCESS_ONCE(p->mm->numa_scan_seq);
+	unsigned long max_faults = 0, local, remote;
+	int max_nid = -1;
+	int nid;
+
+	if (p->numa_scan_seq == seq)
+		return;
+	p->numa_scan_seq = seq;
+
+	if (p->numa_faults) {
+		/* Pick the node with the most faults, and age them all */
+		for_each_online_node(nid) {
+			unsigned long faults = p->numa_faults[nid];
+
+			if (faults > max_faults) {
+				max_faults = faults;
+				max_nid = nid;
+			}
+			p->numa_faults[nid] = faults / 2;
+		}
+		if (max_nid != -1)
+			p->numa_preferred_nid = max_nid;
+	}
+
+	/*
+	 * Scan less often while the faults are mostly local, so that a task
+	 * whose memory is already in the right place is not bothered, and
+	 * more often while they are mostly remote.
+	 */
+	remote = p->numa_faults_locality[0];
+	local = p->numa_faults_locality[1];
+	if (local + remote) {
+		if (local > 3 * remote)
+			p->numa_scan_period = min(p->numa_scan_period * 2,
+					sysctl_numa_balancing_scan_period_max);
+		else if (remote > local)
+			p->numa_scan_period = max(p->numa_scan_period / 2,
+					sysctl_numa_balancing_scan_period_min);
+	}
+	p->numa_faults_locality[0] = 0;
+	p->numa_faults_locality[1] = 0;
+}
+
+/*
+ * Got a NUMA hinting fault on @pages pages which now live on @node.
+ */
+void task_numa_fault(int node, int pages, bool migrated)
+{
+	struct task_struct *p = current;
+	int local = (node == numa_node_id());
+
+	if (!sysctl_numa_balancing)
+		return;
+
+	if (unlikely(!p->numa_faults)) {
+		p->numa_faults = kzalloc(sizeof(*p->numa_faults) * nr_node_ids,
+					 GFP_KERNEL | __GFP_NOWARN);
+		if (!p->numa_faults)
+			return;
+	}
+
+	task_numa_placement(p);
+
+	p->numa_faults[node] += pages;
+	p->numa_faults_locality[local] += pages;
+	if (local)
+		p->numa_faults_local += pages;
+	else
+		p->numa_faults_remote += pages;
+}
+
+void task_numa_free(struct task_struct *p)
+{
+	kfree(p->numa_faults);
+	p->numa_faults = NULL;
+}
+
+/*
+ * The expensive part of NUMA balancing: runs from task_work when the task
+ * returns to user space, and marks the next scan_size MB of its address
+ * space for hinting faults.
+ */
+static void task_numa_work(struct callback_head *work)
+{
+	unsigned long migrate, next_scan, now = jiffies;
+	struct task_struct *p = current;
+	struct mm_struct *mm = p->mm;
+	struct vm_area_struct *vma;
+	unsigned long start, end;
+	long pages;
+
+	WARN_ON_ONCE(p != container_of(work, struct task_struct, numa_work));
+
+	work->next = work; /* protect against double add */
+	/*
+	 * Who cares about NUMA placement when they're dying.
+	 *
+	 * NOTE: make sure not to dereference p->mm before this check,
+	 * exit_task_work() happens _after_ exit_mm() so we could be called
+	 * without p->mm even though we still had it when we enqueued this
+	 * work.
+	 */
+	if (p->flags & PF_EXITING)
+		return;
+
+	/*
+	 * Enforce maximal scan/migration frequency..
+	 */
+	migrate = mm->numa_next_scan;
+	if (time_before(now, migrate))
+		return;
+
+	next_scan = now + msecs_to_jiffies(p->numa_scan_period);
+	if (cmpxchg(&mm->numa_next_scan, migrate, next_scan) != migrate)
+		return;
+
+	task_numa_placement(p);
+
+	pages = sysctl_numa_balancing_scan_size;
+	pages <<= 20 - PAGE_SHIFT; /* MB in pages */
+	if (!pages)
+		return;
+
+	start = mm->numa_scan_offset;
+
+	down_read(&mm->mmap_sem);
+	vma = find_vma(mm, start);
+	if (!vma) {
+		ACCESS_ONCE(mm->numa_scan_seq)++;
+		start = 0;
+		vma = mm->mmap;
+	}
+	for (; vma; vma = vma->vm_next) {
+		if (!vma_migratable(vma) || is_vm_hugetlb_page(vma))
+			continue;
+
+		/* Skip genuine PROT_NONE mappings, they never fault usefully */
+		if (!(vma->vm_flags & (VM_READ|VM_WRITE|VM_EXEC)))
+			continue;
+
+		start = max(start, vma->vm_start);
+		while (start < vma->vm_end) {
+			end = ALIGN(start + (pages << PAGE_SHIFT), PMD_SIZE);
+			end = min(end, vma->vm_end);
+			change_prot_numa(vma, start, end);
+			pages -= (end - start) >> PAGE_SHIFT;
+			start = end;
+			if (pages <= 0)
+				goto out;
+		}
+	}
+
+out:
+	/*
+	 * It is possible to reach the end of the VMA list but the last few
+	 * VMAs are not guaranteed to be vma_migratable. If they are not, we
+	 * would find the !migratable VMA on the next scan but not reset the
+	 * scanner to the start so check it now.
+	 */
+	if (vma)
+		mm->numa_scan_offset = start;
+	else {
+		mm->numa_scan_offset = 0;
+		ACCESS_ONCE(mm->numa_scan_seq)++;
+	}
+	up_read(&mm->mmap_sem);
+}
+
+/*
+ * Drive the periodic memory faults..
+ */
+static void task_tick_numa(struct rq *rq, struct task_struct *curr)
+{
+	struct callback_head *work = &curr->numa_work;
+	u64 period, now;
+
+	/*
+	 * We don't care about NUMA placement if we don't have memory, or
+	 * only have the one node to place it on.  Kernel threads that
+	 * borrowed an mm with use_mm(), like vhost workers, do not own it
+	 * and must not scan it.
+	 */
+	if (!sysctl_numa_balancing || nr_node_ids < 2 ||
+	    !curr->mm || (curr->flags & (PF_EXITING | PF_KTHREAD)) ||
+	    work->next != work)
+		return;
+
+	/*
+	 * Using runtime rather than walltime has the dual advantage that
+	 * we (mostly) drive the selection from busy threads and that the
+	 * task needs to have done some actual work before we bother with
+	 * NUMA placement.
+	 */
+	now = curr->se.sum_exec_runtime;
+	period = (u64)curr->numa_scan_period * NSEC_PER_MSEC;
+
+	if (now - curr->node_stamp > period) {
+		curr->node_stamp = now;
+
+		if (!time_before(jiffies, curr->mm->numa_next_scan)) {
+			init_task_work(work, task_numa_work);
+			task_work_add(curr, work, true);
+		}
+	}
+}
+#else
+static void task_tick_numa(struct rq *rq, struct task_struct *curr)
+{
+}
+#endif /* CONFIG_NUMA_BALANCING */
+
 /**************************************************
  * Scheduling class queueing methods:
  */
 
+#if defined(CONFIG_FAIR_GROUP_SCHED) && defined(CONFIG_SMP)
+/*
+ * Track the cpus a co-scheduled group has entities queued on, so that
+ * cosched_kick_group() does not have to visit every cpu.
+ */
+static inline void cosched_account_enqueue(struct cfs_rq *cfs_rq)
+{
+	if (cfs_rq->tg->cosched)
+		cpumask_set_cpu(cpu_of(rq_of(cfs_rq)), cfs_rq->tg->cosched_cpus);
+}
+
+static inline void cosched_account_dequeue(struct cfs_rq *cfs_rq)
+{
+	if (cfs_rq->tg->cosched)
+		cpumask_clear_cpu(cpu_of(rq_of(cfs_rq)), cfs_rq->tg->cosched_cpus);
+}
+#else
+static inline void cosched_account_enqueue(struct cfs_rq *cfs_rq) { }
+static inline void cosched_account_dequeue(struct cfs_rq *cfs_rq) { }
+#endif
+
 static void
 account_entity_enqueue(struct cfs_rq *cfs_rq, struct sched_entity *se)
 {
@@ -786,6 +1081,8 @@ account_entity_enqueue(struct cfs_rq *cfs_rq, struct sched_entity *se)
 	if (entity_is_task(se))
 		list_add(&se->group_node, &rq_of(cfs_rq)->cfs_tasks);
 #endif
+	if (!cfs_rq->nr_running)
+		cosched_account_enqueue(cfs_rq);
 	cfs_rq->nr_running++;
 }
 
@@ -798,178 +1095,548 @@ account_entity_dequeue(struct cfs_rq *cfs_rq, struct sched_entity *se)
 	if (entity_is_task(se))
 		list_del_init(&se->group_node);
 	cfs_rq->nr_running--;
+	if (!cfs_rq->nr_running)
+		cosched_account_dequeue(cfs_rq);
 }
 
 #ifdef CONFIG_FAIR_GROUP_SCHED
-/* we need this in update_cfs_load and load-balance functions below */
+/* we need this in update_cfs_shares and load-balance functions below */
 static inline int throttled_hierarchy(struct cfs_rq *cfs_rq);
 # ifdef CONFIG_SMP
-static void update_cfs_rq_load_contribution(struct cfs_rq *cfs_rq,
-					    int global_update)
+static inline long calc_tg_weight(struct task_group *tg, struct cfs_rq *cfs_rq)
 {
-	struct task_group *tg = cfs_rq->tg;
-	long load_avg;
+	long tg_weight;
+
+	/*
+	 * Use this CPU's actual weight instead of the last published
+	 * tg_load_contrib to gain a more accurate current total weight. See
+	 * __update_cfs_rq_tg_load_contrib().
+	 */
+	tg_weight = atomic_long_read(&tg->load_avg);
+	tg_weight -= cfs_rq->tg_load_contrib;
+	tg_weight += cfs_rq->load.weight;
 
-	load_avg = div64_u64(cfs_rq->load_avg, cfs_rq->load_period+1);
-	load_avg -= cfs_rq->load_contribution;
+	return tg_weight;
+}
 
-	if (global_update || abs(load_avg) > cfs_rq->load_contribution / 8) {
-		atomic_add(load_avg, &tg->load_weight);
-		cfs_rq->load_contribution += load_avg;
+static long calc_cfs_shares(struct cfs_rq *cfs_rq, struct task_group *tg)
+{
+	long tg_weight, load, shares;
+
+	tg_weight = calc_tg_weight(tg, cfs_rq);
+	load = cfs_rq->load.weight;
+
+	shares = (tg->shares * load);
+	if (tg_weight)
+		shares /= tg_weight;
+
+	if (shares < MIN_SHARES)
+		shares = MIN_SHARES;
+	if (shares > tg->shares)
+		shares = tg->shares;
+
+	return shares;
+}
+# else /* CONFIG_SMP */
+static inline long calc_cfs_shares(struct cfs_rq *cfs_rq, struct task_group *tg)
+{
+	return tg->shares;
+}
+# endif /* CONFIG_SMP */
+static void reweight_entity(struct cfs_rq *cfs_rq, struct sched_entity *se,
+			    unsigned long weight)
+{
+	if (se->on_rq) {
+		/* commit outstanding execution time */
+		if (cfs_rq->curr == se)
+			update_curr(cfs_rq);
+		account_entity_dequeue(cfs_rq, se);
 	}
+
+	update_load_set(&se->load, weight);
+
+	if (se->on_rq)
+		account_entity_enqueue(cfs_rq, se);
 }
 
-static void update_cfs_load(struct cfs_rq *cfs_rq, int global_update)
+static void update_cfs_shares(struct cfs_rq *cfs_rq)
 {
-	u64 period = sysctl_sched_shares_window;
-	u64 now, delta;
-	unsigned long load = cfs_rq->load.weight;
+	struct task_group *tg;
+	struct sched_entity *se;
+	long shares;
 
-	if (cfs_rq->tg == &root_task_group || throttled_hierarchy(cfs_rq))
+	tg = cfs_rq->tg;
+	se = tg->se[cpu_of(rq_of(cfs_rq))];
+	if (!se || throttled_hierarchy(cfs_rq))
+		return;
+#ifndef CONFIG_SMP
+	if (likely(se->load.weight == tg->shares))
 		return;
+#endif
+	shares = calc_cfs_shares(cfs_rq, tg);
+
+	reweight_entity(cfs_rq_of(se), se, shares);
+}
+#else /* CONFIG_FAIR_GROUP_SCHED */
+static inline void update_cfs_shares(struct cfs_rq *cfs_rq)
+{
+}
+#endif /* CONFIG_FAIR_GROUP_SCHED */
+
+#ifdef CONFIG_SMP
+/*
+ * Per-entity load tracking
+ *
+ * The runnable time of an entity is accounted in periods of 1024us, and
+ * the contribution of a period i periods ago is weighted by y^i:
+ *
+ *   load = u_0 + u_1*y + u_2*y^2 + ...
+ *
+ * where u_i is the fraction of period i the entity was runnable.  y is
+ * chosen so that y^32 = 1/2: a period stops mattering after a few hundred
+ * milliseconds, while a short sleep does not make a busy entity look
+ * idle.  Since the series is geometric, the sum can be decayed in place
+ * each time a period boundary is crossed.
+ */
+#define LOAD_AVG_PERIOD 32
+#define LOAD_AVG_MAX 47742 /* maximum possible load avg */
+#define LOAD_AVG_MAX_N 347 /* number of full periods to produce LOAD_AVG_MAX */
+
+/* Precomputed fixed inverse multiplies for multiplication by y^n */
+static const u32 runnable_avg_yN_inv[] = {
+	0xffffffff, 0xfa83b2db, 0xf5257d15, 0xefe4b99b, 0xeac0c6e7, 0xe5b906e7,
+	0xe0ccdeec, 0xdbfbb797, 0xd744fcca, 0xd2a81d91, 0xce248c15, 0xc9b9bd86,
+	0xc5672a11, 0xc12c4cca, 0xbd08a39f, 0xb8fbaf47, 0xb504f333, 0xb123f581,
+	0xad583eea, 0xa9a15ab4, 0xa5fed6a9, 0xa2704303, 0x9ef53260, 0x9b8d39b9,
+	0x9837f051, 0x94f4efa8, 0x91c3d373, 0x8ea4398b, 0x8b95c1e3, 0x88980e80,
+	0x85aac367, 0x82cd8698,
+};
+
+/*
+ * Precomputed \Sum y^k { 1<=k<=n }.  These are floor(true_value) to prevent
+ * over-estimates when re-combining.
+ */
+static const u32 runnable_avg_yN_sum[] = {
+	    0, 1002, 1982, 2941, 3879, 4797, 5696, 6575, 7436, 8278, 9102,
+	 9908,10697,11469,12225,12965,13689,14397,15090,15768,16432,17081,
+	17716,18338,18947,19543,20126,20696,21254,21800,22334,22857,23369,
+};
 
-	now = rq_of(cfs_rq)->clock_task;
-	delta = now - cfs_rq->load_stamp;
+/*
+ * Approximate:
+ *   val * y^n,    where y^32 ~= 0.5 (~1 scheduling period)
+ */
+static __always_inline u64 decay_load(u64 val, u64 n)
+{
+	unsigned int local_n;
+	u32 inv;
+
+	if (!n)
+		return val;
+	else if (unlikely(n > LOAD_AVG_PERIOD * 63))
+		return 0;
 
-	/* truncate load history at 4 idle periods */
-	if (cfs_rq->load_stamp > cfs_rq->load_last &&
-	    now - cfs_rq->load_last > 4 * period) {
-		cfs_rq->load_period = 0;
-		cfs_rq->load_avg = 0;
-		delta = period - 1;
+	/* after bounds checking we can collapse to 32-bit */
+	local_n = n;
+
+	/*
+	 * As y^PERIOD = 1/2, we can combine
+	 *    y^n = 1/2^(n/PERIOD) * y^(n%PERIOD)
+	 * with a look-up table which covers y^n (n<PERIOD), to achieve
+	 * a constant time decay_load().
+	 */
+	if (unlikely(local_n >= LOAD_AVG_PERIOD)) {
+		val >>= local_n / LOAD_AVG_PERIOD;
+		local_n %= LOAD_AVG_PERIOD;
 	}
 
-	cfs_rq->load_stamp = now;
-	cfs_rq->load_unacc_exec_time = 0;
-	cfs_rq->load_period += delta;
-	if (load) {
-		cfs_rq->load_last = now;
-		cfs_rq->load_avg += delta * load;
+	/*
+	 * Load sums of a whole cfs_rq can exceed 32 bits, so multiply the
+	 * two halves separately to keep the product within 64 bits.
+	 */
+	inv = runnable_avg_yN_inv[local_n];
+	return (val >> 32) * inv + (((val & 0xffffffffULL) * inv) >> 32);
+}
+
+/*
+ * For updates fully spanning n periods, the contribution to runnable
+ * average will be: \Sum 1024*y^n
+ *
+ * We can compute this reasonably efficiently by combining:
+ *   y^PERIOD = 1/2 with precomputed \Sum 1024*y^n {for  n <PERIOD}
+ */
+static u32 __compute_runnable_contrib(u64 n)
+{
+	u32 contrib = 0;
+
+	if (likely(n <= LOAD_AVG_PERIOD))
+		return runnable_avg_yN_sum[n];
+	else if (unlikely(n >= LOAD_AVG_MAX_N))
+		return LOAD_AVG_MAX;
+
+	/* Compute \Sum y^n combining precomputed values for y^i, \Sum y^j */
+	do {
+		contrib /= 2; /* y^LOAD_AVG_PERIOD = 1/2 */
+		contrib += runnable_avg_yN_sum[LOAD_AVG_PERIOD];
+
+		n -= LOAD_AVG_PERIOD;
+	} while (n > LOAD_AVG_PERIOD);
+
+	contrib = decay_load(contrib, n);
+	return contrib + runnable_avg_yN_sum[n];
+}
+
+/*
+ * Account the time since the last update of @sa, as runnable time if
+ * @runnable is set, and fold in the decay of every period boundary that
+ * was crossed meanwhile.  Time is measured in units of 1024ns, which is
+ * close enough to a microsecond and cheap to compute.
+ *
+ * Returns non-zero when at least one period boundary was crossed, i.e.
+ * when the averages have changed enough to be worth propagating.
+ */
+static __always_inline int __update_entity_runnable_avg(u64 now,
+							struct sched_avg *sa,
+							int runnable)
+{
+	u64 delta, periods;
+	u32 runnable_contrib;
+	int delta_w, decayed = 0;
+
+	delta = now - sa->last_runnable_update;
+	/*
+	 * This should only happen when time goes backwards, which it
+	 * unfortunately does during sched clock init when we swap over to TSC.
+	 */
+	if ((s64)delta < 0) {
+		sa->last_runnable_update = now;
+		return 0;
 	}
 
-	/* consider updating load contribution on each fold or truncate */
-	if (global_update || cfs_rq->load_period > period
-	    || !cfs_rq->load_period)
-		update_cfs_rq_load_contribution(cfs_rq, global_update);
+	delta >>= 10;
+	if (!delta)
+		return 0;
+	sa->last_runnable_update = now;
+
+	/* delta_w is the amount already accumulated against our next period */
+	delta_w = sa->runnable_avg_period % 1024;
+	if (delta + delta_w >= 1024) {
+		/* period roll-over */
+		decayed = 1;
 
-	while (cfs_rq->load_period > period) {
 		/*
-		 * Inline assembly required to prevent the compiler
-		 * optimising this loop into a divmod call.
-		 * See __iter_div_u64_rem() for another example of this.
+		 * Now that we know we're crossing a period boundary, figure
+		 * out how much from delta we need to complete the current
+		 * period and accrue it.
 		 */
-		asm("" : "+rm" (cfs_rq->load_period));
-		cfs_rq->load_period /= 2;
-		cfs_rq->load_avg /= 2;
+		delta_w = 1024 - delta_w;
+		if (runnable)
+			sa->runnable_avg_sum += delta_w;
+		sa->runnable_avg_period += delta_w;
+
+		delta -= delta_w;
+
+		/* Figure out how many additional periods this update spans */
+		periods = delta / 1024;
+		delta %= 1024;
+
+		sa->runnable_avg_sum = decay_load(sa->runnable_avg_sum,
+						  periods + 1);
+		sa->runnable_avg_period = decay_load(sa->runnable_avg_period,
+						     periods + 1);
+
+		/* Efficiently calculate \sum (1..n_period) 1024*y^i */
+		runnable_contrib = __compute_runnable_contrib(periods);
+		if (runnable)
+			sa->runnable_avg_sum += runnable_contrib;
+		sa->runnable_avg_period += runnable_contrib;
 	}
 
-	if (!cfs_rq->curr && !cfs_rq->nr_running && !cfs_rq->load_avg)
-		list_del_leaf_cfs_rq(cfs_rq);
+	/* Remainder of delta accrued against u_0` */
+	if (runnable)
+		sa->runnable_avg_sum += delta;
+	sa->runnable_avg_period += delta;
+
+	return decayed;
 }
 
-static inline long calc_tg_weight(struct task_group *tg, struct cfs_rq *cfs_rq)
+/* Synchronize an entity's decay with its parenting cfs_rq.*/
+static inline u64 __synchronize_entity_decay(struct sched_entity *se)
 {
-	long tg_weight;
+	struct cfs_rq *cfs_rq = cfs_rq_of(se);
+	u64 decays = atomic64_read(&cfs_rq->decay_counter);
 
-	/*
-	 * Use this CPU's actual weight instead of the last load_contribution
-	 * to gain a more accurate current total weight. See
-	 * update_cfs_rq_load_contribution().
-	 */
-	tg_weight = atomic_read(&tg->load_weight);
-	tg_weight -= cfs_rq->load_contribution;
-	tg_weight += cfs_rq->load.weight;
+	decays -= se->avg.decay_count;
+	if (!decays)
+		return 0;
 
-	return tg_weight;
+	se->avg.load_avg_contrib = decay_load(se->avg.load_avg_contrib, decays);
+	se->avg.decay_count = 0;
+
+	return decays;
 }
 
-static long calc_cfs_shares(struct cfs_rq *cfs_rq, struct task_group *tg)
+#ifdef CONFIG_FAIR_GROUP_SCHED
+/*
+ * Fold this cfs_rq's load into tg->load_avg.  To keep the shared counter
+ * cool, small changes are only published once they exceed 1/8th of what
+ * was published last, or when @force_update is set.
+ */
+static inline void __update_cfs_rq_tg_load_contrib(struct cfs_rq *cfs_rq,
+						   int force_update)
 {
-	long tg_weight, load, shares;
+	struct task_group *tg = cfs_rq->tg;
+	long tg_contrib;
 
-	tg_weight = calc_tg_weight(tg, cfs_rq);
-	load = cfs_rq->load.weight;
+	tg_contrib = cfs_rq->runnable_load_avg + cfs_rq->blocked_load_avg;
+	tg_contrib -= cfs_rq->tg_load_contrib;
 
-	shares = (tg->shares * load);
-	if (tg_weight)
-		shares /= tg_weight;
+	if (force_update || abs(tg_contrib) > cfs_rq->tg_load_contrib / 8) {
+		atomic_long_add(tg_contrib, &tg->load_avg);
+		cfs_rq->tg_load_contrib += tg_contrib;
+	}
+}
 
-	if (shares < MIN_SHARES)
-		shares = MIN_SHARES;
-	if (shares > tg->shares)
-		shares = tg->shares;
+/*
+ * Aggregate cfs_rq runnable averages into an equal-weight, per-cpu
+ * representation of the task_group's cpu usage, for use in
+ * __update_group_entity_contrib().
+ */
+static inline void __update_tg_runnable_avg(struct sched_avg *sa,
+					    struct cfs_rq *cfs_rq)
+{
+	struct task_group *tg = cfs_rq->tg;
+	long contrib;
 
-	return shares;
+	/* The fraction of a cpu used by this cfs_rq */
+	contrib = div_u64((u64)sa->runnable_avg_sum << NICE_0_SHIFT,
+			  sa->runnable_avg_period + 1);
+	contrib -= cfs_rq->tg_runnable_contrib;
+
+	if (abs(contrib) > cfs_rq->tg_runnable_contrib / 64) {
+		atomic_add(contrib, &tg->runnable_avg);
+		cfs_rq->tg_runnable_contrib += contrib;
+	}
 }
 
-static void update_entity_shares_tick(struct cfs_rq *cfs_rq)
+static inline void __update_group_entity_contrib(struct sched_entity *se)
 {
-	if (cfs_rq->load_unacc_exec_time > sysctl_sched_shares_window) {
-		update_cfs_load(cfs_rq, 0);
-		update_cfs_shares(cfs_rq);
+	struct cfs_rq *cfs_rq = group_cfs_rq(se);
+	struct task_group *tg = cfs_rq->tg;
+	int runnable_avg;
+	u64 contrib;
+
+	contrib = (u64)cfs_rq->tg_load_contrib * tg->shares;
+	se->avg.load_avg_contrib = div64_u64(contrib,
+				atomic_long_read(&tg->load_avg) + 1);
+
+	/*
+	 * A group whose tasks together use less than one cpu would, by the
+	 * above, contribute less than a single task of the same weight
+	 * running on its own.  Scale it back by the fraction of a cpu the
+	 * group actually uses.  The sum of the per-cpu fractions is only a
+	 * lower bound of that (runnable periods on different cpus may
+	 * overlap), but it converges quickly as soon as the group is busy.
+	 */
+	runnable_avg = atomic_read(&tg->runnable_avg);
+	if (runnable_avg < NICE_0_LOAD) {
+		se->avg.load_avg_contrib *= runnable_avg;
+		se->avg.load_avg_contrib >>= NICE_0_SHIFT;
 	}
 }
-# else /* CONFIG_SMP */
-static void update_cfs_load(struct cfs_rq *cfs_rq, int global_update)
+#else
+static inline void __update_cfs_rq_tg_load_contrib(struct cfs_rq *cfs_rq,
+						   int force_update) {}
+static inline void __update_tg_runnable_avg(struct sched_avg *sa,
+					    struct cfs_rq *cfs_rq) {}
+static inline void __update_group_entity_contrib(struct sched_entity *se) {}
+#endif /* CONFIG_FAIR_GROUP_SCHED */
+
+static inline void __update_task_entity_contrib(struct sched_entity *se)
 {
+	u32 contrib;
+
+	/* avoid overflowing a 32-bit type w/ SCHED_LOAD_SCALE */
+	contrib = se->avg.runnable_avg_sum * scale_load_down(se->load.weight);
+	contrib /= (se->avg.runnable_avg_period + 1);
+	se->avg.load_avg_contrib = scale_load(contrib);
 }
 
-static inline long calc_cfs_shares(struct cfs_rq *cfs_rq, struct task_group *tg)
+/* Compute the current contribution to load_avg by se, return any delta */
+static long __update_entity_load_avg_contrib(struct sched_entity *se)
 {
-	return tg->shares;
+	long old_contrib = se->avg.load_avg_contrib;
+
+	if (entity_is_task(se)) {
+		__update_task_entity_contrib(se);
+	} else {
+		__update_tg_runnable_avg(&se->avg, group_cfs_rq(se));
+		__update_group_entity_contrib(se);
+	}
+
+	return se->avg.load_avg_contrib - old_contrib;
 }
 
-static inline void update_entity_shares_tick(struct cfs_rq *cfs_rq)
+static inline void subtract_blocked_load_contrib(struct cfs_rq *cfs_rq,
+						 long load_contrib)
 {
+	if (likely(load_contrib < cfs_rq->blocked_load_avg))
+		cfs_rq->blocked_load_avg -= load_contrib;
+	else
+		cfs_rq->blocked_load_avg = 0;
 }
-# endif /* CONFIG_SMP */
-static void reweight_entity(struct cfs_rq *cfs_rq, struct sched_entity *se,
-			    unsigned long weight)
+
+static inline u64 cfs_rq_clock_task(struct cfs_rq *cfs_rq);
+
+/* Update a sched_entity's runnable average */
+static inline void update_entity_load_avg(struct sched_entity *se,
+					  int update_cfs_rq)
 {
-	if (se->on_rq) {
-		/* commit outstanding execution time */
-		if (cfs_rq->curr == se)
-			update_curr(cfs_rq);
-		account_entity_dequeue(cfs_rq, se);
-	}
+	struct cfs_rq *cfs_rq = cfs_rq_of(se);
+	long contrib_delta;
+	u64 now;
+
+	/*
+	 * For a group entity we need to use their owned cfs_rq_clock_task() in
+	 * case they are the parent of a throttled hierarchy.
+	 */
+	if (entity_is_task(se))
+		now = cfs_rq_clock_task(cfs_rq);
+	else
+		now = cfs_rq_clock_task(group_cfs_rq(se));
+
+	if (!__update_entity_runnable_avg(now, &se->avg, se->on_rq))
+		return;
 
-	update_load_set(&se->load, weight);
+	contrib_delta = __update_entity_load_avg_contrib(se);
+
+	if (!update_cfs_rq)
+		return;
 
 	if (se->on_rq)
-		account_entity_enqueue(cfs_rq, se);
+		cfs_rq->runnable_load_avg += contrib_delta;
+	else
+		subtract_blocked_load_contrib(cfs_rq, -contrib_delta);
 }
 
-static void update_cfs_shares(struct cfs_rq *cfs_rq)
+/*
+ * Decay the load contributed by all blocked children and account this so that
+ * their contribution may appropriately discounted when they wake up.
+ */
+static void update_cfs_rq_blocked_load(struct cfs_rq *cfs_rq, int force_update)
 {
-	struct task_group *tg;
-	struct sched_entity *se;
-	long shares;
+	u64 now = cfs_rq_clock_task(cfs_rq) >> 20;
+	u64 decays;
 
-	tg = cfs_rq->tg;
-	se = tg->se[cpu_of(rq_of(cfs_rq))];
-	if (!se || throttled_hierarchy(cfs_rq))
-		return;
-#ifndef CONFIG_SMP
-	if (likely(se->load.weight == tg->shares))
+	decays = now - cfs_rq->last_decay;
+	if (!decays && !force_update)
 		return;
-#endif
-	shares = calc_cfs_shares(cfs_rq, tg);
 
-	reweight_entity(cfs_rq_of(se), se, shares);
+	if (atomic_long_read(&cfs_rq->removed_load)) {
+		long removed_load = atomic_long_xchg(&cfs_rq->removed_load, 0);
+		subtract_blocked_load_contrib(cfs_rq, removed_load);
+	}
+
+	if (decays) {
+		cfs_rq->blocked_load_avg = decay_load(cfs_rq->blocked_load_avg,
+						      decays);
+		atomic64_add(decays, &cfs_rq->decay_counter);
+		cfs_rq->last_decay = now;
+	}
+
+	__update_cfs_rq_tg_load_contrib(cfs_rq, force_update);
 }
-#else /* CONFIG_FAIR_GROUP_SCHED */
-static void update_cfs_load(struct cfs_rq *cfs_rq, int global_update)
+
+/* Add the load generated by se into cfs_rq's child load-average */
+static inline void enqueue_entity_load_avg(struct cfs_rq *cfs_rq,
+					   struct sched_entity *se,
+					   int wakeup)
 {
+	/*
+	 * We track migrations using entity decay_count <= 0, on a wake-up
+	 * migration we use a negative decay count to track the remote decays
+	 * accumulated while sleeping.
+	 */
+	if (unlikely(se->avg.decay_count <= 0)) {
+		se->avg.last_runnable_update = rq_of(cfs_rq)->clock_task;
+		if (se->avg.decay_count) {
+			/*
+			 * In a wake-up migration we have to approximate the
+			 * time sleeping.  This is because we can't synchronize
+			 * clock_task between the two cpus, and it is not
+			 * guaranteed to be read-safe.  Instead, we can
+			 * approximate this using our carried decays, which are
+			 * explicitly atomically readable.
+			 */
+			se->avg.last_runnable_update -= (-se->avg.decay_count)
+							<< 20;
+			update_entity_load_avg(se, 0);
+			/* Indicate that we're now synchronized and on-rq */
+			se->avg.decay_count = 0;
+		}
+		wakeup = 0;
+	} else {
+		__synchronize_entity_decay(se);
+	}
+
+	/* migrated tasks did not contribute to our blocked load */
+	if (wakeup) {
+		subtract_blocked_load_contrib(cfs_rq, se->avg.load_avg_contrib);
+		update_entity_load_avg(se, 0);
+	}
+
+	cfs_rq->runnable_load_avg += se->avg.load_avg_contrib;
+	/* we force update consideration on load-balancer moves */
+	update_cfs_rq_blocked_load(cfs_rq, !wakeup);
 }
 
-static inline void update_cfs_shares(struct cfs_rq *cfs_rq)
+/*
+ * Remove se's load from this cfs_rq child load-average, if the entity is
+ * transitioning to a blocked state we track its projected decay using
+ * blocked_load_avg.
+ */
+static inline void dequeue_entity_load_avg(struct cfs_rq *cfs_rq,
+					   struct sched_entity *se,
+					   int sleep)
 {
+	update_entity_load_avg(se, 1);
+	/* we force update consideration on load-balancer moves */
+	update_cfs_rq_blocked_load(cfs_rq, !sleep);
+
+	cfs_rq->runnable_load_avg -= se->avg.load_avg_contrib;
+	if (sleep) {
+		cfs_rq->blocked_load_avg += se->avg.load_avg_contrib;
+		se->avg.decay_count = atomic64_read(&cfs_rq->decay_counter);
+	} /* migrations, e.g. sleep=0 leave decay_count == 0 */
 }
 
-static inline void update_entity_shares_tick(struct cfs_rq *cfs_rq)
+/*
+ * A new task has no history yet.  Treat it as having been runnable for
+ * one full slice, so that fork balancing and the first wakeups see it
+ * as a task rather than as nothing at all.
+ */
+void init_task_runnable_average(struct task_struct *p)
 {
+	u32 slice;
+
+	p->se.avg.decay_count = 0;
+	slice = sched_slice(task_cfs_rq(p), &p->se) >> 10;
+	p->se.avg.runnable_avg_sum = slice;
+	p->se.avg.runnable_avg_period = slice;
+	__update_task_entity_contrib(&p->se);
 }
-#endif /* CONFIG_FAIR_GROUP_SCHED */
+#else
+static inline void update_entity_load_avg(struct sched_entity *se,
+					  int update_cfs_rq) {}
+static inline void enqueue_entity_load_avg(struct cfs_rq *cfs_rq,
+					   struct sched_entity *se,
+					   int wakeup) {}
+static inline void dequeue_entity_load_avg(struct cfs_rq *cfs_rq,
+					   struct sched_entity *se,
+					   int sleep) {}
+static inline void update_cfs_rq_blocked_load(struct cfs_rq *cfs_rq,
+					      int force_update) {}
+#endif /* CONFIG_SMP */
 
 static void enqueue_sleeper(struct cfs_rq *cfs_rq, struct sched_entity *se)
 {
@@ -1096,7 +1763,7 @@ enqueue_entity(struct cfs_rq *cfs_rq, struct sched_entity *se, int flags)
 	 * Update run-time statistics of the 'current'.
 	 */
 	update_curr(cfs_rq);
-	update_cfs_load(cfs_rq, 0);
+	enqueue_entity_load_avg(cfs_rq, se, flags & ENQUEUE_WAKEUP);
 	account_entity_enqueue(cfs_rq, se);
 	update_cfs_shares(cfs_rq);
 
@@ -1171,6 +1838,7 @@ dequeue_entity(struct cfs_rq *cfs_rq, struct sched_entity *se, int flags)
 	 * Update run-time statistics of the 'current'.
 	 */
 	update_curr(cfs_rq);
+	dequeue_entity_load_avg(cfs_rq, se, flags & DEQUEUE_SLEEP);
 
 	update_stats_dequeue(cfs_rq, se);
 	if (flags & DEQUEUE_SLEEP) {
@@ -1191,7 +1859,6 @@ dequeue_entity(struct cfs_rq *cfs_rq, struct sched_entity *se, int flags)
 	if (se != cfs_rq->curr)
 		__dequeue_entity(cfs_rq, se);
 	se->on_rq = 0;
-	update_cfs_load(cfs_rq, 0);
 	account_entity_dequeue(cfs_rq, se);
 
 	/*
@@ -1332,6 +1999,8 @@ static void put_prev_entity(struct cfs_rq *cfs_rq, struct sched_entity *prev)
 	if (prev->on_rq)
 		update_curr(cfs_rq);
 
+	update_stats_curr_end(cfs_rq, prev);
+
 	/* throttle cfs_rqs exceeding runtime */
 	check_cfs_rq_runtime(cfs_rq);
 
@@ -1340,6 +2009,8 @@ static void put_prev_entity(struct cfs_rq *cfs_rq, struct sched_entity *prev)
 		update_stats_wait_start(cfs_rq, prev);
 		/* Put 'current' back into the tree. */
 		__enqueue_entity(cfs_rq, prev);
+		/* in !on_rq case, update occurred at dequeue */
+		update_entity_load_avg(prev, 1);
 	}
 	cfs_rq->curr = NULL;
 }
@@ -1353,9 +2024,11 @@ entity_tick(struct cfs_rq *cfs_rq, struct sched_entity *curr, int queued)
 	update_curr(cfs_rq);
 
 	/*
-	 * Update share accounting for long-running entities.
+	 * Ensure that runnable average is periodically updated.
 	 */
-	update_entity_shares_tick(cfs_rq);
+	update_entity_load_avg(curr, 1);
+	update_cfs_rq_blocked_load(cfs_rq, 1);
+	update_cfs_shares(cfs_rq);
 
 #ifdef CONFIG_SCHED_HRTICK
 	/*
@@ -1555,6 +2228,15 @@ void account_cfs_rq_runtime(struct cfs_rq *cfs_rq, unsigned long delta_exec)
 	__account_cfs_rq_runtime(cfs_rq, delta_exec);
 }
 
+/* rq->clock_task normalized against any time this cfs_rq has spent throttled */
+static inline u64 cfs_rq_clock_task(struct cfs_rq *cfs_rq)
+{
+	if (unlikely(cfs_rq->throttle_count))
+		return cfs_rq->throttled_clock_task;
+
+	return rq_of(cfs_rq)->clock_task - cfs_rq->throttled_clock_task_time;
+}
+
 static inline int cfs_rq_throttled(struct cfs_rq *cfs_rq)
 {
 	return cfs_bandwidth_used() && cfs_rq->throttled;
@@ -1592,11 +2274,9 @@ static int tg_unthrottle_up(struct task_group *tg, void *data)
 	cfs_rq->throttle_count--;
 #ifdef CONFIG_SMP
 	if (!cfs_rq->throttle_count) {
-		u64 delta = rq->clock_task - cfs_rq->load_stamp;
-
-		/* leaving throttled state, advance shares averaging windows */
-		cfs_rq->load_stamp += delta;
-		cfs_rq->load_last += delta;
+		/* adjust cfs_rq_clock_task() */
+		cfs_rq->throttled_clock_task_time += rq->clock_task -
+					     cfs_rq->throttled_clock_task;
 
 		/* update entity weight now that we are on_rq again */
 		update_cfs_shares(cfs_rq);
@@ -1611,9 +2291,9 @@ static int tg_throttle_down(struct task_group *tg, void *data)
 	struct rq *rq = data;
 	struct cfs_rq *cfs_rq = tg->cfs_rq[cpu_of(rq)];
 
-	/* group is entering throttled state, record last load */
+	/* group is entering throttled state, stop time */
 	if (!cfs_rq->throttle_count)
-		update_cfs_load(cfs_rq, 0);
+		cfs_rq->throttled_clock_task = rq->clock_task;
 	cfs_rq->throttle_count++;
 
 	return 0;
@@ -2079,6 +2759,11 @@ static void check_cfs_rq_runtime(struct cfs_rq *cfs_rq) {}
 static void check_enqueue_throttle(struct cfs_rq *cfs_rq) {}
 static __always_inline void return_cfs_rq_runtime(struct cfs_rq *cfs_rq) {}
 
+static inline u64 cfs_rq_clock_task(struct cfs_rq *cfs_rq)
+{
+	return rq_of(cfs_rq)->clock_task;
+}
+
 static inline int cfs_rq_throttled(struct cfs_rq *cfs_rq)
 {
 	return 0;
@@ -2207,8 +2892,8 @@ enqueue_task_fair(struct rq *rq, struct task_struct *p, int flags)
 		if (cfs_rq_throttled(cfs_rq))
 			break;
 
-		update_cfs_load(cfs_rq, 0);
 		update_cfs_shares(cfs_rq);
+		update_entity_load_avg(se, 1);
 	}
 
 	if (!se)
@@ -2266,8 +2951,8 @@ static void dequeue_task_fair(struct rq *rq, struct task_struct *p, int flags)
 		if (cfs_rq_throttled(cfs_rq))
 			break;
 
-		update_cfs_load(cfs_rq, 0);
 		update_cfs_shares(cfs_rq);
+		update_entity_load_avg(se, 1);
 	}
 
 	if (!se)
@@ -2279,7 +2964,7 @@ static void dequeue_task_fair(struct rq *rq, struct task_struct *p, int flags)
 /* Used instead of source_load when we know the type == 0 */
 static unsigned long weighted_cpuload(const int cpu)
 {
-	return cpu_rq(cpu)->load.weight;
+	return cpu_rq(cpu)->cfs.runnable_load_avg;
 }
 
 /*
@@ -2324,9 +3009,10 @@ static unsigned long cpu_avg_load_per_task(int cpu)
 {
 	struct rq *rq = cpu_rq(cpu);
 	unsigned long nr_running = ACCESS_ONCE(rq->nr_running);
+	unsigned long load_avg = rq->cfs.runnable_load_avg;
 
 	if (nr_running)
-		return rq->load.weight / nr_running;
+		return load_avg / nr_running;
 
 	return 0;
 }
@@ -2353,6 +3039,31 @@ static void task_waking_fair(struct task_struct *p)
 	se->vruntime -= min_vruntime;
 }
 
+/*
+ * Called immediately before a task is migrated to a new cpu; task_cpu(p) and
+ * cfs_rq_of(p) references at time of call are still valid and identify the
+ * previous cpu.  However, the caller only guarantees p->pi_lock is held; no
+ * other assumptions, including the state of rq->lock, should be made.
+ */
+static void
+migrate_task_rq_fair(struct task_struct *p, int next_cpu)
+{
+	struct sched_entity *se = &p->se;
+	struct cfs_rq *cfs_rq = cfs_rq_of(se);
+
+	/*
+	 * Load tracking: accumulate removed load so that it can be processed
+	 * when we next update owning cfs_rq under rq->lock.  Tasks contribute
+	 * to blocked load iff they have a positive decay-count.  It can never
+	 * be negative here since on-rq tasks have decay-count == 0.
+	 */
+	if (se->avg.decay_count) {
+		se->avg.decay_count = -__synchronize_entity_decay(se);
+		atomic_long_add(se->avg.load_avg_contrib,
+				&cfs_rq->removed_load);
+	}
+}
+
 #ifdef CONFIG_FAIR_GROUP_SCHED
 /*
  * effective_load() calculates the load change as seen from the root_task_group
@@ -2629,6 +3340,37 @@ find_idlest_cpu(struct sched_group *group, struct task_struct *p, int this_cpu)
 	return idlest;
 }
 
+/*
+ * Find an idle cpu that shares the cache with @target, using the mask of
+ * idle cpus of the cache domain rather than looking at every cpu.  The
+ * scan starts right after @target and wraps around, so that wakeups aimed
+ * at different cpus do not all pile onto the first idle one.
+ */
+static int select_idle_cpu(struct task_struct *p, struct sched_domain *sd,
+			   int target)
+{
+	struct cpumask *idle_mask = per_cpu(sd_llc_idle_mask, target);
+	int cpu = target, wrapped = 0;
+
+	for (;;) {
+		cpu = cpumask_next_and(cpu, idle_mask, sched_domain_span(sd));
+		if (cpu >= nr_cpu_ids) {
+			if (wrapped++)
+				break;
+			cpu = -1;
+			continue;
+		}
+		if (wrapped && cpu >= target)
+			break;
+
+		/* The mask is set and cleared locklessly, check it */
+		if (cpumask_test_cpu(cpu, tsk_cpus_allowed(p)) && idle_cpu(cpu))
+			return cpu;
+	}
+
+	return -1;
+}
+
 /*
  * Try and locate an idle CPU in the sched_domain.
  */
@@ -2637,6 +3379,7 @@ static int select_idle_sibling(struct task_struct *p, int target)
 	int cpu = smp_processor_id();
 	int prev_cpu = task_cpu(p);
 	struct sched_domain *sd;
+	int idle;
 
 	/*
 	 * If the task is going to be woken-up on this cpu and if it is
@@ -2653,16 +3396,15 @@ static int select_idle_sibling(struct task_struct *p, int target)
 		return prev_cpu;
 
 	/*
-	 * Otherwise, check assigned siblings to find an elegible idle cpu.
+	 * Otherwise, look for an idle cpu sharing the cache with target.
 	 */
 	sd = rcu_dereference(per_cpu(sd_llc, target));
+	if (!sd)
+		return target;
 
-	for_each_lower_domain(sd) {
-		if (!cpumask_test_cpu(sd->idle_buddy, tsk_cpus_allowed(p)))
-			continue;
-		if (idle_cpu(sd->idle_buddy))
-			return sd->idle_buddy;
-	}
+	idle = select_idle_cpu(p, sd, target);
+	if (idle >= 0)
+		return idle;
 
 	return target;
 }
@@ -2957,6 +3699,151 @@ preempt:
 		set_last_buddy(se);
 }
 
+#if defined(CONFIG_FAIR_GROUP_SCHED) && defined(CONFIG_SMP)
+/*
+ * Co-scheduling: the threads of a group with cpu.cosched set, typically
+ * the vcpu threads of a virtual machine, are run at the same time on their
+ * cpus as far as fairness allows.  When the group starts running on a cpu,
+ * the cpus where it has threads waiting are asked to switch to it as well;
+ * when it is preempted on a cpu, the cpus running it are asked to switch
+ * to their other work.
+ *
+ * The requests go through the next and skip buddies and are honoured only
+ * if that is not unfair by more than the wakeup granularity, so the threads
+ * start and stop within about that much of each other rather than in strict
+ * lockstep.  A cpu that switched on request does not pass the request on.
+ */
+atomic_t sched_cosched_groups;
+
+/* The closest group of @p, or one of its parents, that has cosched set */
+static struct task_group *cosched_group(struct task_struct *p)
+{
+	struct task_group *tg;
+
+	for (tg = task_group(p); tg; tg = tg->parent) {
+		if (tg->cosched)
+			return tg;
+	}
+	return NULL;
+}
+
+static void cosched_kick_cpu(struct task_group *tg, int cpu, bool start)
+{
+	struct cfs_rq *cfs_rq = tg->cfs_rq[cpu];
+	struct sched_entity *se = tg->se[cpu], *curr_se;
+	struct rq *rq = cpu_rq(cpu);
+
+	/* Racy, but saves taking the lock of every cpu */
+	if (start ? (!cfs_rq->h_nr_running || cfs_rq->curr) : !cfs_rq->curr)
+		return;
+
+	/* We hold our own rq->lock, so never wait for another one */
+	if (!raw_spin_trylock(&rq->lock))
+		return;
+
+	if (rq->curr->sched_class != &fair_sched_class ||
+	    test_tsk_need_resched(rq->curr))
+		goto unlock;
+
+	if (start) {
+		if (cfs_rq->curr || !se->on_rq || throttled_hierarchy(cfs_rq))
+			goto unlock;
+
+		curr_se = &rq->curr->se;
+		find_matching_se(&curr_se, &se);
+		if (wakeup_preempt_entity(se, curr_se) == 1)
+			goto unlock;
+
+		set_next_buddy(tg->se[cpu]);
+	} else {
+		/* Nothing else to run there */
+		if (!cfs_rq->curr || rq->cfs.h_nr_running <= cfs_rq->h_nr_running)
+			goto unlock;
+
+		set_skip_buddy(se);
+	}
+	cfs_rq->cosched_kicked = 1;
+	resched_task(rq->curr);
+unlock:
+	raw_spin_unlock(&rq->lock);
+}
+
+static void cosched_kick_group(struct rq *rq, struct task_group *tg, bool start)
+{
+	struct cfs_rq *cfs_rq = tg->cfs_rq[cpu_of(rq)];
+	int cpu;
+
+	if (cfs_rq->cosched_kicked) {
+		cfs_rq->cosched_kicked = 0;
+		return;
+	}
+
+	/* Only the cpus where the group has something queued */
+	for_each_cpu_and(cpu, tg->cosched_cpus, cpu_active_mask) {
+		if (cpu != cpu_of(rq))
+			cosched_kick_cpu(tg, cpu, start);
+	}
+}
+
+/*
+ * Called with rq->curr still being the previous task, once @next has been
+ * picked to replace it.
+ */
+static void cosched_switch(struct rq *rq, struct task_struct *next)
+{
+	struct task_struct *prev = rq->curr;
+	struct task_group *prev_tg = NULL, *next_tg;
+
+	if (!atomic_read(&sched_cosched_groups))
+		return;
+
+	if (prev->sched_class == &fair_sched_class)
+		prev_tg = cosched_group(prev);
+	next_tg = cosched_group(next);
+	if (prev_tg == next_tg)
+		return;
+
+	/* Preempted rather than gone to sleep, stop the others as well */
+	if (prev_tg) {
+		if (prev->on_rq)
+			cosched_kick_group(rq, prev_tg, false);
+		else
+			prev_tg->cfs_rq[cpu_of(rq)]->cosched_kicked = 0;
+	}
+	if (next_tg)
+		cosched_kick_group(rq, next_tg, true);
+}
+
+/*
+ * Ask @rq, the runqueue of @p, to switch to @p if @p is a waiting member
+ * of a co-scheduled group.  Called with @p's rq->lock held, from another
+ * cpu.
+ */
+bool cosched_kick_task(struct rq *rq, struct task_struct *p)
+{
+	struct sched_entity *se = &p->se, *curr_se;
+
+	if (!p->on_rq || p->sched_class != &fair_sched_class ||
+	    task_current(rq, p) || !cosched_group(p))
+		return false;
+
+	if (rq->curr->sched_class != &fair_sched_class ||
+	    throttled_hierarchy(cfs_rq_of(se)))
+		return false;
+
+	curr_se = &rq->curr->se;
+	find_matching_se(&curr_se, &se);
+	if (wakeup_preempt_entity(se, curr_se) == 1)
+		return false;
+
+	set_next_buddy(&p->se);
+	resched_task(rq->curr);
+	return true;
+}
+#else
+static inline void cosched_switch(struct rq *rq, struct task_struct *next) { }
+#endif
+
 static struct task_struct *pick_next_task_fair(struct rq *rq)
 {
 	struct task_struct *p;
@@ -2976,6 +3863,8 @@ static struct task_struct *pick_next_task_fair(struct rq *rq)
 	if (hrtick_enabled(rq))
 		hrtick_start_fair(rq, p);
 
+	cosched_switch(rq, p);
+
 	return p;
 }
 
@@ -3123,6 +4012,38 @@ task_hot(struct task_struct *p, u64 now, struct sched_domain *sd)
 	return delta < (s64)sysctl_sched_migration_cost;
 }
 
+#ifdef CONFIG_NUMA_BALANCING
+/*
+ * Returns 1 if moving p from src_cpu to dst_cpu brings it to the node
+ * most of its NUMA hinting faults were on, -1 if it takes p away from
+ * that node, and 0 if it makes no difference.
+ */
+static int migrate_numa_locality(struct task_struct *p, struct lb_env *env)
+{
+	int src_nid, dst_nid;
+
+	if (!sched_feat(NUMA_LOCALITY) || p->numa_preferred_nid < 0)
+		return 0;
+
+	src_nid = cpu_to_node(env->src_cpu);
+	dst_nid = cpu_to_node(env->dst_cpu);
+	if (src_nid == dst_nid)
+		return 0;
+
+	if (dst_nid == p->numa_preferred_nid)
+		return 1;
+	if (src_nid == p->numa_preferred_nid)
+		return -1;
+	return 0;
+}
+#else
+static inline int migrate_numa_locality(struct task_struct *p,
+					struct lb_env *env)
+{
+	return 0;
+}
+#endif
+
 /*
  * can_migrate_task - may task p from runqueue rq be migrated to this_cpu?
  */
@@ -3130,6 +4051,7 @@ static
 int can_migrate_task(struct task_struct *p, struct lb_env *env)
 {
 	int tsk_cache_hot = 0;
+	int locality;
 	/*
 	 * We do not migrate tasks that are:
 	 * 1) running (obviously), or
@@ -3176,6 +4098,17 @@ int can_migrate_task(struct task_struct *p, struct lb_env *env)
 	 */
 
 	tsk_cache_hot = task_hot(p, env->src_rq->clock_task, env->sd);
+
+	/*
+	 * A task is better off on the node holding its memory: moving it
+	 * there is worth losing its cache, moving it away is not.
+	 */
+	locality = migrate_numa_locality(p, env);
+	if (locality > 0)
+		tsk_cache_hot = 0;
+	else if (locality < 0)
+		tsk_cache_hot = 1;
+
 	if (!tsk_cache_hot ||
 		env->sd->nr_balance_failed > env->sd->cache_nice_tries) {
 #ifdef CONFIG_SCHEDSTATS
@@ -3312,10 +4245,12 @@ next:
 
 #ifdef CONFIG_FAIR_GROUP_SCHED
 /*
- * update tg->load_weight by folding this cpu's load_avg
+ * update tg->load_avg by decaying this cpu's blocked load and folding it,
+ * together with the group entity's own average, into the hierarchy
  */
 static int update_shares_cpu(struct task_group *tg, int cpu)
 {
+	struct sched_entity *se;
 	struct cfs_rq *cfs_rq;
 	unsigned long flags;
 	struct rq *rq;
@@ -3324,19 +4259,30 @@ static int update_shares_cpu(struct task_group *tg, int cpu)
 		return 0;
 
 	rq = cpu_rq(cpu);
+	se = tg->se[cpu];
 	cfs_rq = tg->cfs_rq[cpu];
 
 	raw_spin_lock_irqsave(&rq->lock, flags);
 
 	update_rq_clock(rq);
-	update_cfs_load(cfs_rq, 1);
+	update_cfs_rq_blocked_load(cfs_rq, 1);
+	update_entity_load_avg(se, 1);
 
 	/*
-	 * We need to update shares after updating tg->load_weight in
+	 * We need to update shares after updating tg->load_avg in
 	 * order to adjust the weight of groups with long running tasks.
 	 */
 	update_cfs_shares(cfs_rq);
 
+	/*
+	 * We pivot on our runnable average having decayed to zero for list
+	 * removal.  This generally implies that all our children have also
+	 * been removed (modulo rounding error or bandwidth control); such
+	 * cases are rare and fixed up when the cfs_rq is next enqueued.
+	 */
+	if (!se->avg.runnable_avg_sum && !cfs_rq->nr_running)
+		list_del_leaf_cfs_rq(cfs_rq);
+
 	raw_spin_unlock_irqrestore(&rq->lock, flags);
 
 	return 0;
@@ -3373,11 +4319,11 @@ static int tg_load_down(struct task_group *tg, void *data)
 	long cpu = (long)data;
 
 	if (!tg->parent) {
-		load = cpu_rq(cpu)->load.weight;
+		load = cpu_rq(cpu)->cfs.runnable_load_avg;
 	} else {
 		load = tg->parent->cfs_rq[cpu]->h_load;
-		load *= tg->se[cpu]->load.weight;
-		load /= tg->parent->cfs_rq[cpu]->load.weight + 1;
+		load *= tg->se[cpu]->avg.load_avg_contrib;
+		load /= tg->parent->cfs_rq[cpu]->runnable_load_avg + 1;
 	}
 
 	tg->cfs_rq[cpu]->h_load = load;
@@ -3405,8 +4351,9 @@ static unsigned long task_h_load(struct task_struct *p)
 	struct cfs_rq *cfs_rq = task_cfs_rq(p);
 	unsigned long load;
 
-	load = p->se.load.weight;
-	load = div_u64(load * cfs_rq->h_load, cfs_rq->load.weight + 1);
+	load = p->se.avg.load_avg_contrib;
+	load = div_u64((u64)load * cfs_rq->h_load,
+		       cfs_rq->runnable_load_avg + 1);
 
 	return load;
 }
@@ -3421,7 +4368,7 @@ static inline void update_h_load(long cpu)
 
 static unsigned long task_h_load(struct task_struct *p)
 {
-	return p->se.load.weight;
+	return p->se.avg.load_avg_contrib;
 }
 #endif
 
@@ -4468,11 +5415,15 @@ void idle_balance(int this_cpu, struct rq *this_rq)
 	struct sched_domain *sd;
 	int pulled_task = 0;
 	unsigned long next_balance = jiffies + HZ;
+	u64 curr_cost = 0;
 
 	this_rq->idle_stamp = this_rq->clock;
 
-	if (this_rq->avg_idle < sysctl_sched_migration_cost)
+	if (this_rq->avg_idle < sysctl_sched_migration_cost) {
+		schedstat_inc(this_rq, nib_skipped);
 		return;
+	}
+	schedstat_inc(this_rq, nib_count);
 
 	/*
 	 * Drop the rq->lock, but keep IRQ/preempt disabled.
@@ -4484,14 +5435,33 @@ void idle_balance(int this_cpu, struct rq *this_rq)
 	for_each_domain(this_cpu, sd) {
 		unsigned long interval;
 		int balance = 1;
+		u64 t0, domain_cost;
 
 		if (!(sd->flags & SD_LOAD_BALANCE))
 			continue;
 
+		/*
+		 * Balancing this domain as well would likely take longer
+		 * than we are going to be idle; stop here, the outer
+		 * domains are only more expensive.
+		 */
+		if (this_rq->avg_idle < curr_cost + sd->max_newidle_lb_cost) {
+			schedstat_inc(sd, lb_newidle_skipped);
+			break;
+		}
+
 		if (sd->flags & SD_BALANCE_NEWIDLE) {
+			t0 = sched_clock_cpu(this_cpu);
+
 			/* If we've pulled tasks over stop searching: */
 			pulled_task = load_balance(this_cpu, this_rq,
 						   sd, CPU_NEWLY_IDLE, &balance);
+
+			domain_cost = sched_clock_cpu(this_cpu) - t0;
+			if (domain_cost > sd->max_newidle_lb_cost)
+				sd->max_newidle_lb_cost = domain_cost;
+
+			curr_cost += domain_cost;
 		}
 
 		interval = msecs_to_jiffies(sd->balance_interval);
@@ -4513,6 +5483,9 @@ void idle_balance(int this_cpu, struct rq *this_rq)
 		 */
 		this_rq->next_balance = next_balance;
 	}
+
+	if (curr_cost > this_rq->max_idle_balance_cost)
+		this_rq->max_idle_balance_cost = curr_cost;
 }
 
 /*
@@ -4737,15 +5710,36 @@ static void rebalance_domains(int cpu, enum cpu_idle_type idle)
 	/* Earliest time when we have to do rebalance again */
 	unsigned long next_balance = jiffies + 60*HZ;
 	int update_next_balance = 0;
-	int need_serialize;
+	int need_serialize, need_decay = 0;
+	u64 max_cost = 0;
 
 	update_shares(cpu);
 
 	rcu_read_lock();
 	for_each_domain(cpu, sd) {
+		/*
+		 * Decay the newidle max times here because this is a regular
+		 * visit to all the domains. Decay ~1% per second.
+		 */
+		if (time_after(jiffies, sd->next_decay_max_lb_cost)) {
+			sd->max_newidle_lb_cost =
+				(sd->max_newidle_lb_cost * 253) / 256;
+			sd->next_decay_max_lb_cost = jiffies + HZ;
+			need_decay = 1;
+		}
+		max_cost += sd->max_newidle_lb_cost;
+
 		if (!(sd->flags & SD_LOAD_BALANCE))
 			continue;
 
+		/*
+		 * Stop the load balance at this level. There is another
+		 * CPU in our sched group which is doing load balancing more
+		 * actively.  Keep walking the domains for the decay above.
+		 */
+		if (!balance)
+			continue;
+
 		interval = sd->balance_interval;
 		if (idle != CPU_IDLE)
 			interval *= sd->busy_factor;
@@ -4778,14 +5772,14 @@ out:
 			next_balance = sd->last_balance + interval;
 			update_next_balance = 1;
 		}
-
+	}
+	if (need_decay) {
 		/*
-		 * Stop the load balance at this level. There is another
-		 * CPU in our sched group which is doing load balancing more
-		 * actively.
+		 * Ensure the rq-wide value also decays but keep it at a
+		 * reasonable floor to avoid funnies with rq->avg_idle.
 		 */
-		if (!balance)
-			break;
+		rq->max_idle_balance_cost =
+			max((u64)sysctl_sched_migration_cost, max_cost);
 	}
 	rcu_read_unlock();
 
@@ -4972,6 +5966,8 @@ static void task_tick_fair(struct rq *rq, struct task_struct *curr, int queued)
 		cfs_rq = cfs_rq_of(se);
 		entity_tick(cfs_rq, se, queued);
 	}
+
+	task_tick_numa(rq, curr);
 }
 
 /*
@@ -5064,6 +6060,19 @@ static void switched_from_fair(struct rq *rq, struct task_struct *p)
 		place_entity(cfs_rq, se, 0);
 		se->vruntime -= cfs_rq->min_vruntime;
 	}
+
+#ifdef CONFIG_SMP
+	/*
+	 * Remove our load from contribution when we leave sched_fair
+	 * and ensure we don't carry in an old decay_count if we
+	 * switch back.
+	 */
+	if (se->avg.decay_count > 0) {
+		__synchronize_entity_decay(se);
+		subtract_blocked_load_contrib(cfs_rq, se->avg.load_avg_contrib);
+		se->avg.decay_count = 0;
+	}
+#endif
 }
 
 /*
@@ -5110,6 +6119,10 @@ void init_cfs_rq(struct cfs_rq *cfs_rq)
 #ifndef CONFIG_64BIT
 	cfs_rq->min_vruntime_copy = cfs_rq->min_vruntime;
 #endif
+#ifdef CONFIG_SMP
+	atomic64_set(&cfs_rq->decay_counter, 1);
+	atomic_long_set(&cfs_rq->removed_load, 0);
+#endif
 }
 
 #ifdef CONFIG_FAIR_GROUP_SCHED
@@ -5140,14 +6153,36 @@ static void task_move_group_fair(struct task_struct *p, int on_rq)
 	 * To prevent boost or penalty in the new cfs_rq caused by delta
 	 * min_vruntime between the two cfs_rqs, we skip vruntime adjustment.
 	 */
-	if (!on_rq && (!p->se.sum_exec_runtime || p->state == TASK_WAKING))
+	struct sched_entity *se = &p->se;
+	struct cfs_rq *cfs_rq;
+#ifdef CONFIG_SMP
+	int blocked = 0;
+#endif
+
+	if (!on_rq && (!se->sum_exec_runtime || p->state == TASK_WAKING))
 		on_rq = 1;
 
+#ifdef CONFIG_SMP
+	/* a sleeping task takes its blocked load along to the new group */
+	if (!se->on_rq && se->avg.decay_count > 0) {
+		cfs_rq = cfs_rq_of(se);
+		__synchronize_entity_decay(se);
+		subtract_blocked_load_contrib(cfs_rq, se->avg.load_avg_contrib);
+		blocked = 1;
+	}
+#endif
 	if (!on_rq)
-		p->se.vruntime -= cfs_rq_of(&p->se)->min_vruntime;
+		se->vruntime -= cfs_rq_of(se)->min_vruntime;
 	set_task_rq(p, task_cpu(p));
+	cfs_rq = cfs_rq_of(se);
 	if (!on_rq)
-		p->se.vruntime += cfs_rq_of(&p->se)->min_vruntime;
+		se->vruntime += cfs_rq->min_vruntime;
+#ifdef CONFIG_SMP
+	if (blocked) {
+		se->avg.decay_count = atomic64_read(&cfs_rq->decay_counter);
+		cfs_rq->blocked_load_avg += se->avg.load_avg_contrib;
+	}
+#endif
 }
 
 void free_fair_sched_group(struct task_group *tg)
@@ -5156,6 +6191,11 @@ void free_fair_sched_group(struct task_group *tg)
 
 	destroy_cfs_bandwidth(tg_cfs_bandwidth(tg));
 
+#ifdef CONFIG_SMP
+	if (tg->cosched)
+		atomic_dec(&sched_cosched_groups);
+#endif
+
 	for_each_possible_cpu(i) {
 		if (tg->cfs_rq)
 			kfree(tg->cfs_rq[i]);
@@ -5165,6 +6205,10 @@ void free_fair_sched_group(struct task_group *tg)
 
 	kfree(tg->cfs_rq);
 	kfree(tg->se);
+	free_cpumask_var(tg->cosched_cpus);
+#ifdef CONFIG_SCHEDSTATS
+	free_percpu(tg->lat_hist);
+#endif
 }
 
 int alloc_fair_sched_group(struct task_group *tg, struct task_group *parent)
@@ -5179,6 +6223,13 @@ int alloc_fair_sched_group(struct task_group *tg, struct task_group *parent)
 	tg->se = kzalloc(sizeof(se) * nr_cpu_ids, GFP_KERNEL);
 	if (!tg->se)
 		goto err;
+	if (!zalloc_cpumask_var(&tg->cosched_cpus, GFP_KERNEL))
+		goto err;
+#ifdef CONFIG_SCHEDSTATS
+	tg->lat_hist = alloc_percpu(struct sched_lat_hist);
+	if (!tg->lat_hist)
+		goto err;
+#endif
 
 	tg->shares = NICE_0_LOAD;
 
@@ -5232,10 +6283,6 @@ void init_tg_cfs_entry(struct task_group *tg, struct cfs_rq *cfs_rq,
 
 	cfs_rq->tg = tg;
 	cfs_rq->rq = rq;
-#ifdef CONFIG_SMP
-	/* allow initial update_cfs_load() to truncate */
-	cfs_rq->load_stamp = 1;
-#endif
 	init_cfs_rq_runtime(cfs_rq);
 
 	tg->cfs_rq[cpu] = cfs_rq;
@@ -5291,6 +6338,43 @@ done:
 	mutex_unlock(&shares_mutex);
 	return 0;
 }
+
+static DEFINE_MUTEX(cosched_mutex);
+
+int sched_group_set_cosched(struct task_group *tg, int cosched)
+{
+	/*
+	 * The root group holds every task, there is nothing to gang.
+	 */
+	if (!tg->se[0])
+		return -EINVAL;
+
+	mutex_lock(&cosched_mutex);
+	if (tg->cosched != cosched) {
+		tg->cosched = cosched;
+#ifdef CONFIG_SMP
+		if (cosched) {
+			int cpu;
+
+			/*
+			 * Enqueues record their cpu from now on; pick up the
+			 * cpus where the group already has entities queued.
+			 */
+			smp_mb();
+			for_each_possible_cpu(cpu) {
+				if (tg->cfs_rq[cpu]->nr_running)
+					cpumask_set_cpu(cpu, tg->cosched_cpus);
+			}
+			atomic_inc(&sched_cosched_groups);
+		} else {
+			atomic_dec(&sched_cosched_groups);
+			cpumask_clear(tg->cosched_cpus);
+		}
+#endif
+	}
+	mutex_unlock(&cosched_mutex);
+	return 0;
+}
 #else /* CONFIG_FAIR_GROUP_SCHED */
 
 void free_fair_sched_group(struct task_group *tg) { }
@@ -5341,6 +6425,8 @@ const struct sched_class fair_sched_class = {
 	.rq_online		= rq_online_fair,
 	.rq_offline		= rq_offline_fair,
 
+	.migrate_task_rq	= migrate_task_rq_fair,
+
 	.task_waking		= task_waking_fair,
 #endif
 
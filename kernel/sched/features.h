@@ -69,3 +69,11 @@ SCHED_FEAT(TTWU_QUEUE, true)
 SCHED_FEAT(FORCE_SD_OVERLAP, false)
 SCHED_FEAT(RT_RUNTIME_SHARE, true)
 SCHED_FEAT(LB_MIN, false)
+
+/*
+ * Prefer to keep tasks on, and move them to, the node most of their
+ * NUMA hinting faults were on, over the cache hotness of the task.
+ */
+#ifdef CONFIG_NUMA_BALANCING
+SCHED_FEAT(NUMA_LOCALITY, true)
+#endif
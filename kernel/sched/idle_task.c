@@ -25,6 +25,10 @@ static void check_preempt_curr_idle(struct rq *rq, struct task_struct *p, int fl
 static struct task_struct *pick_next_task_idle(struct rq *rq)
 {
 	schedstat_inc(rq, sched_goidle);
+#ifdef CONFIG_SMP
+	/* Let select_idle_sibling() find us */
+	cpumask_set_cpu(cpu_of(rq), per_cpu(sd_llc_idle_mask, cpu_of(rq)));
+#endif
 	return rq->idle;
 }
 
@@ -43,6 +47,9 @@ dequeue_task_idle(struct rq *rq, struct task_struct *p, int flags)
 
 static void put_prev_task_idle(struct rq *rq, struct task_struct *prev)
 {
+#ifdef CONFIG_SMP
+	cpumask_clear_cpu(cpu_of(rq), per_cpu(sd_llc_idle_mask, cpu_of(rq)));
+#endif
 }
 
 static void task_tick_idle(struct rq *rq, struct task_struct *curr, int queued)
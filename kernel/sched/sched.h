@@ -3,6 +3,7 @@
 #include <linux/mutex.h>
 #include <linux/spinlock.h>
 #include <linux/stop_machine.h>
+#include <linux/tick.h>
 
 #include "cpupri.h"
 
@@ -43,6 +44,12 @@ extern __read_mostly int scheduler_running;
  */
 #define RUNTIME_INF	((u64)~0ULL)
 
+/*
+ * Scaling applied to -deadline time values where their products must
+ * not overflow a u64; it reduces their granularity to about 1us.
+ */
+#define DL_SCALE	10
+
 static inline int rt_policy(int policy)
 {
 	if (policy == SCHED_FIFO || policy == SCHED_RR)
@@ -50,11 +57,35 @@ static inline int rt_policy(int policy)
 	return 0;
 }
 
+static inline int dl_policy(int policy)
+{
+	return policy == SCHED_DEADLINE;
+}
+
 static inline int task_has_rt_policy(struct task_struct *p)
 {
 	return rt_policy(p->policy);
 }
 
+static inline int task_has_dl_policy(struct task_struct *p)
+{
+	return dl_policy(p->policy);
+}
+
+static inline bool dl_time_before(u64 a, u64 b)
+{
+	return (s64)(a - b) < 0;
+}
+
+/*
+ * Tells if entity @a should preempt entity @b.
+ */
+static inline bool
+dl_entity_preempt(struct sched_dl_entity *a, struct sched_dl_entity *b)
+{
+	return dl_time_before(a->deadline, b->deadline);
+}
+
 /*
  * This is the priority-queue data structure of the RT scheduling class:
  */
@@ -71,6 +102,31 @@ struct rt_bandwidth {
 	struct hrtimer		rt_period_timer;
 };
 
+/*
+ * To keep the bandwidth of -deadline tasks under control we need some
+ * place where:
+ *  - store the maximum -deadline bandwidth of the system (the group);
+ *  - cache the fraction of that bandwidth that is currently allocated.
+ *
+ * This is all done in the data structure below. It is similar to the
+ * one used for RT-throttling (rt_bandwidth), with the main difference
+ * that, since here we are only interested in admission control, we
+ * do not decrease any runtime while the group "executes", neither we
+ * need a timer to replenish it.
+ *
+ * With respect to SMP, the bandwidth is given on a per-CPU basis,
+ * meaning that:
+ *  - dl_bw (< 100%) is the bandwidth of the system (group) on each CPU;
+ *  - total_bw is the currently allocated bandwidth in each root domain.
+ *
+ * The maximum bandwidth is not stored here, it follows the
+ * sched_rt_runtime_us/sched_rt_period_us sysctls (see dl_bw_limit()).
+ */
+struct dl_bw {
+	raw_spinlock_t lock;
+	u64 total_bw;
+};
+
 extern struct mutex sched_domains_mutex;
 
 #ifdef CONFIG_CGROUP_SCHED
@@ -100,6 +156,24 @@ struct cfs_bandwidth {
 #endif
 };
 
+#ifdef CONFIG_SCHEDSTATS
+/*
+ * Per-cpu log2 histograms of how long the tasks of a group waited on the
+ * runqueue and how long they then ran, see cpu.latency_hist.
+ */
+#define SCHED_LAT_BUCKETS	32
+
+enum {
+	SCHED_LAT_WAIT,
+	SCHED_LAT_SLICE,
+	SCHED_LAT_NR,
+};
+
+struct sched_lat_hist {
+	unsigned long count[SCHED_LAT_NR][SCHED_LAT_BUCKETS];
+};
+#endif
+
 /* task group related information */
 struct task_group {
 	struct cgroup_subsys_state css;
@@ -110,8 +184,16 @@ struct task_group {
 	/* runqueue "owned" by this group on each cpu */
 	struct cfs_rq **cfs_rq;
 	unsigned long shares;
+	/* run the threads of this group at the same time, see fair.c */
+	int cosched;
+	/* cpus the group may have entities queued on, while cosched is set */
+	cpumask_var_t cosched_cpus;
 
-	atomic_t load_weight;
+	atomic_long_t load_avg;
+	atomic_t runnable_avg;
+#ifdef CONFIG_SCHEDSTATS
+	struct sched_lat_hist __percpu *lat_hist;
+#endif
 #endif
 
 #ifdef CONFIG_RT_GROUP_SCHED
@@ -181,6 +263,9 @@ extern void init_tg_cfs_entry(struct task_group *tg, struct cfs_rq *cfs_rq,
 			struct sched_entity *parent);
 extern void init_cfs_bandwidth(struct cfs_bandwidth *cfs_b);
 extern int sched_group_set_shares(struct task_group *tg, unsigned long shares);
+extern int sched_group_set_cosched(struct task_group *tg, int cosched);
+extern atomic_t sched_cosched_groups;
+extern bool cosched_kick_task(struct rq *rq, struct task_struct *p);
 
 extern void __refill_cfs_bandwidth_runtime(struct cfs_bandwidth *cfs_b);
 extern void __start_cfs_bandwidth(struct cfs_bandwidth *cfs_b);
@@ -222,6 +307,29 @@ struct cfs_rq {
 	unsigned int nr_spread_over;
 #endif
 
+#ifdef CONFIG_SMP
+	/*
+	 * CFS load tracking
+	 *
+	 * Load is tracked on a per-entity basis and aggregated up: the
+	 * runnable average is the sum of the load contributions of the
+	 * queued entities, the blocked average that of entities which are
+	 * sleeping but still expected to come back to this cfs_rq.  The
+	 * blocked average decays once per 2^20ns (~1ms), decay_counter
+	 * counts those decays so that a sleeper can catch up on wakeup.
+	 */
+	unsigned long runnable_load_avg, blocked_load_avg;
+	atomic64_t decay_counter;
+	u64 last_decay;
+	atomic_long_t removed_load;
+
+#ifdef CONFIG_FAIR_GROUP_SCHED
+	/* Required to track per-cpu representation of a task_group */
+	u32 tg_runnable_contrib;
+	unsigned long tg_load_contrib;
+#endif /* CONFIG_FAIR_GROUP_SCHED */
+#endif /* CONFIG_SMP */
+
 #ifdef CONFIG_FAIR_GROUP_SCHED
 	struct rq *rq;	/* cpu runqueue to which this cfs_rq is attached */
 
@@ -238,6 +346,9 @@ struct cfs_rq {
 	struct task_group *tg;	/* group that "owns" this runqueue */
 
 #ifdef CONFIG_SMP
+	/* the group was switched to or from here on request of another cpu */
+	int cosched_kicked;
+
 	/*
 	 *   h_load = weight * f(tg)
 	 *
@@ -245,19 +356,6 @@ struct cfs_rq {
 	 * this group.
 	 */
 	unsigned long h_load;
-
-	/*
-	 * Maintaining per-cpu shares distribution for group scheduling
-	 *
-	 * load_stamp is the last time we updated the load average
-	 * load_last is the last time we updated the load average and saw load
-	 * load_unacc_exec_time is currently unaccounted execution time
-	 */
-	u64 load_avg;
-	u64 load_period;
-	u64 load_stamp, load_last, load_unacc_exec_time;
-
-	unsigned long load_contribution;
 #endif /* CONFIG_SMP */
 #ifdef CONFIG_CFS_BANDWIDTH
 	int runtime_enabled;
@@ -265,6 +363,7 @@ struct cfs_rq {
 	s64 runtime_remaining;
 
 	u64 throttled_timestamp;
+	u64 throttled_clock_task, throttled_clock_task_time;
 	int throttled, throttle_count;
 	struct list_head throttled_list;
 #endif /* CONFIG_CFS_BANDWIDTH */
@@ -309,6 +408,41 @@ struct rt_rq {
 #endif
 };
 
+/* Deadline class' related fields in a runqueue */
+struct dl_rq {
+	/* runqueue is an rbtree, ordered by deadline */
+	struct rb_root rb_root;
+	struct rb_node *rb_leftmost;
+
+	unsigned long dl_nr_running;
+
+#ifdef CONFIG_SMP
+	/*
+	 * Deadline values of the currently executing and the
+	 * earliest ready task on this rq. Caching these facilitates
+	 * the decision whether or not a ready but not running task
+	 * should migrate somewhere else.
+	 */
+	struct {
+		u64 curr;
+		u64 next;
+	} earliest_dl;
+
+	unsigned long dl_nr_migratory;
+	int overloaded;
+
+	/*
+	 * Tasks on this rq that can be pushed away. They are kept in
+	 * an rb-tree, ordered by tasks' deadlines, with caching
+	 * of the leftmost (earliest deadline) element.
+	 */
+	struct rb_root pushable_dl_tasks_root;
+	struct rb_node *pushable_dl_tasks_leftmost;
+#else
+	struct dl_bw dl_bw;
+#endif
+};
+
 #ifdef CONFIG_SMP
 
 /*
@@ -332,6 +466,14 @@ struct root_domain {
 	 */
 	cpumask_var_t rto_mask;
 	struct cpupri cpupri;
+
+	/*
+	 * The "DL overload" flag: it gets set if a CPU has more than
+	 * one runnable -deadline task.
+	 */
+	cpumask_var_t dlo_mask;
+	atomic_t dlo_count;
+	struct dl_bw dl_bw;
 };
 
 extern struct root_domain def_root_domain;
@@ -370,6 +512,7 @@ struct rq {
 
 	struct cfs_rq cfs;
 	struct rt_rq rt;
+	struct dl_rq dl;
 
 #ifdef CONFIG_FAIR_GROUP_SCHED
 	/* list of leaf cfs_rq on this cpu: */
@@ -422,6 +565,9 @@ struct rq {
 	u64 age_stamp;
 	u64 idle_stamp;
 	u64 avg_idle;
+
+	/* This is used to determine avg_idle's max value */
+	u64 max_idle_balance_cost;
 #endif
 
 #ifdef CONFIG_IRQ_TIME_ACCOUNTING
@@ -462,6 +608,10 @@ struct rq {
 	/* try_to_wake_up() stats */
 	unsigned int ttwu_count;
 	unsigned int ttwu_local;
+
+	/* idle_balance() stats */
+	unsigned int nib_count;
+	unsigned int nib_skipped;
 #endif
 
 #ifdef CONFIG_SMP
@@ -529,6 +679,7 @@ static inline struct sched_domain *highest_flag_domain(int cpu, int flag)
 
 DECLARE_PER_CPU(struct sched_domain *, sd_llc);
 DECLARE_PER_CPU(int, sd_llc_id);
+DECLARE_PER_CPU(struct cpumask *, sd_llc_idle_mask);
 
 extern int group_balance_cpu(struct sched_group *sg);
 
@@ -661,6 +812,55 @@ static inline u64 global_rt_runtime(void)
 	return (u64)sysctl_sched_rt_runtime * NSEC_PER_USEC;
 }
 
+extern unsigned long to_ratio(u64 period, u64 runtime);
+
+/*
+ * The bandwidth -deadline tasks may reserve on each cpu, in the same
+ * fixed point format as sched_dl_entity::dl_bw.  It follows the RT
+ * throttling sysctls, so that -deadline and RT tasks together can not
+ * starve the rest of the system.
+ */
+static inline u64 dl_bw_limit(void)
+{
+	return to_ratio(global_rt_period(), global_rt_runtime());
+}
+
+#ifdef CONFIG_SMP
+static inline struct dl_bw *dl_bw_of(int i)
+{
+	return &cpu_rq(i)->rd->dl_bw;
+}
+
+static inline int dl_bw_cpus(int i)
+{
+	return cpumask_weight(cpu_rq(i)->rd->span);
+}
+#else
+static inline struct dl_bw *dl_bw_of(int i)
+{
+	return &cpu_rq(i)->dl.dl_bw;
+}
+
+static inline int dl_bw_cpus(int i)
+{
+	return 1;
+}
+#endif
+
+static inline void __dl_add(struct dl_bw *dl_b, u64 tsk_bw)
+{
+	dl_b->total_bw += tsk_bw;
+}
+
+static inline void __dl_clear(struct dl_bw *dl_b, u64 tsk_bw)
+{
+	/*
+	 * A rebuilt root domain starts from zero, so tasks admitted
+	 * before the rebuild may give back more than it accounted.
+	 */
+	dl_b->total_bw -= min(tsk_bw, dl_b->total_bw);
+}
+
 
 
 static inline int task_current(struct rq *rq, struct task_struct *p)
@@ -847,6 +1047,7 @@ enum cpuacct_stat_index {
    for (class = sched_class_highest; class; class = class->next)
 
 extern const struct sched_class stop_sched_class;
+extern const struct sched_class dl_sched_class;
 extern const struct sched_class rt_sched_class;
 extern const struct sched_class fair_sched_class;
 extern const struct sched_class idle_sched_class;
@@ -856,6 +1057,7 @@ extern const struct sched_class idle_sched_class;
 
 extern void trigger_load_balance(struct rq *rq, int cpu);
 extern void idle_balance(int this_cpu, struct rq *this_rq);
+extern void init_task_runnable_average(struct task_struct *p);
 
 #else	/* CONFIG_SMP */
 
@@ -863,6 +1065,10 @@ static inline void idle_balance(int cpu, struct rq *rq)
 {
 }
 
+static inline void init_task_runnable_average(struct task_struct *p)
+{
+}
+
 #endif
 
 extern void sysrq_sched_debug_show(void);
@@ -871,6 +1077,7 @@ extern void update_max_interval(void);
 extern void update_group_power(struct sched_domain *sd, int cpu);
 extern int update_runtime(struct notifier_block *nfb, unsigned long action, void *hcpu);
 extern void init_sched_rt_class(void);
+extern void init_sched_dl_class(void);
 extern void init_sched_fair_class(void);
 
 extern void resched_task(struct task_struct *p);
@@ -879,6 +1086,9 @@ extern void resched_cpu(int cpu);
 extern struct rt_bandwidth def_rt_bandwidth;
 extern void init_rt_bandwidth(struct rt_bandwidth *rt_b, u64 period, u64 runtime);
 
+extern void init_dl_bw(struct dl_bw *dl_b);
+extern void init_dl_task_timer(struct sched_dl_entity *dl_se);
+
 extern void update_idle_cpu_load(struct rq *this_rq);
 
 #ifdef CONFIG_CGROUP_CPUACCT
@@ -920,6 +1130,14 @@ static inline void cpuacct_charge(struct task_struct *tsk, u64 cputime) {}
 static inline void inc_nr_running(struct rq *rq)
 {
 	rq->nr_running++;
+
+#ifdef CONFIG_NO_HZ_FULL
+	if (rq->nr_running == 2 && tick_nohz_full_cpu(rq->cpu)) {
+		/* Order rq->nr_running write against the IPI */
+		smp_wmb();
+		tick_nohz_full_kick_cpu(rq->cpu);
+	}
+#endif
 }
 
 static inline void dec_nr_running(struct rq *rq)
@@ -1141,9 +1359,11 @@ extern struct sched_entity *__pick_first_entity(struct cfs_rq *cfs_rq);
 extern struct sched_entity *__pick_last_entity(struct cfs_rq *cfs_rq);
 extern void print_cfs_stats(struct seq_file *m, int cpu);
 extern void print_rt_stats(struct seq_file *m, int cpu);
+extern void print_dl_stats(struct seq_file *m, int cpu);
 
 extern void init_cfs_rq(struct cfs_rq *cfs_rq);
 extern void init_rt_rq(struct rt_rq *rt_rq, struct rq *rq);
+extern void init_dl_rq(struct dl_rq *dl_rq, struct rq *rq);
 extern void unthrottle_offline_cfs_rqs(struct rq *rq);
 
 extern void account_cfs_bandwidth_used(int enabled, int was_enabled);
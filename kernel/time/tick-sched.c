@@ -11,12 +11,16 @@
  *
  *  Distribute under GPLv2.
  */
+#include <linux/bootmem.h>
 #include <linux/cpu.h>
 #include <linux/err.h>
 #include <linux/hrtimer.h>
 #include <linux/interrupt.h>
+#include <linux/irq_work.h>
 #include <linux/kernel_stat.h>
 #include <linux/percpu.h>
+#include <linux/perf_event.h>
+#include <linux/posix-timers.h>
 #include <linux/profile.h>
 #include <linux/sched.h>
 #include <linux/module.h>
@@ -123,6 +127,100 @@ static int __init setup_tick_nohz(char *str)
 
 __setup("nohz=", setup_tick_nohz);
 
+#ifdef CONFIG_NO_HZ_FULL
+cpumask_var_t tick_nohz_full_mask;
+bool tick_nohz_full_running;
+
+/*
+ * Parse the nohz_full= cpu list.  The boot cpu keeps the timekeeping
+ * duty for the full dynticks cpus, so it can't be one of them.
+ */
+static int __init tick_nohz_full_setup(char *str)
+{
+	int cpu = smp_processor_id();
+
+	alloc_bootmem_cpumask_var(&tick_nohz_full_mask);
+	if (cpulist_parse(str, tick_nohz_full_mask) < 0) {
+		printk(KERN_WARNING "NOHZ: Incorrect nohz_full cpumask\n");
+		cpumask_clear(tick_nohz_full_mask);
+		return 1;
+	}
+
+	if (cpumask_test_cpu(cpu, tick_nohz_full_mask)) {
+		printk(KERN_WARNING "NOHZ: Clearing boot cpu %d from nohz_full "
+		       "range for timekeeping\n", cpu);
+		cpumask_clear_cpu(cpu, tick_nohz_full_mask);
+	}
+	tick_nohz_full_running = !cpumask_empty(tick_nohz_full_mask);
+
+	return 1;
+}
+__setup("nohz_full=", tick_nohz_full_setup);
+
+/*
+ * Kicking a full dynticks cpu only needs to get it through irq_exit(),
+ * which decides again whether its tick can stay stopped.
+ */
+static void nohz_full_kick_work_func(struct irq_work *work)
+{
+}
+
+static DEFINE_PER_CPU(struct irq_work, nohz_full_kick_work) = {
+	.func = nohz_full_kick_work_func,
+};
+
+/**
+ * tick_nohz_full_kick - re-evaluate the stopped tick of this cpu
+ *
+ * Called when something that needs the tick, a timer, a perf event or a
+ * posix cpu timer, was set up while the tick of this cpu is stopped.
+ * Must be called with preemption disabled.
+ */
+void tick_nohz_full_kick(void)
+{
+	if (__this_cpu_read(tick_cpu_sched.tick_stopped))
+		irq_work_queue(&__get_cpu_var(nohz_full_kick_work));
+}
+
+/**
+ * tick_nohz_full_kick_cpu - re-evaluate the tick of a full dynticks cpu
+ * @cpu: the cpu to kick
+ *
+ * The remote cpu gets a reschedule IPI, which scheduler_ipi() lets through
+ * irq_exit() on full dynticks cpus.  Must be called with preemption
+ * disabled.
+ */
+void tick_nohz_full_kick_cpu(int cpu)
+{
+	if (!tick_nohz_full_cpu(cpu))
+		return;
+
+	if (cpu == smp_processor_id()) {
+		tick_nohz_full_kick();
+		return;
+	}
+
+	smp_send_reschedule(cpu);
+}
+
+/*
+ * Kick all the full dynticks cpus, for state that is not tied to one cpu
+ * such as the posix cpu timers of a thread group.
+ */
+void tick_nohz_full_kick_all(void)
+{
+	int cpu;
+
+	if (!tick_nohz_full_running)
+		return;
+
+	preempt_disable();
+	for_each_cpu_and(cpu, tick_nohz_full_mask, cpu_online_mask)
+		tick_nohz_full_kick_cpu(cpu);
+	preempt_enable();
+}
+#endif /* CONFIG_NO_HZ_FULL */
+
 /**
  * tick_nohz_update_jiffies - update jiffies when idle was interrupted
  *
@@ -300,6 +398,17 @@ static ktime_t tick_nohz_stop_sched_tick(struct tick_sched *ts,
 			next_jiffies = last_jiffies + rcu_delta_jiffies;
 			delta_jiffies = rcu_delta_jiffies;
 		}
+#ifdef CONFIG_NO_HZ_FULL
+		/*
+		 * A busy cpu still takes a tick every second, which keeps
+		 * the scheduler statistics, the load average and the rt
+		 * throttling of the running task going.
+		 */
+		if (!ts->inidle && delta_jiffies > HZ) {
+			next_jiffies = last_jiffies + HZ;
+			delta_jiffies = HZ;
+		}
+#endif
 	}
 	/*
 	 * Do not stop the tick, if we are only one off
@@ -372,8 +481,10 @@ static ktime_t tick_nohz_stop_sched_tick(struct tick_sched *ts,
 		 * the scheduler tick in nohz_restart_sched_tick.
 		 */
 		if (!ts->tick_stopped) {
-			select_nohz_load_balancer(1);
-			calc_load_enter_idle();
+			if (ts->inidle) {
+				select_nohz_load_balancer(1);
+				calc_load_enter_idle();
+			}
 
 			ts->last_tick = hrtimer_get_expires(&ts->sched_timer);
 			ts->tick_stopped = 1;
@@ -430,6 +541,19 @@ static bool can_stop_idle_tick(int cpu, struct tick_sched *ts)
 	if (unlikely(ts->nohz_mode == NOHZ_MODE_INACTIVE))
 		return false;
 
+#ifdef CONFIG_NO_HZ_FULL
+	/*
+	 * The timekeeping cpu keeps its tick while there are full dynticks
+	 * cpus: they rely on it for jiffies and wall time.
+	 */
+	if (tick_nohz_full_running) {
+		if (tick_do_timer_cpu == cpu)
+			return false;
+		if (tick_do_timer_cpu == TICK_DO_TIMER_NONE)
+			return false;
+	}
+#endif
+
 	if (need_resched())
 		return false;
 
@@ -510,6 +634,118 @@ void tick_nohz_idle_enter(void)
 	local_irq_enable();
 }
 
+static void tick_nohz_restart_sched_tick(struct tick_sched *ts, ktime_t now);
+
+#ifdef CONFIG_NO_HZ_FULL
+/*
+ * The tick accounts one jiffy of cpu time to the running task at a time.
+ * Catch up with the jiffies that passed while it was stopped.  The tick
+ * is only stopped for a single task, which is normally spinning in user
+ * space, so they are accounted as user time.
+ */
+static void tick_nohz_full_account_ticks(struct tick_sched *ts,
+					 struct task_struct *p)
+{
+#ifndef CONFIG_VIRT_CPU_ACCOUNTING
+	unsigned long ticks = jiffies - ts->full_jiffies;
+	cputime_t cputime;
+
+	if (ticks && ticks < LONG_MAX) {
+		cputime = jiffies_to_cputime(ticks);
+		account_user_time(p, cputime, cputime_to_scaled(cputime));
+	}
+#endif
+	ts->full_jiffies = jiffies;
+}
+
+static void tick_nohz_restart_full_tick(struct tick_sched *ts,
+					struct task_struct *p)
+{
+	tick_nohz_full_account_ticks(ts, p);
+	tick_nohz_restart_sched_tick(ts, ktime_get());
+}
+
+static bool can_stop_full_tick(int cpu, struct tick_sched *ts)
+{
+	WARN_ON_ONCE(!irqs_disabled());
+
+	if (unlikely(ts->nohz_mode != NOHZ_MODE_HIGHRES))
+		return false;
+
+	if (!sched_can_stop_tick())
+		return false;
+
+	if (!posix_cpu_timers_can_stop_tick(current))
+		return false;
+
+	if (!perf_event_can_stop_tick())
+		return false;
+
+	if (rcu_cpu_needs_tick(cpu))
+		return false;
+
+#ifdef CONFIG_HAVE_UNSTABLE_SCHED_CLOCK
+	/* An unstable sched_clock() is only kept in check by the tick */
+	if (!sched_clock_stable)
+		return false;
+#endif
+
+	return true;
+}
+
+/*
+ * Stop the tick of a busy full dynticks cpu from irq exit, or restart it
+ * when it is needed again.
+ */
+static void tick_nohz_full_stop_tick(struct tick_sched *ts)
+{
+	int cpu = smp_processor_id();
+	int was_stopped;
+
+	if (!tick_nohz_full_cpu(cpu) || is_idle_task(current))
+		return;
+
+	if (!can_stop_full_tick(cpu, ts)) {
+		if (ts->tick_stopped)
+			tick_nohz_restart_full_tick(ts, current);
+		return;
+	}
+
+	ts->full_calls++;
+	was_stopped = ts->tick_stopped;
+	tick_nohz_stop_sched_tick(ts, ktime_get(), cpu);
+	if (!was_stopped && ts->tick_stopped) {
+		ts->full_jiffies = ts->last_jiffies;
+		ts->full_stops++;
+	}
+}
+
+/**
+ * tick_nohz_task_switch - restart the tick stopped for the previous task
+ * @prev: the task which was running with the tick stopped
+ *
+ * The tick is only stopped on behalf of the task running at the time,
+ * so restart it on a context switch and let the next irq exit decide
+ * for the new task.  Called from finish_task_switch().
+ */
+void tick_nohz_task_switch(struct task_struct *prev)
+{
+	struct tick_sched *ts;
+	unsigned long flags;
+
+	if (!tick_nohz_full_cpu(smp_processor_id()))
+		return;
+
+	local_irq_save(flags);
+	ts = &__get_cpu_var(tick_cpu_sched);
+	if (ts->tick_stopped && !ts->inidle)
+		tick_nohz_restart_full_tick(ts, prev);
+	local_irq_restore(flags);
+}
+#else
+static inline void tick_nohz_full_stop_tick(struct tick_sched *ts) { }
+#endif /* CONFIG_NO_HZ_FULL */
+
 /**
  * tick_nohz_irq_exit - update next tick event from interrupt exit
  *
@@ -517,15 +753,18 @@ void tick_nohz_idle_enter(void)
  * a reschedule, it may still add, modify or delete a timer, enqueue
  * an RCU callback, etc...
  * So we need to re-calculate and reprogram the next tick event.
+ *
+ * On a busy full dynticks cpu this is where the tick is stopped, or
+ * restarted when the running task needs it again.
  */
 void tick_nohz_irq_exit(void)
 {
 	struct tick_sched *ts = &__get_cpu_var(tick_cpu_sched);
 
-	if (!ts->inidle)
-		return;
-
-	__tick_nohz_idle_enter(ts);
+	if (ts->inidle)
+		__tick_nohz_idle_enter(ts);
+	else
+		tick_nohz_full_stop_tick(ts);
 }
 
 /**
@@ -659,7 +898,8 @@ static void tick_nohz_handler(struct clock_event_device *dev)
 	 * this duty, then the jiffies update is still serialized by
 	 * xtime_lock.
 	 */
-	if (unlikely(tick_do_timer_cpu == TICK_DO_TIMER_NONE))
+	if (unlikely(tick_do_timer_cpu == TICK_DO_TIMER_NONE) &&
+	    !tick_nohz_full_cpu(cpu))
 		tick_do_timer_cpu = cpu;
 
 	/* Check, if the jiffies need an update */
@@ -811,7 +1051,8 @@ static enum hrtimer_restart tick_sched_timer(struct hrtimer *timer)
 	 * this duty, then the jiffies update is still serialized by
 	 * xtime_lock.
 	 */
-	if (unlikely(tick_do_timer_cpu == TICK_DO_TIMER_NONE))
+	if (unlikely(tick_do_timer_cpu == TICK_DO_TIMER_NONE) &&
+	    !tick_nohz_full_cpu(cpu))
 		tick_do_timer_cpu = cpu;
 #endif
 
@@ -836,6 +1077,13 @@ static enum hrtimer_restart tick_sched_timer(struct hrtimer *timer)
 			touch_softlockup_watchdog();
 			if (idle_cpu(cpu))
 				ts->idle_jiffies++;
+#ifdef CONFIG_NO_HZ_FULL
+			else if (!ts->inidle) {
+				/* update_process_times() accounts this jiffy */
+				ts->full_jiffies++;
+				tick_nohz_full_account_ticks(ts, current);
+			}
+#endif
 		}
 		update_process_times(user_mode(regs));
 		profile_tick(CPU_PROFILING);
@@ -55,22 +55,57 @@ u64 jiffies_64 __cacheline_aligned_in_smp = INITIAL_JIFFIES;
 EXPORT_SYMBOL(jiffies_64);
 
 /*
- * per-CPU timer vector definitions:
+ * The timer wheel has LVL_DEPTH levels of LVL_SIZE buckets each.  Every
+ * level is LVL_CLK_DIV times coarser than the one below it:
+ *
+ * HZ 1000 (LVL_DEPTH 9)
+ * Level Offset  Granularity            Range
+ *  0      0         1 ms                0 ms -         62 ms
+ *  1     64         8 ms               63 ms -        503 ms
+ *  2    128        64 ms              504 ms -       4031 ms (~0.5s - ~4s)
+ *  3    192       512 ms             4032 ms -      32255 ms (~4s - ~32s)
+ *  4    256      4096 ms (~4s)      32256 ms -     258047 ms (~32s - ~4m)
+ *  5    320     32768 ms (~32s)    258048 ms -    2064383 ms (~4m - ~34m)
+ *  6    384    262144 ms (~4m)    2064384 ms -   16515071 ms (~34m - ~4h)
+ *  7    448   2097152 ms (~34m)  16515072 ms -  132120575 ms (~4h - ~1d)
+ *  8    512  16777216 ms (~4h)  132120576 ms - 1056964607 ms (~1d - ~12d)
+ *
+ * A timer is queued on the level whose range covers its timeout and its
+ * expiry is rounded up to that level's granularity, so it never fires
+ * early but may fire late by up to about 1/8 of its timeout.  In return
+ * timers are never cascaded down the levels: a bucket of level n is
+ * looked at when base->timer_jiffies is a multiple of its granularity,
+ * and everything in it has expired.  Timeouts beyond the last level are
+ * clamped to WHEEL_TIMEOUT_MAX.
+ *
+ * Most timers with long timeouts (networking retransmit and keepalive
+ * timers, for instance) are modified or deleted long before they expire,
+ * which is cheap with this layout and no longer costs a cascade.
  */
-#define TVN_BITS (CONFIG_BASE_SMALL ? 4 : 6)
-#define TVR_BITS (CONFIG_BASE_SMALL ? 6 : 8)
-#define TVN_SIZE (1 << TVN_BITS)
-#define TVR_SIZE (1 << TVR_BITS)
-#define TVN_MASK (TVN_SIZE - 1)
-#define TVR_MASK (TVR_SIZE - 1)
-
-struct tvec {
-	struct list_head vec[TVN_SIZE];
-};
+#define LVL_CLK_SHIFT	3
+#define LVL_CLK_DIV	(1UL << LVL_CLK_SHIFT)
+#define LVL_CLK_MASK	(LVL_CLK_DIV - 1)
+#define LVL_SHIFT(n)	((n) * LVL_CLK_SHIFT)
+#define LVL_GRAN(n)	(1UL << LVL_SHIFT(n))
+
+/* Start of level n, i.e. the smallest timeout queued on it. */
+#define LVL_START(n)	((LVL_SIZE - 1) << (((n) - 1) * LVL_CLK_SHIFT))
+
+#define LVL_BITS	6
+#define LVL_SIZE	(1UL << LVL_BITS)
+#define LVL_MASK	(LVL_SIZE - 1)
+#define LVL_OFFS(n)	((n) * LVL_SIZE)
+
+#if HZ > 100
+# define LVL_DEPTH	9
+#else
+# define LVL_DEPTH	8
+#endif
 
-struct tvec_root {
-	struct list_head vec[TVR_SIZE];
-};
+#define WHEEL_SIZE	(LVL_SIZE * LVL_DEPTH)
+
+#define WHEEL_TIMEOUT_CUTOFF	(LVL_START(LVL_DEPTH))
+#define WHEEL_TIMEOUT_MAX	(WHEEL_TIMEOUT_CUTOFF - LVL_GRAN(LVL_DEPTH - 1))
 
 struct tvec_base {
 	spinlock_t lock;
@@ -78,11 +113,8 @@ struct tvec_base {
 	unsigned long timer_jiffies;
 	unsigned long next_timer;
 	unsigned long active_timers;
-	struct tvec_root tv1;
-	struct tvec tv2;
-	struct tvec tv3;
-	struct tvec tv4;
-	struct tvec tv5;
+	DECLARE_BITMAP(pending_map, WHEEL_SIZE);
+	struct list_head vectors[WHEEL_SIZE];
 } ____cacheline_aligned;
 
 struct tvec_base boot_tvec_bases;
@@ -331,58 +363,144 @@ void set_timer_slack(struct timer_list *timer, int slack_hz)
 }
 EXPORT_SYMBOL_GPL(set_timer_slack);
 
-static void
-__internal_add_timer(struct tvec_base *base, struct timer_list *timer)
+/*
+ * Bucket of level @lvl for @expires, rounded up to the granularity of the
+ * level.  *@bucket_expiry is set to the time the bucket gets expired.
+ */
+static inline unsigned int calc_index(unsigned long expires, unsigned int lvl,
+				      unsigned long *bucket_expiry)
+{
+	expires = (expires + LVL_GRAN(lvl) - 1) >> LVL_SHIFT(lvl);
+	*bucket_expiry = expires << LVL_SHIFT(lvl);
+	return LVL_OFFS(lvl) + (expires & LVL_MASK);
+}
+
+static unsigned int calc_wheel_index(unsigned long expires, unsigned long clk,
+				     unsigned long *bucket_expiry)
 {
-	unsigned long expires = timer->expires;
-	unsigned long idx = expires - base->timer_jiffies;
-	struct list_head *vec;
-
-	if (idx < TVR_SIZE) {
-		int i = expires & TVR_MASK;
-		vec = base->tv1.vec + i;
-	} else if (idx < 1 << (TVR_BITS + TVN_BITS)) {
-		int i = (expires >> TVR_BITS) & TVN_MASK;
-		vec = base->tv2.vec + i;
-	} else if (idx < 1 << (TVR_BITS + 2 * TVN_BITS)) {
-		int i = (expires >> (TVR_BITS + TVN_BITS)) & TVN_MASK;
-		vec = base->tv3.vec + i;
-	} else if (idx < 1 << (TVR_BITS + 3 * TVN_BITS)) {
-		int i = (expires >> (TVR_BITS + 2 * TVN_BITS)) & TVN_MASK;
-		vec = base->tv4.vec + i;
-	} else if ((signed long) idx < 0) {
+	unsigned long delta = expires - clk;
+	unsigned int lvl;
+
+	if ((long)delta < 0) {
 		/*
 		 * Can happen if you add a timer with expires == jiffies,
 		 * or you set a timer to go off in the past
 		 */
-		vec = base->tv1.vec + (base->timer_jiffies & TVR_MASK);
+		*bucket_expiry = clk;
+		return clk & LVL_MASK;
+	}
+
+	if (delta >= WHEEL_TIMEOUT_CUTOFF) {
+		expires = clk + WHEEL_TIMEOUT_MAX;
+		lvl = LVL_DEPTH - 1;
 	} else {
-		int i;
-		/* If the timeout is larger than 0xffffffff on 64-bit
-		 * architectures then we use the maximum timeout:
+		for (lvl = 0; lvl < LVL_DEPTH - 1; lvl++)
+			if (delta < LVL_START(lvl + 1))
+				break;
+	}
+	return calc_index(expires, lvl, bucket_expiry);
+}
+
+#ifdef CONFIG_NO_HZ
+/*
+ * Return the expiry of the first bucket holding a timer that has not been
+ * expired yet, or @limit if there is none before it.  Deferrable timers
+ * only count if @deferrable.
+ */
+static unsigned long next_pending_bucket(struct tvec_base *base,
+					 unsigned long limit, bool deferrable)
+{
+	unsigned long clk = base->timer_jiffies;
+	unsigned long expires = limit;
+	unsigned long pos, start, bucket_expiry;
+	unsigned int lvl, offs, idx;
+	struct timer_list *nte;
+
+	for (lvl = 0; lvl < LVL_DEPTH; lvl++) {
+		/*
+		 * The first bucket of the level still to be expired: the
+		 * current one has been already unless clk is a multiple
+		 * of the level's granularity.
 		 */
-		if (idx > 0xffffffffUL) {
-			idx = 0xffffffffUL;
-			expires = idx + base->timer_jiffies;
+		start = clk >> LVL_SHIFT(lvl);
+		if (clk & (LVL_GRAN(lvl) - 1))
+			start++;
+
+		for (offs = 0; offs < LVL_SIZE; offs++) {
+			pos = start + offs;
+			bucket_expiry = pos << LVL_SHIFT(lvl);
+			/* Later levels can still hold an earlier bucket */
+			if (!time_before(bucket_expiry, expires))
+				break;
+			idx = LVL_OFFS(lvl) + (pos & LVL_MASK);
+			if (!test_bit(idx, base->pending_map))
+				continue;
+			list_for_each_entry(nte, base->vectors + idx, entry) {
+				if (!deferrable &&
+				    tbase_get_deferrable(nte->base))
+					continue;
+				expires = bucket_expiry;
+				break;
+			}
+			if (expires == bucket_expiry)
+				break;
 		}
-		i = (expires >> (TVR_BITS + 3 * TVN_BITS)) & TVN_MASK;
-		vec = base->tv5.vec + i;
 	}
+	return expires;
+}
+
+/*
+ * base->timer_jiffies stands still while the cpu is idle without a tick,
+ * and a timeout measured from it would put a new timer on a level much
+ * coarser than its timeout calls for.  Move it up to jiffies first, but
+ * never past a bucket that still holds a timer: __run_timers() has to
+ * stop at every one of them.
+ */
+static void forward_timer_base(struct tvec_base *base)
+{
+	unsigned long jnow = ACCESS_ONCE(jiffies);
+
+	/* The tick is running, or a softirq is about to catch up */
+	if ((long)(jnow - base->timer_jiffies) < 2)
+		return;
+
+	base->timer_jiffies = next_pending_bucket(base, jnow, true);
+}
+#else
+static inline void forward_timer_base(struct tvec_base *base) { }
+#endif
+
+/*
+ * Queue @timer on the wheel and return the time its bucket expires,
+ * which is no earlier than timer->expires.
+ */
+static unsigned long
+__internal_add_timer(struct tvec_base *base, struct timer_list *timer)
+{
+	unsigned long bucket_expiry;
+	unsigned int idx;
+
+	forward_timer_base(base);
+	idx = calc_wheel_index(timer->expires, base->timer_jiffies,
+			       &bucket_expiry);
 	/*
 	 * Timers are FIFO:
 	 */
-	list_add_tail(&timer->entry, vec);
+	list_add_tail(&timer->entry, base->vectors + idx);
+	__set_bit(idx, base->pending_map);
+	return bucket_expiry;
 }
 
 static void internal_add_timer(struct tvec_base *base, struct timer_list *timer)
 {
-	__internal_add_timer(base, timer);
+	unsigned long bucket_expiry = __internal_add_timer(base, timer);
+
 	/*
 	 * Update base->active_timers and base->next_timer
 	 */
 	if (!tbase_get_deferrable(timer->base)) {
-		if (time_before(timer->expires, base->next_timer))
-			base->next_timer = timer->expires;
+		if (time_before(bucket_expiry, base->next_timer))
+			base->next_timer = bucket_expiry;
 		base->active_timers++;
 	}
 }
@@ -689,16 +807,34 @@ detach_expired_timer(struct timer_list *timer, struct tvec_base *base)
 		timer->base->active_timers--;
 }
 
+/*
+ * Clear the pending bit of the wheel bucket @timer is queued on if @timer
+ * is its only entry.  Timers collected by __run_timers() sit on a private
+ * list, which has no bit to clear.
+ */
+static inline void
+clear_pending_bucket(struct tvec_base *base, struct timer_list *timer)
+{
+	struct list_head *head = timer->entry.next;
+
+	if (head != timer->entry.prev)
+		return;
+	if (head >= base->vectors && head < base->vectors + WHEEL_SIZE)
+		__clear_bit(head - base->vectors, base->pending_map);
+}
+
 static int detach_if_pending(struct timer_list *timer, struct tvec_base *base,
 			     bool clear_pending)
 {
 	if (!timer_pending(timer))
 		return 0;
 
+	clear_pending_bucket(base, timer);
 	detach_timer(timer, clear_pending);
 	if (!tbase_get_deferrable(timer->base)) {
 		timer->base->active_timers--;
-		if (timer->expires == base->next_timer)
+		/* The timer's bucket may be the one base->next_timer is */
+		if (time_before_eq(timer->expires, base->next_timer))
 			base->next_timer = base->timer_jiffies;
 	}
 	return 1;
@@ -784,6 +920,13 @@ __mod_timer(struct timer_list *timer, unsigned long expires,
 	timer->expires = expires;
 	internal_add_timer(base, timer);
 
+	/*
+	 * A full dynticks cpu may have stopped its tick before the timer
+	 * was queued, make it evaluate the timer wheel again.
+	 */
+	if (base == new_base)
+		tick_nohz_full_kick_cpu(cpu);
+
 out_unlock:
 	spin_unlock_irqrestore(&base->lock, flags);
 
@@ -954,9 +1097,10 @@ void add_timer_on(struct timer_list *timer, int cpu)
 	 * active. We are protected against the other CPU fiddling
 	 * with the timer by holding the timer base lock. This also
 	 * makes sure that a CPU on the way to idle can not evaluate
-	 * the timer wheel.
+	 * the timer wheel.  A busy full dynticks CPU is kicked the
+	 * same way.
 	 */
-	wake_up_idle_cpu(cpu);
+	wake_up_nohz_cpu(cpu);
 	spin_unlock_irqrestore(&base->lock, flags);
 }
 EXPORT_SYMBOL_GPL(add_timer_on);
@@ -1084,27 +1228,6 @@ int del_timer_sync(struct timer_list *timer)
 EXPORT_SYMBOL(del_timer_sync);
 #endif
 
-static int cascade(struct tvec_base *base, struct tvec *tv, int index)
-{
-	/* cascade all the timers from tv up one level */
-	struct timer_list *timer, *tmp;
-	struct list_head tv_list;
-
-	list_replace_init(tv->vec + index, &tv_list);
-
-	/*
-	 * We are removing _all_ timers from the list, so we
-	 * don't have to detach them individually.
-	 */
-	list_for_each_entry_safe(timer, tmp, &tv_list, entry) {
-		BUG_ON(tbase_get_base(timer->base) != base);
-		/* No accounting, while moving them */
-		__internal_add_timer(base, timer);
-	}
-
-	return index;
-}
-
 static void call_timer_fn(struct timer_list *timer, void (*fn)(unsigned long),
 			  unsigned long data)
 {
@@ -1148,52 +1271,73 @@ static void call_timer_fn(struct timer_list *timer, void (*fn)(unsigned long),
 	}
 }
 
-#define INDEX(N) ((base->timer_jiffies >> (TVR_BITS + (N) * TVN_BITS)) & TVN_MASK)
+/*
+ * Move the timers of all buckets expiring at base->timer_jiffies to
+ * @heads, one list per level, and return the number of lists.  A bucket
+ * of a level is only looked at when base->timer_jiffies is a multiple of
+ * the level's granularity.
+ */
+static int collect_expired_timers(struct tvec_base *base,
+				  struct list_head *heads)
+{
+	unsigned long clk = base->timer_jiffies;
+	unsigned int idx;
+	int i, levels = 0;
+
+	for (i = 0; i < LVL_DEPTH; i++) {
+		idx = (clk & LVL_MASK) + i * LVL_SIZE;
+
+		if (__test_and_clear_bit(idx, base->pending_map))
+			list_replace_init(base->vectors + idx, heads + levels++);
+		/* Is it time to look at the next level? */
+		if (clk & LVL_CLK_MASK)
+			break;
+		clk >>= LVL_CLK_SHIFT;
+	}
+	return levels;
+}
+
+static void expire_timers(struct tvec_base *base, struct list_head *head)
+{
+	struct timer_list *timer;
+
+	while (!list_empty(head)) {
+		void (*fn)(unsigned long);
+		unsigned long data;
+
+		timer = list_first_entry(head, struct timer_list, entry);
+		fn = timer->function;
+		data = timer->data;
+
+		timer_stats_account_timer(timer);
+
+		base->running_timer = timer;
+		detach_expired_timer(timer, base);
+
+		spin_unlock_irq(&base->lock);
+		call_timer_fn(timer, fn, data);
+		spin_lock_irq(&base->lock);
+	}
+}
 
 /**
  * __run_timers - run all expired timers (if any) on this CPU.
  * @base: the timer vector to be processed.
  *
- * This function cascades all vectors and executes all expired timer
- * vectors.
+ * This function collects the expired buckets of all levels and executes
+ * their timers.
  */
 static inline void __run_timers(struct tvec_base *base)
 {
-	struct timer_list *timer;
+	struct list_head heads[LVL_DEPTH];
+	int levels;
 
 	spin_lock_irq(&base->lock);
 	while (time_after_eq(jiffies, base->timer_jiffies)) {
-		struct list_head work_list;
-		struct list_head *head = &work_list;
-		int index = base->timer_jiffies & TVR_MASK;
-
-		/*
-		 * Cascade timers:
-		 */
-		if (!index &&
-			(!cascade(base, &base->tv2, INDEX(0))) &&
-				(!cascade(base, &base->tv3, INDEX(1))) &&
-					!cascade(base, &base->tv4, INDEX(2)))
-			cascade(base, &base->tv5, INDEX(3));
+		levels = collect_expired_timers(base, heads);
 		++base->timer_jiffies;
-		list_replace_init(base->tv1.vec + index, &work_list);
-		while (!list_empty(head)) {
-			void (*fn)(unsigned long);
-			unsigned long data;
-
-			timer = list_first_entry(head, struct timer_list,entry);
-			fn = timer->function;
-			data = timer->data;
-
-			timer_stats_account_timer(timer);
-
-			base->running_timer = timer;
-			detach_expired_timer(timer, base);
-
-			spin_unlock_irq(&base->lock);
-			call_timer_fn(timer, fn, data);
-			spin_lock_irq(&base->lock);
-		}
+		while (levels--)
+			expire_timers(base, heads + levels);
 	}
 	base->running_timer = NULL;
 	spin_unlock_irq(&base->lock);
@@ -1207,72 +1351,9 @@ static inline void __run_timers(struct tvec_base *base)
  */
 static unsigned long __next_timer_interrupt(struct tvec_base *base)
 {
-	unsigned long timer_jiffies = base->timer_jiffies;
-	unsigned long expires = timer_jiffies + NEXT_TIMER_MAX_DELTA;
-	int index, slot, array, found = 0;
-	struct timer_list *nte;
-	struct tvec *varray[4];
-
-	/* Look for timer events in tv1. */
-	index = slot = timer_jiffies & TVR_MASK;
-	do {
-		list_for_each_entry(nte, base->tv1.vec + slot, entry) {
-			if (tbase_get_deferrable(nte->base))
-				continue;
-
-			found = 1;
-			expires = nte->expires;
-			/* Look at the cascade bucket(s)? */
-			if (!index || slot < index)
-				goto cascade;
-			return expires;
-		}
-		slot = (slot + 1) & TVR_MASK;
-	} while (slot != index);
-
-cascade:
-	/* Calculate the next cascade event */
-	if (index)
-		timer_jiffies += TVR_SIZE - index;
-	timer_jiffies >>= TVR_BITS;
-
-	/* Check tv2-tv5. */
-	varray[0] = &base->tv2;
-	varray[1] = &base->tv3;
-	varray[2] = &base->tv4;
-	varray[3] = &base->tv5;
-
-	for (array = 0; array < 4; array++) {
-		struct tvec *varp = varray[array];
-
-		index = slot = timer_jiffies & TVN_MASK;
-		do {
-			list_for_each_entry(nte, varp->vec + slot, entry) {
-				if (tbase_get_deferrable(nte->base))
-					continue;
-
-				found = 1;
-				if (time_before(nte->expires, expires))
-					expires = nte->expires;
-			}
-			/*
-			 * Do we still search for the first timer or are
-			 * we looking up the cascade buckets ?
-			 */
-			if (found) {
-				/* Look at the cascade bucket(s)? */
-				if (!index || slot < index)
-					break;
-				return expires;
-			}
-			slot = (slot + 1) & TVN_MASK;
-		} while (slot != index);
-
-		if (index)
-			timer_jiffies += TVN_SIZE - index;
-		timer_jiffies >>= TVN_BITS;
-	}
-	return expires;
+	return next_pending_bucket(base,
+				   base->timer_jiffies + NEXT_TIMER_MAX_DELTA,
+				   false);
 }
 
 /*
@@ -1697,14 +1778,9 @@ static int __cpuinit init_timers_cpu(int cpu)
 
 	spin_lock_init(&base->lock);
 
-	for (j = 0; j < TVN_SIZE; j++) {
-		INIT_LIST_HEAD(base->tv5.vec + j);
-		INIT_LIST_HEAD(base->tv4.vec + j);
-		INIT_LIST_HEAD(base->tv3.vec + j);
-		INIT_LIST_HEAD(base->tv2.vec + j);
-	}
-	for (j = 0; j < TVR_SIZE; j++)
-		INIT_LIST_HEAD(base->tv1.vec + j);
+	for (j = 0; j < WHEEL_SIZE; j++)
+		INIT_LIST_HEAD(base->vectors + j);
+	bitmap_zero(base->pending_map, WHEEL_SIZE);
 
 	base->timer_jiffies = jiffies;
 	base->next_timer = base->timer_jiffies;
@@ -1744,14 +1820,8 @@ static void __cpuinit migrate_timers(int cpu)
 
 	BUG_ON(old_base->running_timer);
 
-	for (i = 0; i < TVR_SIZE; i++)
-		migrate_timer_list(new_base, old_base->tv1.vec + i);
-	for (i = 0; i < TVN_SIZE; i++) {
-		migrate_timer_list(new_base, old_base->tv2.vec + i);
-		migrate_timer_list(new_base, old_base->tv3.vec + i);
-		migrate_timer_list(new_base, old_base->tv4.vec + i);
-		migrate_timer_list(new_base, old_base->tv5.vec + i);
-	}
+	for (i = 0; i < WHEEL_SIZE; i++)
+		migrate_timer_list(new_base, old_base->vectors + i);
 
 	spin_unlock(&old_base->lock);
 	spin_unlock_irq(&new_base->lock);
@@ -0,0 +1,308 @@
+/*
+ * Timer wheel stress test and benchmark
+ *
+ * Arms a large number of timers on every online cpu and keeps modifying
+ * them the way the retransmit and keepalive timers of many TCP connections
+ * behave: most of them are pushed out again long before they expire, the
+ * others expire and are rearmed from their handler.  Meanwhile the time
+ * spent in each run of the timer softirq is recorded through the softirq
+ * tracepoints and reported as a histogram when the test ends:
+ *
+ *	# modprobe timer_benchmark nr_timers=1000000 duration=60
+ *	# dmesg | grep timer_benchmark
+ *
+ * The test does not cope with cpus going offline while it runs.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ */
+#define pr_fmt(fmt) KBUILD_MODNAME ": " fmt
+
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/kthread.h>
+#include <linux/interrupt.h>
+#include <linux/percpu.h>
+#include <linux/random.h>
+#include <linux/sched.h>
+#include <linux/timer.h>
+#include <linux/vmalloc.h>
+#include <linux/log2.h>
+#include <linux/err.h>
+#include <trace/events/irq.h>
+
+MODULE_LICENSE("GPL");
+
+static unsigned int nr_timers = 100000;
+module_param(nr_timers, uint, 0444);
+MODULE_PARM_DESC(nr_timers, "Number of timers per cpu");
+
+static unsigned int min_timeout = 200;
+module_param(min_timeout, uint, 0444);
+MODULE_PARM_DESC(min_timeout, "Shortest timeout in ms");
+
+static unsigned int max_timeout = 120000;
+module_param(max_timeout, uint, 0444);
+MODULE_PARM_DESC(max_timeout, "Longest timeout in ms");
+
+static unsigned int mods_per_tick = 100;
+module_param(mods_per_tick, uint, 0444);
+MODULE_PARM_DESC(mods_per_tick, "Timers modified per cpu and tick");
+
+static unsigned int duration = 30;
+module_param(duration, uint, 0444);
+MODULE_PARM_DESC(duration, "Run time in seconds");
+
+/* Softirq run times are counted in log2(ns) buckets */
+#define TB_BUCKETS	32
+
+struct tb_cpu {
+	struct timer_list *timers;
+	struct task_struct *worker;
+	u64 softirq_start;
+	u64 total_ns;
+	u64 max_ns;
+	unsigned long runs;
+	unsigned long hist[TB_BUCKETS];
+	unsigned long expired;
+	unsigned long modified;
+};
+
+static DEFINE_PER_CPU(struct tb_cpu, tb_cpu);
+static struct task_struct *tb_control_task;
+static unsigned long min_jiffies, max_jiffies;
+static int tb_stopping;
+
+static unsigned long tb_timeout(void)
+{
+	return min_jiffies + random32() % (max_jiffies - min_jiffies + 1);
+}
+
+static void tb_softirq_entry(void *ignore, unsigned int vec_nr)
+{
+	if (vec_nr == TIMER_SOFTIRQ)
+		__get_cpu_var(tb_cpu).softirq_start = local_clock();
+}
+
+static void tb_softirq_exit(void *ignore, unsigned int vec_nr)
+{
+	struct tb_cpu *tc = &__get_cpu_var(tb_cpu);
+	u64 delta;
+
+	if (vec_nr != TIMER_SOFTIRQ || !tc->softirq_start)
+		return;
+
+	delta = local_clock() - tc->softirq_start;
+	tc->softirq_start = 0;
+	tc->runs++;
+	tc->total_ns += delta;
+	if (delta > tc->max_ns)
+		tc->max_ns = delta;
+	tc->hist[min_t(int, ilog2(delta | 1), TB_BUCKETS - 1)]++;
+}
+
+static void tb_timer_fn(unsigned long data)
+{
+	struct timer_list *timer = (struct timer_list *)data;
+
+	__get_cpu_var(tb_cpu).expired++;
+	if (!ACCESS_ONCE(tb_stopping))
+		mod_timer(timer, jiffies + tb_timeout());
+}
+
+/* Arm the timers of a cpu, then keep pushing random ones out. */
+static int tb_worker(void *arg)
+{
+	struct tb_cpu *tc = arg;
+	struct timer_list *timer;
+	unsigned int i;
+
+	for (i = 0; i < nr_timers; i++) {
+		timer = &tc->timers[i];
+		setup_timer(timer, tb_timer_fn, (unsigned long)timer);
+		mod_timer(timer, jiffies + tb_timeout());
+		if (!(i % 1024))
+			cond_resched();
+	}
+
+	while (!kthread_should_stop()) {
+		for (i = 0; i < mods_per_tick; i++) {
+			timer = &tc->timers[random32() % nr_timers];
+			mod_timer(timer, jiffies + tb_timeout());
+		}
+		tc->modified += mods_per_tick;
+		schedule_timeout_interruptible(1);
+	}
+	return 0;
+}
+
+static void tb_stop(void)
+{
+	struct tb_cpu *tc;
+	unsigned int i;
+	int cpu;
+
+	tb_stopping = 1;
+	smp_mb(); /* Timer handlers must stop rearming before we delete. */
+
+	for_each_possible_cpu(cpu) {
+		tc = &per_cpu(tb_cpu, cpu);
+		if (tc->worker)
+			kthread_stop(tc->worker);
+		tc->worker = NULL;
+	}
+	for_each_possible_cpu(cpu) {
+		tc = &per_cpu(tb_cpu, cpu);
+		if (!tc->timers)
+			continue;
+		for (i = 0; i < nr_timers; i++) {
+			if (tc->timers[i].function)
+				del_timer_sync(&tc->timers[i]);
+			if (!(i % 1024))
+				cond_resched();
+		}
+	}
+
+	unregister_trace_softirq_exit(tb_softirq_exit, NULL);
+	unregister_trace_softirq_entry(tb_softirq_entry, NULL);
+	tracepoint_synchronize_unregister();
+}
+
+static void tb_report(void)
+{
+	unsigned long hist[TB_BUCKETS] = { 0 };
+	unsigned long runs = 0, expired = 0, modified = 0;
+	u64 total_ns = 0, max_ns = 0;
+	struct tb_cpu *tc;
+	int cpu, i, nr_cpus = 0;
+
+	for_each_possible_cpu(cpu) {
+		tc = &per_cpu(tb_cpu, cpu);
+		if (!tc->timers)
+			continue;
+		nr_cpus++;
+		runs += tc->runs;
+		total_ns += tc->total_ns;
+		max_ns = max(max_ns, tc->max_ns);
+		expired += tc->expired;
+		modified += tc->modified;
+		for (i = 0; i < TB_BUCKETS; i++)
+			hist[i] += tc->hist[i];
+	}
+
+	pr_info("%u timers on each of %d cpus, timeouts %u-%u ms, "
+		"%u modifications per tick and cpu, %u seconds\n",
+		nr_timers, nr_cpus, min_timeout, max_timeout, mods_per_tick,
+		duration);
+	pr_info("%lu timers expired, %lu modified\n", expired, modified);
+	pr_info("%lu timer softirq runs, %llu ns total, %llu ns average, "
+		"%llu ns max\n", runs, (unsigned long long)total_ns,
+		(unsigned long long)(runs ? div64_u64(total_ns, runs) : 0),
+		(unsigned long long)max_ns);
+	for (i = 0; i < TB_BUCKETS; i++) {
+		if (!hist[i])
+			continue;
+		pr_info("  %10llu - %10llu ns: %lu\n", 1ULL << i,
+			(2ULL << i) - 1, hist[i]);
+	}
+}
+
+static int tb_control(void *unused)
+{
+	unsigned long end = jiffies + duration * HZ;
+
+	while (!kthread_should_stop() && time_before(jiffies, end))
+		schedule_timeout_interruptible(HZ);
+
+	tb_stop();
+	tb_report();
+
+	/* Wait for the module to be unloaded */
+	set_current_state(TASK_INTERRUPTIBLE);
+	while (!kthread_should_stop()) {
+		schedule();
+		set_current_state(TASK_INTERRUPTIBLE);
+	}
+	__set_current_state(TASK_RUNNING);
+	return 0;
+}
+
+static void tb_free(void)
+{
+	struct tb_cpu *tc;
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		tc = &per_cpu(tb_cpu, cpu);
+		vfree(tc->timers);
+		tc->timers = NULL;
+	}
+}
+
+static int __init timer_benchmark_init(void)
+{
+	struct task_struct *t;
+	struct tb_cpu *tc;
+	int cpu, ret;
+
+	if (!nr_timers || !min_timeout || min_timeout > max_timeout)
+		return -EINVAL;
+	min_jiffies = msecs_to_jiffies(min_timeout);
+	max_jiffies = msecs_to_jiffies(max_timeout);
+
+	for_each_online_cpu(cpu) {
+		tc = &per_cpu(tb_cpu, cpu);
+		tc->timers = vzalloc(nr_timers * sizeof(struct timer_list));
+		if (!tc->timers) {
+			tb_free();
+			return -ENOMEM;
+		}
+	}
+
+	ret = register_trace_softirq_entry(tb_softirq_entry, NULL);
+	if (ret)
+		goto out_free;
+	ret = register_trace_softirq_exit(tb_softirq_exit, NULL);
+	if (ret) {
+		unregister_trace_softirq_entry(tb_softirq_entry, NULL);
+		tracepoint_synchronize_unregister();
+		goto out_free;
+	}
+
+	for_each_online_cpu(cpu) {
+		tc = &per_cpu(tb_cpu, cpu);
+		t = kthread_create(tb_worker, tc, "timer_bench/%d", cpu);
+		if (IS_ERR(t)) {
+			ret = PTR_ERR(t);
+			goto out_stop;
+		}
+		kthread_bind(t, cpu);
+		tc->worker = t;
+		wake_up_process(t);
+	}
+
+	t = kthread_run(tb_control, NULL, "timer_bench");
+	if (IS_ERR(t)) {
+		ret = PTR_ERR(t);
+		goto out_stop;
+	}
+	tb_control_task = t;
+	return 0;
+
+out_stop:
+	tb_stop();
+out_free:
+	tb_free();
+	return ret;
+}
+
+static void __exit timer_benchmark_exit(void)
+{
+	kthread_stop(tb_control_task);
+	tb_free();
+}
+
+module_init(timer_benchmark_init);
+module_exit(timer_benchmark_exit);
@@ -0,0 +1,93 @@
+/*
+ * Benchmark of alloc_pages_bulk()/free_pages_bulk() against allocating
+ * and freeing the same number of order-0 pages one at a time.
+ *
+ * Each round allocates nr_pages pages and frees them again, first with
+ * alloc_page()/__free_page() in a loop and then with the bulk
+ * interfaces.  After nr_rounds rounds of each, the rate in pages per
+ * second is printed for both.  The whole run happens in init, which
+ * refuses the load with -EAGAIN, so it can be repeated with other
+ * parameters right away:
+ *
+ *	modprobe test_page_bulk nr_pages=64 nr_rounds=100000
+ */
+
+#define pr_fmt(fmt) "test_page_bulk: " fmt
+
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/gfp.h>
+#include <linux/mm.h>
+#include <linux/list.h>
+#include <linux/ktime.h>
+#include <linux/sched.h>
+
+static unsigned int nr_pages = 64;
+module_param(nr_pages, uint, 0444);
+MODULE_PARM_DESC(nr_pages, "Pages allocated and freed per round");
+
+static unsigned int nr_rounds = 100000;
+module_param(nr_rounds, uint, 0444);
+MODULE_PARM_DESC(nr_rounds, "Rounds per method");
+
+static int test_page_loop(void)
+{
+	struct page *page, *next;
+	unsigned int i;
+	LIST_HEAD(pages);
+
+	for (i = 0; i < nr_pages; i++) {
+		page = alloc_page(GFP_KERNEL);
+		if (!page)
+			break;
+		list_add(&page->lru, &pages);
+	}
+	list_for_each_entry_safe(page, next, &pages, lru) {
+		list_del(&page->lru);
+		__free_page(page);
+	}
+	return i == nr_pages ? 0 : -ENOMEM;
+}
+
+static int test_page_bulk(void)
+{
+	unsigned long allocated;
+	LIST_HEAD(pages);
+
+	allocated = alloc_pages_bulk(GFP_KERNEL, nr_pages, &pages);
+	free_pages_bulk(&pages);
+	return allocated == nr_pages ? 0 : -ENOMEM;
+}
+
+static void test_page_run(const char *name, int (*fn)(void))
+{
+	unsigned int i, failed = 0;
+	ktime_t start;
+	u64 ns;
+
+	start = ktime_get();
+	for (i = 0; i < nr_rounds; i++) {
+		if (fn())
+			failed++;
+		cond_resched();
+	}
+	ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+	pr_info("%s: %llu pages/s, %llu ns per round, %u failed\n",
+		name, div64_u64((u64)nr_pages * nr_rounds * NSEC_PER_SEC, ns ? : 1),
+		div_u64(ns, nr_rounds), failed);
+}
+
+static int __init test_page_bulk_init(void)
+{
+	if (!nr_pages || !nr_rounds)
+		return -EINVAL;
+
+	test_page_run("loop", test_page_loop);
+	test_page_run("bulk", test_page_bulk);
+	return -EAGAIN;
+}
+module_init(test_page_bulk_init);
+MODULE_LICENSE("GPL");
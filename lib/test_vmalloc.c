@@ -0,0 +1,140 @@
+/*
+ * Benchmark of vmalloc()/vfree() pairs run from several threads at once,
+ * to measure contention in the vmap area allocator.
+ *
+ * Every thread allocates and frees a buffer of nr_pages pages nr_pairs
+ * times, touching its first byte in between.  Once all threads are done
+ * the average cost of a pair is printed for each thread, along with the
+ * elapsed time of the whole run.  All threads start together and are
+ * reaped before init returns; the load itself then fails with -EAGAIN,
+ * leaving nothing to unload:
+ *
+ *	modprobe test_vmalloc nr_threads=16 nr_pairs=100000 nr_pages=4
+ */
+
+#define pr_fmt(fmt) "test_vmalloc: " fmt
+
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/kthread.h>
+#include <linux/completion.h>
+#include <linux/vmalloc.h>
+#include <linux/slab.h>
+#include <linux/ktime.h>
+#include <linux/atomic.h>
+#include <linux/sched.h>
+
+static unsigned int test_nr_threads;
+module_param_named(nr_threads, test_nr_threads, uint, 0444);
+MODULE_PARM_DESC(nr_threads, "Number of threads (default: online cpus)");
+
+static unsigned int nr_pairs = 100000;
+module_param(nr_pairs, uint, 0444);
+MODULE_PARM_DESC(nr_pairs, "vmalloc/vfree pairs per thread");
+
+static unsigned int nr_pages = 1;
+module_param(nr_pages, uint, 0444);
+MODULE_PARM_DESC(nr_pages, "Size of each buffer in pages");
+
+struct test_vmalloc_thread {
+	struct task_struct *task;
+	unsigned int id;
+	unsigned int failed;
+	u64 ns;
+};
+
+static atomic_t test_vmalloc_running;
+static DECLARE_COMPLETION(test_vmalloc_start);
+static DECLARE_COMPLETION(test_vmalloc_done);
+
+static int test_vmalloc_fn(void *data)
+{
+	struct test_vmalloc_thread *t = data;
+	unsigned long size = (unsigned long)nr_pages << PAGE_SHIFT;
+	ktime_t start;
+	unsigned int i;
+	char *p;
+
+	wait_for_completion(&test_vmalloc_start);
+
+	start = ktime_get();
+	for (i = 0; i < nr_pairs; i++) {
+		p = vmalloc(size);
+		if (!p) {
+			t->failed++;
+			continue;
+		}
+		*p = (char)i;
+		vfree(p);
+		cond_resched();
+	}
+	t->ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+	if (atomic_dec_and_test(&test_vmalloc_running))
+		complete(&test_vmalloc_done);
+
+	/* Returning runs module text: the init function must wait for us */
+	while (!kthread_should_stop()) {
+		set_current_state(TASK_INTERRUPTIBLE);
+		if (kthread_should_stop())
+			break;
+		schedule();
+	}
+	__set_current_state(TASK_RUNNING);
+	return 0;
+}
+
+static int __init test_vmalloc_init(void)
+{
+	struct test_vmalloc_thread *threads;
+	unsigned int i, started = 0;
+	ktime_t start;
+	u64 elapsed;
+
+	if (!test_nr_threads)
+		test_nr_threads = num_online_cpus();
+	if (!nr_pairs || !nr_pages)
+		return -EINVAL;
+
+	threads = kcalloc(test_nr_threads, sizeof(*threads), GFP_KERNEL);
+	if (!threads)
+		return -ENOMEM;
+
+	atomic_set(&test_vmalloc_running, test_nr_threads);
+	for (i = 0; i < test_nr_threads; i++) {
+		threads[i].id = i;
+		threads[i].task = kthread_run(test_vmalloc_fn, &threads[i],
+					      "test_vmalloc/%u", i);
+		if (IS_ERR(threads[i].task)) {
+			pr_err("failed to start thread %u\n", i);
+			break;
+		}
+		started++;
+	}
+	/* account for the threads that never started */
+	if (started < test_nr_threads &&
+	    atomic_sub_and_test(test_nr_threads - started,
+				&test_vmalloc_running))
+		complete(&test_vmalloc_done);
+
+	start = ktime_get();
+	complete_all(&test_vmalloc_start);
+	wait_for_completion(&test_vmalloc_done);
+	elapsed = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+	for (i = 0; i < started; i++)
+		kthread_stop(threads[i].task);
+
+	for (i = 0; i < started; i++)
+		pr_info("thread %u: %llu ns per pair, %u failed\n",
+			i, div_u64(threads[i].ns, nr_pairs), threads[i].failed);
+	pr_info("%u threads x %u pairs of %u pages in %llu us\n",
+		started, nr_pairs, nr_pages, div_u64(elapsed, NSEC_PER_USEC));
+
+	kfree(threads);
+	return -EAGAIN;
+}
+module_init(test_vmalloc_init);
+MODULE_LICENSE("GPL");
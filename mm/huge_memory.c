@@ -40,12 +40,11 @@ unsigned long transparent_hugepage_flags __read_mostly =
 
 /* default scan 8*512 pte (or vmas) every 30 second */
 static unsigned int khugepaged_pages_to_scan __read_mostly = HPAGE_PMD_NR*8;
-static unsigned int khugepaged_pages_collapsed;
+static atomic_t khugepaged_pages_collapsed = ATOMIC_INIT(0);
 static unsigned int khugepaged_full_scans;
 static unsigned int khugepaged_scan_sleep_millisecs __read_mostly = 10000;
 /* during fragmentation poll the hugepage allocator once every minute */
 static unsigned int khugepaged_alloc_sleep_millisecs __read_mostly = 60000;
-static struct task_struct *khugepaged_thread __read_mostly;
 static DEFINE_MUTEX(khugepaged_mutex);
 static DEFINE_SPINLOCK(khugepaged_mm_lock);
 static DECLARE_WAIT_QUEUE_HEAD(khugepaged_wait);
@@ -56,7 +55,7 @@ static DECLARE_WAIT_QUEUE_HEAD(khugepaged_wait);
  */
 static unsigned int khugepaged_max_ptes_none __read_mostly = HPAGE_PMD_NR-1;
 
-static int khugepaged(void *none);
+static int khugepaged(void *data);
 static int mm_slots_hash_init(void);
 static int khugepaged_slab_init(void);
 static void khugepaged_slab_free(void);
@@ -68,13 +67,15 @@ static struct kmem_cache *mm_slot_cache __read_mostly;
 /**
  * struct mm_slot - hash lookup from mm to mm_slot
  * @hash: hash collision list
- * @mm_node: khugepaged scan list headed in khugepaged_scan.mm_head
+ * @mm_node: khugepaged scan list headed in khugepaged_scans[nid].mm_head
  * @mm: the mm that this information is valid for
+ * @nid: the node whose khugepaged worker owns this mm_slot
  */
 struct mm_slot {
 	struct hlist_node hash;
 	struct list_head mm_node;
 	struct mm_struct *mm;
+	int nid;
 };
 
 /**
@@ -82,17 +83,41 @@ struct mm_slot {
  * @mm_head: the head of the mm list to scan
  * @mm_slot: the current mm_slot we are scanning
  * @address: the next address inside that to be scanned
+ * @thread: the khugepaged worker walking this cursor
+ * @nid: the node this worker is bound to
  *
- * There is only the one khugepaged_scan instance of this cursor structure.
+ * There is one khugepaged_scan instance per node.  Every mm is queued
+ * on the list of the node it registered from, so the workers never
+ * scan the same mm and can collapse pages in parallel.
  */
 struct khugepaged_scan {
 	struct list_head mm_head;
 	struct mm_slot *mm_slot;
 	unsigned long address;
+	struct task_struct *thread;
+	int nid;
 };
-static struct khugepaged_scan khugepaged_scan = {
-	.mm_head = LIST_HEAD_INIT(khugepaged_scan.mm_head),
-};
+static struct khugepaged_scan khugepaged_scans[MAX_NUMNODES];
+
+static void __init khugepaged_scans_init(void)
+{
+	int nid;
+
+	for (nid = 0; nid < MAX_NUMNODES; nid++) {
+		INIT_LIST_HEAD(&khugepaged_scans[nid].mm_head);
+		khugepaged_scans[nid].nid = nid;
+	}
+}
+
+static int khugepaged_has_mms(void)
+{
+	int nid;
+
+	for_each_node(nid)
+		if (!list_empty(&khugepaged_scans[nid].mm_head))
+			return 1;
+	return 0;
+}
 
 
 static int set_recommended_min_free_kbytes(void)
@@ -135,26 +160,45 @@ static int set_recommended_min_free_kbytes(void)
 }
 late_initcall(set_recommended_min_free_kbytes);
 
+static int start_khugepaged_node(int nid)
+{
+	struct khugepaged_scan *scan = &khugepaged_scans[nid];
+	struct task_struct *thread;
+
+	if (scan->thread)
+		return 0;
+
+	thread = kthread_create_on_node(khugepaged, scan, nid,
+					"khugepaged/%d", nid);
+	if (unlikely(IS_ERR(thread))) {
+		printk(KERN_ERR
+		       "khugepaged: kthread_create(khugepaged/%d) failed\n",
+		       nid);
+		return PTR_ERR(thread);
+	}
+	if (cpumask_weight(cpumask_of_node(nid)))
+		set_cpus_allowed_ptr(thread, cpumask_of_node(nid));
+	scan->thread = thread;
+	wake_up_process(thread);
+	return 0;
+}
+
 static int start_khugepaged(void)
 {
 	int err = 0;
 	if (khugepaged_enabled()) {
-		int wakeup;
+		int wakeup, nid;
 		if (unlikely(!mm_slot_cache || !mm_slots_hash)) {
 			err = -ENOMEM;
 			goto out;
 		}
 		mutex_lock(&khugepaged_mutex);
-		if (!khugepaged_thread)
-			khugepaged_thread = kthread_run(khugepaged, NULL,
-							"khugepaged");
-		if (unlikely(IS_ERR(khugepaged_thread))) {
-			printk(KERN_ERR
-			       "khugepaged: kthread_run(khugepaged) failed\n");
-			err = PTR_ERR(khugepaged_thread);
-			khugepaged_thread = NULL;
+		for_each_online_node(nid) {
+			err = start_khugepaged_node(nid);
+			if (err)
+				break;
 		}
-		wakeup = !list_empty(&khugepaged_scan.mm_head);
+		wakeup = khugepaged_has_mms();
 		mutex_unlock(&khugepaged_mutex);
 		if (wakeup)
 			wake_up_interruptible(&khugepaged_wait);
@@ -408,7 +452,7 @@ static ssize_t pages_collapsed_show(struct kobject *kobj,
 				    struct kobj_attribute *attr,
 				    char *buf)
 {
-	return sprintf(buf, "%u\n", khugepaged_pages_collapsed);
+	return sprintf(buf, "%u\n", atomic_read(&khugepaged_pages_collapsed));
 }
 static struct kobj_attribute pages_collapsed_attr =
 	__ATTR_RO(pages_collapsed);
@@ -541,6 +585,8 @@ static int __init hugepage_init(void)
 	int err;
 	struct kobject *hugepage_kobj;
 
+	khugepaged_scans_init();
+
 	if (!has_transparent_hugepage()) {
 		transparent_hugepage_flags = 0;
 		return -EINVAL;
@@ -667,6 +713,7 @@ static int __do_huge_pmd_anonymous_page(struct mm_struct *mm,
 		set_pmd_at(mm, haddr, pmd, entry);
 		prepare_pmd_huge_pte(pgtable, mm);
 		add_mm_counter(mm, MM_ANONPAGES, HPAGE_PMD_NR);
+		add_mm_counter(mm, MM_ANONHUGEPAGES, HPAGE_PMD_NR);
 		mm->nr_ptes++;
 		spin_unlock(&mm->page_table_lock);
 	}
@@ -787,6 +834,7 @@ int copy_huge_pmd(struct mm_struct *dst_mm, struct mm_struct *src_mm,
 	get_page(src_page);
 	page_dup_rmap(src_page);
 	add_mm_counter(dst_mm, MM_ANONPAGES, HPAGE_PMD_NR);
+	add_mm_counter(dst_mm, MM_ANONHUGEPAGES, HPAGE_PMD_NR);
 
 	pmdp_set_wrprotect(src_mm, addr, src_pmd);
 	pmd = pmd_mkold(pmd_wrprotect(pmd));
@@ -894,6 +942,7 @@ static int do_huge_pmd_wp_page_fallback(struct mm_struct *mm,
 	smp_wmb(); /* make pte visible before pmd */
 	pmd_populate(mm, pmd, pgtable);
 	page_remove_rmap(page);
+	add_mm_counter(mm, MM_ANONHUGEPAGES, -HPAGE_PMD_NR);
 	spin_unlock(&mm->page_table_lock);
 
 	ret |= VM_FAULT_WRITE;
@@ -1048,6 +1097,7 @@ int zap_huge_pmd(struct mmu_gather *tlb, struct vm_area_struct *vma,
 		page_remove_rmap(page);
 		VM_BUG_ON(page_mapcount(page) < 0);
 		add_mm_counter(tlb->mm, MM_ANONPAGES, -HPAGE_PMD_NR);
+		add_mm_counter(tlb->mm, MM_ANONHUGEPAGES, -HPAGE_PMD_NR);
 		VM_BUG_ON(!PageHead(page));
 		tlb->mm->nr_ptes--;
 		spin_unlock(&tlb->mm->page_table_lock);
@@ -1409,6 +1459,7 @@ static int __split_huge_page_map(struct page *page,
 		set_pmd_at(mm, address, pmd, pmd_mknotpresent(*pmd));
 		flush_tlb_range(vma, address, address + HPAGE_PMD_SIZE);
 		pmd_populate(mm, pmd, pgtable);
+		add_mm_counter(mm, MM_ANONHUGEPAGES, -HPAGE_PMD_NR);
 		ret = 1;
 	}
 	spin_unlock(&mm->page_table_lock);
@@ -1612,6 +1663,7 @@ static inline int khugepaged_test_exit(struct mm_struct *mm)
 
 int __khugepaged_enter(struct mm_struct *mm)
 {
+	struct khugepaged_scan *scan;
 	struct mm_slot *mm_slot;
 	int wakeup;
 
@@ -1626,14 +1678,29 @@ int __khugepaged_enter(struct mm_struct *mm)
 		return 0;
 	}
 
+	/*
+	 * Hand the mm to the worker of the node it is faulting from,
+	 * which is where most of its memory is likely to live.
+	 */
+	mm_slot->nid = numa_node_id();
+	scan = &khugepaged_scans[mm_slot->nid];
+
+	/* The node may have come online after the workers were started */
+	if (unlikely(!ACCESS_ONCE(scan->thread))) {
+		mutex_lock(&khugepaged_mutex);
+		if (khugepaged_enabled())
+			start_khugepaged_node(mm_slot->nid);
+		mutex_unlock(&khugepaged_mutex);
+	}
+
 	spin_lock(&khugepaged_mm_lock);
 	insert_to_mm_slots_hash(mm, mm_slot);
 	/*
 	 * Insert just behind the scanning cursor, to let the area settle
 	 * down a little.
 	 */
-	wakeup = list_empty(&khugepaged_scan.mm_head);
-	list_add_tail(&mm_slot->mm_node, &khugepaged_scan.mm_head);
+	wakeup = list_empty(&scan->mm_head);
+	list_add_tail(&mm_slot->mm_node, &scan->mm_head);
 	spin_unlock(&khugepaged_mm_lock);
 
 	atomic_inc(&mm->mm_count);
@@ -1674,7 +1741,7 @@ void __khugepaged_exit(struct mm_struct *mm)
 
 	spin_lock(&khugepaged_mm_lock);
 	mm_slot = get_mm_slot(mm);
-	if (mm_slot && khugepaged_scan.mm_slot != mm_slot) {
+	if (mm_slot && khugepaged_scans[mm_slot->nid].mm_slot != mm_slot) {
 		hlist_del(&mm_slot->hash);
 		list_del(&mm_slot->mm_node);
 		free = 1;
@@ -1991,12 +2058,13 @@ static void collapse_huge_page(struct mm_struct *mm,
 	set_pmd_at(mm, address, pmd, _pmd);
 	update_mmu_cache(vma, address, _pmd);
 	prepare_pmd_huge_pte(pgtable, mm);
+	add_mm_counter(mm, MM_ANONHUGEPAGES, HPAGE_PMD_NR);
 	spin_unlock(&mm->page_table_lock);
 
 #ifndef CONFIG_NUMA
 	*hpage = NULL;
 #endif
-	khugepaged_pages_collapsed++;
+	atomic_inc(&khugepaged_pages_collapsed);
 out_up_write:
 	up_write(&mm->mmap_sem);
 	return;
@@ -2104,7 +2172,8 @@ static void collect_mm_slot(struct mm_slot *mm_slot)
 	}
 }
 
-static unsigned int khugepaged_scan_mm_slot(unsigned int pages,
+static unsigned int khugepaged_scan_mm_slot(struct khugepaged_scan *scan,
+					    unsigned int pages,
 					    struct page **hpage)
 	__releases(&khugepaged_mm_lock)
 	__acquires(&khugepaged_mm_lock)
@@ -2117,13 +2186,13 @@ static unsigned int khugepaged_scan_mm_slot(unsigned int pages,
 	VM_BUG_ON(!pages);
 	VM_BUG_ON(NR_CPUS != 1 && !spin_is_locked(&khugepaged_mm_lock));
 
-	if (khugepaged_scan.mm_slot)
-		mm_slot = khugepaged_scan.mm_slot;
+	if (scan->mm_slot)
+		mm_slot = scan->mm_slot;
 	else {
-		mm_slot = list_entry(khugepaged_scan.mm_head.next,
+		mm_slot = list_entry(scan->mm_head.next,
 				     struct mm_slot, mm_node);
-		khugepaged_scan.address = 0;
-		khugepaged_scan.mm_slot = mm_slot;
+		scan->address = 0;
+		scan->mm_slot = mm_slot;
 	}
 	spin_unlock(&khugepaged_mm_lock);
 
@@ -2132,7 +2201,7 @@ static unsigned int khugepaged_scan_mm_slot(unsigned int pages,
 	if (unlikely(khugepaged_test_exit(mm)))
 		vma = NULL;
 	else
-		vma = find_vma(mm, khugepaged_scan.address);
+		vma = find_vma(mm, scan->address);
 
 	progress++;
 	for (; vma; vma = vma->vm_next) {
@@ -2166,26 +2235,26 @@ static unsigned int khugepaged_scan_mm_slot(unsigned int pages,
 		hend = vma->vm_end & HPAGE_PMD_MASK;
 		if (hstart >= hend)
 			goto skip;
-		if (khugepaged_scan.address > hend)
+		if (scan->address > hend)
 			goto skip;
-		if (khugepaged_scan.address < hstart)
-			khugepaged_scan.address = hstart;
-		VM_BUG_ON(khugepaged_scan.address & ~HPAGE_PMD_MASK);
+		if (scan->address < hstart)
+			scan->address = hstart;
+		VM_BUG_ON(scan->address & ~HPAGE_PMD_MASK);
 
-		while (khugepaged_scan.address < hend) {
+		while (scan->address < hend) {
 			int ret;
 			cond_resched();
 			if (unlikely(khugepaged_test_exit(mm)))
 				goto breakouterloop;
 
-			VM_BUG_ON(khugepaged_scan.address < hstart ||
-				  khugepaged_scan.address + HPAGE_PMD_SIZE >
+			VM_BUG_ON(scan->address < hstart ||
+				  scan->address + HPAGE_PMD_SIZE >
 				  hend);
 			ret = khugepaged_scan_pmd(mm, vma,
-						  khugepaged_scan.address,
+						  scan->address,
 						  hpage);
 			/* move to next address */
-			khugepaged_scan.address += HPAGE_PMD_SIZE;
+			scan->address += HPAGE_PMD_SIZE;
 			progress += HPAGE_PMD_NR;
 			if (ret)
 				/* we released mmap_sem so break loop */
@@ -2199,7 +2268,7 @@ breakouterloop:
 breakouterloop_mmap_sem:
 
 	spin_lock(&khugepaged_mm_lock);
-	VM_BUG_ON(khugepaged_scan.mm_slot != mm_slot);
+	VM_BUG_ON(scan->mm_slot != mm_slot);
 	/*
 	 * Release the current mm_slot if this mm is about to die, or
 	 * if we scanned all vmas of this mm.
@@ -2210,13 +2279,13 @@ breakouterloop_mmap_sem:
 		 * khugepaged runs here, khugepaged_exit will find
 		 * mm_slot not pointing to the exiting mm.
 		 */
-		if (mm_slot->mm_node.next != &khugepaged_scan.mm_head) {
-			khugepaged_scan.mm_slot = list_entry(
+		if (mm_slot->mm_node.next != &scan->mm_head) {
+			scan->mm_slot = list_entry(
 				mm_slot->mm_node.next,
 				struct mm_slot, mm_node);
-			khugepaged_scan.address = 0;
+			scan->address = 0;
 		} else {
-			khugepaged_scan.mm_slot = NULL;
+			scan->mm_slot = NULL;
 			khugepaged_full_scans++;
 		}
 
@@ -2226,19 +2295,20 @@ breakouterloop_mmap_sem:
 	return progress;
 }
 
-static int khugepaged_has_work(void)
+static int khugepaged_has_work(struct khugepaged_scan *scan)
 {
-	return !list_empty(&khugepaged_scan.mm_head) &&
+	return !list_empty(&scan->mm_head) &&
 		khugepaged_enabled();
 }
 
-static int khugepaged_wait_event(void)
+static int khugepaged_wait_event(struct khugepaged_scan *scan)
 {
-	return !list_empty(&khugepaged_scan.mm_head) ||
+	return !list_empty(&scan->mm_head) ||
 		!khugepaged_enabled();
 }
 
-static void khugepaged_do_scan(struct page **hpage)
+static void khugepaged_do_scan(struct khugepaged_scan *scan,
+			       struct page **hpage)
 {
 	unsigned int progress = 0, pass_through_head = 0;
 	unsigned int pages = khugepaged_pages_to_scan;
@@ -2266,11 +2336,12 @@ static void khugepaged_do_scan(struct page **hpage)
 			break;
 
 		spin_lock(&khugepaged_mm_lock);
-		if (!khugepaged_scan.mm_slot)
+		if (!scan->mm_slot)
 			pass_through_head++;
-		if (khugepaged_has_work() &&
+		if (khugepaged_has_work(scan) &&
 		    pass_through_head < 2)
-			progress += khugepaged_scan_mm_slot(pages - progress,
+			progress += khugepaged_scan_mm_slot(scan,
+							    pages - progress,
 							    hpage);
 		else
 			progress = pages;
@@ -2302,7 +2373,7 @@ static struct page *khugepaged_alloc_hugepage(void)
 }
 #endif
 
-static void khugepaged_loop(void)
+static void khugepaged_loop(struct khugepaged_scan *scan)
 {
 	struct page *hpage;
 
@@ -2321,7 +2392,7 @@ static void khugepaged_loop(void)
 		}
 #endif
 
-		khugepaged_do_scan(&hpage);
+		khugepaged_do_scan(scan, &hpage);
 #ifndef CONFIG_NUMA
 		if (hpage)
 			put_page(hpage);
@@ -2329,19 +2400,20 @@ static void khugepaged_loop(void)
 		try_to_freeze();
 		if (unlikely(kthread_should_stop()))
 			break;
-		if (khugepaged_has_work()) {
+		if (khugepaged_has_work(scan)) {
 			if (!khugepaged_scan_sleep_millisecs)
 				continue;
 			wait_event_freezable_timeout(khugepaged_wait, false,
 			    msecs_to_jiffies(khugepaged_scan_sleep_millisecs));
 		} else if (khugepaged_enabled())
 			wait_event_freezable(khugepaged_wait,
-					     khugepaged_wait_event());
+					     khugepaged_wait_event(scan));
 	}
 }
 
-static int khugepaged(void *none)
+static int khugepaged(void *data)
 {
+	struct khugepaged_scan *scan = data;
 	struct mm_slot *mm_slot;
 
 	set_freezable();
@@ -2352,9 +2424,9 @@ static int khugepaged(void *none)
 
 	for (;;) {
 		mutex_unlock(&khugepaged_mutex);
-		VM_BUG_ON(khugepaged_thread != current);
-		khugepaged_loop();
-		VM_BUG_ON(khugepaged_thread != current);
+		VM_BUG_ON(scan->thread != current);
+		khugepaged_loop(scan);
+		VM_BUG_ON(scan->thread != current);
 
 		mutex_lock(&khugepaged_mutex);
 		if (!khugepaged_enabled())
@@ -2364,13 +2436,13 @@ static int khugepaged(void *none)
 	}
 
 	spin_lock(&khugepaged_mm_lock);
-	mm_slot = khugepaged_scan.mm_slot;
-	khugepaged_scan.mm_slot = NULL;
+	mm_slot = scan->mm_slot;
+	scan->mm_slot = NULL;
 	if (mm_slot)
 		collect_mm_slot(mm_slot);
 	spin_unlock(&khugepaged_mm_lock);
 
-	khugepaged_thread = NULL;
+	scan->thread = NULL;
 	mutex_unlock(&khugepaged_mutex);
 
 	return 0;
@@ -356,3 +356,33 @@ extern unsigned long vm_mmap_pgoff(struct file *, unsigned long,
         unsigned long, unsigned long);
 
 extern void set_pageblock_order(void);
+
+#ifdef CONFIG_NUMA_BALANCING
+/*
+ * The protection NUMA hinting ptes are given: that of the vma with all
+ * access removed, so that any access to the page faults.
+ */
+static inline pgprot_t vma_prot_none(struct vm_area_struct *vma)
+{
+	return vm_get_page_prot(vma->vm_flags & ~(VM_READ|VM_WRITE|VM_EXEC));
+}
+
+/*
+ * Is this present pte a NUMA hinting pte set up by change_prot_numa()?
+ * Genuine PROT_NONE mappings never are, and neither are ptes which still
+ * carry the vma's own protection.
+ */
+static inline bool pte_numa(struct vm_area_struct *vma, pte_t pte)
+{
+	if (!(vma->vm_flags & (VM_READ|VM_WRITE|VM_EXEC)))
+		return false;
+	if (pte_same(pte, pte_modify(pte, vma->vm_page_prot)))
+		return false;
+	return pte_same(pte, pte_modify(pte, vma_prot_none(vma)));
+}
+#else
+static inline bool pte_numa(struct vm_area_struct *vma, pte_t pte)
+{
+	return false;
+}
+#endif
@@ -23,7 +23,7 @@
 #include <linux/pagemap.h>
 #include <linux/rmap.h>
 #include <linux/spinlock.h>
-#include <linux/jhash.h>
+#include <linux/bitops.h>
 #include <linux/delay.h>
 #include <linux/kthread.h>
 #include <linux/wait.h>
@@ -78,6 +78,14 @@
  *    take 10 attempts to find a page in the unstable tree, once it is found,
  *    it is secured in the stable tree.  (When we scan a new page, we first
  *    compare it against the stable tree, and then against the unstable tree.)
+ *
+ * Unless merge_across_nodes is set, there is a stable and an unstable tree
+ * per NUMA node, and a page is only ever merged with pages of its own node.
+ *
+ * The mm_slots list may be scanned by several ksmd threads at once: each
+ * mm_slot belongs to one thread, each thread keeps its own cursor, and a
+ * full scan ends when every thread has been through its share of the list.
+ * The trees of each node are serialized by that node's tree lock.
  */
 
 /**
@@ -86,28 +94,46 @@
  * @mm_list: link into the mm_slots list, rooted in ksm_mm_head
  * @rmap_list: head for this mm_slot's singly-linked list of rmap_items
  * @mm: the mm that this information is valid for
+ * @seq: order of arrival, which decides the ksmd thread scanning this mm
  */
 struct mm_slot {
 	struct hlist_node link;
 	struct list_head mm_list;
 	struct rmap_item *rmap_list;
 	struct mm_struct *mm;
+	unsigned long seq;
 };
 
 /**
- * struct ksm_scan - cursor for scanning
+ * struct ksm_scan - cursor for scanning, one per ksmd thread
  * @mm_slot: the current mm_slot we are scanning
  * @address: the next address inside that to be scanned
  * @rmap_list: link to the next rmap to be scanned in the rmap_list
- * @seqnr: count of completed full scans (needed when removing unstable node)
- *
- * There is only the one ksm_scan instance of this cursor structure.
+ * @stale: rmap_items unlinked under mmap_sem, to be removed from the trees
+ * @id: index of this cursor, and of the thread using it
+ * @done: this thread has finished its share of the current full scan
+ * @task: the ksmd thread, if running
+ * @pages_scanned: pages scanned by this thread
+ * @pages_merged: pages merged by this thread
+ * @rate_stamp: jiffies when the rates below were last sampled
+ * @scan_rate: pages scanned per second over the last sample
+ * @merge_rate: pages merged per second over the last sample
  */
 struct ksm_scan {
 	struct mm_slot *mm_slot;
 	unsigned long address;
 	struct rmap_item **rmap_list;
-	unsigned long seqnr;
+	struct rmap_item *stale;
+	int id;
+	bool done;
+	struct task_struct *task;
+	unsigned long pages_scanned;
+	unsigned long pages_merged;
+	unsigned long rate_stamp;
+	unsigned long rate_scanned;
+	unsigned long rate_merged;
+	unsigned long scan_rate;
+	unsigned long merge_rate;
 };
 
 /**
@@ -115,11 +141,13 @@ struct ksm_scan {
  * @node: rb node of this ksm page in the stable tree
  * @hlist: hlist head of rmap_items using this ksm page
  * @kpfn: page frame number of this ksm page
+ * @nid: the NUMA node whose stable tree holds this node
  */
 struct stable_node {
 	struct rb_node node;
 	struct hlist_head hlist;
 	unsigned long kpfn;
+	int nid;
 };
 
 /**
@@ -129,6 +157,7 @@ struct stable_node {
  * @mm: the memory structure this rmap_item is pointing into
  * @address: the virtual address this rmap_item tracks (+ flags in low bits)
  * @oldchecksum: previous checksum of the page at that virtual address
+ * @nid: NUMA node of the tree holding this rmap_item, when in one
  * @node: rb node of this rmap_item in the unstable tree
  * @head: pointer to stable_node heading this list in the stable tree
  * @hlist: link into hlist of rmap_items hanging off that stable_node
@@ -139,6 +168,7 @@ struct rmap_item {
 	struct mm_struct *mm;
 	unsigned long address;		/* + low bits used for flags below */
 	unsigned int oldchecksum;	/* when unstable */
+	int nid;
 	union {
 		struct rb_node node;	/* when node of unstable tree */
 		struct {		/* when listed from stable tree */
@@ -152,9 +182,20 @@ struct rmap_item {
 #define UNSTABLE_FLAG	0x100	/* is a node of the unstable tree */
 #define STABLE_FLAG	0x200	/* is listed from the stable tree */
 
-/* The stable and unstable tree heads */
-static struct rb_root root_stable_tree = RB_ROOT;
-static struct rb_root root_unstable_tree = RB_ROOT;
+/**
+ * struct ksm_tree - the stable and unstable tree heads of one NUMA node
+ * @stable: the stable tree
+ * @unstable: the unstable tree, reset after each full scan
+ * @lock: serializes ksmd threads searching and changing these trees
+ */
+struct ksm_tree {
+	struct rb_root stable;
+	struct rb_root unstable;
+	struct mutex lock;
+};
+
+/* One ksm_tree per node, or just ksm_trees[0] if merge_across_nodes */
+static struct ksm_tree *ksm_trees;
 
 #define MM_SLOTS_HASH_SHIFT 10
 #define MM_SLOTS_HASH_HEADS (1 << MM_SLOTS_HASH_SHIFT)
@@ -163,25 +204,44 @@ static struct hlist_head mm_slots_hash[MM_SLOTS_HASH_HEADS];
 static struct mm_slot ksm_mm_head = {
 	.mm_list = LIST_HEAD_INIT(ksm_mm_head.mm_list),
 };
-static struct ksm_scan ksm_scan = {
-	.mm_slot = &ksm_mm_head,
+#define KSM_MAX_SCAN_THREADS	32
+
+static struct ksm_scan ksm_scans[KSM_MAX_SCAN_THREADS] = {
+	[0 ... KSM_MAX_SCAN_THREADS - 1] = {
+		.mm_slot = &ksm_mm_head,
+	},
 };
 
+/* Number of ksmd threads sharing out the mm_slots list */
+static unsigned int ksm_nr_scan_threads = 1;
+
+/* Threads which have finished their share of the current full scan */
+static unsigned int ksm_scans_done;
+
+/* The mm_slot unmerge_and_remove_all_rmap_items() is working on */
+static struct mm_slot *ksm_unmerge_slot;
+
+/* Count of completed full scans (needed when removing unstable node) */
+static unsigned long ksm_seqnr;
+
+/* Order of arrival of the next mm_slot */
+static unsigned long ksm_slot_seq;
+
 static struct kmem_cache *rmap_item_cache;
 static struct kmem_cache *stable_node_cache;
 static struct kmem_cache *mm_slot_cache;
 
 /* The number of nodes in the stable tree */
-static unsigned long ksm_pages_shared;
+static atomic_long_t ksm_pages_shared;
 
 /* The number of page slots additionally sharing those nodes */
-static unsigned long ksm_pages_sharing;
+static atomic_long_t ksm_pages_sharing;
 
 /* The number of nodes in the unstable tree */
-static unsigned long ksm_pages_unshared;
+static atomic_long_t ksm_pages_unshared;
 
 /* The number of rmap_items in use: to calculate pages_volatile */
-static unsigned long ksm_rmap_items;
+static atomic_long_t ksm_rmap_items;
 
 /* Number of pages ksmd should scan in one batch */
 static unsigned int ksm_thread_pages_to_scan = 100;
@@ -194,8 +254,15 @@ static unsigned int ksm_thread_sleep_millisecs = 20;
 #define KSM_RUN_UNMERGE	2
 static unsigned int ksm_run = KSM_RUN_STOP;
 
+/* Zero to keep merges within a NUMA node, and a tree per node */
+static unsigned int ksm_merge_across_nodes;
+
+/*
+ * ksmd threads hold ksm_thread_sem for read while scanning; the control
+ * paths which must see them all stopped take it for write.
+ */
 static DECLARE_WAIT_QUEUE_HEAD(ksm_thread_wait);
-static DEFINE_MUTEX(ksm_thread_mutex);
+static DECLARE_RWSEM(ksm_thread_sem);
 static DEFINE_SPINLOCK(ksm_mmlist_lock);
 
 #define KSM_KMEM_CACHE(__struct, __flags) kmem_cache_create("ksm_"#__struct,\
@@ -240,13 +307,13 @@ static inline struct rmap_item *alloc_rmap_item(void)
 
 	rmap_item = kmem_cache_zalloc(rmap_item_cache, GFP_KERNEL);
 	if (rmap_item)
-		ksm_rmap_items++;
+		atomic_long_inc(&ksm_rmap_items);
 	return rmap_item;
 }
 
 static inline void free_rmap_item(struct rmap_item *rmap_item)
 {
-	ksm_rmap_items--;
+	atomic_long_dec(&ksm_rmap_items);
 	rmap_item->mm = NULL;	/* debug safety */
 	kmem_cache_free(rmap_item_cache, rmap_item);
 }
@@ -302,6 +369,40 @@ static inline int in_stable_tree(struct rmap_item *rmap_item)
 	return rmap_item->address & STABLE_FLAG;
 }
 
+static inline int get_kpfn_nid(unsigned long kpfn)
+{
+	return ksm_merge_across_nodes ? 0 : pfn_to_nid(kpfn);
+}
+
+/* Caller holds ksm_mmlist_lock */
+static inline bool ksm_slot_owned(struct ksm_scan *scan, struct mm_slot *slot)
+{
+	return slot->seq % ksm_nr_scan_threads == scan->id;
+}
+
+/* Caller holds ksm_mmlist_lock */
+static struct mm_slot *ksm_next_slot(struct ksm_scan *scan,
+				     struct mm_slot *slot)
+{
+	do {
+		slot = list_entry(slot->mm_list.next, struct mm_slot, mm_list);
+	} while (slot != &ksm_mm_head && !ksm_slot_owned(scan, slot));
+	return slot;
+}
+
+/* Caller holds ksm_mmlist_lock */
+static bool ksm_slot_scanned(struct mm_slot *slot)
+{
+	int i;
+
+	if (slot == ksm_unmerge_slot)
+		return true;
+	for (i = 0; i < KSM_MAX_SCAN_THREADS; i++)
+		if (ksm_scans[i].mm_slot == slot)
+			return true;
+	return false;
+}
+
 /*
  * ksmd, and unmerge_and_remove_all_rmap_items(), must not touch an mm's
  * page tables after it has passed through ksm_exit() - which, if necessary,
@@ -454,15 +555,15 @@ static void remove_node_from_stable_tree(struct stable_node *stable_node)
 
 	hlist_for_each_entry(rmap_item, hlist, &stable_node->hlist, hlist) {
 		if (rmap_item->hlist.next)
-			ksm_pages_sharing--;
+			atomic_long_dec(&ksm_pages_sharing);
 		else
-			ksm_pages_shared--;
+			atomic_long_dec(&ksm_pages_shared);
 		put_anon_vma(rmap_item->anon_vma);
 		rmap_item->address &= PAGE_MASK;
 		cond_resched();
 	}
 
-	rb_erase(&stable_node->node, &root_stable_tree);
+	rb_erase(&stable_node->node, &ksm_trees[stable_node->nid].stable);
 	free_stable_node(stable_node);
 }
 
@@ -484,7 +585,7 @@ static void remove_node_from_stable_tree(struct stable_node *stable_node)
  * a page to put something that might look like our key in page->mapping.
  *
  * include/linux/pagemap.h page_cache_get_speculative() is a good reference,
- * but this is different - made simpler by ksm_thread_mutex being held, but
+ * but this is different - made simpler by the tree lock being held, but
  * interesting for assuming that no other use of the struct page could ever
  * put our expected_mapping into page->mapping (or a field of the union which
  * coincides with page->mapping).  The RCU calls are not for KSM at all, but
@@ -523,8 +624,9 @@ stale:
 /*
  * Removing rmap_item from stable or unstable tree.
  * This function will clean the information from the stable/unstable tree.
+ * The caller holds the lock of the tree the rmap_item is in.
  */
-static void remove_rmap_item_from_tree(struct rmap_item *rmap_item)
+static void __remove_rmap_item_from_tree(struct rmap_item *rmap_item)
 {
 	if (rmap_item->address & STABLE_FLAG) {
 		struct stable_node *stable_node;
@@ -541,9 +643,9 @@ static void remove_rmap_item_from_tree(struct rmap_item *rmap_item)
 		put_page(page);
 
 		if (stable_node->hlist.first)
-			ksm_pages_sharing--;
+			atomic_long_dec(&ksm_pages_sharing);
 		else
-			ksm_pages_shared--;
+			atomic_long_dec(&ksm_pages_shared);
 
 		put_anon_vma(rmap_item->anon_vma);
 		rmap_item->address &= PAGE_MASK;
@@ -552,31 +654,74 @@ static void remove_rmap_item_from_tree(struct rmap_item *rmap_item)
 		unsigned char age;
 		/*
 		 * Usually ksmd can and must skip the rb_erase, because
-		 * root_unstable_tree was already reset to RB_ROOT.
+		 * the unstable tree was already reset to RB_ROOT.
 		 * But be careful when an mm is exiting: do the rb_erase
 		 * if this rmap_item was inserted by this scan, rather
 		 * than left over from before.
 		 */
-		age = (unsigned char)(ksm_scan.seqnr - rmap_item->address);
+		age = (unsigned char)(ksm_seqnr - rmap_item->address);
 		BUG_ON(age > 1);
 		if (!age)
-			rb_erase(&rmap_item->node, &root_unstable_tree);
+			rb_erase(&rmap_item->node,
+				 &ksm_trees[rmap_item->nid].unstable);
 
-		ksm_pages_unshared--;
+		atomic_long_dec(&ksm_pages_unshared);
 		rmap_item->address &= PAGE_MASK;
 	}
 out:
 	cond_resched();		/* we're called from many long loops */
 }
 
-static void remove_trailing_rmap_items(struct mm_slot *mm_slot,
-				       struct rmap_item **rmap_list)
+/*
+ * Only another ksmd thread holding the tree lock can change the flags of an
+ * rmap_item in a tree, and it never puts one into a tree, so it's safe to
+ * peek at them before taking the lock.
+ */
+static void remove_rmap_item_from_tree(struct rmap_item *rmap_item)
+{
+	struct mutex *lock;
+
+	if (!(rmap_item->address & (STABLE_FLAG | UNSTABLE_FLAG))) {
+		cond_resched();
+		return;
+	}
+
+	lock = &ksm_trees[rmap_item->nid].lock;
+	mutex_lock(lock);
+	__remove_rmap_item_from_tree(rmap_item);
+	mutex_unlock(lock);
+}
+
+/*
+ * rmap_items are unlinked from their mm_slot while holding its mmap_sem,
+ * but removing them from a tree needs the tree lock, which nests outside
+ * mmap_sem: so put them on a stale list, to be freed once mmap_sem is
+ * dropped.  The mm must not be dropped before that is done.
+ */
+static inline void defer_rmap_item(struct rmap_item *rmap_item,
+				   struct rmap_item **stale)
+{
+	rmap_item->rmap_list = *stale;
+	*stale = rmap_item;
+}
+
+static void free_stale_rmap_items(struct rmap_item **stale)
+{
+	while (*stale) {
+		struct rmap_item *rmap_item = *stale;
+		*stale = rmap_item->rmap_list;
+		remove_rmap_item_from_tree(rmap_item);
+		free_rmap_item(rmap_item);
+	}
+}
+
+static void remove_trailing_rmap_items(struct rmap_item **rmap_list,
+				       struct rmap_item **stale)
 {
 	while (*rmap_list) {
 		struct rmap_item *rmap_item = *rmap_list;
 		*rmap_list = rmap_item->rmap_list;
-		remove_rmap_item_from_tree(rmap_item);
-		free_rmap_item(rmap_item);
+		defer_rmap_item(rmap_item, stale);
 	}
 }
 
@@ -619,15 +764,20 @@ static int unmerge_and_remove_all_rmap_items(void)
 	struct mm_slot *mm_slot;
 	struct mm_struct *mm;
 	struct vm_area_struct *vma;
+	struct rmap_item *stale = NULL;
 	int err = 0;
 
+	/*
+	 * The cursor is published in ksm_unmerge_slot, so that __ksm_exit()
+	 * leaves the slot we are working on for us to free.
+	 */
 	spin_lock(&ksm_mmlist_lock);
-	ksm_scan.mm_slot = list_entry(ksm_mm_head.mm_list.next,
+	ksm_unmerge_slot = list_entry(ksm_mm_head.mm_list.next,
 						struct mm_slot, mm_list);
 	spin_unlock(&ksm_mmlist_lock);
 
-	for (mm_slot = ksm_scan.mm_slot;
-			mm_slot != &ksm_mm_head; mm_slot = ksm_scan.mm_slot) {
+	for (mm_slot = ksm_unmerge_slot;
+			mm_slot != &ksm_mm_head; mm_slot = ksm_unmerge_slot) {
 		mm = mm_slot->mm;
 		down_read(&mm->mmap_sem);
 		for (vma = mm->mmap; vma; vma = vma->vm_next) {
@@ -641,45 +791,93 @@ static int unmerge_and_remove_all_rmap_items(void)
 				goto error;
 		}
 
-		remove_trailing_rmap_items(mm_slot, &mm_slot->rmap_list);
+		remove_trailing_rmap_items(&mm_slot->rmap_list, &stale);
 
 		spin_lock(&ksm_mmlist_lock);
-		ksm_scan.mm_slot = list_entry(mm_slot->mm_list.next,
+		ksm_unmerge_slot = list_entry(mm_slot->mm_list.next,
 						struct mm_slot, mm_list);
 		if (ksm_test_exit(mm)) {
 			hlist_del(&mm_slot->link);
 			list_del(&mm_slot->mm_list);
 			spin_unlock(&ksm_mmlist_lock);
 
-			free_mm_slot(mm_slot);
 			clear_bit(MMF_VM_MERGEABLE, &mm->flags);
 			up_read(&mm->mmap_sem);
+			free_stale_rmap_items(&stale);
+			free_mm_slot(mm_slot);
 			mmdrop(mm);
 		} else {
 			spin_unlock(&ksm_mmlist_lock);
 			up_read(&mm->mmap_sem);
+			free_stale_rmap_items(&stale);
 		}
 	}
 
-	ksm_scan.seqnr = 0;
+	spin_lock(&ksm_mmlist_lock);
+	ksm_unmerge_slot = NULL;
+	spin_unlock(&ksm_mmlist_lock);
+	ksm_seqnr = 0;
 	return 0;
 
 error:
 	up_read(&mm->mmap_sem);
 	spin_lock(&ksm_mmlist_lock);
-	ksm_scan.mm_slot = &ksm_mm_head;
+	ksm_unmerge_slot = NULL;
 	spin_unlock(&ksm_mmlist_lock);
 	return err;
 }
 #endif /* CONFIG_SYSFS */
 
+/*
+ * The checksum only has to notice that a page changed between two scans,
+ * it need not be strong: four independent multiply-rotate lanes over native
+ * words keep the multiplier busy.  32-bit kernels use 32-bit lanes, as a
+ * 64-bit multiply takes several instructions there.
+ */
+#if BITS_PER_LONG == 64
+#define KSM_HASH_PRIME1	0x9e3779b185ebca87UL
+#define KSM_HASH_PRIME2	0xc2b2ae3d27d4eb4fUL
+#define KSM_HASH_ROTATE	31
+#else
+#define KSM_HASH_PRIME1	0x9e3779b1UL
+#define KSM_HASH_PRIME2	0x85ebca77UL
+#define KSM_HASH_ROTATE	13
+#endif
+
+static inline unsigned long checksum_rol(unsigned long word, unsigned int shift)
+{
+	return (word << shift) | (word >> (BITS_PER_LONG - shift));
+}
+
+static inline unsigned long checksum_round(unsigned long acc,
+					   unsigned long word)
+{
+	return checksum_rol(acc + word * KSM_HASH_PRIME2, KSM_HASH_ROTATE) *
+		KSM_HASH_PRIME1;
+}
+
 static u32 calc_checksum(struct page *page)
 {
-	u32 checksum;
+	unsigned long a = KSM_HASH_PRIME1, b = KSM_HASH_PRIME2, c = 0, d = 17;
+	const unsigned long *p, *end;
 	void *addr = kmap_atomic(page);
-	checksum = jhash2(addr, PAGE_SIZE / 4, 17);
+
+	end = addr + PAGE_SIZE;
+	for (p = addr; p < end; p += 4) {
+		a = checksum_round(a, p[0]);
+		b = checksum_round(b, p[1]);
+		c = checksum_round(c, p[2]);
+		d = checksum_round(d, p[3]);
+	}
 	kunmap_atomic(addr);
-	return checksum;
+
+	a ^= checksum_rol(b, BITS_PER_LONG / 4) ^
+	     checksum_rol(c, BITS_PER_LONG / 2) ^
+	     checksum_rol(d, 3 * BITS_PER_LONG / 4);
+#if BITS_PER_LONG == 64
+	a ^= a >> 32;
+#endif
+	return (u32)a;
 }
 
 static int memcmp_pages(struct page *page1, struct page *page2)
@@ -987,9 +1185,9 @@ static struct page *try_to_merge_two_pages(struct rmap_item *rmap_item,
  * This function returns the stable tree node of identical content if found,
  * NULL otherwise.
  */
-static struct page *stable_tree_search(struct page *page)
+static struct page *stable_tree_search(struct page *page, int nid)
 {
-	struct rb_node *node = root_stable_tree.rb_node;
+	struct rb_node *node = ksm_trees[nid].stable.rb_node;
 	struct stable_node *stable_node;
 
 	stable_node = page_stable_node(page);
@@ -1016,6 +1214,10 @@ static struct page *stable_tree_search(struct page *page)
 		} else if (ret > 0) {
 			put_page(tree_page);
 			node = node->rb_right;
+		} else if (get_kpfn_nid(stable_node->kpfn) != nid) {
+			/* Migrated to another node since: don't share it */
+			put_page(tree_page);
+			return NULL;
 		} else
 			return tree_page;
 	}
@@ -1030,9 +1232,9 @@ static struct page *stable_tree_search(struct page *page)
  * This function returns the stable tree node just allocated on success,
  * NULL otherwise.
  */
-static struct stable_node *stable_tree_insert(struct page *kpage)
+static struct stable_node *stable_tree_insert(struct page *kpage, int nid)
 {
-	struct rb_node **new = &root_stable_tree.rb_node;
+	struct rb_node **new = &ksm_trees[nid].stable.rb_node;
 	struct rb_node *parent = NULL;
 	struct stable_node *stable_node;
 
@@ -1069,9 +1271,10 @@ static struct stable_node *stable_tree_insert(struct page *kpage)
 		return NULL;
 
 	rb_link_node(&stable_node->node, parent, new);
-	rb_insert_color(&stable_node->node, &root_stable_tree);
+	rb_insert_color(&stable_node->node, &ksm_trees[nid].stable);
 
 	INIT_HLIST_HEAD(&stable_node->hlist);
+	stable_node->nid = nid;
 
 	stable_node->kpfn = page_to_pfn(kpage);
 	set_page_stable_node(kpage, stable_node);
@@ -1096,10 +1299,11 @@ static struct stable_node *stable_tree_insert(struct page *kpage)
 static
 struct rmap_item *unstable_tree_search_insert(struct rmap_item *rmap_item,
 					      struct page *page,
-					      struct page **tree_pagep)
+					      struct page **tree_pagep,
+					      int nid)
 
 {
-	struct rb_node **new = &root_unstable_tree.rb_node;
+	struct rb_node **new = &ksm_trees[nid].unstable.rb_node;
 	struct rb_node *parent = NULL;
 
 	while (*new) {
@@ -1114,9 +1318,11 @@ struct rmap_item *unstable_tree_search_insert(struct rmap_item *rmap_item,
 			return NULL;
 
 		/*
-		 * Don't substitute a ksm page for a forked page.
+		 * Don't substitute a ksm page for a forked page, nor
+		 * merge with a page which has moved to another node.
 		 */
-		if (page == tree_page) {
+		if (page == tree_page ||
+		    get_kpfn_nid(page_to_pfn(tree_page)) != nid) {
 			put_page(tree_page);
 			return NULL;
 		}
@@ -1137,11 +1343,12 @@ struct rmap_item *unstable_tree_search_insert(struct rmap_item *rmap_item,
 	}
 
 	rmap_item->address |= UNSTABLE_FLAG;
-	rmap_item->address |= (ksm_scan.seqnr & SEQNR_MASK);
+	rmap_item->address |= (ksm_seqnr & SEQNR_MASK);
+	rmap_item->nid = nid;
 	rb_link_node(&rmap_item->node, parent, new);
-	rb_insert_color(&rmap_item->node, &root_unstable_tree);
+	rb_insert_color(&rmap_item->node, &ksm_trees[nid].unstable);
 
-	ksm_pages_unshared++;
+	atomic_long_inc(&ksm_pages_unshared);
 	return NULL;
 }
 
@@ -1154,13 +1361,14 @@ static void stable_tree_append(struct rmap_item *rmap_item,
 			       struct stable_node *stable_node)
 {
 	rmap_item->head = stable_node;
+	rmap_item->nid = stable_node->nid;
 	rmap_item->address |= STABLE_FLAG;
 	hlist_add_head(&rmap_item->hlist, &stable_node->hlist);
 
 	if (rmap_item->hlist.next)
-		ksm_pages_sharing++;
+		atomic_long_inc(&ksm_pages_sharing);
 	else
-		ksm_pages_shared++;
+		atomic_long_inc(&ksm_pages_shared);
 }
 
 /*
@@ -1169,22 +1377,30 @@ static void stable_tree_append(struct rmap_item *rmap_item,
  * be inserted into the unstable tree, or merged with a page already there and
  * both transferred to the stable tree.
  *
+ * @scan: the cursor of the ksmd thread doing this
  * @page: the page that we are searching identical page to.
  * @rmap_item: the reverse mapping into the virtual address of this page
  */
-static void cmp_and_merge_page(struct page *page, struct rmap_item *rmap_item)
+static void cmp_and_merge_page(struct ksm_scan *scan, struct page *page,
+			       struct rmap_item *rmap_item)
 {
 	struct rmap_item *tree_rmap_item;
 	struct page *tree_page = NULL;
 	struct stable_node *stable_node;
 	struct page *kpage;
 	unsigned int checksum;
+	struct mutex *lock;
+	int nid;
 	int err;
 
 	remove_rmap_item_from_tree(rmap_item);
 
+	nid = get_kpfn_nid(page_to_pfn(page));
+	lock = &ksm_trees[nid].lock;
+
 	/* We first start with searching the page inside the stable tree */
-	kpage = stable_tree_search(page);
+	mutex_lock(lock);
+	kpage = stable_tree_search(page, nid);
 	if (kpage) {
 		err = try_to_merge_with_ksm_page(rmap_item, page, kpage);
 		if (!err) {
@@ -1195,16 +1411,20 @@ static void cmp_and_merge_page(struct page *page, struct rmap_item *rmap_item)
 			lock_page(kpage);
 			stable_tree_append(rmap_item, page_stable_node(kpage));
 			unlock_page(kpage);
+			scan->pages_merged++;
 		}
 		put_page(kpage);
+		mutex_unlock(lock);
 		return;
 	}
+	mutex_unlock(lock);
 
 	/*
 	 * If the hash value of the page has changed from the last time
 	 * we calculated it, this page is changing frequently: therefore we
 	 * don't want to insert it in the unstable tree, and we don't want
 	 * to waste our time searching for something identical to it there.
+	 * No tree is looked at, so leave the other threads to their trees.
 	 */
 	checksum = calc_checksum(page);
 	if (rmap_item->oldchecksum != checksum) {
@@ -1212,8 +1432,9 @@ static void cmp_and_merge_page(struct page *page, struct rmap_item *rmap_item)
 		return;
 	}
 
+	mutex_lock(lock);
 	tree_rmap_item =
-		unstable_tree_search_insert(rmap_item, page, &tree_page);
+		unstable_tree_search_insert(rmap_item, page, &tree_page, nid);
 	if (tree_rmap_item) {
 		kpage = try_to_merge_two_pages(rmap_item, page,
 						tree_rmap_item, tree_page);
@@ -1224,13 +1445,14 @@ static void cmp_and_merge_page(struct page *page, struct rmap_item *rmap_item)
 		 * tree, and insert it instead as new node in the stable tree.
 		 */
 		if (kpage) {
-			remove_rmap_item_from_tree(tree_rmap_item);
+			__remove_rmap_item_from_tree(tree_rmap_item);
 
 			lock_page(kpage);
-			stable_node = stable_tree_insert(kpage);
+			stable_node = stable_tree_insert(kpage, nid);
 			if (stable_node) {
 				stable_tree_append(tree_rmap_item, stable_node);
 				stable_tree_append(rmap_item, stable_node);
+				scan->pages_merged += 2;
 			}
 			unlock_page(kpage);
 
@@ -1246,9 +1468,11 @@ static void cmp_and_merge_page(struct page *page, struct rmap_item *rmap_item)
 			}
 		}
 	}
+	mutex_unlock(lock);
 }
 
-static struct rmap_item *get_next_rmap_item(struct mm_slot *mm_slot,
+static struct rmap_item *get_next_rmap_item(struct ksm_scan *scan,
+					    struct mm_slot *mm_slot,
 					    struct rmap_item **rmap_list,
 					    unsigned long addr)
 {
@@ -1261,8 +1485,7 @@ static struct rmap_item *get_next_rmap_item(struct mm_slot *mm_slot,
 		if (rmap_item->address > addr)
 			break;
 		*rmap_list = rmap_item->rmap_list;
-		remove_rmap_item_from_tree(rmap_item);
-		free_rmap_item(rmap_item);
+		defer_rmap_item(rmap_item, &scan->stale);
 	}
 
 	rmap_item = alloc_rmap_item();
@@ -1276,45 +1499,79 @@ static struct rmap_item *get_next_rmap_item(struct mm_slot *mm_slot,
 	return rmap_item;
 }
 
-static struct rmap_item *scan_get_next_rmap_item(struct page **page)
+/*
+ * Called by each ksmd thread when it has been through its share of the
+ * mm_slots list: the last one to get here ends the full scan, flushing the
+ * unstable trees and setting all the threads off on the next one.
+ */
+static void ksm_scan_done(struct ksm_scan *scan)
+{
+	bool last;
+	int i, nid;
+
+	spin_lock(&ksm_mmlist_lock);
+	scan->done = true;
+	last = ++ksm_scans_done >= ksm_nr_scan_threads;
+	spin_unlock(&ksm_mmlist_lock);
+
+	if (!last)
+		return;
+
+	/*
+	 * A number of pages can hang around indefinitely on per-cpu
+	 * pagevecs, raised page count preventing write_protect_page
+	 * from merging them.  Though it doesn't really matter much,
+	 * it is puzzling to see some stuck in pages_volatile until
+	 * other activity jostles them out, and they also prevented
+	 * LTP's KSM test from succeeding deterministically; so drain
+	 * them here (here rather than on entry to ksm_do_scan(),
+	 * so we don't IPI too often when pages_to_scan is set low).
+	 */
+	lru_add_drain_all();
+
+	for (nid = 0; nid < nr_node_ids; nid++) {
+		mutex_lock(&ksm_trees[nid].lock);
+		ksm_trees[nid].unstable = RB_ROOT;
+		mutex_unlock(&ksm_trees[nid].lock);
+	}
+
+	spin_lock(&ksm_mmlist_lock);
+	ksm_seqnr++;
+	ksm_scans_done = 0;
+	for (i = 0; i < KSM_MAX_SCAN_THREADS; i++)
+		ksm_scans[i].done = false;
+	spin_unlock(&ksm_mmlist_lock);
+
+	wake_up_interruptible(&ksm_thread_wait);
+}
+
+static struct rmap_item *scan_get_next_rmap_item(struct ksm_scan *scan,
+						 struct page **page)
 {
 	struct mm_struct *mm;
 	struct mm_slot *slot;
 	struct vm_area_struct *vma;
 	struct rmap_item *rmap_item;
 
-	if (list_empty(&ksm_mm_head.mm_list))
+	if (list_empty(&ksm_mm_head.mm_list) || scan->done)
 		return NULL;
 
-	slot = ksm_scan.mm_slot;
+	slot = scan->mm_slot;
 	if (slot == &ksm_mm_head) {
-		/*
-		 * A number of pages can hang around indefinitely on per-cpu
-		 * pagevecs, raised page count preventing write_protect_page
-		 * from merging them.  Though it doesn't really matter much,
-		 * it is puzzling to see some stuck in pages_volatile until
-		 * other activity jostles them out, and they also prevented
-		 * LTP's KSM test from succeeding deterministically; so drain
-		 * them here (here rather than on entry to ksm_do_scan(),
-		 * so we don't IPI too often when pages_to_scan is set low).
-		 */
-		lru_add_drain_all();
-
-		root_unstable_tree = RB_ROOT;
-
 		spin_lock(&ksm_mmlist_lock);
-		slot = list_entry(slot->mm_list.next, struct mm_slot, mm_list);
-		ksm_scan.mm_slot = slot;
+		slot = ksm_next_slot(scan, slot);
+		scan->mm_slot = slot;
 		spin_unlock(&ksm_mmlist_lock);
 		/*
-		 * Although we tested list_empty() above, a racing __ksm_exit
+		 * There may be nothing on the list for this thread; or,
+		 * although we tested list_empty() above, a racing __ksm_exit
 		 * of the last mm on the list may have removed it since then.
 		 */
 		if (slot == &ksm_mm_head)
-			return NULL;
+			goto done;
 next_mm:
-		ksm_scan.address = 0;
-		ksm_scan.rmap_list = &slot->rmap_list;
+		scan->address = 0;
+		scan->rmap_list = &slot->rmap_list;
 	}
 
 	mm = slot->mm;
@@ -1322,60 +1579,58 @@ next_mm:
 	if (ksm_test_exit(mm))
 		vma = NULL;
 	else
-		vma = find_vma(mm, ksm_scan.address);
+		vma = find_vma(mm, scan->address);
 
 	for (; vma; vma = vma->vm_next) {
 		if (!(vma->vm_flags & VM_MERGEABLE))
 			continue;
-		if (ksm_scan.address < vma->vm_start)
-			ksm_scan.address = vma->vm_start;
+		if (scan->address < vma->vm_start)
+			scan->address = vma->vm_start;
 		if (!vma->anon_vma)
-			ksm_scan.address = vma->vm_end;
+			scan->address = vma->vm_end;
 
-		while (ksm_scan.address < vma->vm_end) {
+		while (scan->address < vma->vm_end) {
 			if (ksm_test_exit(mm))
 				break;
-			*page = follow_page(vma, ksm_scan.address, FOLL_GET);
+			*page = follow_page(vma, scan->address, FOLL_GET);
 			if (IS_ERR_OR_NULL(*page)) {
-				ksm_scan.address += PAGE_SIZE;
+				scan->address += PAGE_SIZE;
 				cond_resched();
 				continue;
 			}
 			if (PageAnon(*page) ||
 			    page_trans_compound_anon(*page)) {
-				flush_anon_page(vma, *page, ksm_scan.address);
+				flush_anon_page(vma, *page, scan->address);
 				flush_dcache_page(*page);
-				rmap_item = get_next_rmap_item(slot,
-					ksm_scan.rmap_list, ksm_scan.address);
+				rmap_item = get_next_rmap_item(scan, slot,
+					scan->rmap_list, scan->address);
 				if (rmap_item) {
-					ksm_scan.rmap_list =
+					scan->rmap_list =
 							&rmap_item->rmap_list;
-					ksm_scan.address += PAGE_SIZE;
+					scan->address += PAGE_SIZE;
 				} else
 					put_page(*page);
 				up_read(&mm->mmap_sem);
 				return rmap_item;
 			}
 			put_page(*page);
-			ksm_scan.address += PAGE_SIZE;
+			scan->address += PAGE_SIZE;
 			cond_resched();
 		}
 	}
 
 	if (ksm_test_exit(mm)) {
-		ksm_scan.address = 0;
-		ksm_scan.rmap_list = &slot->rmap_list;
+		scan->address = 0;
+		scan->rmap_list = &slot->rmap_list;
 	}
 	/*
 	 * Nuke all the rmap_items that are above this current rmap:
 	 * because there were no VM_MERGEABLE vmas with such addresses.
 	 */
-	remove_trailing_rmap_items(slot, ksm_scan.rmap_list);
+	remove_trailing_rmap_items(scan->rmap_list, &scan->stale);
 
 	spin_lock(&ksm_mmlist_lock);
-	ksm_scan.mm_slot = list_entry(slot->mm_list.next,
-						struct mm_slot, mm_list);
-	if (ksm_scan.address == 0) {
+	if (scan->address == 0) {
 		/*
 		 * We've completed a full scan of all vmas, holding mmap_sem
 		 * throughout, and found no VM_MERGEABLE: so do the same as
@@ -1384,78 +1639,142 @@ next_mm:
 		 * (but beware: we can reach here even before __ksm_exit),
 		 * or when all VM_MERGEABLE areas have been unmapped (and
 		 * mmap_sem then protects against race with MADV_MERGEABLE).
+		 * Once off the hash, nobody else can find the slot, so the
+		 * stale rmap_items can safely be freed after mmap_sem.
 		 */
+		scan->mm_slot = ksm_next_slot(scan, slot);
 		hlist_del(&slot->link);
 		list_del(&slot->mm_list);
 		spin_unlock(&ksm_mmlist_lock);
 
-		free_mm_slot(slot);
 		clear_bit(MMF_VM_MERGEABLE, &mm->flags);
 		up_read(&mm->mmap_sem);
+		free_stale_rmap_items(&scan->stale);
+		free_mm_slot(slot);
 		mmdrop(mm);
 	} else {
+		/*
+		 * Keep the cursor on this slot until its stale rmap_items
+		 * are gone, so that __ksm_exit cannot free it under them.
+		 */
 		spin_unlock(&ksm_mmlist_lock);
 		up_read(&mm->mmap_sem);
+		free_stale_rmap_items(&scan->stale);
+
+		spin_lock(&ksm_mmlist_lock);
+		scan->mm_slot = ksm_next_slot(scan, slot);
+		spin_unlock(&ksm_mmlist_lock);
 	}
 
-	/* Repeat until we've completed scanning the whole list */
-	slot = ksm_scan.mm_slot;
+	/* Repeat until we've completed scanning our share of the list */
+	slot = scan->mm_slot;
 	if (slot != &ksm_mm_head)
 		goto next_mm;
-
-	ksm_scan.seqnr++;
+done:
+	ksm_scan_done(scan);
 	return NULL;
 }
 
 /**
  * ksm_do_scan  - the ksm scanner main worker function.
+ * @scan - the cursor of the calling ksmd thread
  * @scan_npages - number of pages we want to scan before we return.
  */
-static void ksm_do_scan(unsigned int scan_npages)
+static void ksm_do_scan(struct ksm_scan *scan, unsigned int scan_npages)
 {
 	struct rmap_item *rmap_item;
 	struct page *uninitialized_var(page);
 
 	while (scan_npages-- && likely(!freezing(current))) {
 		cond_resched();
-		rmap_item = scan_get_next_rmap_item(&page);
+		rmap_item = scan_get_next_rmap_item(scan, &page);
+		free_stale_rmap_items(&scan->stale);
 		if (!rmap_item)
 			return;
 		if (!PageKsm(page) || !in_stable_tree(rmap_item))
-			cmp_and_merge_page(page, rmap_item);
+			cmp_and_merge_page(scan, page, rmap_item);
 		put_page(page);
+		scan->pages_scanned++;
 	}
 }
 
-static int ksmd_should_run(void)
+/* Caller holds ksm_thread_sem for write */
+static void ksm_reset_scans(void)
 {
-	return (ksm_run & KSM_RUN_MERGE) && !list_empty(&ksm_mm_head.mm_list);
+	int i;
+
+	spin_lock(&ksm_mmlist_lock);
+	for (i = 0; i < KSM_MAX_SCAN_THREADS; i++) {
+		ksm_scans[i].mm_slot = &ksm_mm_head;
+		ksm_scans[i].done = false;
+	}
+	ksm_scans_done = 0;
+	spin_unlock(&ksm_mmlist_lock);
 }
 
-static int ksm_scan_thread(void *nothing)
+static void ksm_update_rates(struct ksm_scan *scan)
 {
+	unsigned long elapsed = jiffies - scan->rate_stamp;
+
+	if (elapsed < HZ)
+		return;
+	scan->scan_rate = (scan->pages_scanned - scan->rate_scanned) *
+				HZ / elapsed;
+	scan->merge_rate = (scan->pages_merged - scan->rate_merged) *
+				HZ / elapsed;
+	scan->rate_scanned = scan->pages_scanned;
+	scan->rate_merged = scan->pages_merged;
+	scan->rate_stamp = jiffies;
+}
+
+static int ksmd_should_run(struct ksm_scan *scan)
+{
+	return (ksm_run & KSM_RUN_MERGE) && !list_empty(&ksm_mm_head.mm_list) &&
+		scan->id < ksm_nr_scan_threads && !scan->done;
+}
+
+static int ksm_scan_thread(void *data)
+{
+	struct ksm_scan *scan = data;
+
 	set_freezable();
 	set_user_nice(current, 5);
+	scan->rate_stamp = jiffies;
 
 	while (!kthread_should_stop()) {
-		mutex_lock(&ksm_thread_mutex);
-		if (ksmd_should_run())
-			ksm_do_scan(ksm_thread_pages_to_scan);
-		mutex_unlock(&ksm_thread_mutex);
+		down_read(&ksm_thread_sem);
+		if (ksmd_should_run(scan))
+			ksm_do_scan(scan, ksm_thread_pages_to_scan);
+		up_read(&ksm_thread_sem);
 
+		ksm_update_rates(scan);
 		try_to_freeze();
 
-		if (ksmd_should_run()) {
+		if (ksmd_should_run(scan)) {
 			schedule_timeout_interruptible(
 				msecs_to_jiffies(ksm_thread_sleep_millisecs));
 		} else {
 			wait_event_freezable(ksm_thread_wait,
-				ksmd_should_run() || kthread_should_stop());
+				ksmd_should_run(scan) || kthread_should_stop());
 		}
 	}
 	return 0;
 }
 
+static int ksm_start_scan_thread(struct ksm_scan *scan)
+{
+	struct task_struct *task;
+
+	if (scan->id)
+		task = kthread_run(ksm_scan_thread, scan, "ksmd/%d", scan->id);
+	else
+		task = kthread_run(ksm_scan_thread, scan, "ksmd");
+	if (IS_ERR(task))
+		return PTR_ERR(task);
+	scan->task = task;
+	return 0;
+}
+
 int ksm_madvise(struct vm_area_struct *vma, unsigned long start,
 		unsigned long end, int advice, unsigned long *vm_flags)
 {
@@ -1502,6 +1821,7 @@ int ksm_madvise(struct vm_area_struct *vma, unsigned long start,
 int __ksm_enter(struct mm_struct *mm)
 {
 	struct mm_slot *mm_slot;
+	struct ksm_scan *scan;
 	int needs_wakeup;
 
 	mm_slot = alloc_mm_slot();
@@ -1513,12 +1833,15 @@ int __ksm_enter(struct mm_struct *mm)
 
 	spin_lock(&ksm_mmlist_lock);
 	insert_to_mm_slots_hash(mm, mm_slot);
+	mm_slot->seq = ksm_slot_seq++;
 	/*
-	 * Insert just behind the scanning cursor, to let the area settle
-	 * down a little; when fork is followed by immediate exec, we don't
-	 * want ksmd to waste time setting up and tearing down an rmap_list.
+	 * Insert just behind the cursor of the thread which will scan it,
+	 * to let the area settle down a little; when fork is followed by
+	 * immediate exec, we don't want ksmd to waste time setting up and
+	 * tearing down an rmap_list.
 	 */
-	list_add_tail(&mm_slot->mm_list, &ksm_scan.mm_slot->mm_list);
+	scan = &ksm_scans[mm_slot->seq % ksm_nr_scan_threads];
+	list_add_tail(&mm_slot->mm_list, &scan->mm_slot->mm_list);
 	spin_unlock(&ksm_mmlist_lock);
 
 	set_bit(MMF_VM_MERGEABLE, &mm->flags);
@@ -1546,14 +1869,16 @@ void __ksm_exit(struct mm_struct *mm)
 
 	spin_lock(&ksm_mmlist_lock);
 	mm_slot = get_mm_slot(mm);
-	if (mm_slot && ksm_scan.mm_slot != mm_slot) {
+	if (mm_slot && !ksm_slot_scanned(mm_slot)) {
 		if (!mm_slot->rmap_list) {
 			hlist_del(&mm_slot->link);
 			list_del(&mm_slot->mm_list);
 			easy_to_free = 1;
 		} else {
-			list_move(&mm_slot->mm_list,
-				  &ksm_scan.mm_slot->mm_list);
+			struct ksm_scan *scan;
+
+			scan = &ksm_scans[mm_slot->seq % ksm_nr_scan_threads];
+			list_move(&mm_slot->mm_list, &scan->mm_slot->mm_list);
 		}
 	}
 	spin_unlock(&ksm_mmlist_lock);
@@ -1768,14 +2093,18 @@ static struct stable_node *ksm_check_stable_tree(unsigned long start_pfn,
 						 unsigned long end_pfn)
 {
 	struct rb_node *node;
+	int nid;
 
-	for (node = rb_first(&root_stable_tree); node; node = rb_next(node)) {
-		struct stable_node *stable_node;
+	for (nid = 0; nid < nr_node_ids; nid++) {
+		for (node = rb_first(&ksm_trees[nid].stable); node;
+		     node = rb_next(node)) {
+			struct stable_node *stable_node;
 
-		stable_node = rb_entry(node, struct stable_node, node);
-		if (stable_node->kpfn >= start_pfn &&
-		    stable_node->kpfn < end_pfn)
-			return stable_node;
+			stable_node = rb_entry(node, struct stable_node, node);
+			if (stable_node->kpfn >= start_pfn &&
+			    stable_node->kpfn < end_pfn)
+				return stable_node;
+		}
 	}
 	return NULL;
 }
@@ -1791,13 +2120,13 @@ static int ksm_memory_callback(struct notifier_block *self,
 		/*
 		 * Keep it very simple for now: just lock out ksmd and
 		 * MADV_UNMERGEABLE while any memory is going offline.
-		 * mutex_lock_nested() is necessary because lockdep was alarmed
-		 * that here we take ksm_thread_mutex inside notifier chain
+		 * down_write_nested() is necessary because lockdep was alarmed
+		 * that here we take ksm_thread_sem inside notifier chain
 		 * mutex, and later take notifier chain mutex inside
-		 * ksm_thread_mutex to unlock it.   But that's safe because both
+		 * ksm_thread_sem to unlock it.   But that's safe because both
 		 * are inside mem_hotplug_mutex.
 		 */
-		mutex_lock_nested(&ksm_thread_mutex, SINGLE_DEPTH_NESTING);
+		down_write_nested(&ksm_thread_sem, SINGLE_DEPTH_NESTING);
 		break;
 
 	case MEM_OFFLINE:
@@ -1812,7 +2141,7 @@ static int ksm_memory_callback(struct notifier_block *self,
 		/* fallthrough */
 
 	case MEM_CANCEL_OFFLINE:
-		mutex_unlock(&ksm_thread_mutex);
+		up_write(&ksm_thread_sem);
 		break;
 	}
 	return NOTIFY_OK;
@@ -1901,12 +2230,13 @@ static ssize_t run_store(struct kobject *kobj, struct kobj_attribute *attr,
 	 * on the list for when ksmd may be set running again).
 	 */
 
-	mutex_lock(&ksm_thread_mutex);
+	down_write(&ksm_thread_sem);
 	if (ksm_run != flags) {
 		ksm_run = flags;
 		if (flags & KSM_RUN_UNMERGE) {
 			int oom_score_adj;
 
+			ksm_reset_scans();
 			oom_score_adj = test_set_oom_score_adj(OOM_SCORE_ADJ_MAX);
 			err = unmerge_and_remove_all_rmap_items();
 			compare_swap_oom_score_adj(OOM_SCORE_ADJ_MAX,
@@ -1917,7 +2247,7 @@ static ssize_t run_store(struct kobject *kobj, struct kobj_attribute *attr,
 			}
 		}
 	}
-	mutex_unlock(&ksm_thread_mutex);
+	up_write(&ksm_thread_sem);
 
 	if (flags & KSM_RUN_MERGE)
 		wake_up_interruptible(&ksm_thread_wait);
@@ -1929,21 +2259,21 @@ KSM_ATTR(run);
 static ssize_t pages_shared_show(struct kobject *kobj,
 				 struct kobj_attribute *attr, char *buf)
 {
-	return sprintf(buf, "%lu\n", ksm_pages_shared);
+	return sprintf(buf, "%ld\n", atomic_long_read(&ksm_pages_shared));
 }
 KSM_ATTR_RO(pages_shared);
 
 static ssize_t pages_sharing_show(struct kobject *kobj,
 				  struct kobj_attribute *attr, char *buf)
 {
-	return sprintf(buf, "%lu\n", ksm_pages_sharing);
+	return sprintf(buf, "%ld\n", atomic_long_read(&ksm_pages_sharing));
 }
 KSM_ATTR_RO(pages_sharing);
 
 static ssize_t pages_unshared_show(struct kobject *kobj,
 				   struct kobj_attribute *attr, char *buf)
 {
-	return sprintf(buf, "%lu\n", ksm_pages_unshared);
+	return sprintf(buf, "%ld\n", atomic_long_read(&ksm_pages_unshared));
 }
 KSM_ATTR_RO(pages_unshared);
 
@@ -1952,8 +2282,10 @@ static ssize_t pages_volatile_show(struct kobject *kobj,
 {
 	long ksm_pages_volatile;
 
-	ksm_pages_volatile = ksm_rmap_items - ksm_pages_shared
-				- ksm_pages_sharing - ksm_pages_unshared;
+	ksm_pages_volatile = atomic_long_read(&ksm_rmap_items)
+				- atomic_long_read(&ksm_pages_shared)
+				- atomic_long_read(&ksm_pages_sharing)
+				- atomic_long_read(&ksm_pages_unshared);
 	/*
 	 * It was not worth any locking to calculate that statistic,
 	 * but it might therefore sometimes be negative: conceal that.
@@ -1967,10 +2299,120 @@ KSM_ATTR_RO(pages_volatile);
 static ssize_t full_scans_show(struct kobject *kobj,
 			       struct kobj_attribute *attr, char *buf)
 {
-	return sprintf(buf, "%lu\n", ksm_scan.seqnr);
+	return sprintf(buf, "%lu\n", ksm_seqnr);
 }
 KSM_ATTR_RO(full_scans);
 
+#ifdef CONFIG_NUMA
+static ssize_t merge_across_nodes_show(struct kobject *kobj,
+				       struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", ksm_merge_across_nodes);
+}
+
+static ssize_t merge_across_nodes_store(struct kobject *kobj,
+				   struct kobj_attribute *attr,
+				   const char *buf, size_t count)
+{
+	int err;
+	unsigned long knob;
+
+	err = strict_strtoul(buf, 10, &knob);
+	if (err || knob > 1)
+		return -EINVAL;
+
+	/*
+	 * The trees are indexed by node only while merging within nodes:
+	 * don't switch while any ksm page might be filed under the other.
+	 */
+	down_write(&ksm_thread_sem);
+	if (ksm_merge_across_nodes != knob) {
+		if (atomic_long_read(&ksm_pages_shared))
+			err = -EBUSY;
+		else
+			ksm_merge_across_nodes = knob;
+	}
+	up_write(&ksm_thread_sem);
+
+	return err ? err : count;
+}
+KSM_ATTR(merge_across_nodes);
+#endif
+
+static ssize_t scan_threads_show(struct kobject *kobj,
+				 struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", ksm_nr_scan_threads);
+}
+
+static ssize_t scan_threads_store(struct kobject *kobj,
+				  struct kobj_attribute *attr,
+				  const char *buf, size_t count)
+{
+	static DEFINE_MUTEX(scan_threads_mutex);
+	unsigned long nr;
+	int i, err;
+
+	err = strict_strtoul(buf, 10, &nr);
+	if (err || nr < 1 || nr > KSM_MAX_SCAN_THREADS)
+		return -EINVAL;
+
+	mutex_lock(&scan_threads_mutex);
+	/*
+	 * New threads find themselves beyond ksm_nr_scan_threads and idle
+	 * until it is raised; surplus ones are stopped before it is lowered.
+	 */
+	for (i = ksm_nr_scan_threads; i < nr; i++) {
+		err = ksm_start_scan_thread(&ksm_scans[i]);
+		if (err) {
+			while (--i >= ksm_nr_scan_threads) {
+				kthread_stop(ksm_scans[i].task);
+				ksm_scans[i].task = NULL;
+			}
+			goto out;
+		}
+	}
+	for (i = nr; i < ksm_nr_scan_threads; i++) {
+		kthread_stop(ksm_scans[i].task);
+		ksm_scans[i].task = NULL;
+	}
+
+	/* Share out the mm_slots afresh, restarting the current full scan */
+	down_write(&ksm_thread_sem);
+	spin_lock(&ksm_mmlist_lock);
+	ksm_nr_scan_threads = nr;
+	spin_unlock(&ksm_mmlist_lock);
+	ksm_reset_scans();
+	up_write(&ksm_thread_sem);
+
+	wake_up_interruptible(&ksm_thread_wait);
+out:
+	mutex_unlock(&scan_threads_mutex);
+	return err ? err : count;
+}
+KSM_ATTR(scan_threads);
+
+static ssize_t thread_stats_show(struct kobject *kobj,
+				 struct kobj_attribute *attr, char *buf)
+{
+	ssize_t len = 0;
+	int i;
+
+	for (i = 0; i < ksm_nr_scan_threads; i++) {
+		struct ksm_scan *scan = &ksm_scans[i];
+		unsigned long scan_rate = scan->scan_rate;
+		unsigned long merge_rate = scan->merge_rate;
+
+		/* Rates are sampled as the thread runs: idle means none */
+		if (time_after(jiffies, scan->rate_stamp + 2 * HZ))
+			scan_rate = merge_rate = 0;
+		len += sprintf(buf + len, "%d %lu %lu\n",
+			       i, scan_rate, merge_rate);
+	}
+	return len;
+}
+KSM_ATTR_RO(thread_stats);
+
 static struct attribute *ksm_attrs[] = {
 	&sleep_millisecs_attr.attr,
 	&pages_to_scan_attr.attr,
@@ -1980,6 +2422,11 @@ static struct attribute *ksm_attrs[] = {
 	&pages_unshared_attr.attr,
 	&pages_volatile_attr.attr,
 	&full_scans_attr.attr,
+#ifdef CONFIG_NUMA
+	&merge_across_nodes_attr.attr,
+#endif
+	&scan_threads_attr.attr,
+	&thread_stats_attr.attr,
 	NULL,
 };
 
@@ -1991,26 +2438,38 @@ static struct attribute_group ksm_attr_group = {
 
 static int __init ksm_init(void)
 {
-	struct task_struct *ksm_thread;
+	int i, nid;
 	int err;
 
 	err = ksm_slab_init();
 	if (err)
 		goto out;
 
-	ksm_thread = kthread_run(ksm_scan_thread, NULL, "ksmd");
-	if (IS_ERR(ksm_thread)) {
-		printk(KERN_ERR "ksm: creating kthread failed\n");
-		err = PTR_ERR(ksm_thread);
+	ksm_trees = kcalloc(nr_node_ids, sizeof(*ksm_trees), GFP_KERNEL);
+	if (!ksm_trees) {
+		err = -ENOMEM;
 		goto out_free;
 	}
+	for (nid = 0; nid < nr_node_ids; nid++) {
+		ksm_trees[nid].stable = RB_ROOT;
+		ksm_trees[nid].unstable = RB_ROOT;
+		mutex_init(&ksm_trees[nid].lock);
+	}
+	for (i = 0; i < KSM_MAX_SCAN_THREADS; i++)
+		ksm_scans[i].id = i;
+
+	err = ksm_start_scan_thread(&ksm_scans[0]);
+	if (err) {
+		printk(KERN_ERR "ksm: creating kthread failed\n");
+		goto out_free_trees;
+	}
 
 #ifdef CONFIG_SYSFS
 	err = sysfs_create_group(mm_kobj, &ksm_attr_group);
 	if (err) {
 		printk(KERN_ERR "ksm: register sysfs failed\n");
-		kthread_stop(ksm_thread);
-		goto out_free;
+		kthread_stop(ksm_scans[0].task);
+		goto out_free_trees;
 	}
 #else
 	ksm_run = KSM_RUN_MERGE;	/* no way for user to start it */
@@ -2019,13 +2478,15 @@ static int __init ksm_init(void)
 
 #ifdef CONFIG_MEMORY_HOTREMOVE
 	/*
-	 * Choose a high priority since the callback takes ksm_thread_mutex:
+	 * Choose a high priority since the callback takes ksm_thread_sem:
 	 * later callbacks could only be taking locks which nest within that.
 	 */
 	hotplug_memory_notifier(ksm_memory_callback, 100);
 #endif
 	return 0;
 
+out_free_trees:
+	kfree(ksm_trees);
 out_free:
 	ksm_slab_free();
 out:
@@ -103,6 +103,10 @@ enum mem_cgroup_events_index {
 	MEM_CGROUP_EVENTS_PGPGOUT,	/* # of pages paged out */
 	MEM_CGROUP_EVENTS_PGFAULT,	/* # of page-faults */
 	MEM_CGROUP_EVENTS_PGMAJFAULT,	/* # of major page-faults */
+	MEM_CGROUP_EVENTS_PGRECLAIM_DIRECT,	/* # of pages reclaimed by
+						   charging tasks */
+	MEM_CGROUP_EVENTS_PGRECLAIM_BG,	/* # of pages reclaimed in the
+					   background */
 	MEM_CGROUP_EVENTS_NSTATS,
 };
 
@@ -111,6 +115,8 @@ static const char * const mem_cgroup_events_names[] = {
 	"pgpgout",
 	"pgfault",
 	"pgmajfault",
+	"pgreclaim_direct",
+	"pgreclaim_background",
 };
 
 /*
@@ -292,6 +298,15 @@ struct mem_cgroup {
 	/* set when res.limit == memsw.limit */
 	bool		memsw_is_minimum;
 
+	/*
+	 * Background reclaim: once the room left under the limit drops
+	 * below low_wmark_distance, bg_reclaim_work reclaims until there
+	 * is high_wmark_distance of room again.  Zero disables it.
+	 */
+	u64		low_wmark_distance;
+	u64		high_wmark_distance;
+	struct work_struct bg_reclaim_work;
+
 	/* protect arrays of thresholds */
 	struct mutex thresholds_lock;
 
@@ -834,6 +849,25 @@ static bool mem_cgroup_event_ratelimit(struct mem_cgroup *memcg,
 	return false;
 }
 
+/*
+ * Queue background reclaim for @memcg and every ancestor it charges,
+ * if it got closer to its limit than its low watermark.
+ */
+static void mem_cgroup_check_wmark(struct mem_cgroup *memcg)
+{
+	for (; memcg; memcg = parent_mem_cgroup(memcg)) {
+		u64 low = ACCESS_ONCE(memcg->low_wmark_distance);
+
+		if (!low || res_counter_margin(&memcg->res) >= low)
+			continue;
+		if (work_pending(&memcg->bg_reclaim_work))
+			continue;
+		mem_cgroup_get(memcg);
+		if (!queue_work(system_unbound_wq, &memcg->bg_reclaim_work))
+			mem_cgroup_put(memcg);
+	}
+}
+
 /*
  * Check events in order.
  *
@@ -856,6 +890,7 @@ static void memcg_check_events(struct mem_cgroup *memcg, struct page *page)
 		preempt_enable();
 
 		mem_cgroup_threshold(memcg);
+		mem_cgroup_check_wmark(memcg);
 		if (unlikely(do_softlimit))
 			mem_cgroup_update_tree(memcg, page);
 #if MAX_NUMNODES > 1
@@ -1574,6 +1609,46 @@ static unsigned long mem_cgroup_reclaim(struct mem_cgroup *memcg,
 	return total;
 }
 
+/*
+ * Background reclaim, queued by mem_cgroup_check_wmark(): reclaim from
+ * the hierarchy under @memcg until its usage is high_wmark_distance
+ * below the limit, so that charging tasks do not have to do it.  Only
+ * memory.limit_in_bytes is considered; a mem+swap limit can only be
+ * dealt with by reclaiming without swap, which is left to direct
+ * reclaim.
+ */
+static void mem_cgroup_bg_reclaim(struct work_struct *work)
+{
+	struct mem_cgroup *memcg = container_of(work, struct mem_cgroup,
+						bg_reclaim_work);
+	u64 high = ACCESS_ONCE(memcg->high_wmark_distance);
+	unsigned long total = 0;
+	int loop = 0;
+
+	while (res_counter_margin(&memcg->res) < high) {
+		unsigned long nr_reclaimed;
+
+		nr_reclaimed = try_to_free_mem_cgroup_pages(memcg, GFP_KERNEL,
+						memcg->memsw_is_minimum);
+		total += nr_reclaimed;
+		/*
+		 * Like direct reclaim, give up after two passes that
+		 * reclaimed nothing.
+		 */
+		if (!nr_reclaimed) {
+			if (loop++)
+				break;
+			drain_all_stock_async(memcg);
+		} else
+			loop = 0;
+		cond_resched();
+	}
+
+	this_cpu_add(memcg->stat->events[MEM_CGROUP_EVENTS_PGRECLAIM_BG],
+		     total);
+	mem_cgroup_put(memcg);
+}
+
 /**
  * test_mem_cgroup_node_reclaimable
  * @memcg: the target memcg
@@ -2260,6 +2335,8 @@ static int mem_cgroup_do_charge(struct mem_cgroup *memcg, gfp_t gfp_mask,
 		return CHARGE_WOULDBLOCK;
 
 	ret = mem_cgroup_reclaim(mem_over_limit, gfp_mask, flags);
+	this_cpu_add(mem_over_limit->stat->events[MEM_CGROUP_EVENTS_PGRECLAIM_DIRECT],
+		     ret);
 	if (mem_cgroup_margin(mem_over_limit) >= nr_pages)
 		return CHARGE_RETRY;
 	/*
@@ -3502,6 +3579,13 @@ static int mem_cgroup_resize_limit(struct mem_cgroup *memcg,
 			mutex_unlock(&set_limit_mutex);
 			break;
 		}
+		/* The background reclaim watermarks must stay below it */
+		if (memcg->high_wmark_distance &&
+		    memcg->high_wmark_distance >= val) {
+			ret = -EINVAL;
+			mutex_unlock(&set_limit_mutex);
+			break;
+		}
 
 		memlimit = res_counter_read_u64(&memcg->res, RES_LIMIT);
 		if (memlimit < val)
@@ -4229,6 +4313,62 @@ static int memcg_stat_show(struct cgroup *cont, struct cftype *cft,
 	return 0;
 }
 
+enum {
+	MEMCG_WMARK_LOW,
+	MEMCG_WMARK_HIGH,
+};
+
+static u64 mem_cgroup_wmark_read(struct cgroup *cgrp, struct cftype *cft)
+{
+	struct mem_cgroup *memcg = mem_cgroup_from_cont(cgrp);
+
+	if (cft->private == MEMCG_WMARK_LOW)
+		return memcg->low_wmark_distance;
+	return memcg->high_wmark_distance;
+}
+
+/*
+ * The low watermark must not be further from the limit than the high
+ * one, so when enabling, set the high watermark first; when disabling,
+ * clear the low one first.  Both must stay below the limit, or background
+ * reclaim would try to empty the group every time it runs; the limit
+ * cannot be lowered below them either, see mem_cgroup_resize_limit().
+ */
+static int mem_cgroup_wmark_write(struct cgroup *cgrp, struct cftype *cft,
+				  const char *buffer)
+{
+	struct mem_cgroup *memcg = mem_cgroup_from_cont(cgrp);
+	unsigned long long val;
+	int ret;
+
+	if (mem_cgroup_is_root(memcg))
+		return -EINVAL;
+
+	ret = res_counter_memparse_write_strategy(buffer, &val);
+	if (ret)
+		return ret;
+
+	cgroup_lock();
+	mutex_lock(&set_limit_mutex);
+	if (val && val >= res_counter_read_u64(&memcg->res, RES_LIMIT))
+		ret = -EINVAL;
+	else if (cft->private == MEMCG_WMARK_LOW) {
+		if (val > memcg->high_wmark_distance)
+			ret = -EINVAL;
+		else
+			memcg->low_wmark_distance = val;
+	} else {
+		if (val < memcg->low_wmark_distance)
+			ret = -EINVAL;
+		else
+			memcg->high_wmark_distance = val;
+	}
+	mutex_unlock(&set_limit_mutex);
+	cgroup_unlock();
+
+	return ret;
+}
+
 static u64 mem_cgroup_swappiness_read(struct cgroup *cgrp, struct cftype *cft)
 {
 	struct mem_cgroup *memcg = mem_cgroup_from_cont(cgrp);
@@ -4654,6 +4794,18 @@ static struct cftype mem_cgroup_files[] = {
 		.trigger = mem_cgroup_reset,
 		.read = mem_cgroup_read,
 	},
+	{
+		.name = "low_wmark_distance",
+		.private = MEMCG_WMARK_LOW,
+		.write_string = mem_cgroup_wmark_write,
+		.read_u64 = mem_cgroup_wmark_read,
+	},
+	{
+		.name = "high_wmark_distance",
+		.private = MEMCG_WMARK_HIGH,
+		.write_string = mem_cgroup_wmark_write,
+		.read_u64 = mem_cgroup_wmark_read,
+	},
 	{
 		.name = "stat",
 		.read_seq_string = memcg_stat_show,
@@ -4983,6 +5135,7 @@ mem_cgroup_create(struct cgroup *cont)
 	memcg->move_charge_at_immigrate = 0;
 	mutex_init(&memcg->thresholds_lock);
 	spin_lock_init(&memcg->move_lock);
+	INIT_WORK(&memcg->bg_reclaim_work, mem_cgroup_bg_reclaim);
 
 	error = memcg_init_kmem(memcg, &mem_cgroup_subsys);
 	if (error) {
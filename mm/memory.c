@@ -57,6 +57,7 @@
 #include <linux/swapops.h>
 #include <linux/elf.h>
 #include <linux/gfp.h>
+#include <linux/migrate.h>
 
 #include <asm/io.h>
 #include <asm/pgalloc.h>
@@ -3433,6 +3434,54 @@ static int do_nonlinear_fault(struct mm_struct *mm, struct vm_area_struct *vma,
  * but allow concurrent faults), and pte mapped but not yet locked.
  * We return with mmap_sem still held, but pte unmapped and unlocked.
  */
+#ifdef CONFIG_NUMA_BALANCING
+/*
+ * A NUMA hinting fault: change_prot_numa() took all access away from this
+ * pte so that the next touch tells us which node the page is used from.
+ * Restore the vma protection, then try to move the page next to the cpu
+ * that touched it and let the scheduler know where its memory lives.
+ */
+static int do_numa_page(struct mm_struct *mm, struct vm_area_struct *vma,
+			unsigned long address, pte_t *ptep, pmd_t *pmd,
+			spinlock_t *ptl, pte_t entry)
+{
+	struct page *page;
+	int page_nid, target_nid;
+	int migrated = 0;
+
+	entry = pte_mkyoung(pte_modify(entry, vma->vm_page_prot));
+	set_pte_at(mm, address, ptep, entry);
+	update_mmu_cache(vma, address, ptep);
+
+	page = vm_normal_page(vma, address, entry);
+	if (!page) {
+		pte_unmap_unlock(ptep, ptl);
+		return 0;
+	}
+	get_page(page);
+	pte_unmap_unlock(ptep, ptl);
+
+	page_nid = page_to_nid(page);
+	target_nid = numa_node_id();
+	if (page_nid != target_nid && page_mapcount(page) == 1) {
+		/* migrate_misplaced_page() drops our reference */
+		migrated = migrate_misplaced_page(page, target_nid) > 0;
+	} else
+		put_page(page);
+
+	task_numa_fault(migrated ? target_nid : page_nid, 1, migrated);
+	return 0;
+}
+#else
+static inline int do_numa_page(struct mm_struct *mm,
+			struct vm_area_struct *vma, unsigned long address,
+			pte_t *ptep, pmd_t *pmd, spinlock_t *ptl, pte_t entry)
+{
+	BUG();
+	return 0;
+}
+#endif
+
 int handle_pte_fault(struct mm_struct *mm,
 		     struct vm_area_struct *vma, unsigned long address,
 		     pte_t *pte, pmd_t *pmd, unsigned int flags)
@@ -3462,6 +3511,8 @@ int handle_pte_fault(struct mm_struct *mm,
 	spin_lock(ptl);
 	if (unlikely(!pte_same(*pte, entry)))
 		goto unlock;
+	if (pte_numa(vma, entry))
+		return do_numa_page(mm, vma, address, pte, pmd, ptl, entry);
 	if (flags & FAULT_FLAG_WRITE) {
 		if (!pte_write(entry))
 			return do_wp_page(mm, vma, address,
@@ -1404,3 +1404,86 @@ int migrate_vmas(struct mm_struct *mm, const nodemask_t *to,
  	return err;
 }
 #endif
+
+#ifdef CONFIG_NUMA_BALANCING
+/*
+ * Returns true if this is a safe migration target node for misplaced NUMA
+ * pages.  Only the watermarks are checked, which is crude but cheap.
+ */
+static bool migrate_balanced_pgdat(struct pglist_data *pgdat,
+				   int nr_migrate_pages)
+{
+	int z;
+
+	for (z = pgdat->nr_zones - 1; z >= 0; z--) {
+		struct zone *zone = pgdat->node_zones + z;
+
+		if (!populated_zone(zone))
+			continue;
+
+		if (zone->all_unreclaimable)
+			continue;
+
+		/* Avoid waking kswapd by allocating nr_migrate_pages pages */
+		if (!zone_watermark_ok(zone, 0,
+				       high_wmark_pages(zone) +
+				       nr_migrate_pages,
+				       0, 0))
+			continue;
+		return true;
+	}
+	return false;
+}
+
+static struct page *alloc_misplaced_dst_page(struct page *page,
+					     unsigned long data,
+					     int **result)
+{
+	int nid = (int) data;
+
+	return alloc_pages_exact_node(nid,
+				      GFP_HIGHUSER_MOVABLE | __GFP_THISNODE |
+				      __GFP_NOMEMALLOC | __GFP_NORETRY |
+				      __GFP_NOWARN, 0);
+}
+
+/*
+ * Attempt to migrate a misplaced page to the specified destination
+ * node. Caller is expected to have an elevated reference count on
+ * the page that will be dropped by this function before returning.
+ * Returns 1 if the page was migrated, 0 otherwise.
+ */
+int migrate_misplaced_page(struct page *page, int node)
+{
+	LIST_HEAD(migratepages);
+	int nr_remaining;
+
+	/*
+	 * Don't migrate pages that are mapped in multiple processes, and
+	 * don't push a node under its watermarks to do it.
+	 */
+	if (page_mapcount(page) != 1 ||
+	    !migrate_balanced_pgdat(NODE_DATA(node), 1) ||
+	    isolate_lru_page(page)) {
+		put_page(page);
+		return 0;
+	}
+
+	/*
+	 * Isolation took a reference of its own, so the caller's can be
+	 * dropped now without the page going away under migration.
+	 */
+	put_page(page);
+	inc_zone_page_state(page, NR_ISOLATED_ANON + page_is_file_cache(page));
+	list_add(&page->lru, &migratepages);
+
+	nr_remaining = migrate_pages(&migratepages, alloc_misplaced_dst_page,
+				     node, false, MIGRATE_ASYNC);
+	if (nr_remaining) {
+		putback_lru_pages(&migratepages);
+		return 0;
+	}
+	current->numa_pages_migrated++;
+	return 1;
+}
+#endif /* CONFIG_NUMA_BALANCING */
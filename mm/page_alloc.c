@@ -1287,25 +1287,16 @@ void mark_free_pages(struct zone *zone)
 #endif /* CONFIG_PM */
 
 /*
- * Free a 0-order page
- * cold == 1 ? free a cold page : free a hot page
+ * Put a 0-order page prepared by free_pages_prepare(), with its pageblock
+ * migratetype in page_private, on the pcp list of its zone.
+ * Must be called with interrupts disabled.
  */
-void free_hot_cold_page(struct page *page, int cold)
+static void __free_hot_cold_page(struct page *page, int cold)
 {
 	struct zone *zone = page_zone(page);
 	struct per_cpu_pages *pcp;
-	unsigned long flags;
-	int migratetype;
-	int wasMlocked = __TestClearPageMlocked(page);
-
-	if (!free_pages_prepare(page, 0))
-		return;
+	int migratetype = page_private(page);
 
-	migratetype = get_pageblock_migratetype(page);
-	set_page_private(page, migratetype);
-	local_irq_save(flags);
-	if (unlikely(wasMlocked))
-		free_page_mlock(page);
 	__count_vm_event(PGFREE);
 
 	/*
@@ -1318,7 +1309,7 @@ void free_hot_cold_page(struct page *page, int cold)
 	if (migratetype >= MIGRATE_PCPTYPES) {
 		if (unlikely(migratetype == MIGRATE_ISOLATE)) {
 			free_one_page(zone, page, 0, migratetype);
-			goto out;
+			return;
 		}
 		migratetype = MIGRATE_MOVABLE;
 	}
@@ -1333,24 +1324,96 @@ void free_hot_cold_page(struct page *page, int cold)
 		free_pcppages_bulk(zone, pcp->batch, pcp);
 		pcp->count -= pcp->batch;
 	}
+}
 
-out:
+/*
+ * Free a 0-order page
+ * cold == 1 ? free a cold page : free a hot page
+ */
+void free_hot_cold_page(struct page *page, int cold)
+{
+	unsigned long flags;
+	int wasMlocked = __TestClearPageMlocked(page);
+
+	if (!free_pages_prepare(page, 0))
+		return;
+
+	set_page_private(page, get_pageblock_migratetype(page));
+	local_irq_save(flags);
+	if (unlikely(wasMlocked))
+		free_page_mlock(page);
+	__free_hot_cold_page(page, cold);
 	local_irq_restore(flags);
 }
 
+/*
+ * Pages handed to the pcp lists, or taken from them, per interrupt
+ * disabled section of the bulk interfaces.
+ */
+#define PCP_BULK_BATCH	32
+
 /*
  * Free a list of 0-order pages
+ *
+ * The pages are checked first, and then put on the pcp lists with
+ * interrupts disabled once per PCP_BULK_BATCH pages rather than once
+ * per page.
  */
 void free_hot_cold_page_list(struct list_head *list, int cold)
 {
 	struct page *page, *next;
+	unsigned long flags;
+	int batch = 0;
 
 	list_for_each_entry_safe(page, next, list, lru) {
+		int wasMlocked = __TestClearPageMlocked(page);
+
 		trace_mm_page_free_batched(page, cold);
-		free_hot_cold_page(page, cold);
+		if (!free_pages_prepare(page, 0)) {
+			list_del(&page->lru);
+			continue;
+		}
+		set_page_private(page, get_pageblock_migratetype(page));
+		if (unlikely(wasMlocked)) {
+			local_irq_save(flags);
+			free_page_mlock(page);
+			local_irq_restore(flags);
+		}
+	}
+
+	local_irq_save(flags);
+	list_for_each_entry_safe(page, next, list, lru) {
+		__free_hot_cold_page(page, cold);
+		if (++batch == PCP_BULK_BATCH) {
+			local_irq_restore(flags);
+			batch = 0;
+			local_irq_save(flags);
+		}
 	}
+	local_irq_restore(flags);
 }
 
+/**
+ * free_pages_bulk - drop a reference to each page on a list
+ * @list: order-0 pages linked through page->lru
+ *
+ * Pages whose last reference goes away are freed together through
+ * free_hot_cold_page_list().  The list is empty on return.
+ */
+void free_pages_bulk(struct list_head *list)
+{
+	struct page *page, *next;
+	LIST_HEAD(pages_to_free);
+
+	list_for_each_entry_safe(page, next, list, lru) {
+		list_del(&page->lru);
+		if (put_page_testzero(page))
+			list_add(&page->lru, &pages_to_free);
+	}
+	free_hot_cold_page_list(&pages_to_free, 0);
+}
+EXPORT_SYMBOL(free_pages_bulk);
+
 /*
  * split_page takes a non-compound higher-order page, and splits it into
  * n (1<<order) sub-pages: page[0..n]
@@ -2594,6 +2657,150 @@ out:
 }
 EXPORT_SYMBOL(__alloc_pages_nodemask);
 
+/*
+ * Take up to @nr_pages order-0 pages off the pcp list of @zone, refilling
+ * it from the buddy lists as needed, with interrupts disabled once per
+ * PCP_BULK_BATCH pages.  The pages are prepared and added to @list.
+ * Returns the number of pages added.
+ */
+static unsigned long rmqueue_pcp_bulk(struct zone *preferred_zone,
+			struct zone *zone, gfp_t gfp_flags, int migratetype,
+			unsigned long nr_pages, struct list_head *list)
+{
+	int cold = !!(gfp_flags & __GFP_COLD);
+	unsigned long allocated = 0;
+
+	while (allocated < nr_pages) {
+		struct per_cpu_pages *pcp;
+		struct list_head *pcp_list;
+		struct page *page, *next;
+		unsigned long flags;
+		LIST_HEAD(pages);
+		int i, nr = 0;
+
+		local_irq_save(flags);
+		pcp = &this_cpu_ptr(zone->pageset)->pcp;
+		pcp_list = &pcp->lists[migratetype];
+		for (i = 0; i < PCP_BULK_BATCH && allocated + nr < nr_pages; i++) {
+			if (list_empty(pcp_list)) {
+				pcp->count += rmqueue_bulk(zone, 0,
+						pcp->batch, pcp_list,
+						migratetype, cold);
+				if (unlikely(list_empty(pcp_list)))
+					break;
+			}
+
+			if (cold)
+				page = list_entry(pcp_list->prev, struct page, lru);
+			else
+				page = list_entry(pcp_list->next, struct page, lru);
+
+			list_move_tail(&page->lru, &pages);
+			pcp->count--;
+			zone_statistics(preferred_zone, zone, gfp_flags);
+			nr++;
+		}
+		__count_zone_vm_events(PGALLOC, zone, nr);
+		local_irq_restore(flags);
+
+		if (!nr)
+			break;
+
+		list_for_each_entry_safe(page, next, &pages, lru) {
+			VM_BUG_ON(bad_range(zone, page));
+			/* bad pages are leaked, as in buffered_rmqueue() */
+			if (prep_new_page(page, 0, gfp_flags))
+				continue;
+			list_move_tail(&page->lru, list);
+			allocated++;
+		}
+	}
+	return allocated;
+}
+
+/**
+ * __alloc_pages_bulk - allocate a number of order-0 pages at once
+ * @gfp_mask: GFP flags for the allocation
+ * @zonelist: zonelist to allocate from
+ * @nodemask: nodes to allocate from, or NULL
+ * @nr_pages: number of pages wanted
+ * @list: list the pages are added to, linked through page->lru
+ *
+ * Where the first eligible zone has enough free memory above its low
+ * watermark, the pages are taken from its pcp list a batch at a time,
+ * rather than paying for the zonelist walk and the interrupt toggling
+ * of __alloc_pages_nodemask() once per page.  Whatever cannot be had
+ * that way is allocated one page at a time through the normal path,
+ * which may reclaim.
+ *
+ * Returns the number of pages added to @list, which is less than
+ * @nr_pages only if the allocation failed part way through.
+ */
+unsigned long __alloc_pages_bulk(gfp_t gfp_mask, struct zonelist *zonelist,
+				 nodemask_t *nodemask, unsigned long nr_pages,
+				 struct list_head *list)
+{
+	enum zone_type high_zoneidx = gfp_zone(gfp_mask);
+	int migratetype = allocflags_to_migratetype(gfp_mask);
+	unsigned int cpuset_mems_cookie;
+	struct zone *preferred_zone, *zone;
+	unsigned long allocated = 0;
+	struct zoneref *z;
+
+	gfp_mask &= gfp_allowed_mask;
+
+	might_sleep_if(gfp_mask & __GFP_WAIT);
+
+	/*
+	 * The dirty page limits of __GFP_WRITE and the retries of
+	 * __GFP_NOFAIL are only implemented by the single page path.
+	 */
+	if (nr_pages < 2 || (gfp_mask & (__GFP_WRITE | __GFP_NOFAIL)) ||
+	    unlikely(!zonelist->_zonerefs->zone))
+		goto fallback;
+
+	lockdep_trace_alloc(gfp_mask);
+
+	cpuset_mems_cookie = get_mems_allowed();
+
+	first_zones_zonelist(zonelist, high_zoneidx,
+				nodemask ? : &cpuset_current_mems_allowed,
+				&preferred_zone);
+	if (!preferred_zone)
+		goto out;
+
+	for_each_zone_zonelist_nodemask(zone, z, zonelist,
+					high_zoneidx, nodemask) {
+		if (!cpuset_zone_allowed_softwall(zone,
+						  gfp_mask | __GFP_HARDWALL))
+			continue;
+		if (!zone_watermark_ok(zone, 0,
+				       low_wmark_pages(zone) + nr_pages,
+				       zone_idx(preferred_zone), 0))
+			continue;
+
+		allocated = rmqueue_pcp_bulk(preferred_zone, zone, gfp_mask,
+					     migratetype, nr_pages, list);
+		break;
+	}
+
+out:
+	put_mems_allowed(cpuset_mems_cookie);
+
+fallback:
+	while (allocated < nr_pages) {
+		struct page *page;
+
+		page = __alloc_pages_nodemask(gfp_mask, 0, zonelist, nodemask);
+		if (!page)
+			break;
+		list_add_tail(&page->lru, list);
+		allocated++;
+	}
+	return allocated;
+}
+EXPORT_SYMBOL(__alloc_pages_bulk);
+
 /*
  * Common helper functions.
  */
@@ -20,6 +20,9 @@
 #include <linux/syscalls.h>
 #include <linux/file.h>
 
+#define CREATE_TRACE_POINTS
+#include <trace/events/readahead.h>
+
 /*
  * Initialise a struct file's readahead state.  Assumes that the caller has
  * memset *ra to zero.
@@ -247,6 +250,94 @@ unsigned long max_sane_readahead(unsigned long nr)
 		+ node_page_state(numa_node_id(), NR_FREE_PAGES)) / 2);
 }
 
+/*
+ * The maximum readahead window of a file adapts to how much of what is
+ * read ahead gets used, within these factors of the default window of
+ * its backing device.
+ */
+#define RA_SHRINK_SHIFT		2
+#define RA_GROW_SHIFT		2
+
+/*
+ * Adapt ra_pages once there is a window's worth of history: halve it
+ * while more than half of the readahead pages are lost, and double it
+ * back towards the device default while nearly all of them are used.
+ * Older history counts for less at every step.
+ */
+static void ra_adapt(struct address_space *mapping, struct file_ra_state *ra)
+{
+	unsigned long def = mapping->backing_dev_info->ra_pages;
+	unsigned long total = ra->hits + ra->misses;
+
+	if (!def || total < ra->ra_pages)
+		return;
+
+	if (ra->misses * 2 > total)
+		ra->ra_pages = max_t(unsigned long, ra->ra_pages / 2,
+				     max(def >> RA_SHRINK_SHIFT, 1UL));
+	else if (ra->misses * 8 <= total && ra->ra_pages < def)
+		ra->ra_pages = min_t(unsigned long, ra->ra_pages * 2, def);
+
+	ra->hits /= 2;
+	ra->misses /= 2;
+}
+
+/*
+ * The reader got up to @offset, so the pending readahead pages before it
+ * were used.
+ */
+static void ra_account_hit(struct address_space *mapping,
+			   struct file_ra_state *ra, pgoff_t offset)
+{
+	unsigned long hit;
+
+	if (offset <= ra->mark || !ra->pending)
+		goto out;
+
+	hit = min_t(unsigned long, offset - ra->mark, ra->pending);
+	ra->pending -= hit;
+	ra->hits += hit;
+	__add_bdi_stat(mapping->backing_dev_info, BDI_READAHEAD_HIT, hit);
+	ra_adapt(mapping, ra);
+out:
+	ra->mark = offset;
+}
+
+/*
+ * @nr of the pending readahead pages were evicted before the reader got
+ * to them, or the reader went elsewhere.
+ */
+static void ra_account_miss(struct address_space *mapping,
+			    struct file_ra_state *ra, unsigned long nr)
+{
+	nr = min_t(unsigned long, nr, ra->pending);
+	if (!nr)
+		return;
+
+	ra->pending -= nr;
+	ra->misses += nr;
+	__add_bdi_stat(mapping->backing_dev_info, BDI_READAHEAD_MISS, nr);
+	ra_adapt(mapping, ra);
+}
+
+/*
+ * The reader caught up with readahead I/O still in flight, although it
+ * uses nearly everything read ahead: the window is too small to cover
+ * the latency of the device, so let it grow past the device default.
+ */
+static void ra_account_wait(struct address_space *mapping,
+			    struct file_ra_state *ra)
+{
+	unsigned long max = mapping->backing_dev_info->ra_pages << RA_GROW_SHIFT;
+
+	if (ra->size < ra->ra_pages || ra->ra_pages >= max)
+		return;
+	if (!ra->hits || ra->misses * 8 > ra->hits + ra->misses)
+		return;
+
+	ra->ra_pages = min_t(unsigned long, ra->ra_pages * 2, max);
+}
+
 /*
  * Submit IO for the read-ahead request in file_ra_state.
  */
@@ -258,6 +349,10 @@ unsigned long ra_submit(struct file_ra_state *ra,
 	actual = __do_page_cache_readahead(mapping, filp,
 					ra->start, ra->size, ra->async_size);
 
+	ra->pending += actual;
+	__add_bdi_stat(mapping->backing_dev_info, BDI_READAHEAD, actual);
+	trace_readahead(mapping, ra, actual);
+
 	return actual;
 }
 
@@ -414,6 +509,7 @@ ondemand_readahead(struct address_space *mapping,
 	 */
 	if ((offset == (ra->start + ra->size - ra->async_size) ||
 	     offset == (ra->start + ra->size))) {
+		ra_account_hit(mapping, ra, offset);
 		ra->start += ra->size;
 		ra->size = get_next_ra_size(ra, max);
 		ra->async_size = ra->size;
@@ -436,6 +532,7 @@ ondemand_readahead(struct address_space *mapping,
 		if (!start || start - offset > max)
 			return 0;
 
+		ra_account_hit(mapping, ra, offset);
 		ra->start = start;
 		ra->size = start - offset;	/* old async_size */
 		ra->size += req_size;
@@ -444,6 +541,16 @@ ondemand_readahead(struct address_space *mapping,
 		goto readit;
 	}
 
+	/*
+	 * A cache miss inside the current window: pages read ahead were
+	 * evicted before the reader got to them.  Otherwise the reader
+	 * moved away, and whatever it did not use of the window is lost.
+	 */
+	if (offset >= ra->start && offset < ra->start + ra->size)
+		ra_account_miss(mapping, ra, ra->start + ra->size - offset);
+	else
+		ra_account_miss(mapping, ra, ra->pending);
+
 	/*
 	 * oversize read
 	 */
@@ -473,6 +580,7 @@ initial_readahead:
 	ra->start = offset;
 	ra->size = get_init_ra_size(req_size, max);
 	ra->async_size = ra->size > req_size ? ra->size - req_size : ra->size;
+	ra->mark = offset + req_size;
 
 readit:
 	/*
@@ -554,6 +662,9 @@ page_cache_async_readahead(struct address_space *mapping,
 
 	ClearPageReadahead(page);
 
+	if (!PageUptodate(page))
+		ra_account_wait(mapping, ra);
+
 	/*
 	 * Defer asynchronous read-ahead on IO congestion.
 	 */
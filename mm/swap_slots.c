@@ -0,0 +1,255 @@
+/*
+ * Manage cache of swap slots to be used for and returned from
+ * swap.
+ *
+ * Every swap-out used to take swap_lock in get_swap_page() and every
+ * release of the last reference to a slot took it again in
+ * swap_free() or swapcache_free().  With many reclaiming threads
+ * writing to a fast swap device, swap_lock becomes the bottleneck.
+ *
+ * Instead, each cpu keeps a cache of slots allocated from the swap
+ * map in one go, and hands them out without touching swap_lock.
+ * Slots being freed are likewise collected per cpu and returned to
+ * the swap map in a batch when the cache fills up.
+ *
+ * Slots sitting in a cache look allocated to the rest of the system,
+ * so the caches are only used while there is plenty of free swap.
+ * When free swap runs low they are drained and deactivated, and they
+ * are disabled altogether while swapoff runs, so that try_to_unuse()
+ * never meets a slot reserved by a cache.
+ *
+ * The alloc_lock of a cache is a mutex, since refilling it may have
+ * to wait for swap_lock while scan_swap_map() is preemptible; the
+ * free_lock is a spinlock, since slots are freed from under page
+ * table locks.  Neither lock is ever taken with swap_lock held.
+ */
+
+#include <linux/swap_slots.h>
+#include <linux/cpu.h>
+#include <linux/cpumask.h>
+#include <linux/percpu.h>
+#include <linux/mm.h>
+
+static DEFINE_PER_CPU(struct swap_slots_cache, swp_slots);
+static bool	swap_slot_cache_active;
+bool	swap_slot_cache_enabled;
+static bool	swap_slot_cache_initialized;
+/* Serialize activation, deactivation and draining of the caches */
+static DEFINE_MUTEX(swap_slots_cache_mutex);
+/* Serialize swap_slot_cache_enabled changes against swapon/swapoff */
+static DEFINE_MUTEX(swap_slots_cache_enable_mutex);
+
+#define SLOTS_CACHE	0x1
+#define SLOTS_CACHE_RET	0x2
+
+static void drain_slots_cache_cpu(unsigned int cpu, unsigned int type)
+{
+	struct swap_slots_cache *cache = &per_cpu(swp_slots, cpu);
+
+	if (type & SLOTS_CACHE) {
+		mutex_lock(&cache->alloc_lock);
+		if (cache->nr)
+			swapcache_free_entries(cache->slots + cache->cur,
+					       cache->nr);
+		cache->cur = 0;
+		cache->nr = 0;
+		mutex_unlock(&cache->alloc_lock);
+	}
+	if (type & SLOTS_CACHE_RET) {
+		spin_lock(&cache->free_lock);
+		if (cache->n_ret)
+			swapcache_free_entries(cache->slots_ret, cache->n_ret);
+		cache->n_ret = 0;
+		spin_unlock(&cache->free_lock);
+	}
+}
+
+static void __drain_swap_slots_cache(unsigned int type)
+{
+	unsigned int cpu;
+
+	/*
+	 * Offline cpus were drained by the hotplug notifier, and their
+	 * caches can not be refilled until they come back, so only the
+	 * online ones need to be walked.  Holding get_online_cpus()
+	 * keeps a cpu from going away under us.
+	 */
+	get_online_cpus();
+	for_each_online_cpu(cpu)
+		drain_slots_cache_cpu(cpu, type);
+	put_online_cpus();
+}
+
+static void deactivate_swap_slots_cache(void)
+{
+	mutex_lock(&swap_slots_cache_mutex);
+	swap_slot_cache_active = false;
+	__drain_swap_slots_cache(SLOTS_CACHE|SLOTS_CACHE_RET);
+	mutex_unlock(&swap_slots_cache_mutex);
+}
+
+static void reactivate_swap_slots_cache(void)
+{
+	mutex_lock(&swap_slots_cache_mutex);
+	swap_slot_cache_active = true;
+	mutex_unlock(&swap_slots_cache_mutex);
+}
+
+/*
+ * Disable the caches and return all slots they hold to the swap map.
+ * They stay disabled until reenable_swap_slots_cache_unlock().
+ */
+void disable_swap_slots_cache_lock(void)
+{
+	mutex_lock(&swap_slots_cache_enable_mutex);
+	swap_slot_cache_enabled = false;
+	if (swap_slot_cache_initialized) {
+		mutex_lock(&swap_slots_cache_mutex);
+		__drain_swap_slots_cache(SLOTS_CACHE|SLOTS_CACHE_RET);
+		mutex_unlock(&swap_slots_cache_mutex);
+	}
+}
+
+static void __reenable_swap_slots_cache(void)
+{
+	swap_slot_cache_enabled = has_usable_swap();
+}
+
+void reenable_swap_slots_cache_unlock(void)
+{
+	__reenable_swap_slots_cache();
+	mutex_unlock(&swap_slots_cache_enable_mutex);
+}
+
+static bool check_cache_active(void)
+{
+	long pages;
+
+	if (!swap_slot_cache_enabled || !swap_slot_cache_initialized)
+		return false;
+
+	pages = nr_swap_pages;
+	if (!swap_slot_cache_active) {
+		if (pages > num_online_cpus() *
+		    THRESHOLD_ACTIVATE_SWAP_SLOTS_CACHE)
+			reactivate_swap_slots_cache();
+		goto out;
+	}
+
+	/* if global pool of slot caches too low, deactivate cache */
+	if (pages < num_online_cpus() * THRESHOLD_DEACTIVATE_SWAP_SLOTS_CACHE)
+		deactivate_swap_slots_cache();
+out:
+	return swap_slot_cache_active;
+}
+
+static int __cpuinit swap_slots_cpu_callback(struct notifier_block *nfb,
+					     unsigned long action, void *hcpu)
+{
+	unsigned int cpu = (unsigned long)hcpu;
+
+	switch (action) {
+	case CPU_DEAD:
+	case CPU_DEAD_FROZEN:
+		drain_slots_cache_cpu(cpu, SLOTS_CACHE|SLOTS_CACHE_RET);
+		break;
+	}
+	return NOTIFY_OK;
+}
+
+static struct notifier_block __cpuinitdata swap_slots_cpu_notifier = {
+	.notifier_call = swap_slots_cpu_callback,
+};
+
+void enable_swap_slots_cache(void)
+{
+	unsigned int cpu;
+
+	mutex_lock(&swap_slots_cache_enable_mutex);
+	if (!swap_slot_cache_initialized) {
+		for_each_possible_cpu(cpu) {
+			struct swap_slots_cache *cache;
+
+			cache = &per_cpu(swp_slots, cpu);
+			mutex_init(&cache->alloc_lock);
+			spin_lock_init(&cache->free_lock);
+		}
+		register_hotcpu_notifier(&swap_slots_cpu_notifier);
+		swap_slot_cache_initialized = true;
+	}
+	__reenable_swap_slots_cache();
+	mutex_unlock(&swap_slots_cache_enable_mutex);
+}
+
+/* called with swap slot cache's alloc lock held */
+static int refill_swap_slots_cache(struct swap_slots_cache *cache)
+{
+	if (!swap_slot_cache_enabled || !swap_slot_cache_active)
+		return 0;
+
+	cache->cur = 0;
+	cache->nr = get_swap_pages(SWAP_SLOTS_CACHE_SIZE, cache->slots);
+
+	return cache->nr;
+}
+
+void free_swap_slot(swp_entry_t entry)
+{
+	struct swap_slots_cache *cache;
+
+	if (!swap_slot_cache_enabled || !swap_slot_cache_active)
+		goto direct_free;
+
+	/*
+	 * Any cpu's cache will do, we only need the lock to protect it,
+	 * so don't bother disabling preemption.
+	 */
+	cache = __this_cpu_ptr(&swp_slots);
+	spin_lock(&cache->free_lock);
+	/* Swap slots cache may be deactivated before acquiring lock */
+	if (!swap_slot_cache_enabled || !swap_slot_cache_active) {
+		spin_unlock(&cache->free_lock);
+		goto direct_free;
+	}
+	if (cache->n_ret >= SWAP_SLOTS_CACHE_SIZE) {
+		/* Return slots to global pool. */
+		swapcache_free_entries(cache->slots_ret, cache->n_ret);
+		cache->n_ret = 0;
+	}
+	cache->slots_ret[cache->n_ret++] = entry;
+	spin_unlock(&cache->free_lock);
+	return;
+
+direct_free:
+	swapcache_free_entries(&entry, 1);
+}
+
+swp_entry_t get_swap_page(void)
+{
+	swp_entry_t entry;
+	struct swap_slots_cache *cache;
+
+	entry.val = 0;
+
+	if (check_cache_active()) {
+		/*
+		 * As in free_swap_slot(), the mutex protects the cache
+		 * even if we migrate to another cpu after picking it.
+		 */
+		cache = __this_cpu_ptr(&swp_slots);
+		mutex_lock(&cache->alloc_lock);
+repeat:
+		if (cache->nr) {
+			entry = cache->slots[cache->cur];
+			cache->slots[cache->cur++].val = 0;
+			cache->nr--;
+		} else if (refill_swap_slots_cache(cache))
+			goto repeat;
+		mutex_unlock(&cache->alloc_lock);
+		if (entry.val)
+			return entry;
+	}
+
+	get_swap_pages(1, &entry);
+	return entry;
+}
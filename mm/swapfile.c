@@ -34,6 +34,7 @@
 #include <linux/frontswap.h>
 #include <linux/swapfile.h>
 #include <linux/export.h>
+#include <linux/swap_slots.h>
 
 #include <asm/pgtable.h>
 #include <asm/tlbflush.h>
@@ -411,17 +412,25 @@ no_page:
 	return 0;
 }
 
-swp_entry_t get_swap_page(void)
+/*
+ * Allocate up to @n_goal swap entries for swap cache into @swp_entries,
+ * taking swap_lock only once, and return how many were allocated.
+ * get_swap_page() uses this to refill the per-cpu swap slots caches.
+ */
+int get_swap_pages(int n_goal, swp_entry_t swp_entries[])
 {
 	struct swap_info_struct *si;
 	pgoff_t offset;
 	int type, next;
 	int wrapped = 0;
+	int n_ret = 0;
 
 	spin_lock(&swap_lock);
 	if (nr_swap_pages <= 0)
 		goto noswap;
-	nr_swap_pages--;
+	if (n_goal > nr_swap_pages)
+		n_goal = nr_swap_pages;
+	nr_swap_pages -= n_goal;
 
 	for (type = swap_list.next; type >= 0 && wrapped < 2; type = next) {
 		si = swap_info[type];
@@ -439,18 +448,32 @@ swp_entry_t get_swap_page(void)
 
 		swap_list.next = next;
 		/* This is called for allocating swap entry for cache */
-		offset = scan_swap_map(si, SWAP_HAS_CACHE);
-		if (offset) {
-			spin_unlock(&swap_lock);
-			return swp_entry(type, offset);
+		while (n_ret < n_goal) {
+			offset = scan_swap_map(si, SWAP_HAS_CACHE);
+			if (!offset)
+				break;
+			swp_entries[n_ret++] = swp_entry(type, offset);
 		}
+		if (n_ret == n_goal)
+			break;
 		next = swap_list.next;
 	}
 
-	nr_swap_pages++;
+	nr_swap_pages += n_goal - n_ret;
 noswap:
 	spin_unlock(&swap_lock);
-	return (swp_entry_t) {0};
+	return n_ret;
+}
+
+bool has_usable_swap(void)
+{
+	bool ret = true;
+
+	spin_lock(&swap_lock);
+	if (swap_list.head < 0)
+		ret = false;
+	spin_unlock(&swap_lock);
+	return ret;
 }
 
 /* The only caller of this function is now susupend routine */
@@ -511,8 +534,13 @@ out:
 	return NULL;
 }
 
-static unsigned char swap_entry_free(struct swap_info_struct *p,
-				     swp_entry_t entry, unsigned char usage)
+/*
+ * Drop @usage from the swap map entry.  When that was the last reference
+ * the slot is left reserved as SWAP_HAS_CACHE, and the caller returns it
+ * with free_swap_slot() after dropping swap_lock.
+ */
+static unsigned char __swap_entry_put(struct swap_info_struct *p,
+				      swp_entry_t entry, unsigned char usage)
 {
 	unsigned long offset = swp_offset(entry);
 	unsigned char count;
@@ -545,10 +573,21 @@ static unsigned char swap_entry_free(struct swap_info_struct *p,
 		mem_cgroup_uncharge_swap(entry);
 
 	usage = count | has_cache;
-	p->swap_map[offset] = usage;
+	p->swap_map[offset] = usage ? usage : SWAP_HAS_CACHE;
+
+	return usage;
+}
+
+static unsigned char swap_entry_free(struct swap_info_struct *p,
+				     swp_entry_t entry, unsigned char usage)
+{
+	unsigned long offset = swp_offset(entry);
+
+	usage = __swap_entry_put(p, entry, usage);
 
 	/* free if no reference */
 	if (!usage) {
+		p->swap_map[offset] = 0;
 		if (offset < p->lowest_bit)
 			p->lowest_bit = offset;
 		if (offset > p->highest_bit)
@@ -580,8 +619,11 @@ void swap_free(swp_entry_t entry)
 
 	p = swap_info_get(entry);
 	if (p) {
-		swap_entry_free(p, entry, 1);
+		unsigned char usage = __swap_entry_put(p, entry, 1);
+
 		spin_unlock(&swap_lock);
+		if (!usage)
+			free_swap_slot(entry);
 	}
 }
 
@@ -595,13 +637,59 @@ void swapcache_free(swp_entry_t entry, struct page *page)
 
 	p = swap_info_get(entry);
 	if (p) {
-		count = swap_entry_free(p, entry, SWAP_HAS_CACHE);
+		count = __swap_entry_put(p, entry, SWAP_HAS_CACHE);
 		if (page)
 			mem_cgroup_uncharge_swapcache(page, entry, count != 0);
 		spin_unlock(&swap_lock);
+		if (!count)
+			free_swap_slot(entry);
 	}
 }
 
+/*
+ * Release swap slots left reserved by __swap_entry_put() or allocated
+ * by get_swap_pages(), taking swap_lock once for the whole batch.
+ */
+void swapcache_free_entries(swp_entry_t *entries, int n)
+{
+	struct swap_info_struct *p;
+	int i;
+
+	if (n <= 0)
+		return;
+
+	spin_lock(&swap_lock);
+	for (i = 0; i < n; ++i) {
+		p = swap_info[swp_type(entries[i])];
+		VM_BUG_ON(p->swap_map[swp_offset(entries[i])] !=
+			  SWAP_HAS_CACHE);
+		swap_entry_free(p, entries[i], SWAP_HAS_CACHE);
+	}
+	spin_unlock(&swap_lock);
+}
+
+/*
+ * How many references to the swap entry are there, not counting the
+ * swap cache?  Unlike page_swapcount() this does not complain about
+ * free entries, which swapin readahead runs into all the time.
+ */
+int __swp_swapcount(swp_entry_t entry)
+{
+	struct swap_info_struct *p;
+	unsigned long offset = swp_offset(entry);
+	unsigned long type = swp_type(entry);
+	int count = 0;
+
+	spin_lock(&swap_lock);
+	if (type < nr_swapfiles) {
+		p = swap_info[type];
+		if ((p->flags & SWP_USED) && offset < p->max)
+			count = swap_count(p->swap_map[offset]);
+	}
+	spin_unlock(&swap_lock);
+	return count;
+}
+
 /*
  * How many references to page are currently swapped out?
  * This does not give an exact answer when swap count is continued,
@@ -698,7 +786,9 @@ int free_swap_and_cache(swp_entry_t entry)
 
 	p = swap_info_get(entry);
 	if (p) {
-		if (swap_entry_free(p, entry, 1) == SWAP_HAS_CACHE) {
+		unsigned char usage = __swap_entry_put(p, entry, 1);
+
+		if (usage == SWAP_HAS_CACHE) {
 			page = find_get_page(&swapper_space, entry.val);
 			if (page && !trylock_page(page)) {
 				page_cache_release(page);
@@ -706,6 +796,8 @@ int free_swap_and_cache(swp_entry_t entry)
 			}
 		}
 		spin_unlock(&swap_lock);
+		if (!usage)
+			free_swap_slot(entry);
 	}
 	if (page) {
 		/*
@@ -1545,6 +1637,9 @@ SYSCALL_DEFINE1(swapoff, const char __user *, specialfile)
 	p->flags &= ~SWP_WRITEOK;
 	spin_unlock(&swap_lock);
 
+	/* return the slots the per-cpu caches hold back to the swap map */
+	disable_swap_slots_cache_lock();
+
 	oom_score_adj = test_set_oom_score_adj(OOM_SCORE_ADJ_MAX);
 	err = try_to_unuse(type, false, 0); /* force all pages to be unused */
 	compare_swap_oom_score_adj(OOM_SCORE_ADJ_MAX, oom_score_adj);
@@ -1558,8 +1653,10 @@ SYSCALL_DEFINE1(swapoff, const char __user *, specialfile)
 		 */
 		/* re-insert swap space back into swap_list */
 		enable_swap_info(p, p->prio, p->swap_map, frontswap_map_get(p));
+		reenable_swap_slots_cache_unlock();
 		goto out_dput;
 	}
+	reenable_swap_slots_cache_unlock();
 
 	destroy_swap_extents(p);
 	if (p->flags & SWP_CONTINUED)
@@ -2063,6 +2160,8 @@ SYSCALL_DEFINE2(swapon, const char __user *, specialfile, int, swap_flags)
 	atomic_inc(&proc_poll_event);
 	wake_up_interruptible(&proc_poll_wait);
 
+	enable_swap_slots_cache();
+
 	if (S_ISREG(inode->i_mode))
 		inode->i_flags |= S_SWAPFILE;
 	error = 0;
@@ -22,6 +22,7 @@
 #include <linux/kallsyms.h>
 #include <linux/list.h>
 #include <linux/rbtree.h>
+#include <linux/llist.h>
 #include <linux/radix-tree.h>
 #include <linux/rcupdate.h>
 #include <linux/pfn.h>
@@ -245,8 +246,6 @@ EXPORT_SYMBOL(vmalloc_to_pfn);
 
 /*** Global kva allocator ***/
 
-#define VM_LAZY_FREE	0x01
-#define VM_LAZY_FREEING	0x02
 #define VM_VM_AREA	0x04
 
 struct vmap_area {
@@ -255,9 +254,10 @@ struct vmap_area {
 	unsigned long flags;
 	struct rb_node rb_node;		/* address sorted rbtree */
 	struct list_head list;		/* address sorted list */
-	struct list_head purge_list;	/* "lazy purge" list */
+	struct llist_node purge_list;	/* "lazy purge" list */
 	struct vm_struct *vm;
 	struct rcu_head rcu_head;
+	int cpu;			/* cpu that freed it */
 };
 
 static DEFINE_SPINLOCK(vmap_area_lock);
@@ -272,6 +272,105 @@ static unsigned long cached_align;
 
 static unsigned long vmap_area_pcpu_hole;
 
+/*
+ * Per-cpu caches of vmap areas of common sizes that were freed and have
+ * since been purged, i.e. unmapped with the TLB flushed.  Such an area
+ * is kept in the rbtree and can be handed out again by alloc_vmap_area()
+ * without taking vmap_area_lock or searching for a hole.  An area goes
+ * back to the cache of the cpu that freed it, so a cpu that keeps
+ * allocating and freeing buffers of the same size mostly gets its own
+ * areas back.
+ */
+#define VMAP_AREA_CACHE_PAGES	17	/* 64K with 4K pages, guard page included */
+#define VMAP_AREA_CACHE_NR	32
+
+struct vmap_area_cache {
+	spinlock_t lock;
+	unsigned int nr;
+	struct vmap_area *areas[VMAP_AREA_CACHE_NR];
+};
+
+static DEFINE_PER_CPU(struct vmap_area_cache, vmap_area_cache);
+
+static struct vmap_area *vmap_area_cache_get(unsigned long size,
+				unsigned long align,
+				unsigned long vstart, unsigned long vend)
+{
+	struct vmap_area_cache *vac;
+	struct vmap_area *va = NULL;
+	int i;
+
+	if (size > VMAP_AREA_CACHE_PAGES << PAGE_SHIFT)
+		return NULL;
+
+	/* the lock protects the cache, migrating away is harmless */
+	vac = __this_cpu_ptr(&vmap_area_cache);
+	spin_lock(&vac->lock);
+	for (i = vac->nr - 1; i >= 0; i--) {
+		struct vmap_area *tmp = vac->areas[i];
+
+		if (tmp->va_end - tmp->va_start == size &&
+		    !(tmp->va_start & (align-1)) &&
+		    tmp->va_start >= vstart && tmp->va_end <= vend) {
+			va = tmp;
+			vac->areas[i] = vac->areas[--vac->nr];
+			break;
+		}
+	}
+	spin_unlock(&vac->lock);
+
+	return va;
+}
+
+static bool vmap_area_cache_put(struct vmap_area *va)
+{
+	struct vmap_area_cache *vac;
+	bool cached = false;
+
+	if (va->va_end - va->va_start > VMAP_AREA_CACHE_PAGES << PAGE_SHIFT)
+		return false;
+
+	vac = &per_cpu(vmap_area_cache, va->cpu);
+	spin_lock(&vac->lock);
+	if (vac->nr < VMAP_AREA_CACHE_NR) {
+		va->flags = 0;
+		vac->areas[vac->nr++] = va;
+		cached = true;
+	}
+	spin_unlock(&vac->lock);
+
+	return cached;
+}
+
+static void __free_vmap_area(struct vmap_area *va);
+
+/*
+ * Give the areas held by the per-cpu caches back to the global allocator,
+ * so that their address space can be used for other sizes.
+ */
+static void vmap_area_cache_drain(void)
+{
+	struct vmap_area *areas[VMAP_AREA_CACHE_NR];
+	int cpu, i, nr;
+
+	for_each_possible_cpu(cpu) {
+		struct vmap_area_cache *vac = &per_cpu(vmap_area_cache, cpu);
+
+		spin_lock(&vac->lock);
+		nr = vac->nr;
+		memcpy(areas, vac->areas, nr * sizeof(areas[0]));
+		vac->nr = 0;
+		spin_unlock(&vac->lock);
+
+		if (!nr)
+			continue;
+		spin_lock(&vmap_area_lock);
+		for (i = 0; i < nr; i++)
+			__free_vmap_area(areas[i]);
+		spin_unlock(&vmap_area_lock);
+	}
+}
+
 static struct vmap_area *__find_vmap_area(unsigned long addr)
 {
 	struct rb_node *n = vmap_area_root.rb_node;
@@ -344,6 +443,10 @@ static struct vmap_area *alloc_vmap_area(unsigned long size,
 	BUG_ON(size & ~PAGE_MASK);
 	BUG_ON(!is_power_of_2(align));
 
+	va = vmap_area_cache_get(size, align, vstart, vend);
+	if (va)
+		return va;
+
 	va = kmalloc_node(sizeof(struct vmap_area),
 			gfp_mask & GFP_RECLAIM_MASK, node);
 	if (unlikely(!va))
@@ -441,6 +544,7 @@ overflow:
 	spin_unlock(&vmap_area_lock);
 	if (!purged) {
 		purge_vmap_area_lazy();
+		vmap_area_cache_drain();
 		purged = 1;
 		goto retry;
 	}
@@ -553,6 +657,9 @@ static unsigned long lazy_max_pages(void)
 
 static atomic_t vmap_lazy_nr = ATOMIC_INIT(0);
 
+/* Areas freed but not yet purged, waiting for the next TLB flush */
+static LLIST_HEAD(vmap_purge_list);
+
 /* for per-CPU blocks */
 static void purge_fragmented_blocks_allcpus(void);
 
@@ -579,9 +686,8 @@ static void __purge_vmap_area_lazy(unsigned long *start, unsigned long *end,
 					int sync, int force_flush)
 {
 	static DEFINE_SPINLOCK(purge_lock);
-	LIST_HEAD(valist);
+	struct llist_node *valist, *node, *tofree = NULL;
 	struct vmap_area *va;
-	struct vmap_area *n_va;
 	int nr = 0;
 
 	/*
@@ -598,31 +704,48 @@ static void __purge_vmap_area_lazy(unsigned long *start, unsigned long *end,
 	if (sync)
 		purge_fragmented_blocks_allcpus();
 
-	rcu_read_lock();
-	list_for_each_entry_rcu(va, &vmap_area_list, list) {
-		if (va->flags & VM_LAZY_FREE) {
-			if (va->va_start < *start)
-				*start = va->va_start;
-			if (va->va_end > *end)
-				*end = va->va_end;
-			nr += (va->va_end - va->va_start) >> PAGE_SHIFT;
-			list_add_tail(&va->purge_list, &valist);
-			va->flags |= VM_LAZY_FREEING;
-			va->flags &= ~VM_LAZY_FREE;
-		}
+	/*
+	 * Only the lazily freed areas are on vmap_purge_list, so there
+	 * is no need to walk every area in the system to find them.
+	 */
+	valist = llist_del_all(&vmap_purge_list);
+	llist_for_each_entry(va, valist, purge_list) {
+		if (va->va_start < *start)
+			*start = va->va_start;
+		if (va->va_end > *end)
+			*end = va->va_end;
+		nr += (va->va_end - va->va_start) >> PAGE_SHIFT;
 	}
-	rcu_read_unlock();
 
 	if (nr)
 		atomic_sub(nr, &vmap_lazy_nr);
 
+	/* one flush covers the whole batch */
 	if (nr || force_flush)
 		flush_tlb_kernel_range(*start, *end);
 
-	if (nr) {
+	/*
+	 * The areas are now safe to reuse.  Park those of common sizes
+	 * in the per-cpu caches and free the rest in one go.
+	 */
+	while (valist) {
+		node = valist;
+		valist = llist_next(node);
+		va = llist_entry(node, struct vmap_area, purge_list);
+		if (vmap_area_cache_put(va))
+			continue;
+		node->next = tofree;
+		tofree = node;
+	}
+
+	if (tofree) {
 		spin_lock(&vmap_area_lock);
-		list_for_each_entry_safe(va, n_va, &valist, purge_list)
-			__free_vmap_area(va);
+		while (tofree) {
+			node = tofree;
+			tofree = llist_next(node);
+			__free_vmap_area(llist_entry(node, struct vmap_area,
+						     purge_list));
+		}
 		spin_unlock(&vmap_area_lock);
 	}
 	spin_unlock(&purge_lock);
@@ -656,9 +779,16 @@ static void purge_vmap_area_lazy(void)
  */
 static void free_vmap_area_noflush(struct vmap_area *va)
 {
-	va->flags |= VM_LAZY_FREE;
-	atomic_add((va->va_end - va->va_start) >> PAGE_SHIFT, &vmap_lazy_nr);
-	if (unlikely(atomic_read(&vmap_lazy_nr) > lazy_max_pages()))
+	int nr_lazy;
+
+	va->cpu = raw_smp_processor_id();
+	nr_lazy = atomic_add_return((va->va_end - va->va_start) >> PAGE_SHIFT,
+				    &vmap_lazy_nr);
+
+	/* After this point, we may free va at any time */
+	llist_add(&va->purge_list, &vmap_purge_list);
+
+	if (unlikely(nr_lazy > lazy_max_pages()))
 		try_purge_vmap_area_lazy();
 }
 
@@ -1188,6 +1318,7 @@ void __init vmalloc_init(void)
 		vbq = &per_cpu(vmap_block_queue, i);
 		spin_lock_init(&vbq->lock);
 		INIT_LIST_HEAD(&vbq->free);
+		spin_lock_init(&per_cpu(vmap_area_cache, i).lock);
 	}
 
 	/* Import existing vmlist entries. */
@@ -2425,6 +2556,7 @@ retry:
 			spin_unlock(&vmap_area_lock);
 			if (!purged) {
 				purge_vmap_area_lazy();
+				vmap_area_cache_drain();
 				purged = true;
 				goto retry;
 			}
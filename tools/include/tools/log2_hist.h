@@ -0,0 +1,55 @@
+#ifndef _TOOLS_LOG2_HIST_H
+#define _TOOLS_LOG2_HIST_H
+
+/*
+ * Timing helpers shared by the scheduler latency tools: a monotonic clock
+ * in nanoseconds and a histogram with power of two buckets.
+ */
+
+#include <stdio.h>
+#include <time.h>
+
+#ifndef NSEC_PER_SEC
+#define NSEC_PER_SEC	1000000000ULL
+#endif
+
+static inline unsigned long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+/* Bucket of @v in a histogram of @nr buckets, the last one catches all */
+static inline int log2_bucket(unsigned long long v, int nr)
+{
+	int l = 0;
+
+	while (v >>= 1)
+		l++;
+	return l < nr ? l : nr - 1;
+}
+
+/*
+ * Print the non-empty buckets of @hist, each as a percentage of @total,
+ * or as a plain count if @total is 0.
+ */
+static inline void print_log2_hist(const unsigned long long *hist, int nr,
+				   const char *unit, unsigned long long total)
+{
+	int i;
+
+	for (i = 0; i < nr; i++) {
+		if (!hist[i])
+			continue;
+		printf(" %10llu - %10llu %s: ", 1ULL << i, (2ULL << i) - 1,
+		       unit);
+		if (total)
+			printf("%6.2lf%%\n", 100.0 * hist[i] / total);
+		else
+			printf("%llu\n", hist[i]);
+	}
+}
+
+#endif /* _TOOLS_LOG2_HIST_H */
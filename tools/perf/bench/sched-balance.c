@@ -0,0 +1,348 @@
+/*
+ *
+ * sched-balance.c
+ *
+ * balance: Benchmark for load balancing of a mixed load in nested cgroups
+ *
+ * Every group is a chain of nested cpu cgroups, and the deepest cgroup of
+ * each chain runs a mix of cpu hogs and bursty tasks, which run for a short
+ * while and then sleep.  At the end of the run the amount of work done is
+ * reported as throughput, and how evenly it was spread as balance: the
+ * spread of busy time across cpus, and the share of the work each group
+ * got compared to a fair share.
+ *
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "../builtin.h"
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <math.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/time.h>
+#include <sys/mman.h>
+
+#define WORK_LOOPS	10000
+
+static const char *cgroup_root = "/sys/fs/cgroup/cpu";
+static unsigned int num_groups = 4;
+static unsigned int depth = 3;
+static unsigned int num_hogs = 1;
+static unsigned int num_bursty = 4;
+static unsigned int run_usec = 1000;
+static unsigned int sleep_usec = 3000;
+static unsigned int runtime = 10;
+
+static const struct option options[] = {
+	OPT_STRING('c', "cgroup", &cgroup_root, "dir",
+		   "Mount point of the cpu cgroup controller"),
+	OPT_UINTEGER('g', "group", &num_groups,
+		     "Specify number of groups"),
+	OPT_UINTEGER('d', "depth", &depth,
+		     "Specify nesting depth of each group"),
+	OPT_UINTEGER('H', "hogs", &num_hogs,
+		     "Specify number of cpu hogs per group"),
+	OPT_UINTEGER('b', "bursty", &num_bursty,
+		     "Specify number of bursty tasks per group"),
+	OPT_UINTEGER('r', "run", &run_usec,
+		     "Specify run time of a burst in usecs"),
+	OPT_UINTEGER('s', "sleep", &sleep_usec,
+		     "Specify sleep time between bursts in usecs"),
+	OPT_UINTEGER('t', "time", &runtime,
+		     "Specify run time of the benchmark in seconds"),
+	OPT_END()
+};
+
+static const char * const bench_sched_balance_usage[] = {
+	"perf bench sched balance <options>",
+	NULL
+};
+
+struct cpu_time {
+	unsigned long long busy;
+	unsigned long long total;
+};
+
+static volatile int *stop;
+static unsigned long long *work;
+
+static void barf(const char *msg)
+{
+	fprintf(stderr, "%s (error: %s)\n", msg, strerror(errno));
+	exit(1);
+}
+
+static unsigned long long now_usec(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec * 1000000ULL + tv.tv_usec;
+}
+
+static void do_work(unsigned long long *counter)
+{
+	static volatile unsigned int sink;
+	unsigned int i;
+
+	for (i = 0; i < WORK_LOOPS; i++)
+		sink += i;
+	(*counter)++;
+}
+
+/* Path of the cgroup at @level of group @group, level 0 is the top */
+static void group_path(char *path, size_t len, unsigned int group,
+		       unsigned int level)
+{
+	unsigned int l;
+	int n;
+
+	n = snprintf(path, len, "%s/perf-bench-balance/g%u", cgroup_root,
+		     group);
+	for (l = 1; l <= level; l++)
+		n += snprintf(path + n, len - n, "/l%u", l);
+}
+
+/* Returns non-zero if the groups could be created */
+static int create_groups(void)
+{
+	char path[PATH_MAX];
+	unsigned int g, l;
+
+	snprintf(path, sizeof(path), "%s/perf-bench-balance", cgroup_root);
+	if (mkdir(path, 0755) && errno != EEXIST)
+		return 0;
+
+	for (g = 0; g < num_groups; g++) {
+		for (l = 0; l < depth; l++) {
+			group_path(path, sizeof(path), g, l);
+			if (mkdir(path, 0755) && errno != EEXIST)
+				return 0;
+		}
+	}
+	return 1;
+}
+
+static void remove_groups(void)
+{
+	char path[PATH_MAX];
+	unsigned int g, l;
+
+	for (g = 0; g < num_groups; g++) {
+		for (l = depth; l-- > 0;) {
+			group_path(path, sizeof(path), g, l);
+			rmdir(path);
+		}
+	}
+	snprintf(path, sizeof(path), "%s/perf-bench-balance", cgroup_root);
+	rmdir(path);
+}
+
+static void join_group(unsigned int group)
+{
+	char path[PATH_MAX];
+	FILE *f;
+
+	group_path(path, sizeof(path), group, depth - 1);
+	strcat(path, "/tasks");
+	f = fopen(path, "w");
+	if (!f)
+		barf("open cgroup tasks");
+	fprintf(f, "%d\n", getpid());
+	if (fclose(f))
+		barf("write cgroup tasks");
+}
+
+static void worker(unsigned int group, int bursty, int in_group,
+		   unsigned long long *counter)
+{
+	unsigned long long end;
+
+	if (in_group)
+		join_group(group);
+
+	while (!*stop) {
+		if (!bursty) {
+			do_work(counter);
+			continue;
+		}
+		end = now_usec() + run_usec;
+		while (now_usec() < end)
+			do_work(counter);
+		usleep(sleep_usec);
+	}
+	exit(0);
+}
+
+/* Returns the number of cpus read from /proc/stat */
+static int read_cpu_times(struct cpu_time *times, int max_cpus)
+{
+	unsigned long long user, nice, system, idle, iowait, irq, softirq;
+	char line[256];
+	int cpu, nr = 0;
+	FILE *f;
+
+	f = fopen("/proc/stat", "r");
+	if (!f)
+		barf("open /proc/stat");
+
+	while (fgets(line, sizeof(line), f)) {
+		if (strncmp(line, "cpu", 3) || line[3] == ' ')
+			continue;
+		if (sscanf(line, "cpu%d %llu %llu %llu %llu %llu %llu %llu",
+			   &cpu, &user, &nice, &system, &idle, &iowait,
+			   &irq, &softirq) != 8)
+			continue;
+		if (nr >= max_cpus)
+			break;
+		times[nr].busy = user + nice + system + irq + softirq;
+		times[nr].total = times[nr].busy + idle + iowait;
+		nr++;
+	}
+	fclose(f);
+	return nr;
+}
+
+int bench_sched_balance(int argc, const char **argv,
+			const char *prefix __used)
+{
+	unsigned int per_group, nr_tasks, g, i;
+	unsigned long long *work_before, *work_after;
+	struct cpu_time *before, *after;
+	unsigned long long total = 0, start_usec, elapsed;
+	double busy, busy_min = 100.0, busy_max = 0.0, busy_sum = 0.0;
+	double busy_sq = 0.0, stddev;
+	int nr_cpus, in_group, cpu;
+	pid_t *pids;
+
+	argc = parse_options(argc, argv, options,
+			     bench_sched_balance_usage, 0);
+
+	if (!num_groups || !depth || !(num_hogs + num_bursty) || !runtime) {
+		usage_with_options(bench_sched_balance_usage, options);
+		exit(1);
+	}
+
+	per_group = num_hogs + num_bursty;
+	nr_tasks = num_groups * per_group;
+
+	nr_cpus = sysconf(_SC_NPROCESSORS_CONF);
+	before = calloc(nr_cpus, sizeof(*before));
+	after = calloc(nr_cpus, sizeof(*after));
+	pids = calloc(nr_tasks, sizeof(*pids));
+	work_before = calloc(nr_tasks, sizeof(*work_before));
+	work_after = calloc(nr_tasks, sizeof(*work_after));
+	if (!before || !after || !pids || !work_before || !work_after)
+		barf("calloc");
+
+	/* one work counter per task, followed by the stop flag */
+	work = mmap(NULL, (nr_tasks + 1) * sizeof(*work),
+		    PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (work == MAP_FAILED)
+		barf("mmap");
+	stop = (volatile int *)&work[nr_tasks];
+
+	in_group = create_groups();
+	if (!in_group) {
+		fprintf(stderr, "cannot create cgroups below %s, "
+			"running without groups\n", cgroup_root);
+		remove_groups();
+	}
+
+	for (i = 0; i < nr_tasks; i++) {
+		pids[i] = fork();
+		if (pids[i] < 0)
+			barf("fork");
+		if (!pids[i])
+			worker(i / per_group, i % per_group >= num_hogs,
+			       in_group, &work[i]);
+	}
+
+	/* let the load settle before measuring */
+	sleep(1);
+	memcpy(work_before, work, nr_tasks * sizeof(*work));
+	nr_cpus = read_cpu_times(before, nr_cpus);
+	start_usec = now_usec();
+
+	sleep(runtime);
+
+	memcpy(work_after, work, nr_tasks * sizeof(*work));
+	read_cpu_times(after, nr_cpus);
+	elapsed = now_usec() - start_usec;
+	*stop = 1;
+	for (i = 0; i < nr_tasks; i++)
+		waitpid(pids[i], NULL, 0);
+	if (in_group)
+		remove_groups();
+
+	for (i = 0; i < nr_tasks; i++) {
+		work_after[i] -= work_before[i];
+		total += work_after[i];
+	}
+
+	for (cpu = 0; cpu < nr_cpus; cpu++) {
+		unsigned long long delta_total;
+
+		delta_total = after[cpu].total - before[cpu].total;
+		busy = delta_total ? 100.0 * (after[cpu].busy -
+			before[cpu].busy) / delta_total : 0.0;
+		if (busy < busy_min)
+			busy_min = busy;
+		if (busy > busy_max)
+			busy_max = busy;
+		busy_sum += busy;
+		busy_sq += busy * busy;
+	}
+	busy = busy_sum / nr_cpus;
+	stddev = sqrt(busy_sq / nr_cpus - busy * busy);
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		printf("# %u groups of depth %u, each with %u hogs and "
+		       "%u bursty tasks (%u/%u usecs)%s\n\n",
+		       num_groups, depth, num_hogs, num_bursty, run_usec,
+		       sleep_usec, in_group ? "" : ", without cgroups");
+
+		printf(" %14s: %llu.%03llu [sec]\n", "Total time",
+		       elapsed / 1000000, (elapsed % 1000000) / 1000);
+		printf(" %14.0lf work/sec\n\n",
+		       total * 1000000.0 / elapsed);
+
+		printf(" %14s: %.1lf%% avg, %.1lf%% min, %.1lf%% max, "
+		       "%.1lf stddev\n\n", "CPU busy", busy, busy_min,
+		       busy_max, stddev);
+
+		for (g = 0; g < num_groups; g++) {
+			unsigned long long group_work = 0;
+
+			for (i = 0; i < per_group; i++)
+				group_work += work_after[g * per_group + i];
+			printf(" %11s %2u: %.1lf%% of work (fair share %.1lf%%)\n",
+			       "Group", g,
+			       total ? 100.0 * group_work / total : 0.0,
+			       100.0 / num_groups);
+		}
+		break;
+
+	case BENCH_FORMAT_SIMPLE:
+		printf("%.0lf %.1lf\n", total * 1000000.0 / elapsed, stddev);
+		break;
+
+	default:
+		/* reaching here is something disaster */
+		fprintf(stderr, "Unknown format:%d\n", bench_format);
+		exit(1);
+		break;
+	}
+
+	return 0;
+}
@@ -0,0 +1,240 @@
+/*
+ *
+ * sched-wakeup.c
+ *
+ * wakeup: Benchmark for wakeup latency of many request/reply pairs
+ *
+ * Every pair is a client and a server process talking over pipes, like an
+ * RPC server with one connection per worker: the client sends a request,
+ * the server does a little work and replies.  Each message carries the time
+ * it was sent at, so both sides measure how long it took from the send until
+ * they ran with the message in hand, which is mostly the wakeup latency.
+ * With more pairs than cpus sharing a cache, this exercises the search for
+ * an idle cpu on wakeup.  The cpu time used per request, as reported by
+ * getrusage(), shows what the wakeups cost.
+ *
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "../builtin.h"
+#include "bench.h"
+#include "../../include/tools/log2_hist.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/mman.h>
+
+#define NR_BUCKETS	32
+
+static unsigned int num_pairs;
+static unsigned int loops = 100000;
+static unsigned int work_usec = 5;
+
+static const struct option options[] = {
+	OPT_UINTEGER('p', "pairs", &num_pairs,
+		     "Specify number of client/server pairs (default: nr cpus)"),
+	OPT_UINTEGER('l', "loop", &loops,
+		     "Specify number of requests per pair"),
+	OPT_UINTEGER('w', "work", &work_usec,
+		     "Specify work done per request in usecs"),
+	OPT_END()
+};
+
+static const char * const bench_sched_wakeup_usage[] = {
+	"perf bench sched wakeup <options>",
+	NULL
+};
+
+/* Per pair results, shared with the parent */
+struct pair_stats {
+	unsigned long long wakeups;
+	unsigned long long lat_sum;
+	unsigned long long lat_max;
+	unsigned long long hist[NR_BUCKETS];
+};
+
+static void barf(const char *msg)
+{
+	fprintf(stderr, "%s (error: %s)\n", msg, strerror(errno));
+	exit(1);
+}
+
+static void account(struct pair_stats *stats, unsigned long long sent)
+{
+	unsigned long long lat = now_ns() - sent;
+
+	stats->wakeups++;
+	stats->lat_sum += lat;
+	if (lat > stats->lat_max)
+		stats->lat_max = lat;
+	stats->hist[log2_bucket(lat, NR_BUCKETS)]++;
+}
+
+static void send_msg(int fd)
+{
+	unsigned long long sent = now_ns();
+
+	if (write(fd, &sent, sizeof(sent)) != sizeof(sent))
+		barf("write");
+}
+
+static unsigned long long recv_msg(int fd)
+{
+	unsigned long long sent;
+
+	if (read(fd, &sent, sizeof(sent)) != sizeof(sent))
+		barf("read");
+	return sent;
+}
+
+static void server(int in, int out, struct pair_stats *stats)
+{
+	unsigned long long end;
+	unsigned int i;
+
+	for (i = 0; i < loops; i++) {
+		account(stats, recv_msg(in));
+		end = now_ns() + work_usec * 1000ULL;
+		while (now_ns() < end)
+			;
+		send_msg(out);
+	}
+	exit(0);
+}
+
+static void client(int in, int out, struct pair_stats *stats)
+{
+	unsigned int i;
+
+	for (i = 0; i < loops; i++) {
+		send_msg(out);
+		account(stats, recv_msg(in));
+	}
+	exit(0);
+}
+
+int bench_sched_wakeup(int argc, const char **argv,
+		       const char *prefix __used)
+{
+	unsigned long long hist[NR_BUCKETS] = { 0 };
+	unsigned long long wakeups = 0, lat_sum = 0, lat_max = 0;
+	unsigned long long start, elapsed, cpu_usec;
+	struct pair_stats *stats;
+	struct rusage ru;
+	unsigned int i, j, nr_tasks;
+	int to_server[2], to_client[2];
+	pid_t *pids;
+
+	num_pairs = sysconf(_SC_NPROCESSORS_ONLN);
+
+	argc = parse_options(argc, argv, options,
+			     bench_sched_wakeup_usage, 0);
+
+	if (!num_pairs || !loops) {
+		usage_with_options(bench_sched_wakeup_usage, options);
+		exit(1);
+	}
+
+	nr_tasks = 2 * num_pairs;
+	pids = calloc(nr_tasks, sizeof(*pids));
+	if (!pids)
+		barf("calloc");
+
+	/* one slot per task, so that nobody shares a counter */
+	stats = mmap(NULL, nr_tasks * sizeof(*stats), PROT_READ | PROT_WRITE,
+		     MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (stats == MAP_FAILED)
+		barf("mmap");
+	memset(stats, 0, nr_tasks * sizeof(*stats));
+
+	start = now_ns();
+
+	for (i = 0; i < num_pairs; i++) {
+		if (pipe(to_server) || pipe(to_client))
+			barf("pipe");
+
+		pids[2 * i] = fork();
+		if (pids[2 * i] < 0)
+			barf("fork");
+		if (!pids[2 * i])
+			server(to_server[0], to_client[1], &stats[2 * i]);
+
+		pids[2 * i + 1] = fork();
+		if (pids[2 * i + 1] < 0)
+			barf("fork");
+		if (!pids[2 * i + 1])
+			client(to_client[0], to_server[1], &stats[2 * i + 1]);
+
+		close(to_server[0]);
+		close(to_server[1]);
+		close(to_client[0]);
+		close(to_client[1]);
+	}
+
+	for (i = 0; i < nr_tasks; i++)
+		waitpid(pids[i], NULL, 0);
+	elapsed = now_ns() - start;
+
+	if (getrusage(RUSAGE_CHILDREN, &ru))
+		barf("getrusage");
+	cpu_usec = ru.ru_utime.tv_sec * 1000000ULL + ru.ru_utime.tv_usec +
+		   ru.ru_stime.tv_sec * 1000000ULL + ru.ru_stime.tv_usec;
+
+	for (i = 0; i < nr_tasks; i++) {
+		wakeups += stats[i].wakeups;
+		lat_sum += stats[i].lat_sum;
+		if (stats[i].lat_max > lat_max)
+			lat_max = stats[i].lat_max;
+		for (j = 0; j < NR_BUCKETS; j++)
+			hist[j] += stats[i].hist[j];
+	}
+	if (!wakeups)
+		wakeups = 1;
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		printf("# %u client/server pairs, %u requests each, "
+		       "%u usecs of work per request\n\n",
+		       num_pairs, loops, work_usec);
+
+		printf(" %14s: %llu.%03llu [sec]\n", "Total time",
+		       elapsed / 1000000000ULL,
+		       (elapsed % 1000000000ULL) / 1000000ULL);
+		printf(" %14.0lf requests/sec\n",
+		       (double)num_pairs * loops * 1e9 / elapsed);
+		printf(" %14.3lf usecs of cpu time per request "
+		       "(%.3lf sys)\n\n",
+		       (double)cpu_usec / num_pairs / loops,
+		       (ru.ru_stime.tv_sec * 1e6 + ru.ru_stime.tv_usec) /
+		       num_pairs / loops);
+
+		printf(" %14s: %.3lf usecs avg, %.3lf usecs max\n\n",
+		       "Wakeup latency", (double)lat_sum / wakeups / 1000.0,
+		       lat_max / 1000.0);
+		print_log2_hist(hist, NR_BUCKETS, "nsecs", wakeups);
+		break;
+
+	case BENCH_FORMAT_SIMPLE:
+		printf("%.3lf %.3lf\n", (double)lat_sum / wakeups / 1000.0,
+		       (double)cpu_usec / num_pairs / loops);
+		break;
+
+	default:
+		/* reaching here is something disaster */
+		fprintf(stderr, "Unknown format:%d\n", bench_format);
+		exit(1);
+		break;
+	}
+
+	return 0;
+}
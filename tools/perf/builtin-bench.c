@@ -42,6 +42,12 @@ static struct bench_suite sched_suites[] = {
 	{ "pipe",
 	  "Flood of communication over pipe() between two processes",
 	  bench_sched_pipe      },
+	{ "balance",
+	  "Mixed load in nested cgroups, for load balancing",
+	  bench_sched_balance   },
+	{ "wakeup",
+	  "Wakeup latency of many request/reply pairs",
+	  bench_sched_wakeup    },
 	suite_all,
 	{ NULL,
 	  NULL,
@@ -0,0 +1,295 @@
+/*
+ * cosched_bench: throughput of overcommitted "virtual machines"
+ *
+ * Each machine is a process in its own cpu cgroup, with one thread per
+ * virtual cpu.  The threads repeatedly take a ticket spinlock shared by
+ * the machine, hold it for a short critical section, and do some work
+ * outside of it, much like a guest kernel does.  With more threads than
+ * cpus, a thread that is preempted while holding the lock leaves its
+ * siblings spinning until it runs again; running the threads of a machine
+ * together (cpu.cosched) avoids most of that.  The lock acquisitions per
+ * second of every machine are reported, so compare:
+ *
+ *	# cosched_bench -n 4 -t 20
+ *	# cosched_bench -n 4 -t 20 -C
+ *
+ * To look at real guests instead, put the vcpu threads of each guest in a
+ * cpu cgroup with cpu.cosched set and run cosched_bench -n 1 -g inside the
+ * guests, which then reports the guest throughput.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; version 2.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <tools/log2_hist.h>
+
+#define NSEC_PER_USEC	1000ULL
+#define MAX_VMS		64
+
+static const char *cgroup_root = "/sys/fs/cgroup/cpu";
+static unsigned int nr_vms = 2;
+static unsigned int nr_vcpus;
+static unsigned int duration = 10;
+static uint64_t hold_ns = 1000, work_ns = 10000;
+static int cosched;
+static int no_cgroup;
+
+struct ticket_lock {
+	volatile unsigned int next;
+	volatile unsigned int owner;
+};
+
+/* One per machine, shared with the parent */
+struct vm {
+	struct ticket_lock lock;
+	volatile int stop;
+	volatile uint64_t ops;
+	char cgroup[256];
+} __attribute__((aligned(64)));
+
+static struct vm *vms;
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s [options]\n"
+		"  -n vms     number of machines (default: %u)\n"
+		"  -v vcpus   threads per machine (default: number of cpus)\n"
+		"  -t secs    run time in seconds (default: %u)\n"
+		"  -H usecs   time the lock is held (default: %llu)\n"
+		"  -W usecs   work between lock acquisitions (default: %llu)\n"
+		"  -C         set cpu.cosched for the machines\n"
+		"  -m path    mount point of the cpu cgroup controller "
+		"(default: %s)\n"
+		"  -g         do not create cgroups\n",
+		prog, nr_vms, duration,
+		(unsigned long long)(hold_ns / NSEC_PER_USEC),
+		(unsigned long long)(work_ns / NSEC_PER_USEC), cgroup_root);
+	exit(1);
+}
+
+static inline void cpu_relax(void)
+{
+#if defined(__i386__) || defined(__x86_64__)
+	asm volatile("pause" ::: "memory");
+#else
+	asm volatile("" ::: "memory");
+#endif
+}
+
+static void burn(uint64_t ns)
+{
+	uint64_t end = now_ns() + ns;
+
+	while (now_ns() < end)
+		cpu_relax();
+}
+
+static void ticket_lock(struct ticket_lock *lock)
+{
+	unsigned int ticket = __sync_fetch_and_add(&lock->next, 1);
+
+	while (lock->owner != ticket)
+		cpu_relax();
+	__sync_synchronize();
+}
+
+static void ticket_unlock(struct ticket_lock *lock)
+{
+	__sync_synchronize();
+	lock->owner++;
+}
+
+static void *vcpu_thread(void *arg)
+{
+	struct vm *vm = arg;
+
+	while (!vm->stop) {
+		ticket_lock(&vm->lock);
+		burn(hold_ns);
+		vm->ops++;
+		ticket_unlock(&vm->lock);
+		burn(work_ns);
+	}
+	return NULL;
+}
+
+static int write_file(const char *dir, const char *file, const char *val)
+{
+	char path[512];
+	FILE *f;
+	int ret;
+
+	snprintf(path, sizeof(path), "%s/%s", dir, file);
+	f = fopen(path, "w");
+	if (!f)
+		return -1;
+	ret = fputs(val, f) < 0 ? -1 : 0;
+	if (fclose(f))
+		ret = -1;
+	return ret;
+}
+
+static void run_vm(struct vm *vm)
+{
+	pthread_t *threads;
+	unsigned int i;
+	char pid[32];
+
+	if (vm->cgroup[0]) {
+		snprintf(pid, sizeof(pid), "%d\n", getpid());
+		if (write_file(vm->cgroup, "tasks", pid)) {
+			perror(vm->cgroup);
+			exit(1);
+		}
+	}
+
+	threads = calloc(nr_vcpus, sizeof(*threads));
+	if (!threads)
+		exit(1);
+	for (i = 0; i < nr_vcpus; i++) {
+		if (pthread_create(&threads[i], NULL, vcpu_thread, vm)) {
+			perror("pthread_create");
+			exit(1);
+		}
+	}
+	for (i = 0; i < nr_vcpus; i++)
+		pthread_join(threads[i], NULL);
+	exit(0);
+}
+
+static int setup_cgroup(struct vm *vm, unsigned int nr)
+{
+	snprintf(vm->cgroup, sizeof(vm->cgroup), "%s/cosched_bench.%d.%u",
+		 cgroup_root, getpid(), nr);
+	if (mkdir(vm->cgroup, 0755)) {
+		perror(vm->cgroup);
+		return -1;
+	}
+	if (write_file(vm->cgroup, "cpu.cosched", cosched ? "1\n" : "0\n")) {
+		perror("cpu.cosched");
+		return -1;
+	}
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	uint64_t total = 0, min = UINT64_MAX, max = 0, ops;
+	pid_t pids[MAX_VMS] = { 0 };
+	unsigned int i;
+	int c, ret = 0;
+
+	nr_vcpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+	while ((c = getopt(argc, argv, "n:v:t:H:W:Cm:gh")) != -1) {
+		switch (c) {
+		case 'n':
+			nr_vms = strtoul(optarg, NULL, 0);
+			break;
+		case 'v':
+			nr_vcpus = strtoul(optarg, NULL, 0);
+			break;
+		case 't':
+			duration = strtoul(optarg, NULL, 0);
+			break;
+		case 'H':
+			hold_ns = strtoull(optarg, NULL, 0) * NSEC_PER_USEC;
+			break;
+		case 'W':
+			work_ns = strtoull(optarg, NULL, 0) * NSEC_PER_USEC;
+			break;
+		case 'C':
+			cosched = 1;
+			break;
+		case 'm':
+			cgroup_root = optarg;
+			break;
+		case 'g':
+			no_cgroup = 1;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (!nr_vms || nr_vms > MAX_VMS || !nr_vcpus || !duration)
+		usage(argv[0]);
+	if (cosched && no_cgroup)
+		usage(argv[0]);
+
+	vms = mmap(NULL, nr_vms * sizeof(*vms), PROT_READ | PROT_WRITE,
+		   MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (vms == MAP_FAILED) {
+		perror("mmap");
+		return 1;
+	}
+	memset(vms, 0, nr_vms * sizeof(*vms));
+
+	for (i = 0; i < nr_vms; i++) {
+		if (!no_cgroup && setup_cgroup(&vms[i], i)) {
+			ret = 1;
+			nr_vms = i + 1;
+			goto out;
+		}
+	}
+
+	for (i = 0; i < nr_vms; i++) {
+		pids[i] = fork();
+		if (pids[i] < 0) {
+			perror("fork");
+			ret = 1;
+			break;
+		}
+		if (!pids[i])
+			run_vm(&vms[i]);
+	}
+
+	sleep(duration);
+
+	for (i = 0; i < nr_vms; i++)
+		vms[i].stop = 1;
+	for (i = 0; i < nr_vms; i++) {
+		if (pids[i] > 0)
+			waitpid(pids[i], NULL, 0);
+	}
+
+	printf("%u machines of %u vcpus on %ld cpus, cosched %s, "
+	       "hold %llu us, work %llu us, %u seconds\n", nr_vms, nr_vcpus,
+	       sysconf(_SC_NPROCESSORS_ONLN), cosched ? "on" : "off",
+	       (unsigned long long)(hold_ns / NSEC_PER_USEC),
+	       (unsigned long long)(work_ns / NSEC_PER_USEC), duration);
+	for (i = 0; i < nr_vms; i++) {
+		ops = vms[i].ops / duration;
+		total += ops;
+		if (ops < min)
+			min = ops;
+		if (ops > max)
+			max = ops;
+		printf("  machine %2u: %10llu ops/sec\n", i,
+		       (unsigned long long)ops);
+	}
+	printf("  total:      %10llu ops/sec (min %llu, max %llu)\n",
+	       (unsigned long long)total, (unsigned long long)min,
+	       (unsigned long long)max);
+
+out:
+	for (i = 0; i < nr_vms; i++) {
+		if (vms[i].cgroup[0])
+			rmdir(vms[i].cgroup);
+	}
+	return ret;
+}
@@ -0,0 +1,176 @@
+/*
+ * jitter: measure the interruptions seen by a spinning user thread
+ *
+ * The thread is pinned to a cpu and reads the clock in a tight loop.  Any
+ * gap between two reads longer than the threshold is time the cpu spent
+ * elsewhere: in an interrupt, a softirq, another task, or the hypervisor.
+ * The gaps are reported as a count, a total and a log2 histogram, along
+ * with the local timer interrupts the cpu took meanwhile (on x86, from
+ * the LOC line of /proc/interrupts).
+ *
+ * With nohz_full= the tick of the cpu should stop once the thread is the
+ * only task on it, which shows as (almost) no timer interrupts:
+ *
+ *	# jitter -c 3 -t 10
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; version 2.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <sched.h>
+#include <time.h>
+#include <tools/log2_hist.h>
+
+#define NSEC_PER_MSEC	1000000ULL
+#define NR_BUCKETS	64
+
+static int cpu = -1;
+static unsigned int duration = 10;
+static uint64_t threshold = 1000;
+static int rt_prio;
+
+static unsigned long long histogram[NR_BUCKETS];
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s [options]\n"
+		"  -c cpu     cpu to run on (default: the current one)\n"
+		"  -t secs    run time in seconds (default: %u)\n"
+		"  -T nsecs   smallest gap counted as an interruption "
+		"(default: %llu)\n"
+		"  -p prio    run as SCHED_FIFO with this priority\n",
+		prog, duration, (unsigned long long)threshold);
+	exit(1);
+}
+
+/* Local timer interrupts taken by @cpu so far, or -1 if unknown */
+static long long timer_interrupts(int cpu)
+{
+	char line[8192], *p, *end;
+	long long count = -1;
+	int i;
+	FILE *f;
+
+	f = fopen("/proc/interrupts", "r");
+	if (!f)
+		return -1;
+
+	while (fgets(line, sizeof(line), f)) {
+		p = line;
+		while (*p == ' ')
+			p++;
+		if (strncmp(p, "LOC:", 4))
+			continue;
+		p += 4;
+		/* columns are the online cpus, assume they are 0..n-1 */
+		for (i = 0; i <= cpu; i++) {
+			count = strtoll(p, &end, 10);
+			if (end == p) {
+				count = -1;
+				break;
+			}
+			p = end;
+		}
+		break;
+	}
+	fclose(f);
+
+	return count;
+}
+
+int main(int argc, char **argv)
+{
+	uint64_t start, end, prev, t, gap, max_gap = 0, total = 0, nr = 0;
+	long long loc_before, loc_after;
+	struct sched_param param;
+	cpu_set_t set;
+	int c;
+
+	while ((c = getopt(argc, argv, "c:t:T:p:h")) != -1) {
+		switch (c) {
+		case 'c':
+			cpu = atoi(optarg);
+			break;
+		case 't':
+			duration = strtoul(optarg, NULL, 0);
+			break;
+		case 'T':
+			threshold = strtoull(optarg, NULL, 0);
+			break;
+		case 'p':
+			rt_prio = atoi(optarg);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (!duration || !threshold)
+		usage(argv[0]);
+
+	if (cpu < 0)
+		cpu = sched_getcpu();
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	if (sched_setaffinity(0, sizeof(set), &set)) {
+		perror("sched_setaffinity");
+		return 1;
+	}
+
+	if (rt_prio) {
+		param.sched_priority = rt_prio;
+		if (sched_setscheduler(0, SCHED_FIFO, &param)) {
+			perror("sched_setscheduler");
+			return 1;
+		}
+	}
+
+	/* let the tick notice we are alone on the cpu */
+	start = now_ns();
+	while (now_ns() - start < 100 * NSEC_PER_MSEC)
+		;
+
+	loc_before = timer_interrupts(cpu);
+	start = prev = now_ns();
+	end = start + duration * NSEC_PER_SEC;
+
+	do {
+		t = now_ns();
+		gap = t - prev;
+		if (gap >= threshold) {
+			nr++;
+			total += gap;
+			if (gap > max_gap)
+				max_gap = gap;
+			histogram[log2_bucket(gap, NR_BUCKETS)]++;
+		}
+		prev = t;
+	} while (t < end);
+
+	loc_after = timer_interrupts(cpu);
+
+	printf("cpu %d, %u seconds, threshold %llu ns\n", cpu, duration,
+	       (unsigned long long)threshold);
+	printf("  interruptions:    %llu (%.1f/sec)\n",
+	       (unsigned long long)nr, (double)nr / duration);
+	printf("  time interrupted: %llu ns (%.4f%%)\n",
+	       (unsigned long long)total,
+	       100.0 * total / (t - start));
+	printf("  longest:          %llu ns\n", (unsigned long long)max_gap);
+	if (loc_before >= 0 && loc_after >= 0)
+		printf("  timer interrupts: %lld\n", loc_after - loc_before);
+
+	printf("\n");
+	print_log2_hist(histogram, NR_BUCKETS, "ns", 0);
+
+	return 0;
+}
@@ -0,0 +1,237 @@
+/*
+ * dl_periodic.c - periodic task test for SCHED_DEADLINE
+ *
+ * Runs a periodic job under SCHED_DEADLINE: each instance is released at
+ * the start of its period, burns a fixed amount of cpu time and then waits
+ * for the next release.  An instance that completes after its absolute
+ * deadline is counted as a miss.  Before that, admission control is checked
+ * by reserving bandwidth until sched_setattr() refuses with EBUSY.
+ *
+ * Usage: dl_periodic [runtime_us deadline_us period_us work_us jobs]
+ */
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <signal.h>
+#include <time.h>
+#include <sched.h>
+
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#ifndef __NR_sched_setattr
+#error "__NR_sched_setattr is not defined, run make headers_install first"
+#endif
+
+#ifndef SCHED_DEADLINE
+#define SCHED_DEADLINE		6
+#endif
+
+#define NSEC_PER_USEC		1000ULL
+#define NSEC_PER_MSEC		1000000ULL
+#define NSEC_PER_SEC		1000000000ULL
+
+struct sched_attr {
+	uint32_t size;
+	uint32_t sched_policy;
+	uint64_t sched_flags;
+	int32_t sched_nice;
+	uint32_t sched_priority;
+	uint64_t sched_runtime;
+	uint64_t sched_deadline;
+	uint64_t sched_period;
+};
+
+static int sys_sched_setattr(pid_t pid, struct sched_attr *attr)
+{
+	return syscall(__NR_sched_setattr, pid, attr, 0);
+}
+
+static void init_attr(struct sched_attr *attr, uint64_t runtime,
+		      uint64_t deadline, uint64_t period)
+{
+	memset(attr, 0, sizeof(*attr));
+	attr->size = sizeof(*attr);
+	attr->sched_policy = SCHED_DEADLINE;
+	attr->sched_runtime = runtime;
+	attr->sched_deadline = deadline;
+	attr->sched_period = period;
+}
+
+static uint64_t ts_to_ns(const struct timespec *ts)
+{
+	return ts->tv_sec * NSEC_PER_SEC + ts->tv_nsec;
+}
+
+static void ns_to_ts(uint64_t ns, struct timespec *ts)
+{
+	ts->tv_sec = ns / NSEC_PER_SEC;
+	ts->tv_nsec = ns % NSEC_PER_SEC;
+}
+
+static uint64_t clock_ns(clockid_t clk)
+{
+	struct timespec ts;
+
+	clock_gettime(clk, &ts);
+	return ts_to_ns(&ts);
+}
+
+/* Burn @ns of cpu time, as opposed to wall clock time */
+static void burn(uint64_t ns)
+{
+	uint64_t end = clock_ns(CLOCK_THREAD_CPUTIME_ID) + ns;
+
+	while (clock_ns(CLOCK_THREAD_CPUTIME_ID) < end)
+		;
+}
+
+static int run_periodic(uint64_t runtime, uint64_t deadline,
+			uint64_t period, uint64_t work, unsigned int jobs)
+{
+	struct sched_attr attr;
+	uint64_t release, finish, lateness, max_late = 0;
+	unsigned int i, misses = 0;
+	struct timespec ts;
+
+	init_attr(&attr, runtime, deadline, period);
+	if (sys_sched_setattr(0, &attr)) {
+		if (errno == EPERM) {
+			printf("dl_periodic: need CAP_SYS_NICE, skipping\n");
+			return 0;
+		}
+		perror("sched_setattr");
+		return 1;
+	}
+
+	release = clock_ns(CLOCK_MONOTONIC);
+	for (i = 0; i < jobs; i++) {
+		burn(work);
+		finish = clock_ns(CLOCK_MONOTONIC);
+		if (finish > release + deadline) {
+			lateness = finish - release - deadline;
+			if (lateness > max_late)
+				max_late = lateness;
+			misses++;
+		}
+		/* done with this instance, give back the rest of the budget */
+		sched_yield();
+
+		release += period;
+		ns_to_ts(release, &ts);
+		clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+	}
+
+	printf("dl_periodic: %u jobs (%llu/%llu/%llu us, work %llu us): "
+	       "%u deadline misses, max lateness %llu us\n", jobs,
+	       (unsigned long long)(runtime / NSEC_PER_USEC),
+	       (unsigned long long)(deadline / NSEC_PER_USEC),
+	       (unsigned long long)(period / NSEC_PER_USEC),
+	       (unsigned long long)(work / NSEC_PER_USEC), misses,
+	       (unsigned long long)(max_late / NSEC_PER_USEC));
+
+	return misses ? 1 : 0;
+}
+
+/*
+ * Reserve half a cpu per child until admission control refuses; with
+ * n cpus that must happen before 2n children got in.
+ */
+static int run_admission(void)
+{
+	long nr_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	int max = 2 * nr_cpus + 1;
+	struct sched_attr attr;
+	int i, ret = 1, admitted = 0;
+	pid_t *pids;
+	int fds[2];
+	char c = 'e';
+
+	pids = calloc(max, sizeof(*pids));
+	if (!pids || pipe(fds)) {
+		perror("admission setup");
+		return 1;
+	}
+
+	init_attr(&attr, 50 * NSEC_PER_MSEC, 100 * NSEC_PER_MSEC,
+		  100 * NSEC_PER_MSEC);
+
+	for (i = 0; i < max; i++) {
+		pids[i] = fork();
+		if (pids[i] < 0) {
+			perror("fork");
+			break;
+		}
+		if (!pids[i]) {
+			if (sys_sched_setattr(0, &attr))
+				c = errno == EBUSY ? 'b' : 'e';
+			else
+				c = 'o';
+			if (write(fds[1], &c, 1) != 1)
+				exit(1);
+			/* sleeping keeps the bandwidth reserved */
+			pause();
+			exit(0);
+		}
+		if (read(fds[0], &c, 1) != 1)
+			c = 'e';
+		if (c != 'o')
+			break;
+		admitted++;
+	}
+
+	if (c == 'b') {
+		printf("dl_periodic: admission refused after %d tasks on %ld cpus\n",
+		       admitted, nr_cpus);
+		ret = 0;
+	} else if (c == 'o') {
+		printf("dl_periodic: %d tasks admitted on %ld cpus, "
+		       "expected EBUSY\n", admitted, nr_cpus);
+	} else {
+		printf("dl_periodic: admission test failed unexpectedly\n");
+	}
+
+	for (i = 0; i < max && pids[i] > 0; i++) {
+		kill(pids[i], SIGKILL);
+		waitpid(pids[i], NULL, 0);
+	}
+	free(pids);
+
+	return ret;
+}
+
+int main(int argc, char **argv)
+{
+	uint64_t runtime = 10000, deadline = 30000, period = 100000;
+	uint64_t work = 5000;
+	unsigned int jobs = 100;
+	int ret;
+
+	if (argc == 6) {
+		runtime = strtoull(argv[1], NULL, 0);
+		deadline = strtoull(argv[2], NULL, 0);
+		period = strtoull(argv[3], NULL, 0);
+		work = strtoull(argv[4], NULL, 0);
+		jobs = strtoul(argv[5], NULL, 0);
+	} else if (argc != 1) {
+		fprintf(stderr, "usage: %s [runtime_us deadline_us period_us "
+			"work_us jobs]\n", argv[0]);
+		return 1;
+	}
+
+	/* the admission test forks before we become a deadline task */
+	if (geteuid() == 0) {
+		ret = run_admission();
+		if (ret)
+			return ret;
+	}
+
+	return run_periodic(runtime * NSEC_PER_USEC, deadline * NSEC_PER_USEC,
+			    period * NSEC_PER_USEC, work * NSEC_PER_USEC, jobs);
+}
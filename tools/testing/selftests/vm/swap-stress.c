@@ -0,0 +1,153 @@
+/*
+ * swap-stress:
+ *
+ * Multithreaded swap-out benchmark.  Each thread maps its own anonymous
+ * area and keeps dirtying every page of it, so that once the areas
+ * together no longer fit in memory, reclaim has to swap them out from
+ * many cpus at the same time.  At the end the number of pages swapped
+ * out (from /proc/vmstat) and the resulting swap-out rate are printed,
+ * and every page is checked to still hold what was last written to it.
+ *
+ * Run it with swap enabled and either more memory than is free, or
+ * from a memory cgroup whose limit is smaller than threads * size:
+ *
+ *	./swap-stress [-t threads] [-s MB per thread] [-p passes]
+ *
+ * Comparing the rate for increasing thread counts shows how swap-out
+ * scales with cores.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+
+struct worker {
+	pthread_t thread;
+	unsigned char *addr;
+	unsigned long length;
+	int id;
+	int errors;
+};
+
+static unsigned long page_size;
+static int passes = 4;
+
+static unsigned long read_pswpout(void)
+{
+	char name[64];
+	unsigned long val = 0, v;
+	FILE *f;
+
+	f = fopen("/proc/vmstat", "r");
+	if (!f) {
+		perror("/proc/vmstat");
+		exit(1);
+	}
+	while (fscanf(f, "%63s %lu", name, &v) == 2)
+		if (!strcmp(name, "pswpout"))
+			val = v;
+	fclose(f);
+	return val;
+}
+
+static void *worker_fn(void *arg)
+{
+	struct worker *w = arg;
+	unsigned long off;
+	int pass;
+
+	for (pass = 0; pass < passes; pass++)
+		for (off = 0; off < w->length; off += page_size)
+			w->addr[off] = (unsigned char)(w->id + pass + off);
+
+	pass = passes - 1;
+	for (off = 0; off < w->length; off += page_size)
+		if (w->addr[off] != (unsigned char)(w->id + pass + off))
+			w->errors++;
+	return NULL;
+}
+
+int main(int argc, char **argv)
+{
+	struct worker *workers;
+	struct timeval start, end;
+	unsigned long before, after, mb = 256;
+	double secs;
+	int nr_threads = 4, errors = 0;
+	int i, opt;
+
+	while ((opt = getopt(argc, argv, "t:s:p:")) != -1) {
+		switch (opt) {
+		case 't':
+			nr_threads = atoi(optarg);
+			break;
+		case 's':
+			mb = strtoul(optarg, NULL, 0);
+			break;
+		case 'p':
+			passes = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-t threads] "
+				"[-s MB per thread] [-p passes]\n", argv[0]);
+			exit(1);
+		}
+	}
+	if (nr_threads < 1 || passes < 1 || !mb) {
+		fprintf(stderr, "threads, size and passes must be positive\n");
+		exit(1);
+	}
+
+	page_size = sysconf(_SC_PAGESIZE);
+	workers = calloc(nr_threads, sizeof(*workers));
+	if (!workers) {
+		perror("calloc");
+		exit(1);
+	}
+	for (i = 0; i < nr_threads; i++) {
+		workers[i].id = i;
+		workers[i].length = mb << 20;
+		workers[i].addr = mmap(NULL, workers[i].length,
+				       PROT_READ | PROT_WRITE,
+				       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (workers[i].addr == MAP_FAILED) {
+			perror("mmap");
+			exit(1);
+		}
+	}
+
+	before = read_pswpout();
+	gettimeofday(&start, NULL);
+	for (i = 0; i < nr_threads; i++)
+		if (pthread_create(&workers[i].thread, NULL, worker_fn,
+				   &workers[i])) {
+			perror("pthread_create");
+			exit(1);
+		}
+	for (i = 0; i < nr_threads; i++) {
+		pthread_join(workers[i].thread, NULL);
+		errors += workers[i].errors;
+	}
+	gettimeofday(&end, NULL);
+	after = read_pswpout();
+
+	secs = (end.tv_sec - start.tv_sec) +
+		(end.tv_usec - start.tv_usec) / 1000000.0;
+	printf("%d threads x %lu MB x %d passes: %.2f s\n",
+	       nr_threads, mb, passes, secs);
+	printf("pswpout: %lu pages, %.0f pages/s\n",
+	       after - before, secs > 0 ? (after - before) / secs : 0.0);
+	if (after == before)
+		printf("nothing was swapped out, "
+		       "is swap enabled and memory short enough?\n");
+
+	if (errors) {
+		printf("%d pages lost their contents\n", errors);
+		return 1;
+	}
+	return 0;
+}
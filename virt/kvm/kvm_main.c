@@ -220,6 +220,8 @@ int kvm_vcpu_init(struct kvm_vcpu *vcpu, struct kvm *kvm, unsigned id)
 	vcpu->kvm = kvm;
 	vcpu->vcpu_id = id;
 	vcpu->pid = NULL;
+	vcpu->preempted = false;
+	vcpu->state_enabled = false;
 	init_waitqueue_head(&vcpu->wq);
 	kvm_async_pf_vcpu_init(vcpu);
 
@@ -247,12 +249,52 @@ EXPORT_SYMBOL_GPL(kvm_vcpu_init);
 
 void kvm_vcpu_uninit(struct kvm_vcpu *vcpu)
 {
+	kvm_vcpu_set_state_area(vcpu, 0);
 	put_pid(vcpu->pid);
 	kvm_arch_vcpu_uninit(vcpu);
 	free_page((unsigned long)vcpu->run);
 }
 EXPORT_SYMBOL_GPL(kvm_vcpu_uninit);
 
+/*
+ * Register the struct kvm_vcpu_state at @gpa as the state area of @vcpu,
+ * or unregister the current one if KVM_VCPU_STATE_ENABLED is clear.  The
+ * area is reached through a gfn_to_hva_cache, which follows memslot
+ * changes, so nothing stays pinned or mapped while it is registered.
+ * Must be called from the vcpu thread, or while it cannot run.
+ */
+int kvm_vcpu_set_state_area(struct kvm_vcpu *vcpu, gpa_t gpa)
+{
+	u32 preempted = 0;
+	int idx, r;
+
+	/* the preempt notifiers run on this task, keep them off the cache */
+	vcpu->state_enabled = false;
+	barrier();
+
+	if (!(gpa & KVM_VCPU_STATE_ENABLED))
+		return 0;
+
+	gpa &= ~(gpa_t)KVM_VCPU_STATE_ENABLED;
+	/* a naturally aligned area never crosses a page */
+	if (gpa & (sizeof(struct kvm_vcpu_state) - 1))
+		return -EINVAL;
+
+	idx = srcu_read_lock(&vcpu->kvm->srcu);
+	r = kvm_gfn_to_hva_cache_init(vcpu->kvm, &vcpu->state_cache, gpa);
+	if (!r)
+		r = kvm_write_guest_cached(vcpu->kvm, &vcpu->state_cache,
+					   &preempted, sizeof(preempted));
+	srcu_read_unlock(&vcpu->kvm->srcu, idx);
+	if (r)
+		return r;
+
+	barrier();
+	vcpu->state_enabled = true;
+	return 0;
+}
+EXPORT_SYMBOL_GPL(kvm_vcpu_set_state_area);
+
 #if defined(CONFIG_MMU_NOTIFIER) && defined(KVM_ARCH_WANT_MMU_NOTIFIER)
 static inline struct kvm *mmu_notifier_to_kvm(struct mmu_notifier *mn)
 {
@@ -1604,6 +1646,24 @@ void kvm_vcpu_block(struct kvm_vcpu *vcpu)
 	finish_wait(&vcpu->wq, &wait);
 }
 
+/*
+ * Ask the host cpu of a preempted VCPU to run it again, if the VM is
+ * co-scheduled.
+ */
+static bool kvm_vcpu_cosched_kick(struct kvm_vcpu *vcpu)
+{
+	struct task_struct *task;
+	bool kicked = false;
+
+	rcu_read_lock();
+	task = pid_task(rcu_dereference(vcpu->pid), PIDTYPE_PID);
+	if (task)
+		kicked = sched_cosched_kick(task);
+	rcu_read_unlock();
+
+	return kicked;
+}
+
 #ifndef CONFIG_S390
 /*
  * Kick a sleeping VCPU, or a guest VCPU in guest mode, into host kernel mode.
@@ -1625,6 +1685,10 @@ void kvm_vcpu_kick(struct kvm_vcpu *vcpu)
 		if (kvm_arch_vcpu_should_kick(vcpu))
 			smp_send_reschedule(cpu);
 	put_cpu();
+
+	/* A preempted VCPU does not see the kick until it runs again */
+	if (vcpu->preempted)
+		kvm_vcpu_cosched_kick(vcpu);
 }
 #endif /* !CONFIG_S390 */
 
@@ -1704,10 +1768,23 @@ void kvm_vcpu_on_spin(struct kvm_vcpu *me)
 	struct kvm_vcpu *vcpu;
 	int last_boosted_vcpu = me->kvm->last_boosted_vcpu;
 	int yielded = 0;
+	int kicked = 0;
 	int pass;
 	int i;
 
 	kvm_vcpu_set_in_spin_loop(me, true);
+	/*
+	 * In a co-scheduled VM, first ask the host cpus of the preempted
+	 * VCPUs to run them again.  That brings back the lock holder while
+	 * we keep our cpu, so the VCPUs of the VM stay running together.
+	 * Yield only if none of them could be brought back that way.
+	 */
+	kvm_for_each_vcpu(i, vcpu, kvm) {
+		if (vcpu != me && vcpu->preempted &&
+		    kvm_vcpu_cosched_kick(vcpu))
+			kicked = 1;
+	}
+
 	/*
 	 * We boost the priority of a VCPU that is runnable but not
 	 * currently running, because it got preempted by something
@@ -1715,7 +1792,7 @@ void kvm_vcpu_on_spin(struct kvm_vcpu *me)
 	 * VCPU is holding the lock that we need and will release it.
 	 * We approximate round-robin by starting at the last boosted VCPU.
 	 */
-	for (pass = 0; pass < 2 && !yielded; pass++) {
+	for (pass = 0; pass < 2 && !yielded && !kicked; pass++) {
 		kvm_for_each_vcpu(i, vcpu, kvm) {
 			if (!pass && i <= last_boosted_vcpu) {
 				i = last_boosted_vcpu;
@@ -2853,10 +2930,31 @@ struct kvm_vcpu *preempt_notifier_to_vcpu(struct preempt_notifier *pn)
 	return container_of(pn, struct kvm_vcpu, preempt_notifier);
 }
 
+/*
+ * Called from the preempt notifiers, which cannot sleep: if the page of
+ * the state area is not present the update is skipped, not faulted in.
+ */
+static void kvm_vcpu_write_preempted(struct kvm_vcpu *vcpu, u32 preempted)
+{
+	int idx;
+
+	if (!vcpu->state_enabled)
+		return;
+
+	idx = srcu_read_lock(&vcpu->kvm->srcu);
+	pagefault_disable();
+	kvm_write_guest_cached(vcpu->kvm, &vcpu->state_cache,
+			       &preempted, sizeof(preempted));
+	pagefault_enable();
+	srcu_read_unlock(&vcpu->kvm->srcu, idx);
+}
+
 static void kvm_sched_in(struct preempt_notifier *pn, int cpu)
 {
 	struct kvm_vcpu *vcpu = preempt_notifier_to_vcpu(pn);
 
+	vcpu->preempted = false;
+	kvm_vcpu_write_preempted(vcpu, 0);
 	kvm_arch_vcpu_load(vcpu, cpu);
 }
 
@@ -2865,6 +2963,10 @@ static void kvm_sched_out(struct preempt_notifier *pn,
 {
 	struct kvm_vcpu *vcpu = preempt_notifier_to_vcpu(pn);
 
+	if (current->state == TASK_RUNNING) {
+		vcpu->preempted = true;
+		kvm_vcpu_write_preempted(vcpu, 1);
+	}
 	kvm_arch_vcpu_put(vcpu);
 }
 